@@ -0,0 +1,116 @@
+-- -----------------------------------------------------------------------------
+-- measures the cost of dispatching events to lua: synthetic connections (an
+-- accept event, five read events with a http request and a close event) are
+-- fed through the real callback path with server.dispatch(), without any
+-- sockets. the handlers are a no-op callback, the echo and the http example.
+-- run it with the server binary:
+--
+--	$ ./vayu ../bench/dispatch.lua
+-- -----------------------------------------------------------------------------
+
+local _dir = debug.getinfo(1, "S").source:match("^@(.-)[^/]*$")
+
+local _request = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n"
+
+-- the read events per connection
+local _readCount = 5
+
+-- the connections measured with a stopped garbage collector
+local _connCount = 2000
+
+-- the handlers, the examples must not open their sockets
+local _handlers = {
+	{ name = "no-op", load = function ()
+		server.setCallback(function (context) return true end)
+	end },
+	{ name = "echo", load = function ()
+		dofile(_dir .. "../test/simple_echo/echo.lua")
+	end },
+	{ name = "http", load = function ()
+		dofile(_dir .. "../test/simple_http/main.lua")
+	end }
+}
+
+-- -----------------------------------------------------------------------------
+-- simulates the given number of connections, returns the number of events and
+-- allocations.
+-- -----------------------------------------------------------------------------
+local function _run(count)
+	local dispatch = server.dispatch
+	local events, allocations = 0, 0
+
+	-- the descriptors are below SOCKET_MAX (FD_SETSIZE) but not in use, the
+	-- benchmark opens no sockets
+	for i = 1, count do
+		local fd = 64 + i % 64
+		local _, _, a = dispatch("socket_accept", nil, 1, fd)
+		local _, _, b = dispatch("socket_read", _request, _readCount, fd)
+		local _, _, c = dispatch("socket_close", nil, 1, fd)
+
+		events = events + _readCount + 2
+		allocations = allocations + a + b + c
+	end
+
+	return events, allocations
+end
+
+-- -----------------------------------------------------------------------------
+-- measures the given handler.
+-- -----------------------------------------------------------------------------
+local function _measure(handler)
+	local clock = os.clock
+	local openSocket = server.openSocket
+
+	server.openSocket = function () end
+	handler.load()
+	server.openSocket = openSocket
+
+	-- warm up
+	_run(100)
+
+	-- the throughput with the garbage collector running
+	local start, events, allocations = clock(), 0, 0
+
+	repeat
+		local e, a = _run(100)
+		events, allocations = events + e, allocations + a
+	until clock() - start >= 0.5
+
+	local elapsed = clock() - start
+
+	-- the same work without and with a full collection afterwards
+	collectgarbage("collect")
+	collectgarbage("stop")
+
+	local before = collectgarbage("count")
+	local runStart = clock()
+	local stoppedEvents = _run(_connCount)
+	local runTime = clock() - runStart
+	local memory = collectgarbage("count") - before
+
+	local gcStart = clock()
+	collectgarbage("collect")
+	local gcTime = clock() - gcStart
+
+	collectgarbage("restart")
+
+	print(string.format(
+		"%-8s %10.0f %10.2f %10.1f %10.2f %10.2f %7.1f%%",
+		handler.name, events / elapsed, elapsed / events * 1e6,
+		allocations / events, memory * 1024 / stoppedEvents,
+		gcTime / stoppedEvents * 1e6, gcTime / (runTime + gcTime) * 100
+	))
+end
+
+print(string.format(
+	"%-8s %10s %10s %10s %10s %10s %8s",
+	"handler", "events/s", "us/event", "allocs/ev", "bytes/ev", "gc us/ev",
+	"gc"
+))
+
+for _, handler in ipairs(_handlers) do
+	_measure(handler)
+end
+
+-- do not start the server
+os.exit(0)
@@ -0,0 +1,155 @@
+-- -----------------------------------------------------------------------------
+-- measures the throughput of the native hash and base64 functions and compares
+-- crc32c and base64 with plain lua implementations. run it with the server
+-- binary:
+--
+--	$ ./vayu ../bench/hash.lua
+-- -----------------------------------------------------------------------------
+
+local band, bxor, rshift, lshift, bor =
+	bit32.band, bit32.bxor, bit32.rshift, bit32.lshift, bit32.bor
+
+-- -----------------------------------------------------------------------------
+-- lua reference implementations
+-- -----------------------------------------------------------------------------
+local _crcTable = {}
+
+for i = 0, 255 do
+	local crc = i
+
+	for j = 1, 8 do
+		crc = bxor(rshift(crc, 1), band(0x82f63b78, -band(crc, 1)))
+	end
+
+	_crcTable[i] = crc
+end
+
+local function _luaCrc32c(data)
+	local crc = 0xffffffff
+	local byte = string.byte
+
+	for i = 1, #data do
+		crc = bxor(rshift(crc, 8), _crcTable[band(bxor(crc, byte(data, i)), 0xff)])
+	end
+
+	return bxor(crc, 0xffffffff)
+end
+
+local _digits =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+
+local function _luaBase64Encode(data)
+	local result = {}
+	local byte, sub = string.byte, string.sub
+
+	for i = 1, #data - 2, 3 do
+		local a, b, c = byte(data, i, i + 2)
+		local value = bor(lshift(a, 16), lshift(b, 8), c)
+
+		result[#result + 1] =
+			sub(_digits, rshift(value, 18) + 1, rshift(value, 18) + 1) ..
+			sub(_digits, band(rshift(value, 12), 63) + 1, band(rshift(value, 12), 63) + 1) ..
+			sub(_digits, band(rshift(value, 6), 63) + 1, band(rshift(value, 6), 63) + 1) ..
+			sub(_digits, band(value, 63) + 1, band(value, 63) + 1)
+	end
+
+	-- the benchmark only uses sizes divisible by 3
+	assert(#data % 3 == 0)
+
+	return table.concat(result)
+end
+
+-- -----------------------------------------------------------------------------
+-- runs the given function on the data until at least the given time has
+-- passed and returns the throughput in MiB/s.
+-- -----------------------------------------------------------------------------
+local function _measure(fn, data, seconds)
+	local clock = os.clock
+	local start, iterations = clock(), 0
+
+	repeat
+		for i = 1, 16 do
+			fn(data)
+		end
+
+		iterations = iterations + 16
+	until clock() - start >= seconds
+
+	return #data * iterations / (clock() - start) / (1024 * 1024)
+end
+
+-- -----------------------------------------------------------------------------
+-- creates pseudo random data of the given size
+-- -----------------------------------------------------------------------------
+local function _data(size)
+	local bytes, value = {}, 1
+
+	for i = 1, size do
+		value = (value * 1103515245 + 12345) % 2147483648
+		bytes[i] = string.char(value % 256)
+	end
+
+	return table.concat(bytes)
+end
+
+-- the sizes are divisible by 3 so that base64 has no padding
+local _sizes = {66, 4098, 1048578}
+local _inputs = {}
+
+for i = 1, #_sizes do
+	_inputs[i] = _data(_sizes[i])
+end
+
+-- both implementations must produce the same results
+for i = 1, #_inputs do
+	assert(_luaCrc32c(_inputs[i]) == hash.crc32c(_inputs[i]))
+	assert(_luaBase64Encode(_inputs[i]) == encoding.base64Encode(_inputs[i]))
+end
+
+-- -----------------------------------------------------------------------------
+-- native throughput for every size
+-- -----------------------------------------------------------------------------
+local _encoded = {}
+
+for i = 1, #_inputs do
+	_encoded[i] = encoding.base64Encode(_inputs[i])
+end
+
+local _native = {
+	{"crc32c", hash.crc32c, _inputs},
+	{"sha1", hash.sha1, _inputs},
+	{"sha256", hash.sha256, _inputs},
+	{"base64enc", encoding.base64Encode, _inputs},
+	{"base64dec", encoding.base64Decode, _encoded}
+}
+
+print(string.format("%-10s %14s %14s %14s", "MiB/s", "64 B", "4 KiB", "1 MiB"))
+
+for i = 1, #_native do
+	local name, fn, inputs = _native[i][1], _native[i][2], _native[i][3]
+	local results = {}
+
+	for j = 1, #inputs do
+		results[j] = string.format("%14.1f", _measure(fn, inputs[j], 0.2))
+	end
+
+	print(string.format("%-10s %s", name, table.concat(results, " ")))
+end
+
+-- -----------------------------------------------------------------------------
+-- comparison with the lua implementations (4 KiB)
+-- -----------------------------------------------------------------------------
+print()
+
+local function _compare(name, luaFn, nativeFn, data)
+	local luaSpeed = _measure(luaFn, data, 0.5)
+	local nativeSpeed = _measure(nativeFn, data, 0.5)
+
+	print(string.format(
+		"%-10s lua %8.1f MiB/s   native %8.1f MiB/s   speedup %6.1fx",
+		name, luaSpeed, nativeSpeed, nativeSpeed / luaSpeed
+	))
+end
+
+_compare("crc32c", _luaCrc32c, hash.crc32c, _inputs[2])
+_compare("base64enc", _luaBase64Encode, encoding.base64Encode, _inputs[2])
@@ -0,0 +1,1103 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * a load generator for the examples in ./test, see the usage below. build it
+ * with ./bin/buildLoad.sh.
+ *
+ * with a rate (-r) the requests are scheduled open-loop: every connection
+ * sends at fixed intervals and the latency of a request is measured from the
+ * time it was supposed to be sent, so a stalled server is not hidden by a
+ * stalled generator (coordinated omission). without a rate every connection
+ * keeps the pipelining depth (-d) of requests in flight (closed loop).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+/**
+ * defines the maximum number of connections, the descriptors must fit into
+ * an fd_set (like the ones of the server).
+ */
+#define _CONNECTIONS_MAX (FD_SETSIZE - 16)
+
+/**
+ * defines the maximum number of scheduled requests per connection that are
+ * not sent yet. more are dropped (and counted).
+ */
+#define _QUEUE_MAX (65536)
+
+/**
+ * defines the maximum size of the headers of a http response.
+ */
+#define _HEADER_MAX (16 * 1024)
+
+/**
+ * defines the precision of the histogram: every power of two is divided into
+ * 2^_SUB_BITS buckets (less than 1.6% error).
+ */
+#define _SUB_BITS (6)
+#define _SUB_COUNT (1 << _SUB_BITS)
+
+/**
+ * defines the number of buckets of the histogram, enough for latencies of
+ * more than a day in microseconds.
+ */
+#define _BUCKET_COUNT (40 * _SUB_COUNT)
+
+/**
+ * defines the modes of the generator.
+ */
+typedef enum {
+	_MODE_ECHO,
+	_MODE_HTTP
+} _mode_t;
+
+/**
+ * defines a latency histogram in microseconds.
+ */
+typedef struct {
+
+	/* stores the number of values per bucket */
+	unsigned long counts[_BUCKET_COUNT];
+
+	/* stores the number of values, their sum, the minimum and maximum */
+	unsigned long count;
+	double sum;
+	unsigned long min;
+	unsigned long max;
+
+} _histogram_t;
+
+/**
+ * defines a connection.
+ */
+typedef struct {
+
+	/* stores the descriptor (-1 if not connected) and whether connect() is
+	 * still in progress */
+	int fd;
+	int isConnecting;
+
+	/* stores whether the server announced to close the connection */
+	int isClosing;
+
+	/* stores the time of the next connection attempt */
+	double retryTime;
+
+	/* stores the start times of the requests: the ones in flight followed by
+	 * the scheduled ones not sent yet (ring buffer) */
+	double *times;
+	size_t head;
+	size_t inFlight;
+	size_t count;
+
+	/* stores the time the next request is scheduled (open loop) */
+	double nextTime;
+
+	/* stores the data not sent yet */
+	char *out;
+	size_t outPos;
+	size_t outLen;
+
+	/* stores the received data of an incomplete http response */
+	char *in;
+	size_t inLen;
+	size_t inSize;
+
+	/* stores the number of bytes missing of the current echo response */
+	size_t remaining;
+
+} _conn_t;
+
+/**
+ * stores the options.
+ */
+static const char *_host = "127.0.0.1";
+static const char *_port = "12345";
+static const char *_path = "/";
+static const char *_jsonFile;
+static _mode_t _mode = _MODE_HTTP;
+static int _connCount = 16;
+static int _depth = 1;
+static long _size = -1;
+static double _rate;
+static double _duration = 10.0;
+static double _warmup;
+
+/**
+ * stores the address of the server.
+ */
+static struct sockaddr_storage _addr;
+static socklen_t _addrLen;
+
+/**
+ * stores a single request.
+ */
+static char *_request;
+static size_t _requestLen;
+
+/**
+ * stores the connections.
+ */
+static _conn_t *_conns;
+
+/**
+ * stores the interval between two requests of a connection (open loop).
+ */
+static double _interval;
+
+/**
+ * stores the time results are recorded from and the end of the run.
+ */
+static double _recordTime;
+static double _endTime;
+
+/**
+ * stores the results.
+ */
+static _histogram_t _histogram;
+static unsigned long _responses;
+static unsigned long _errors;
+static unsigned long _dropped;
+static unsigned long _connectErrors;
+static unsigned long _bytesRead;
+static unsigned long _bytesWritten;
+
+/**
+ * returns the current time of a monotonic clock in seconds.
+ */
+static double _getTime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * returns the bucket of the given value: the values below 2 * _SUB_COUNT have
+ * their own bucket, larger ones keep their _SUB_BITS + 1 leading bits.
+ */
+static int _getBucket(unsigned long value)
+{
+	int shift = 0, bucket;
+
+	if(value < 2 * _SUB_COUNT)
+	{
+		return (int) value;
+	}
+
+	while((value >> shift) >= 2 * _SUB_COUNT)
+	{
+		++shift;
+	}
+
+	bucket = (shift + 1) * _SUB_COUNT + (int) ((value >> shift) - _SUB_COUNT);
+
+	return bucket < _BUCKET_COUNT ? bucket : _BUCKET_COUNT - 1;
+}
+
+/**
+ * returns the highest value of the given bucket.
+ */
+static unsigned long _getBucketValue(int bucket)
+{
+	int shift;
+
+	if(bucket < 2 * _SUB_COUNT)
+	{
+		return (unsigned long) bucket;
+	}
+
+	shift = bucket / _SUB_COUNT - 1;
+
+	return ((unsigned long) (bucket % _SUB_COUNT + _SUB_COUNT + 1) << shift)
+		- 1;
+}
+
+/**
+ * adds a value to the histogram.
+ */
+static void _histogramAdd(_histogram_t *histogram, unsigned long value)
+{
+	++histogram->counts[_getBucket(value)];
+
+	if(histogram->count == 0 || value < histogram->min)
+	{
+		histogram->min = value;
+	}
+
+	if(value > histogram->max)
+	{
+		histogram->max = value;
+	}
+
+	++histogram->count;
+	histogram->sum += (double) value;
+}
+
+/**
+ * returns the value of the given percentile (0 - 100).
+ */
+static unsigned long _histogramGet(
+	const _histogram_t *histogram,
+	double percentile
+)
+{
+	unsigned long target = (unsigned long) ceil(
+		(double) histogram->count * percentile / 100.0
+	), count = 0;
+	int i;
+
+	target = target > 0 ? target : 1;
+
+	for(i=0;i<_BUCKET_COUNT;++i)
+	{
+		if((count += histogram->counts[i]) >= target)
+		{
+			/* the bucket may go beyond the largest value */
+			return _getBucketValue(i) < histogram->max
+				? _getBucketValue(i) : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
+
+/**
+ * prints the usage and exits.
+ */
+static void _usage(void)
+{
+	fprintf(stderr,
+		"usage: load [options]\n"
+		"  -h host         server address (default 127.0.0.1)\n"
+		"  -p port         server port (default 12345)\n"
+		"  -m echo|http    protocol (default http)\n"
+		"  -u path         http request path (default /)\n"
+		"  -c connections  number of connections (default 16)\n"
+		"  -d depth        requests in flight per connection (default 1)\n"
+		"  -s size         echo message or http request body size in bytes\n"
+		"                  (default 64 for echo, 0 for http)\n"
+		"  -r rate         requests per second over all connections, open\n"
+		"                  loop (default 0: closed loop)\n"
+		"  -t seconds      duration (default 10)\n"
+		"  -w seconds      warmup not recorded (default 0)\n"
+		"  -j file         write the results as json (- for stdout)\n"
+	);
+
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * parses the command line.
+ */
+static void _parseOptions(int argc, char **argv)
+{
+	int option;
+
+	while((option = getopt(argc, argv, "h:p:m:u:c:d:s:r:t:w:j:")) != -1)
+	{
+		switch(option)
+		{
+			case 'h': _host = optarg; break;
+			case 'p': _port = optarg; break;
+			case 'u': _path = optarg; break;
+			case 'c': _connCount = atoi(optarg); break;
+			case 'd': _depth = atoi(optarg); break;
+			case 's': _size = atol(optarg); break;
+			case 'r': _rate = atof(optarg); break;
+			case 't': _duration = atof(optarg); break;
+			case 'w': _warmup = atof(optarg); break;
+			case 'j': _jsonFile = optarg; break;
+
+			case 'm':
+				if(strcmp(optarg, "echo") == 0)
+				{
+					_mode = _MODE_ECHO;
+				}
+				else if(strcmp(optarg, "http") == 0)
+				{
+					_mode = _MODE_HTTP;
+				}
+				else
+				{
+					_usage();
+				}
+				break;
+
+			default:
+				_usage();
+		}
+	}
+
+	if(_size < 0)
+	{
+		_size = _mode == _MODE_ECHO ? 64 : 0;
+	}
+
+	if(optind != argc || _connCount < 1 || _connCount > _CONNECTIONS_MAX
+		|| _depth < 1 || _rate < 0.0 || _duration <= 0.0 || _warmup < 0.0
+		|| (_mode == _MODE_ECHO && _size < 1))
+	{
+		_usage();
+	}
+}
+
+/**
+ * builds the request sent over and over again.
+ */
+static void _prepareRequest(void)
+{
+	char header[1024];
+	int len = 0;
+
+	if(_mode == _MODE_HTTP)
+	{
+		len = sprintf(header, "%s %.512s HTTP/1.1\r\nHost: %.256s\r\n",
+			_size > 0 ? "POST" : "GET", _path, _host
+		);
+
+		if(_size > 0)
+		{
+			len += sprintf(header + len, "Content-Length: %ld\r\n", _size);
+		}
+
+		len += sprintf(header + len, "\r\n");
+	}
+
+	_requestLen = (size_t) len + (size_t) _size;
+
+	if((_request = malloc(_requestLen)) == NULL)
+	{
+		perror("malloc()");
+		exit(EXIT_FAILURE);
+	}
+
+	memcpy(_request, header, (size_t) len);
+	memset(_request + len, 'x', (size_t) _size);
+}
+
+/**
+ * resolves the address of the server.
+ */
+static void _resolve(void)
+{
+	struct addrinfo hints, *result;
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if((error = getaddrinfo(_host, _port, &hints, &result)) != 0)
+	{
+		fprintf(stderr, "getaddrinfo(): %s\n", gai_strerror(error));
+		exit(EXIT_FAILURE);
+	}
+
+	memcpy(&_addr, result->ai_addr, result->ai_addrlen);
+	_addrLen = result->ai_addrlen;
+
+	freeaddrinfo(result);
+}
+
+/**
+ * starts connecting the given connection.
+ */
+static void _connect(_conn_t *conn)
+{
+	int flag = 1;
+
+	if((conn->fd = socket(_addr.ss_family, SOCK_STREAM, 0)) < 0)
+	{
+		perror("socket()");
+		exit(EXIT_FAILURE);
+	}
+
+	if(conn->fd >= FD_SETSIZE)
+	{
+		fprintf(stderr, "too many descriptors\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+	setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+	conn->isConnecting = 1;
+
+	if(connect(conn->fd, (struct sockaddr*) &_addr, _addrLen) == 0)
+	{
+		conn->isConnecting = 0;
+	}
+	else if(errno != EINPROGRESS)
+	{
+		close(conn->fd);
+
+		conn->fd = -1;
+		conn->retryTime = _getTime() + 0.01;
+
+		++_connectErrors;
+	}
+}
+
+/**
+ * closes the given connection. the scheduled requests are sent after
+ * reconnecting, the ones in flight too if the server announced to close the
+ * connection (e.g. after a number of requests). else they are lost.
+ */
+static void _disconnect(_conn_t *conn, double now)
+{
+	close(conn->fd);
+
+	conn->fd = -1;
+
+	if(conn->isClosing)
+	{
+		conn->retryTime = now;
+	}
+	else
+	{
+		conn->retryTime = now + 0.01;
+
+		_errors += conn->inFlight;
+
+		conn->head = (conn->head + conn->inFlight) % _QUEUE_MAX;
+		conn->count -= conn->inFlight;
+	}
+
+	conn->isClosing = 0;
+	conn->inFlight = 0;
+
+	conn->outPos = 0;
+	conn->outLen = 0;
+	conn->inLen = 0;
+	conn->remaining = (size_t) _size;
+}
+
+/**
+ * records the response of the oldest request in flight.
+ */
+static void _complete(_conn_t *conn, double now, int isError)
+{
+	double start = conn->times[conn->head];
+
+	conn->head = (conn->head + 1) % _QUEUE_MAX;
+	--conn->inFlight;
+	--conn->count;
+
+	if(start >= _recordTime)
+	{
+		_histogramAdd(&_histogram, (unsigned long) ((now - start) * 1e6 + 0.5));
+
+		++_responses;
+		_errors += isError ? 1 : 0;
+	}
+}
+
+/**
+ * sends the pending data of the given connection. returns 1 if everything is
+ * ok and 0 if the connection failed.
+ */
+static int _flush(_conn_t *conn)
+{
+	ssize_t written;
+
+	while(conn->outPos < conn->outLen)
+	{
+		written = write(
+			conn->fd, conn->out + conn->outPos, conn->outLen - conn->outPos
+		);
+
+		if(written < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+
+		conn->outPos += (size_t) written;
+		_bytesWritten += (unsigned long) written;
+	}
+
+	conn->outPos = 0;
+	conn->outLen = 0;
+
+	return 1;
+}
+
+/**
+ * schedules the requests of the given connection and sends the ones that fit
+ * into the pipeline. returns 1 if everything is ok and 0 if the connection
+ * failed.
+ */
+static int _schedule(_conn_t *conn, double now)
+{
+	if(_rate > 0.0)
+	{
+		/* scheduled requests keep their time while the pipeline is full */
+		for(;conn->nextTime<=now;conn->nextTime+=_interval)
+		{
+			if(conn->count < _QUEUE_MAX)
+			{
+				conn->times[(conn->head + conn->count++) % _QUEUE_MAX] =
+					conn->nextTime;
+			}
+			else
+			{
+				++_dropped;
+			}
+		}
+	}
+	else
+	{
+		while(conn->count < (size_t) _depth)
+		{
+			conn->times[(conn->head + conn->count++) % _QUEUE_MAX] = now;
+		}
+	}
+
+	if(conn->fd < 0 || conn->isConnecting)
+	{
+		return 1;
+	}
+
+	/* the out buffer holds the whole pipeline */
+	while(conn->inFlight < (size_t) _depth && conn->inFlight < conn->count)
+	{
+		memcpy(conn->out + conn->outLen, _request, _requestLen);
+
+		conn->outLen += _requestLen;
+		++conn->inFlight;
+	}
+
+	return _flush(conn);
+}
+
+/**
+ * parses the http responses received by the given connection. returns 1 if
+ * everything is ok and 0 if the connection failed.
+ */
+static int _parseHttp(_conn_t *conn, double now)
+{
+	char *line, *end;
+	size_t headerLen, total;
+	unsigned long contentLength;
+	int status, isClosing;
+
+	while(conn->inLen > 0)
+	{
+		/* find the end of the headers */
+		for(end=conn->in;end+4<=conn->in+conn->inLen;++end)
+		{
+			if(memcmp(end, "\r\n\r\n", 4) == 0)
+			{
+				break;
+			}
+		}
+
+		if(end + 4 > conn->in + conn->inLen)
+		{
+			return conn->inLen < _HEADER_MAX;
+		}
+
+		headerLen = (size_t) (end - conn->in) + 4;
+
+		if(conn->inFlight == 0 || headerLen < 12
+			|| strncmp(conn->in, "HTTP/1.", 7) != 0)
+		{
+			return 0;
+		}
+
+		status = atoi(conn->in + 9);
+		contentLength = 0;
+		isClosing = 0;
+
+		for(line=conn->in;line<end;line=strstr(line, "\r\n")+2)
+		{
+			if(strncasecmp(line, "content-length:", 15) == 0)
+			{
+				contentLength = strtoul(line + 15, NULL, 10);
+			}
+			else if(strncasecmp(line, "connection:", 11) == 0)
+			{
+				isClosing = strncasecmp(line + 11 + strspn(line + 11, " "),
+					"close", 5
+				) == 0;
+			}
+		}
+
+		/* wait for the body */
+		if((total = headerLen + contentLength) > conn->inLen)
+		{
+			if(total > conn->inSize)
+			{
+				if((conn->in = realloc(conn->in, total + 1)) == NULL)
+				{
+					perror("realloc()");
+					exit(EXIT_FAILURE);
+				}
+
+				conn->inSize = total;
+			}
+
+			return 1;
+		}
+
+		_complete(conn, now, status < 200 || status >= 400);
+
+		memmove(conn->in, conn->in + total, conn->inLen - total);
+		conn->inLen -= total;
+		conn->in[conn->inLen] = '\0';
+
+		/* the requests in flight are sent again on a new connection */
+		if(isClosing)
+		{
+			conn->isClosing = 1;
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * reads the responses of the given connection. returns 1 if everything is ok
+ * and 0 if the connection failed or was closed.
+ */
+static int _read(_conn_t *conn, double now)
+{
+	char buffer[64 * 1024];
+	size_t size, len;
+	ssize_t bytesRead;
+
+	for(;;)
+	{
+		/* http responses are collected, echo responses are only counted */
+		if(_mode == _MODE_HTTP)
+		{
+			if((size = conn->inSize - conn->inLen) == 0)
+			{
+				return 0;
+			}
+
+			bytesRead = read(conn->fd, conn->in + conn->inLen, size);
+		}
+		else
+		{
+			bytesRead = read(conn->fd, buffer, sizeof(buffer));
+		}
+
+		if(bytesRead <= 0)
+		{
+			return bytesRead < 0
+				&& (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+		}
+
+		_bytesRead += (unsigned long) bytesRead;
+
+		if(_mode == _MODE_HTTP)
+		{
+			conn->inLen += (size_t) bytesRead;
+			conn->in[conn->inLen] = '\0';
+
+			if(!_parseHttp(conn, now))
+			{
+				return 0;
+			}
+
+			continue;
+		}
+
+		for(size=(size_t)bytesRead;size>0;size-=len)
+		{
+			len = size < conn->remaining ? size : conn->remaining;
+
+			if((conn->remaining -= len) == 0)
+			{
+				/* more data than requested */
+				if(conn->inFlight == 0)
+				{
+					return 0;
+				}
+
+				_complete(conn, now, 0);
+				conn->remaining = (size_t) _size;
+			}
+		}
+	}
+}
+
+/**
+ * creates the connections.
+ */
+static void _prepareConnections(double now)
+{
+	int i;
+
+	if((_conns = calloc((size_t) _connCount, sizeof(_conn_t))) == NULL)
+	{
+		perror("calloc()");
+		exit(EXIT_FAILURE);
+	}
+
+	for(i=0;i<_connCount;++i)
+	{
+		_conns[i].times = malloc(_QUEUE_MAX * sizeof(double));
+		_conns[i].out = malloc((size_t) _depth * _requestLen + 1);
+		_conns[i].in = malloc(_HEADER_MAX + 1);
+		_conns[i].inSize = _HEADER_MAX;
+		_conns[i].remaining = (size_t) _size;
+
+		if(_conns[i].times == NULL || _conns[i].out == NULL
+			|| _conns[i].in == NULL)
+		{
+			perror("malloc()");
+			exit(EXIT_FAILURE);
+		}
+
+		/* spread the requests of the connections evenly */
+		_conns[i].nextTime = now + _interval * (double) i / (double) _connCount;
+
+		_connect(_conns + i);
+	}
+}
+
+/**
+ * runs the load until the end time.
+ */
+static void _run(void)
+{
+	fd_set readSet, writeSet;
+	struct timeval timeout;
+	double now, wait;
+	int highest, i, error;
+	socklen_t len;
+	_conn_t *conn;
+
+	while((now = _getTime()) < _endTime)
+	{
+		FD_ZERO(&readSet);
+		FD_ZERO(&writeSet);
+
+		highest = -1;
+		wait = _endTime - now;
+
+		for(i=0;i<_connCount;++i)
+		{
+			conn = _conns + i;
+
+			if(conn->fd < 0 && now >= conn->retryTime)
+			{
+				_connect(conn);
+			}
+
+			if(conn->fd >= 0 && !_schedule(conn, now))
+			{
+				_disconnect(conn, now);
+			}
+
+			if(_rate > 0.0 && conn->nextTime - now < wait)
+			{
+				wait = conn->nextTime - now;
+			}
+
+			if(conn->fd < 0)
+			{
+				_schedule(conn, now);
+
+				if(conn->retryTime - now < wait)
+				{
+					wait = conn->retryTime - now;
+				}
+
+				continue;
+			}
+
+			FD_SET(conn->fd, &readSet);
+
+			if(conn->isConnecting || conn->outPos < conn->outLen)
+			{
+				FD_SET(conn->fd, &writeSet);
+			}
+
+			highest = conn->fd > highest ? conn->fd : highest;
+		}
+
+		wait = wait > 0.0 ? wait : 0.0;
+		timeout.tv_sec = (long) wait;
+		timeout.tv_usec = (long) ((wait - (double) timeout.tv_sec) * 1e6);
+
+		if(select(highest + 1, &readSet, &writeSet, NULL, &timeout) < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+
+			perror("select()");
+			exit(EXIT_FAILURE);
+		}
+
+		now = _getTime();
+
+		for(i=0;i<_connCount;++i)
+		{
+			conn = _conns + i;
+
+			if(conn->fd < 0)
+			{
+				continue;
+			}
+
+			if(conn->isConnecting)
+			{
+				if(!FD_ISSET(conn->fd, &writeSet))
+				{
+					continue;
+				}
+
+				len = sizeof(error);
+
+				if(getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0
+					|| error != 0)
+				{
+					++_connectErrors;
+					_disconnect(conn, now);
+
+					continue;
+				}
+
+				conn->isConnecting = 0;
+			}
+
+			if((FD_ISSET(conn->fd, &readSet) && !_read(conn, now))
+				|| (FD_ISSET(conn->fd, &writeSet) && !_flush(conn)))
+			{
+				_disconnect(conn, now);
+			}
+		}
+	}
+}
+
+/**
+ * prints the results as text.
+ */
+static void _printText(FILE *file, double elapsed)
+{
+	static const double percentiles[] = {
+		50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 100.0
+	};
+	unsigned long count, limit;
+	int i, j, width;
+
+	fprintf(file, "%s:%s %s, %d connections, depth %d, %ld bytes, ",
+		_host, _port, _mode == _MODE_ECHO ? "echo" : "http", _connCount,
+		_depth, _size
+	);
+
+	if(_rate > 0.0)
+	{
+		fprintf(file, "open loop at %.0f/s", _rate);
+	}
+	else
+	{
+		fprintf(file, "closed loop");
+	}
+
+	fprintf(file, ", %.1f s\n\n", elapsed);
+
+	fprintf(file, "  responses  %lu (%.1f/s)\n",
+		_responses, (double) _responses / elapsed
+	);
+	fprintf(file, "  errors     %lu, dropped %lu, connect errors %lu\n",
+		_errors, _dropped, _connectErrors
+	);
+	fprintf(file, "  transfer   %.2f MB/s read, %.2f MB/s written\n\n",
+		(double) _bytesRead / elapsed / 1e6,
+		(double) _bytesWritten / elapsed / 1e6
+	);
+
+	if(_histogram.count == 0)
+	{
+		return;
+	}
+
+	fprintf(file, "  latency (us)  min %lu  mean %.1f\n",
+		_histogram.min, _histogram.sum / (double) _histogram.count
+	);
+
+	for(i=0;i<(int)(sizeof(percentiles)/sizeof(percentiles[0]));++i)
+	{
+		fprintf(file, "    p%-7g %lu\n", percentiles[i],
+			_histogramGet(&_histogram, percentiles[i])
+		);
+	}
+
+	/* a coarse histogram with a bucket per power of two */
+	fprintf(file, "\n  histogram (us)\n");
+
+	for(limit=1,i=0;i<_BUCKET_COUNT;limit*=2)
+	{
+		for(count=0;i<_BUCKET_COUNT&&_getBucketValue(i)<limit;++i)
+		{
+			count += _histogram.counts[i];
+		}
+
+		if(count == 0)
+		{
+			continue;
+		}
+
+		width = (int) (50.0 * (double) count / (double) _histogram.count + 0.5);
+
+		fprintf(file, "    < %-9lu %10lu ", limit, count);
+
+		for(j=0;j<width;++j)
+		{
+			fputc('#', file);
+		}
+
+		fputc('\n', file);
+	}
+}
+
+/**
+ * prints the results as json.
+ */
+static void _printJson(FILE *file, double elapsed)
+{
+	int i, isFirst = 1;
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"host\": \"%s\",\n\t\"port\": \"%s\",\n", _host, _port);
+	fprintf(file, "\t\"mode\": \"%s\",\n",
+		_mode == _MODE_ECHO ? "echo" : "http"
+	);
+	fprintf(file, "\t\"connections\": %d,\n\t\"depth\": %d,\n",
+		_connCount, _depth
+	);
+	fprintf(file, "\t\"size\": %ld,\n\t\"rate\": %.1f,\n", _size, _rate);
+	fprintf(file, "\t\"duration\": %.3f,\n", elapsed);
+	fprintf(file, "\t\"responses\": %lu,\n", _responses);
+	fprintf(file, "\t\"throughput\": %.1f,\n", (double) _responses / elapsed);
+	fprintf(file, "\t\"errors\": %lu,\n\t\"dropped\": %lu,\n",
+		_errors, _dropped
+	);
+	fprintf(file, "\t\"connectErrors\": %lu,\n", _connectErrors);
+	fprintf(file, "\t\"bytesRead\": %lu,\n\t\"bytesWritten\": %lu,\n",
+		_bytesRead, _bytesWritten
+	);
+	fprintf(file, "\t\"latency\": {\n");
+	fprintf(file, "\t\t\"min\": %lu,\n", _histogram.min);
+	fprintf(file, "\t\t\"mean\": %.1f,\n", _histogram.count > 0
+		? _histogram.sum / (double) _histogram.count : 0.0
+	);
+	fprintf(file, "\t\t\"p50\": %lu,\n", _histogramGet(&_histogram, 50.0));
+	fprintf(file, "\t\t\"p90\": %lu,\n", _histogramGet(&_histogram, 90.0));
+	fprintf(file, "\t\t\"p99\": %lu,\n", _histogramGet(&_histogram, 99.0));
+	fprintf(file, "\t\t\"p999\": %lu,\n", _histogramGet(&_histogram, 99.9));
+	fprintf(file, "\t\t\"max\": %lu\n", _histogram.max);
+	fprintf(file, "\t},\n");
+
+	/* the non-empty buckets as [highest value in us, count] */
+	fprintf(file, "\t\"histogram\": [");
+
+	for(i=0;i<_BUCKET_COUNT;++i)
+	{
+		if(_histogram.counts[i] > 0)
+		{
+			fprintf(file, "%s[%lu, %lu]", isFirst ? "" : ", ",
+				_getBucketValue(i), _histogram.counts[i]
+			);
+
+			isFirst = 0;
+		}
+	}
+
+	fprintf(file, "]\n}\n");
+}
+
+/**
+ * entry point of the load generator.
+ */
+int main(int argc, char **argv)
+{
+	FILE *file;
+	double start;
+
+	_parseOptions(argc, argv);
+	_prepareRequest();
+	_resolve();
+
+	signal(SIGPIPE, SIG_IGN);
+
+	_interval = _rate > 0.0 ? (double) _connCount / _rate : 0.0;
+
+	start = _getTime();
+	_recordTime = start + _warmup;
+	_endTime = _recordTime + _duration;
+
+	_prepareConnections(start);
+	_run();
+
+	/* the text goes to stderr if stdout gets the json */
+	if(_jsonFile != NULL && strcmp(_jsonFile, "-") == 0)
+	{
+		_printText(stderr, _duration);
+		_printJson(stdout, _duration);
+	}
+	else
+	{
+		_printText(stdout, _duration);
+
+		if(_jsonFile != NULL)
+		{
+			if((file = fopen(_jsonFile, "w")) == NULL)
+			{
+				perror("fopen()");
+				return EXIT_FAILURE;
+			}
+
+			_printJson(file, _duration);
+			fclose(file);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,510 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * microbenchmarks of the buffer and socket primitives, see the usage below.
+ * build it with ./bin/buildMicro.sh.
+ *
+ * every benchmark reports the time, the bytes copied in user space (memcpy(),
+ * memmove() and data moved by the allocator) and the calls of the allocator
+ * per operation. the allocator is installed with bufSetAlloc(), so other
+ * allocators can be compared with -a.
+ */
+
+#include "../src/core/server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/**
+ * defines the signature of a benchmark, it runs a batch of operations and
+ * returns their number.
+ */
+typedef unsigned long (*_run_t)(void);
+
+/**
+ * defines a benchmark.
+ */
+typedef struct {
+
+	/* stores the name */
+	const char *name;
+
+	/* stores the batch and whether it needs the socket pair */
+	_run_t run;
+	int needsSockets;
+
+} _bench_t;
+
+/**
+ * stores the data appended by the benchmarks.
+ */
+static char _data[64 * 1024];
+
+/**
+ * stores the buffer of the benchmarks and a scratch buffer for reading.
+ */
+static buf_t _buf;
+static char _scratch[64 * 1024];
+
+/**
+ * stores the connected socket pair.
+ */
+static int _fds[2] = {-1, -1};
+
+/**
+ * stores whether the allocator rounds up to powers of two.
+ */
+static int _isPow2;
+
+/**
+ * stores the counters.
+ */
+static unsigned long _allocCount;
+static unsigned long _copied;
+
+/**
+ * returns the current time of a monotonic clock in seconds.
+ */
+static double _getTime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * the allocator installed with bufSetAlloc(), it counts the calls and the
+ * data moved by realloc(). the only buffer growing is _buf, so its length is
+ * the data moved.
+ */
+static void *_alloc(void *ptr, size_t size)
+{
+	size_t rounded = size;
+	void *result;
+
+	/* realloc() stays in place while the block is large enough */
+	if(_isPow2)
+	{
+		for(rounded=IO_BUF_SIZE;rounded<size;rounded*=2)
+		{
+		}
+	}
+
+	++_allocCount;
+
+	if((result = realloc(ptr, rounded)) != ptr && ptr != NULL)
+	{
+		_copied += _buf.len;
+	}
+
+	return result;
+}
+
+/**
+ * appends to the buffer and counts the copied bytes.
+ */
+static void _append(size_t len)
+{
+	bufAppend(&_buf, _data, len);
+	_copied += len;
+}
+
+/**
+ * consumes the buffer and counts the moved bytes.
+ */
+static void _consume(size_t len)
+{
+	_copied += len < _buf.len ? _buf.len - len : 0;
+	bufConsume(&_buf, len);
+}
+
+/**
+ * reads everything from the given descriptor.
+ */
+static void _drain(int fd)
+{
+	while(read(fd, _scratch, sizeof(_scratch)) > 0)
+	{
+	}
+}
+
+/**
+ * many small appends to a buffer which keeps its memory.
+ */
+static unsigned long _appendSmallReused(void)
+{
+	int i;
+
+	for(i=0;i<1024;++i)
+	{
+		_append(16);
+	}
+
+	_consume(_buf.len);
+
+	return 1024;
+}
+
+/**
+ * many small appends to a new buffer, it grows IO_BUF_SIZE at a time.
+ */
+static unsigned long _appendSmallNew(void)
+{
+	int i;
+
+	for(i=0;i<1024;++i)
+	{
+		_append(16);
+	}
+
+	bufClear(&_buf);
+
+	return 1024;
+}
+
+/**
+ * many small appends to a new buffer reserved up front.
+ */
+static unsigned long _appendSmallReserved(void)
+{
+	int i;
+
+	bufReserve(&_buf, 1024 * 16);
+
+	for(i=0;i<1024;++i)
+	{
+		_append(16);
+	}
+
+	bufClear(&_buf);
+
+	return 1024;
+}
+
+/**
+ * few large appends to a new buffer.
+ */
+static unsigned long _appendLargeNew(void)
+{
+	int i;
+
+	for(i=0;i<16;++i)
+	{
+		_append(sizeof(_data));
+	}
+
+	bufClear(&_buf);
+
+	return 16;
+}
+
+/**
+ * fills the buffer and extracts the data, like socketWrite() does.
+ */
+static unsigned long _extract(void)
+{
+	size_t len;
+	int i;
+
+	for(i=0;i<64;++i)
+	{
+		_append(4096);
+		free(bufExtract(&_buf, &len));
+	}
+
+	return 64;
+}
+
+/**
+ * fills the buffer and consumes it in small parts, like a parser does.
+ */
+static unsigned long _consumeSmall(void)
+{
+	int i;
+
+	_append(4096);
+
+	for(i=0;i<16;++i)
+	{
+		_consume(256);
+	}
+
+	return 16;
+}
+
+/**
+ * writes a large buffer with socketWrite(), the socket takes only a part of
+ * it per call.
+ */
+static unsigned long _socketWriteLarge(void)
+{
+	unsigned long count = 0;
+
+	_append(sizeof(_data));
+
+	while(bufHasData(&_buf))
+	{
+		socketWrite(_fds[0], &_buf);
+
+		/* the rest is appended to the buffer again */
+		_copied += _buf.len;
+		++count;
+
+		_drain(_fds[1]);
+	}
+
+	return count;
+}
+
+/**
+ * writes a large buffer with socketWriteData() and bufConsume() instead.
+ */
+static unsigned long _socketWriteDataLarge(void)
+{
+	unsigned long count = 0;
+	ssize_t written;
+	size_t len;
+	void *data;
+
+	_append(sizeof(_data));
+
+	while(bufHasData(&_buf))
+	{
+		data = bufPeek(&_buf, &len);
+
+		if((written = socketWriteData(_fds[0], data, len, 0)) > 0)
+		{
+			_consume((size_t) written);
+		}
+
+		++count;
+
+		_drain(_fds[1]);
+	}
+
+	return count;
+}
+
+/**
+ * reads small messages with socketRead().
+ */
+static unsigned long _socketReadSmall(void)
+{
+	int i;
+
+	for(i=0;i<64;++i)
+	{
+		if(write(_fds[1], _data, 1024) != 1024)
+		{
+			return 0;
+		}
+
+		socketRead(_fds[0], &_buf);
+
+		/* peeked and appended */
+		_copied += _buf.len;
+		_consume(_buf.len);
+	}
+
+	return 64;
+}
+
+/**
+ * sends messages from one end of the pair to the other.
+ */
+static unsigned long _socketRoundTrip(void)
+{
+	int i;
+
+	for(i=0;i<64;++i)
+	{
+		_append(4096);
+		socketWrite(_fds[0], &_buf);
+
+		/* socketRead() reads up to IO_BUF_SIZE bytes per call */
+		while(_buf.len < 4096 && socketRead(_fds[1], &_buf))
+		{
+		}
+
+		_copied += _buf.len;
+		_consume(_buf.len);
+	}
+
+	return 64;
+}
+
+/**
+ * stores the benchmarks.
+ */
+static const _bench_t _benches[] = {
+	{"append 16B, reused buffer", _appendSmallReused, 0},
+	{"append 16B, new buffer", _appendSmallNew, 0},
+	{"append 16B, reserved buffer", _appendSmallReserved, 0},
+	{"append 64K, new buffer", _appendLargeNew, 0},
+	{"append 4K + extract", _extract, 0},
+	{"consume 256B of 4K", _consumeSmall, 0},
+	{"socketWrite 64K", _socketWriteLarge, 1},
+	{"socketWriteData 64K", _socketWriteDataLarge, 1},
+	{"socketRead 1K", _socketReadSmall, 1},
+	{"socketWrite + socketRead 4K", _socketRoundTrip, 1},
+	{NULL, NULL, 0}
+};
+
+/**
+ * creates the socket pair. the send buffer is small, so large writes are
+ * partial.
+ */
+static void _prepareSockets(void)
+{
+	int size = 16 * 1024, i;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, _fds) != 0)
+	{
+		perror("socketpair()");
+		exit(EXIT_FAILURE);
+	}
+
+	setsockopt(_fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	for(i=0;i<2;++i)
+	{
+		fcntl(_fds[i], F_SETFL, fcntl(_fds[i], F_GETFL) | O_NONBLOCK);
+	}
+}
+
+/**
+ * prints the usage and exits.
+ */
+static void _usage(void)
+{
+	fprintf(stderr,
+		"usage: micro [options] [filter]\n"
+		"  -a realloc|pow2  allocator (default realloc, pow2 rounds up to\n"
+		"                   powers of two)\n"
+		"  -t seconds       time per benchmark (default 0.5)\n"
+		"  filter           runs the benchmarks containing the text\n"
+	);
+
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * entry point of the microbenchmarks.
+ */
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	double seconds = 0.5, start, elapsed;
+	unsigned long ops;
+	const _bench_t *bench;
+	int option;
+
+	while((option = getopt(argc, argv, "a:t:")) != -1)
+	{
+		switch(option)
+		{
+			case 'a':
+				if(strcmp(optarg, "pow2") == 0)
+				{
+					_isPow2 = 1;
+				}
+				else if(strcmp(optarg, "realloc") != 0)
+				{
+					_usage();
+				}
+				break;
+
+			case 't':
+				seconds = atof(optarg);
+				break;
+
+			default:
+				_usage();
+		}
+	}
+
+	if(optind < argc)
+	{
+		filter = argv[optind++];
+	}
+
+	if(optind != argc || seconds <= 0.0)
+	{
+		_usage();
+	}
+
+	memset(_data, 'x', sizeof(_data));
+	bufSetAlloc(_alloc);
+
+	printf("%-30s %12s %14s %12s\n", "benchmark", "ns/op", "copied B/op",
+		"allocs/op"
+	);
+
+	for(bench=_benches;bench->name!=NULL;++bench)
+	{
+		if(filter != NULL && strstr(bench->name, filter) == NULL)
+		{
+			continue;
+		}
+
+		if(bench->needsSockets && _fds[0] < 0)
+		{
+			_prepareSockets();
+		}
+
+		/* warm up, then count from a clean state */
+		bench->run();
+		bufClear(&_buf);
+
+		_allocCount = 0;
+		_copied = 0;
+		ops = 0;
+
+		start = _getTime();
+
+		do
+		{
+			ops += bench->run();
+		}
+		while((elapsed = _getTime() - start) < seconds);
+
+		bufClear(&_buf);
+
+		printf("%-30s %12.1f %14.1f %12.3f\n", bench->name,
+			elapsed * 1e9 / (double) ops, (double) _copied / (double) ops,
+			(double) _allocCount / (double) ops
+		);
+	}
+
+	return EXIT_SUCCESS;
+}
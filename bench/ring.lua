@@ -0,0 +1,210 @@
+-- -----------------------------------------------------------------------------
+-- compares the native consistent hash ring with hashing keys in lua (a
+-- string.byte loop and the modulo of the number of nodes) and checks how the
+-- keys are redistributed when nodes are removed, added back, added and
+-- weighted. run it with the server binary:
+--
+--	$ ./vayu ../bench/ring.lua
+-- -----------------------------------------------------------------------------
+
+local _keyCount = 100000
+
+-- the nodes of the cluster
+local function _nodes(count)
+	local nodes = {}
+
+	for i = 1, count do
+		nodes[i] = string.format("10.0.0.%d:11211", i)
+	end
+
+	return nodes
+end
+
+-- the keys, shaped like typical cache keys
+local _keys = {}
+
+for i = 1, _keyCount do
+	_keys[i] = "user:" .. i .. ":profile"
+end
+
+-- -----------------------------------------------------------------------------
+-- the lua way: a string.byte loop and the modulo of the number of nodes.
+-- -----------------------------------------------------------------------------
+local function _lookupLua(nodes, key)
+	local byte = string.byte
+	local hash = 5381
+
+	for i = 1, #key do
+		hash = (hash * 33 + byte(key, i)) % 4294967296
+	end
+
+	return nodes[hash % #nodes + 1]
+end
+
+-- -----------------------------------------------------------------------------
+-- runs the given function on every key and returns the number of lookups per
+-- second.
+-- -----------------------------------------------------------------------------
+local function _measure(fn, seconds)
+	local clock = os.clock
+	local start, iterations = clock(), 0
+
+	repeat
+		for i = 1, #_keys do
+			fn(_keys[i])
+		end
+
+		iterations = iterations + #_keys
+	until clock() - start >= seconds
+
+	return iterations / (clock() - start)
+end
+
+-- -----------------------------------------------------------------------------
+-- returns the node of every key.
+-- -----------------------------------------------------------------------------
+local function _map(fn)
+	local result = {}
+
+	for i = 1, #_keys do
+		result[i] = fn(_keys[i])
+	end
+
+	return result
+end
+
+-- -----------------------------------------------------------------------------
+-- compares two mappings, returns the share of the keys that moved. the
+-- optional check is called for every moved key with the old and new node.
+-- -----------------------------------------------------------------------------
+local function _moved(before, after, check)
+	local moved = 0
+
+	for i = 1, #before do
+		if before[i] ~= after[i] then
+			moved = moved + 1
+
+			if check ~= nil then
+				check(before[i], after[i])
+			end
+		end
+	end
+
+	return moved / #before
+end
+
+-- -----------------------------------------------------------------------------
+-- counts the keys of every node.
+-- -----------------------------------------------------------------------------
+local function _shares(mapping)
+	local shares = {}
+
+	for i = 1, #mapping do
+		shares[mapping[i]] = (shares[mapping[i]] or 0) + 1
+	end
+
+	return shares
+end
+
+print("lookup throughput")
+
+for _, count in ipairs({4, 16, 64, 256}) do
+	local nodes = _nodes(count)
+	local native = ring.new(nodes)
+
+	local luaRate = _measure(function (key)
+		return _lookupLua(nodes, key)
+	end, 0.5)
+
+	local nativeRate = _measure(function (key)
+		return native:lookup(key)
+	end, 0.5)
+
+	print(string.format(
+		"%4d nodes   lua modulo %6.2f M/s   native ring %6.2f M/s   speedup %5.1fx",
+		count, luaRate / 1e6, nativeRate / 1e6, nativeRate / luaRate
+	))
+end
+
+print("redistribution (" .. _keyCount .. " keys, 10 nodes)")
+
+local nodes = _nodes(10)
+local native = ring.new(nodes)
+local before = _map(function (key) return native:lookup(key) end)
+local removed = nodes[3]
+
+-- only the keys of a removed node move
+native:remove(removed)
+
+local after = _map(function (key) return native:lookup(key) end)
+local share = _shares(before)[removed] / _keyCount
+local moved = _moved(before, after, function (old, new)
+	assert(old == removed, "key moved between remaining nodes")
+end)
+
+print(string.format("  remove 1 node    moved %5.1f%% (its share %5.1f%%)",
+	moved * 100, share * 100))
+
+-- adding it back restores the previous mapping
+native:add(removed)
+moved = _moved(before, _map(function (key) return native:lookup(key) end))
+assert(moved == 0, "re-added node does not get its keys back")
+print(string.format("  re-add it        moved %5.1f%%", moved * 100))
+
+-- only keys moving to a new node move
+native:add("10.0.0.11:11211")
+moved = _moved(before, _map(function (key) return native:lookup(key) end),
+	function (old, new)
+		assert(new == "10.0.0.11:11211", "key moved between old nodes")
+	end)
+print(string.format("  add 1 node       moved %5.1f%% (ideal %5.1f%%)",
+	moved * 100, 100 / 11))
+native:remove("10.0.0.11:11211")
+
+-- the same for the modulo of the number of nodes
+local modulo = {}
+
+for i = 1, #nodes do
+	if nodes[i] ~= removed then
+		modulo[#modulo + 1] = nodes[i]
+	end
+end
+
+moved = _moved(
+	_map(function (key) return _lookupLua(nodes, key) end),
+	_map(function (key) return _lookupLua(modulo, key) end)
+)
+print(string.format("  lua modulo: remove 1 node moved %5.1f%%", moved * 100))
+
+-- the order the nodes are added in does not matter
+local reversed = ring.new()
+
+for i = #nodes, 1, -1 do
+	reversed:add(nodes[i])
+end
+
+assert(_moved(before, _map(function (key) return reversed:lookup(key) end)) == 0,
+	"mapping depends on the order of the nodes")
+
+-- a node with twice the weight gets about twice the keys
+native:add(nodes[1], 2)
+
+local shares = _shares(_map(function (key) return native:lookup(key) end))
+local ratio = shares[nodes[1]] / ((_keyCount - shares[nodes[1]]) / (#nodes - 1))
+
+print(string.format("  weight 2         gets %4.2fx the keys of a weight 1 node",
+	ratio))
+assert(ratio > 1.7 and ratio < 2.3, "weight is not respected")
+
+-- the spread of the keys over equally weighted nodes
+native:add(nodes[1], 1)
+shares = _shares(_map(function (key) return native:lookup(key) end))
+
+local low, high = math.huge, 0
+
+for _, count in pairs(shares) do
+	low, high = math.min(low, count), math.max(high, count)
+end
+
+print(string.format("  spread           min %5.1f%% max %5.1f%% (ideal %5.1f%%)",
+	low * 100 / _keyCount, high * 100 / _keyCount, 100 / #nodes))
@@ -0,0 +1,107 @@
+-- -----------------------------------------------------------------------------
+-- compares the native router with an if/elseif chain of string.match calls
+-- for 10, 100 and 1000 routes. run it with the server binary:
+--
+--	$ ./vayu ../bench/router.lua
+-- -----------------------------------------------------------------------------
+
+-- the resources of a typical rest api, every resource has a few routes
+local _shapes = {
+	{"GET", "/api/v1/%s", "^/api/v1/%s$", 0},
+	{"POST", "/api/v1/%s", "^/api/v1/%s$", 0},
+	{"GET", "/api/v1/%s/:id", "^/api/v1/%s/([^/]+)$", 1},
+	{"PUT", "/api/v1/%s/:id", "^/api/v1/%s/([^/]+)$", 1},
+	{"GET", "/api/v1/%s/:id/items/:item", "^/api/v1/%s/([^/]+)/items/([^/]+)$", 2}
+}
+
+-- -----------------------------------------------------------------------------
+-- creates the given number of routes, both as table for the native router and
+-- as list of lua patterns checked in order. returns both and a request for
+-- every route.
+-- -----------------------------------------------------------------------------
+local function _routes(count)
+	local routes, chain, requests = {}, {}, {}
+
+	for i = 1, count do
+		local shape = _shapes[(i - 1) % #_shapes + 1]
+		local resource = "resource" .. math.floor((i - 1) / #_shapes)
+		local handler = function () return i end
+		local uri = string.format(shape[2], resource)
+
+		routes[shape[1] .. " " .. uri] = handler
+		chain[i] = {
+			method = shape[1],
+			pattern = string.format(shape[3], resource),
+			handler = handler
+		}
+
+		-- fill in the parameters
+		uri = string.gsub(uri, ":id", "12345")
+		uri = string.gsub(uri, ":item", "abc")
+		requests[i] = {shape[1], uri}
+	end
+
+	return routes, chain, requests
+end
+
+-- -----------------------------------------------------------------------------
+-- the lua way: try every route until one matches.
+-- -----------------------------------------------------------------------------
+local function _matchChain(chain, method, uri)
+	local match = string.match
+
+	for i = 1, #chain do
+		local route = chain[i]
+
+		if route.method == method then
+			local a, b = match(uri, route.pattern)
+
+			if a ~= nil then
+				return route.handler, a, b
+			end
+		end
+	end
+end
+
+-- -----------------------------------------------------------------------------
+-- runs the given function on every request and returns the time per request
+-- in ns.
+-- -----------------------------------------------------------------------------
+local function _measure(fn, requests, seconds)
+	local clock = os.clock
+	local start, iterations = clock(), 0
+
+	repeat
+		for i = 1, #requests do
+			fn(requests[i][1], requests[i][2])
+		end
+
+		iterations = iterations + #requests
+	until clock() - start >= seconds
+
+	return (clock() - start) * 1e9 / iterations
+end
+
+for _, count in ipairs({10, 100, 1000}) do
+	local routes, chain, requests = _routes(count)
+	local native = router.new(routes)
+
+	-- both must find the same handler
+	for i = 1, #requests do
+		local method, uri = requests[i][1], requests[i][2]
+		assert(native:match(method, uri) == _matchChain(chain, method, uri), uri)
+	end
+
+	local luaTime = _measure(function (method, uri)
+		return _matchChain(chain, method, uri)
+	end, requests, 0.5)
+
+	local nativeTime = _measure(function (method, uri)
+		return native:match(method, uri)
+	end, requests, 0.5)
+
+	print(string.format(
+		"%4d routes   lua %9.1f ns/match   native %7.1f ns/match   speedup %6.1fx",
+		count, luaTime, nativeTime, luaTime / nativeTime
+	))
+end
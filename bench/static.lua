@@ -0,0 +1,83 @@
+-- -----------------------------------------------------------------------------
+-- serves a directory on port 12345 twice: paths below /lua/ are read with
+-- io.open like a plain lua handler would do it, all other paths are answered
+-- by the native static file server. run it with the server binary and point a
+-- http benchmark tool (keep alive) at both urls:
+--
+--	$ ROOT=/var/www ./vayu ../bench/static.lua
+--	$ ab -k -n 100000 -c 50 http://127.0.0.1:12345/index.html
+--	$ ab -k -n 100000 -c 50 http://127.0.0.1:12345/lua/index.html
+-- -----------------------------------------------------------------------------
+
+-- the directory to serve, the bench directory by default
+local _root = os.getenv("ROOT")
+	or string.match(debug.getinfo(1, "S").source, "^@(.*)/") or "."
+
+local _files = assert(files.new({ root = _root, index = { "index.html" } }))
+
+-- stores the unparsed part of the requests by socket
+local _pending = {}
+
+-- reads the requested file the way a lua handler does it
+local function _serveLua(oBuf, path)
+	local file = io.open(_root .. path, "rb")
+
+	if file == nil then
+		oBuf:append("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n")
+		return
+	end
+
+	local data = file:read("*a")
+	file:close()
+
+	oBuf:append(
+		"HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n" ..
+		"Content-Length: " .. #data .. "\r\n\r\n" .. data
+	)
+end
+
+-- answers all complete requests of the socket
+local function _handle(context)
+	local data = (_pending[context.cFd] or "") .. context.iBuf:extract()
+
+	while true do
+		local last = string.find(data, "\r\n\r\n", 1, true)
+
+		if last == nil then
+			break
+		end
+
+		local head = string.sub(data, 1, last + 3)
+		local method, uri = string.match(head, "^(%u+) (%S+)")
+		local headers = {}
+
+		data = string.sub(data, last + 4)
+
+		for name, value in string.gmatch(head, "\n([^:\r\n]+):%s*([^\r\n]*)") do
+			headers[string.lower(name)] = value
+		end
+
+		if string.sub(uri or "", 1, 5) == "/lua/" then
+			_serveLua(context.oBuf, string.sub(uri, 5))
+		elseif _files:serve(context.cFd, context.oBuf, method or "", uri or "", headers) == nil then
+			context.oBuf:append("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n")
+		end
+	end
+
+	_pending[context.cFd] = data
+end
+
+server.setCallback(function (context)
+	if context.event == "socket_read" then
+		_handle(context)
+	elseif context.event == "socket_close" and context.cFd ~= nil then
+		_pending[context.cFd] = nil
+	elseif context.event == "idle" then
+		print(string.format("native: %d hits, %d misses, %d open",
+			_files:stats().hits, _files:stats().misses, _files:stats().count))
+	end
+
+	return true
+end)
+
+server.openSocket("0.0.0.0", "12345")
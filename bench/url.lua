@@ -0,0 +1,77 @@
+-- -----------------------------------------------------------------------------
+-- compares the native url encoding functions with the lua implementation of
+-- the http example. run it with the server binary:
+--
+--	$ ./vayu ../bench/url.lua
+-- -----------------------------------------------------------------------------
+
+-- the directory of this script, used to find the http example
+local _dir = string.match(debug.getinfo(1, "S").source, "^@(.*/)") or "./"
+
+-- load the lua implementation without the native replacements
+local _native = encoding
+encoding = nil
+dofile(_dir .. "../test/simple_http/encoding.lua")
+encoding = _native
+
+-- the lua implementations (gsub returns two values, only keep the first)
+local _luaEncode = function (data) return (encode.url(data)) end
+local _luaDecode = function (data) return (decode.url(data)) end
+
+-- -----------------------------------------------------------------------------
+-- realistic request uris, from plain paths to heavily escaped queries
+-- -----------------------------------------------------------------------------
+local _uris = {
+	"/index.html",
+	"/static/css/main.3f2a91c.css",
+	"/api/v1/users/12345/orders?page=2&limit=50",
+	"/search?q=vayu+event+server&lang=en&sort=relevance",
+	"/search?q=%E2%82%AC+100+%26+more%21&filter=price%3E10%2Cprice%3C200",
+	"/login?redirect=https%3A%2F%2Fexample.com%2Faccount%2Fsettings%3Ftab%3Dprofile",
+	"/files/My%20Documents/Report%202014%20%28final%29.pdf",
+	"/track?e=click&d=%7B%22id%22%3A42%2C%22tags%22%3A%5B%22a%22%2C%22b%22%5D%7D"
+}
+
+-- -----------------------------------------------------------------------------
+-- runs the given function on every uri and returns the time per uri in ns.
+-- -----------------------------------------------------------------------------
+local function _measure(fn, inputs, iterations)
+	local clock = os.clock
+	local start = clock()
+
+	for i = 1, iterations do
+		for j = 1, #inputs do
+			fn(inputs[j])
+		end
+	end
+
+	return (clock() - start) * 1e9 / (iterations * #inputs)
+end
+
+-- -----------------------------------------------------------------------------
+-- runs a benchmark comparing the lua and the native function.
+-- -----------------------------------------------------------------------------
+local function _run(name, luaFn, nativeFn, inputs, iterations)
+	-- both implementations must produce the same results
+	for i = 1, #inputs do
+		assert(luaFn(inputs[i]) == nativeFn(inputs[i]), inputs[i])
+	end
+
+	local luaTime = _measure(luaFn, inputs, iterations)
+	local nativeTime = _measure(nativeFn, inputs, iterations)
+
+	print(string.format(
+		"%-10s lua %8.1f ns/uri   native %8.1f ns/uri   speedup %5.1fx",
+		name, luaTime, nativeTime, luaTime / nativeTime
+	))
+end
+
+-- the decoded uris are used as input for the encoding benchmark
+local _decoded = {}
+
+for i = 1, #_uris do
+	_decoded[i] = _luaDecode(_uris[i])
+end
+
+_run("decode", _luaDecode, encoding.urlDecode, _uris, 20000)
+_run("encode", _luaEncode, encoding.urlEncode, _decoded, 20000)
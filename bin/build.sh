@@ -1,3 +1,3 @@
 #!/bin/sh
 
-gcc -Wall -Werror -pedantic -s -O3 -o vayu -lm $(find ../src -name "*.c")
+gcc -Wall -Werror -pedantic -s -O3 -o vayu $(find ../src -name "*.c") -lm -lz -lpthread
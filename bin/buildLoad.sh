@@ -0,0 +1,3 @@
+#!/bin/sh
+
+gcc -Wall -Werror -pedantic -s -O3 -o load ../bench/load.c -lm
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+gcc -Wall -Werror -pedantic -s -O3 -o micro ../bench/micro.c $(find ../src -name "*.c" -and -not -name "main.c") -lm -lz -lpthread
@@ -0,0 +1,411 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+/**
+ * returns the current time of a monotonic clock in seconds.
+ */
+static double _getTime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * copies the leading bits of the address into the key.
+ */
+static void _mask(unsigned char *dst, const unsigned char *src, int bits)
+{
+	int i;
+
+	for(i=0;bits>0;++i,bits-=8)
+	{
+		dst[i] = bits >= 8
+			? src[i] : src[i] & (unsigned char) (0xff << (8 - bits));
+	}
+}
+
+/**
+ * builds the key of the group of the given address. ipv4 addresses mapped to
+ * ipv6 are treated as ipv4 addresses.
+ */
+static void _getKey(
+	admit_t *admit, const struct sockaddr *addr, unsigned char *key
+)
+{
+	static const unsigned char mapped[12] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+	};
+	const unsigned char *bytes;
+
+	memset(key, 0, 17);
+
+	if(addr->sa_family == AF_INET)
+	{
+		key[0] = 4;
+		bytes = (const unsigned char*)
+			&(((const struct sockaddr_in*) addr)->sin_addr);
+
+		_mask(key + 1, bytes, admit->config.ipv4Prefix);
+	}
+	else if(addr->sa_family == AF_INET6)
+	{
+		bytes = (const unsigned char*)
+			&(((const struct sockaddr_in6*) addr)->sin6_addr);
+
+		if(memcmp(bytes, mapped, sizeof(mapped)) == 0)
+		{
+			key[0] = 4;
+
+			_mask(key + 1, bytes + 12, admit->config.ipv4Prefix);
+		}
+		else
+		{
+			key[0] = 6;
+
+			_mask(key + 1, bytes, admit->config.ipv6Prefix);
+		}
+	}
+}
+
+/**
+ * fills up the buckets of the entry for the time passed since the last time.
+ */
+static void _refill(admit_t *admit, admitEntry_t *entry)
+{
+	double now = _getTime(), elapsed = now - entry->updated;
+
+	entry->updated = now;
+	entry->tokens += elapsed * admit->config.rate;
+	entry->byteTokens += elapsed * admit->config.byteRate;
+
+	if(entry->tokens > admit->config.burst)
+	{
+		entry->tokens = admit->config.burst;
+	}
+
+	if(entry->byteTokens > admit->config.byteBurst)
+	{
+		entry->byteTokens = admit->config.byteBurst;
+	}
+}
+
+/**
+ * adds the entry as most recently used entry.
+ */
+static void _link(admit_t *admit, admitEntry_t *entry)
+{
+	entry->newer = NULL;
+	entry->older = admit->newest;
+
+	if(admit->newest != NULL)
+	{
+		admit->newest->newer = entry;
+	}
+	else
+	{
+		admit->oldest = entry;
+	}
+
+	admit->newest = entry;
+}
+
+/**
+ * removes the entry from the lru list.
+ */
+static void _unlink(admit_t *admit, admitEntry_t *entry)
+{
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		admit->newest = entry->older;
+	}
+
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		admit->oldest = entry->newer;
+	}
+}
+
+/**
+ * returns the entry of the given key. a new entry is created if there is
+ * none, reusing the least recently used entry without connections if all
+ * entries are in use.
+ */
+static admitEntry_t *_getEntry(admit_t *admit, const unsigned char *key)
+{
+	unsigned long hash = hashCrc32c(0, key, 17);
+	admitEntry_t *entry, **link;
+
+	for(entry=admit->buckets[hash % ADMIT_ENTRY_MAX];entry!=NULL;
+		entry=entry->next)
+	{
+		if(entry->hash == hash && memcmp(entry->key, key, 17) == 0)
+		{
+			_unlink(admit, entry);
+			_link(admit, entry);
+
+			return entry;
+		}
+	}
+
+	if(admit->count < ADMIT_ENTRY_MAX)
+	{
+		entry = admit->entries + admit->count++;
+	}
+	else
+	{
+		/* there are more entries than sockets, so one is not in use */
+		for(entry=admit->oldest;entry->connections>0;entry=entry->newer);
+
+		link = admit->buckets + entry->hash % ADMIT_ENTRY_MAX;
+
+		while(*link != entry)
+		{
+			link = &((*link)->next);
+		}
+
+		*link = entry->next;
+
+		_unlink(admit, entry);
+
+		++admit->stats.evictions;
+	}
+
+	memcpy(entry->key, key, 17);
+	entry->hash = hash;
+	entry->connections = 0;
+	entry->tokens = admit->config.burst;
+	entry->byteTokens = admit->config.byteBurst;
+	entry->updated = _getTime();
+
+	entry->next = admit->buckets[hash % ADMIT_ENTRY_MAX];
+	admit->buckets[hash % ADMIT_ENTRY_MAX] = entry;
+
+	_link(admit, entry);
+
+	return entry;
+}
+
+/**
+ * initializes the given admission control with the limits. returns 1 if
+ * everything is ok and 0 if there is not enough memory.
+ */
+int admitInit(admit_t *admit, const admitConfig_t *config)
+{
+	memset(admit, 0, sizeof(*admit));
+
+	admit->entries = (admitEntry_t*) malloc(
+		ADMIT_ENTRY_MAX * sizeof(admitEntry_t)
+	);
+	admit->buckets = (admitEntry_t**) calloc(
+		ADMIT_ENTRY_MAX, sizeof(admitEntry_t*)
+	);
+
+	if(admit->entries == NULL || admit->buckets == NULL)
+	{
+		admitClear(admit);
+		return 0;
+	}
+
+	admitSetConfig(admit, config);
+
+	return 1;
+}
+
+/**
+ * changes the limits of the given admission control, the state of the known
+ * groups is kept.
+ */
+void admitSetConfig(admit_t *admit, const admitConfig_t *config)
+{
+	admit->config = *config;
+
+	/* the prefixes are limited by the size of the addresses */
+	if(admit->config.ipv4Prefix <= 0 || admit->config.ipv4Prefix > 32)
+	{
+		admit->config.ipv4Prefix = 32;
+	}
+
+	if(admit->config.ipv6Prefix <= 0 || admit->config.ipv6Prefix > 128)
+	{
+		admit->config.ipv6Prefix = 128;
+	}
+
+	/* without a burst a bucket holds one second worth of tokens, but always
+	 * at least one request */
+	if(admit->config.burst <= 0)
+	{
+		admit->config.burst = admit->config.rate;
+	}
+
+	if(admit->config.burst < 1)
+	{
+		admit->config.burst = 1;
+	}
+
+	if(admit->config.byteBurst <= 0)
+	{
+		admit->config.byteBurst = admit->config.byteRate;
+	}
+}
+
+/**
+ * admits a new connection from the given address. returns the group of the
+ * client or null if the connection exceeds the connection limit or the
+ * request rate of the group.
+ */
+admitEntry_t *admitConnect(admit_t *admit, const struct sockaddr *addr)
+{
+	unsigned char key[17];
+	admitEntry_t *entry;
+
+	_getKey(admit, addr, key);
+
+	entry = _getEntry(admit, key);
+
+	if(admit->config.maxConnections > 0
+		&& entry->connections >= admit->config.maxConnections)
+	{
+		++admit->stats.rejectedConnections;
+		return NULL;
+	}
+
+	if(admit->config.rate > 0)
+	{
+		_refill(admit, entry);
+
+		if(entry->tokens < 1)
+		{
+			++admit->stats.rejectedRate;
+			return NULL;
+		}
+
+		entry->tokens -= 1;
+	}
+
+	++entry->connections;
+	++admit->stats.accepted;
+
+	return entry;
+}
+
+/**
+ * releases a connection admitted with admitConnect().
+ */
+void admitDisconnect(admit_t *admit, admitEntry_t *entry)
+{
+	(void) admit;
+
+	if(entry->connections > 0)
+	{
+		--entry->connections;
+	}
+}
+
+/**
+ * takes the given number of requests from the request bucket of the group.
+ * returns 1 if the requests are admitted and 0 if not.
+ */
+int admitRequest(admit_t *admit, admitEntry_t *entry, double count)
+{
+	if(admit->config.rate <= 0)
+	{
+		return 1;
+	}
+
+	_refill(admit, entry);
+
+	if(entry->tokens < count)
+	{
+		++admit->stats.rejectedRequests;
+		return 0;
+	}
+
+	entry->tokens -= count;
+
+	return 1;
+}
+
+/**
+ * takes the given number of bytes read from the byte bucket of the group.
+ * returns the number of milliseconds reading must pause or 0.
+ */
+long admitRead(admit_t *admit, admitEntry_t *entry, size_t len)
+{
+	if(admit->config.byteRate <= 0)
+	{
+		return 0;
+	}
+
+	_refill(admit, entry);
+
+	/* the bytes are read already, the bucket may become negative */
+	entry->byteTokens -= (double) len;
+
+	if(entry->byteTokens >= 0)
+	{
+		return 0;
+	}
+
+	++admit->stats.throttled;
+
+	/* wait until the bucket is no longer empty */
+	return (long) (-entry->byteTokens * 1000 / admit->config.byteRate) + 1;
+}
+
+/**
+ * returns the counters of the given admission control.
+ */
+const admitStats_t *admitGetStats(admit_t *admit)
+{
+	return &(admit->stats);
+}
+
+/**
+ * frees the resources of the given admission control.
+ */
+void admitClear(admit_t *admit)
+{
+	free(admit->entries);
+	free(admit->buckets);
+
+	memset(admit, 0, sizeof(*admit));
+}
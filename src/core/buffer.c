@@ -58,50 +58,66 @@ static void* _defaultAlloc(void *ptr, size_t newSize)
 static bufAlloc_t _alloc = _defaultAlloc;
 
 /**
- * appends the given data to the specified buffer. returns 1 if this operation
- * succeeded or 0 if not.
+ * makes sure that the given number of bytes can be appended to the buffer
+ * without reallocation. the free space starts at data + len. returns 1 if
+ * this operation succeeded or 0 if not.
  */
-int bufAppend(buf_t *buf, const void *data, size_t len)
+int bufReserve(buf_t *buf, size_t len)
 {
 	void *newData;
-	size_t newLen, newSize;
+	size_t newSize;
 
 	/* validate the buffer */
 	_checkBufRet(buf, 0);
 
-	/* is there data to append */
-	if(data != NULL && len > 0)
-	{
-		newLen = buf->len + len;
-		newSize = newLen;
+	/* align the new buffer size */
+	newSize = _alignBufSize(buf->len + len);
 
-		/* align the new buffer size */
-		newSize = _alignBufSize(newSize);
+	/* is it necessary to reallocate memory for the buffer */
+	if(newSize > buf->size)
+	{
+		/* reallocate memory for the new buffer */
+		newData = _alloc(buf->data, newSize);
 
-		/* is it necessary to reallocate memory for the buffer */
-		if(newSize > buf->size)
+		/* the buffer could not be reallocated */
+		if(newData == NULL)
 		{
-			/* reallocate memory for the new buffer */
-			newData = _alloc(buf->data, newSize);
+			return 0;
+		}
 
-			/* the buffer could not be reallocated */
-			if(newData == NULL)
-			{
-				return 0;
-			}
+		/* set the pointer to the data */
+		buf->data = newData;
+
+		/* set the new size of the buffer */
+		buf->size = newSize;
+	}
 
-			/* set the pointer to the data */
-			buf->data = newData;
+	return 1;
+}
 
-			/* set the new size of the buffer */
-			buf->size = newSize;
+/**
+ * appends the given data to the specified buffer. returns 1 if this operation
+ * succeeded or 0 if not.
+ */
+int bufAppend(buf_t *buf, const void *data, size_t len)
+{
+	/* validate the buffer */
+	_checkBufRet(buf, 0);
+
+	/* is there data to append */
+	if(data != NULL && len > 0)
+	{
+		/* make room for the data */
+		if(!bufReserve(buf, len))
+		{
+			return 0;
 		}
 
 		/* copy the data into the buffer */
 		memcpy((void*) (((unsigned char*) buf->data) + buf->len), data, len);
 
 		/* store the new length of the data */
-		buf->len = newLen;
+		buf->len += len;
 	}
 
 	return 1;
@@ -147,6 +163,35 @@ void* bufExtract(buf_t *buf, size_t *lenDest)
 	return data;
 }
 
+/**
+ * removes the given number of bytes from the beginning of the buffer. if the
+ * buffer contains less data than that it is emptied. the memory of the buffer
+ * is kept for further use.
+ */
+void bufConsume(buf_t *buf, size_t len)
+{
+	/* validate the buffer */
+	_checkBuf(buf);
+
+	/* is the entire data consumed */
+	if(len >= buf->len)
+	{
+		buf->len = 0;
+	}
+	else if(len > 0)
+	{
+		/* move the remaining data to the beginning of the buffer */
+		memmove(
+			buf->data,
+			(void*) (((unsigned char*) buf->data) + len),
+			buf->len - len
+		);
+
+		/* store the new length of the data */
+		buf->len -= len;
+	}
+}
+
 /**
  * checks whether the given buffer contains data or not. returns 1 if the buffer
  * contains data and 0 if not.
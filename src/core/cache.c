@@ -0,0 +1,441 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * defines the initial number of buckets, the table doubles when it holds more
+ * entries than buckets.
+ */
+#define _BUCKETS_MIN (64)
+
+/**
+ * defines the share of the protected segment in percent of the maximum size.
+ */
+#define _PROTECTED_SHARE (80)
+
+/**
+ * returns the key and the value of an entry, they are stored behind it.
+ */
+#define _getKey(e) ((char*) ((e) + 1))
+#define _getValue(e) (_getKey(e) + (e)->keyLen)
+
+/**
+ * returns the number of bytes an entry occupies.
+ */
+#define _getSize(e) (sizeof(cacheEntry_t) + (e)->keyLen + (e)->valueLen)
+
+/**
+ * returns the hash of the given key.
+ */
+static unsigned long _hash(const void *key, size_t len)
+{
+	return hashCrc32c(0, key, len);
+}
+
+/**
+ * adds the entry as most recently used entry to the given segment.
+ */
+static void _link(cache_t *cache, cacheEntry_t *entry, int segment)
+{
+	entry->segment = segment;
+	entry->newer = NULL;
+	entry->older = cache->newest[segment];
+
+	if(cache->newest[segment] != NULL)
+	{
+		cache->newest[segment]->newer = entry;
+	}
+	else
+	{
+		cache->oldest[segment] = entry;
+	}
+
+	cache->newest[segment] = entry;
+	cache->size[segment] += _getSize(entry);
+}
+
+/**
+ * removes the entry from its segment.
+ */
+static void _unlink(cache_t *cache, cacheEntry_t *entry)
+{
+	int segment = entry->segment;
+
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		cache->newest[segment] = entry->older;
+	}
+
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		cache->oldest[segment] = entry->newer;
+	}
+
+	cache->size[segment] -= _getSize(entry);
+}
+
+/**
+ * returns the pointer to the given entry in its bucket.
+ */
+static cacheEntry_t **_findLink(cache_t *cache, cacheEntry_t *entry)
+{
+	cacheEntry_t **link = cache->buckets
+		+ (entry->hash & (cache->bucketCount - 1));
+
+	while(*link != entry)
+	{
+		link = &((*link)->next);
+	}
+
+	return link;
+}
+
+/**
+ * removes the entry from the cache and frees it.
+ */
+static void _remove(cache_t *cache, cacheEntry_t *entry)
+{
+	cacheEntry_t **link = _findLink(cache, entry);
+
+	*link = entry->next;
+
+	_unlink(cache, entry);
+
+	--cache->stats.count;
+	cache->stats.size -= _getSize(entry);
+
+	free(entry);
+}
+
+/**
+ * returns the entry of the given key or null if there is none.
+ */
+static cacheEntry_t *_find(
+	cache_t *cache, unsigned long hash, const void *key, size_t len
+)
+{
+	cacheEntry_t *entry;
+
+	if(cache->buckets == NULL)
+	{
+		return NULL;
+	}
+
+	for(entry=cache->buckets[hash & (cache->bucketCount - 1)];entry!=NULL;
+		entry=entry->next)
+	{
+		if(entry->hash == hash && entry->keyLen == len
+			&& memcmp(_getKey(entry), key, len) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * doubles the number of buckets. returns 1 if everything is ok and 0 if not.
+ */
+static int _grow(cache_t *cache)
+{
+	size_t count = cache->bucketCount > 0
+		? cache->bucketCount * 2 : _BUCKETS_MIN, i;
+	cacheEntry_t **buckets, *entry, *next;
+
+	buckets = (cacheEntry_t**) calloc(count, sizeof(cacheEntry_t*));
+
+	if(buckets == NULL)
+	{
+		return 0;
+	}
+
+	/* move the entries into the new table */
+	for(i=0;i<cache->bucketCount;++i)
+	{
+		for(entry=cache->buckets[i];entry!=NULL;entry=next)
+		{
+			next = entry->next;
+			entry->next = buckets[entry->hash & (count - 1)];
+			buckets[entry->hash & (count - 1)] = entry;
+		}
+	}
+
+	free(cache->buckets);
+
+	cache->buckets = buckets;
+	cache->bucketCount = count;
+
+	return 1;
+}
+
+/**
+ * initializes the given cache with its maximum size in bytes. the size
+ * includes the keys and the bookkeeping of the entries.
+ */
+void cacheInit(cache_t *cache, size_t maxSize)
+{
+	memset(cache, 0, sizeof(*cache));
+
+	cache->maxSize = maxSize;
+}
+
+/**
+ * stores a copy of the given value under the key. the value expires after the
+ * given number of seconds (0 means never) and may be served stale for the
+ * number of seconds of the last parameter afterwards. least recently used
+ * entries are evicted to make room. returns 1 if everything is ok and 0 if
+ * the value does not fit or there is not enough memory.
+ */
+int cacheSet(
+	cache_t *cache, const void *key, size_t keyLen, const void *value,
+	size_t valueLen, long ttl, long stale
+)
+{
+	unsigned long hash = _hash(key, keyLen);
+	cacheEntry_t *entry, *old = _find(cache, hash, key, keyLen), **bucket;
+	size_t size = sizeof(cacheEntry_t) + keyLen + valueLen;
+	int segment = 0;
+
+	/* the old value stays cached if the new one cannot be stored */
+	if(size > cache->maxSize)
+	{
+		return 0;
+	}
+
+	if((entry = (cacheEntry_t*) malloc(size)) == NULL)
+	{
+		return 0;
+	}
+
+	/* the data is copied before the old value is freed, it may be the
+	 * source */
+	entry->keyLen = keyLen;
+	entry->valueLen = valueLen;
+
+	memcpy(_getKey(entry), key, keyLen);
+	memcpy(_getValue(entry), value, valueLen);
+
+	if(cache->stats.count >= cache->bucketCount && !_grow(cache))
+	{
+		free(entry);
+
+		return 0;
+	}
+
+	/* a replaced value keeps its segment */
+	if(old != NULL)
+	{
+		segment = old->segment;
+
+		_remove(cache, old);
+	}
+
+	/* evict the least recently used entries, probation first */
+	while(cache->stats.size + size > cache->maxSize)
+	{
+		_remove(
+			cache, cache->oldest[0] != NULL
+				? cache->oldest[0] : cache->oldest[1]
+		);
+
+		++cache->stats.evictions;
+	}
+
+	entry->hash = hash;
+	entry->revalidating = 0;
+
+	/* the time is only needed for expiring entries */
+	if(ttl > 0)
+	{
+		entry->expires = time(NULL) + ttl;
+		entry->staleUntil = entry->expires + (stale > 0 ? stale : 0);
+	}
+	else
+	{
+		entry->expires = 0;
+		entry->staleUntil = 0;
+	}
+
+	bucket = cache->buckets + (hash & (cache->bucketCount - 1));
+	entry->next = *bucket;
+	*bucket = entry;
+
+	_link(cache, entry, segment);
+
+	++cache->stats.count;
+	cache->stats.size += size;
+
+	return 1;
+}
+
+/**
+ * looks up the value of the given key. the value and its length are stored in
+ * the last two parameters, the value stays valid until the cache is modified.
+ * returns the result of the lookup.
+ */
+cacheResult_t cacheGet(
+	cache_t *cache, const void *key, size_t keyLen, const void **value,
+	size_t *valueLen
+)
+{
+	cacheEntry_t *entry = _find(cache, _hash(key, keyLen), key, keyLen);
+	cacheEntry_t *demoted;
+	cacheResult_t result = CACHE_HIT;
+	time_t now;
+
+	if(entry != NULL && entry->expires != 0 && (now = time(NULL))
+		>= entry->expires)
+	{
+		/* the value is too old to be served at all */
+		if(now >= entry->staleUntil)
+		{
+			_remove(cache, entry);
+			entry = NULL;
+		}
+		/* the first lookup after the expiration revalidates */
+		else if(!entry->revalidating)
+		{
+			entry->revalidating = 1;
+			result = CACHE_STALE;
+		}
+	}
+
+	if(entry == NULL)
+	{
+		++cache->stats.misses;
+
+		return CACHE_MISS;
+	}
+
+	if(result == CACHE_STALE)
+	{
+		++cache->stats.stale;
+	}
+	else
+	{
+		++cache->stats.hits;
+	}
+
+	/* the first hit moves the entry into the protected segment, entries
+	 * which do not fit anymore go back to probation */
+	_unlink(cache, entry);
+	_link(cache, entry, 1);
+
+	while(cache->size[1] > cache->maxSize / 100 * _PROTECTED_SHARE
+		&& cache->oldest[1] != entry)
+	{
+		demoted = cache->oldest[1];
+
+		_unlink(cache, demoted);
+		_link(cache, demoted, 0);
+	}
+
+	*value = _getValue(entry);
+	*valueLen = entry->valueLen;
+
+	return result;
+}
+
+/**
+ * looks up the value of the given key and appends it to the buffer. returns
+ * the result of the lookup, CACHE_MISS if the buffer could not be written.
+ */
+cacheResult_t cacheWrite(
+	cache_t *cache, buf_t *buf, const void *key, size_t keyLen
+)
+{
+	const void *value;
+	size_t len;
+	cacheResult_t result = cacheGet(cache, key, keyLen, &value, &len);
+
+	if(result != CACHE_MISS && !bufAppend(buf, value, len))
+	{
+		return CACHE_MISS;
+	}
+
+	return result;
+}
+
+/**
+ * removes the given key from the cache. returns 1 if it was cached and 0 if
+ * not.
+ */
+int cacheDelete(cache_t *cache, const void *key, size_t keyLen)
+{
+	cacheEntry_t *entry = _find(cache, _hash(key, keyLen), key, keyLen);
+
+	if(entry == NULL)
+	{
+		return 0;
+	}
+
+	_remove(cache, entry);
+
+	return 1;
+}
+
+/**
+ * returns the statistics of the given cache.
+ */
+const cacheStats_t *cacheGetStats(cache_t *cache)
+{
+	return &(cache->stats);
+}
+
+/**
+ * removes all entries and frees the resources of the given cache. the cache
+ * can be used again afterwards.
+ */
+void cacheClear(cache_t *cache)
+{
+	cacheEntry_t *entry, *next;
+	int i;
+
+	for(i=0;i<2;++i)
+	{
+		for(entry=cache->newest[i];entry!=NULL;entry=next)
+		{
+			next = entry->older;
+			free(entry);
+		}
+	}
+
+	free(cache->buckets);
+
+	cacheInit(cache, cache->maxSize);
+}
@@ -0,0 +1,623 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/**
+ * defines the number of buckets of the compression cache.
+ */
+#define _BUCKETS (1024)
+
+/**
+ * defines the largest piece of input passed to zlib at once (its counters
+ * are unsigned int).
+ */
+#define _CHUNK_MAX (1024UL * 1024UL * 1024UL)
+
+/**
+ * defines the window bits of the formats, zlib adds a gzip wrapper for
+ * values above 15.
+ */
+#define _windowBits(f) ((f) == COMP_GZIP ? 15 + 16 : 15)
+
+/**
+ * defines the structure of a cache entry. the entries are kept in a hash
+ * table and in a list ordered by their last use.
+ */
+typedef struct _entry_s {
+
+	/* stores the next entry of the same bucket */
+	struct _entry_s *next;
+
+	/* stores the neighbours in the list of uses */
+	struct _entry_s *newer, *older;
+
+	/* stores the key, the checksum of the uncompressed data, its length and
+	 * the parameters of the compression */
+	unsigned long crc;
+	size_t len;
+	int format, level;
+
+	/* stores the uncompressed data (to rule out collisions of the checksum)
+	 * followed by the compressed data */
+	buf_t data;
+
+} _entry_t;
+
+/**
+ * stores the buckets of the compression cache.
+ */
+static _entry_t *_buckets[_BUCKETS];
+
+/**
+ * stores the most and the least recently used cache entry.
+ */
+static _entry_t *_newest = NULL, *_oldest = NULL;
+
+/**
+ * stores the size and the maximum size of the cache.
+ */
+static size_t _cacheSize = 0, _cacheMax = COMP_CACHE_SIZE;
+
+/**
+ * stores the number of cache hits and misses.
+ */
+static size_t _hits = 0, _misses = 0;
+
+/**
+ * stores the streams used for compressing complete data, one per format.
+ * they are reset instead of allocated for every call.
+ */
+static z_stream *_streams[2] = {NULL, NULL};
+
+/**
+ * stores the level of the streams above.
+ */
+static int _levels[2];
+
+/**
+ * returns the bucket of the given checksum.
+ */
+static _entry_t **_getBucket(unsigned long crc)
+{
+	return _buckets + (crc % _BUCKETS);
+}
+
+/**
+ * removes the given entry from the list of uses.
+ */
+static void _unlink(_entry_t *entry)
+{
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		_newest = entry->older;
+	}
+
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		_oldest = entry->newer;
+	}
+}
+
+/**
+ * makes the given entry the most recently used one.
+ */
+static void _link(_entry_t *entry)
+{
+	entry->newer = NULL;
+	entry->older = _newest;
+
+	if(_newest != NULL)
+	{
+		_newest->newer = entry;
+	}
+	else
+	{
+		_oldest = entry;
+	}
+
+	_newest = entry;
+}
+
+/**
+ * removes the least recently used entries until the cache is not larger than
+ * the given size.
+ */
+static void _shrink(size_t size)
+{
+	_entry_t *entry, **bucket;
+
+	while(_cacheSize > size && (entry = _oldest) != NULL)
+	{
+		/* remove it from its bucket */
+		for(bucket=_getBucket(entry->crc);*bucket!=entry;)
+		{
+			bucket = &((*bucket)->next);
+		}
+
+		*bucket = entry->next;
+
+		_unlink(entry);
+
+		_cacheSize -= sizeof(_entry_t) + entry->data.len;
+
+		bufClear(&(entry->data));
+		free(entry);
+	}
+}
+
+/**
+ * returns the cache entry for the given data or null if there is none.
+ */
+static _entry_t *_lookup(
+	unsigned long crc, const void *data, size_t len, int format, int level
+)
+{
+	_entry_t *entry;
+
+	for(entry=*_getBucket(crc);entry!=NULL;entry=entry->next)
+	{
+		if(entry->crc == crc && entry->len == len && entry->format == format
+			&& entry->level == level
+			&& (len == 0 || memcmp(entry->data.data, data, len) == 0))
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * stores the compressed data in the cache. entries which do not fit are not
+ * stored.
+ */
+static void _store(
+	unsigned long crc, const void *data, size_t len, int format, int level,
+	const void *compressed, size_t compressedLen
+)
+{
+	_entry_t *entry, **bucket;
+	size_t size = sizeof(_entry_t) + len + compressedLen;
+
+	if(size > _cacheMax)
+	{
+		return;
+	}
+
+	_shrink(_cacheMax - size);
+
+	if((entry = (_entry_t*) malloc(sizeof(_entry_t))) == NULL)
+	{
+		return;
+	}
+
+	entry->crc = crc;
+	entry->len = len;
+	entry->format = format;
+	entry->level = level;
+
+	entry->data.data = NULL;
+	entry->data.len = 0;
+	entry->data.size = 0;
+
+	if(!bufReserve(&(entry->data), len + compressedLen))
+	{
+		free(entry);
+
+		return;
+	}
+
+	(void) bufAppend(&(entry->data), data, len);
+	(void) bufAppend(&(entry->data), compressed, compressedLen);
+
+	bucket = _getBucket(crc);
+	entry->next = *bucket;
+	*bucket = entry;
+
+	_link(entry);
+
+	_cacheSize += size;
+}
+
+/**
+ * creates a new zlib stream. returns null if there is not enough memory.
+ */
+static z_stream *_newStream(compFormat_t format, int level)
+{
+	z_stream *stream = (z_stream*) malloc(sizeof(z_stream));
+
+	if(stream == NULL)
+	{
+		return NULL;
+	}
+
+	memset(stream, 0, sizeof(*stream));
+
+	if(deflateInit2(
+		stream, level, Z_DEFLATED, _windowBits(format), 8,
+		Z_DEFAULT_STRATEGY
+	) != Z_OK)
+	{
+		free(stream);
+
+		return NULL;
+	}
+
+	return stream;
+}
+
+/**
+ * frees the given zlib stream.
+ */
+static void _freeStream(z_stream *stream)
+{
+	if(stream != NULL)
+	{
+		deflateEnd(stream);
+		free(stream);
+	}
+}
+
+/**
+ * passes the given data to zlib and appends the output to the buffer. the
+ * output is written directly into the buffer. returns the result of the last
+ * call of deflate().
+ */
+static int _deflate(
+	z_stream *stream, buf_t *buf, const void *data, size_t len, int flush
+)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	size_t chunk, space;
+	int result;
+
+	do
+	{
+		/* pass the input in pieces zlib can handle */
+		chunk = len < _CHUNK_MAX ? len : _CHUNK_MAX;
+		stream->next_in = (Bytef*) src;
+		stream->avail_in = (uInt) chunk;
+		src += chunk;
+		len -= chunk;
+
+		do
+		{
+			/* the bound is exact for the remaining input, so usually the
+			 * loop runs once */
+			space = deflateBound(stream, stream->avail_in);
+			space = space < _CHUNK_MAX ? space : _CHUNK_MAX;
+
+			if(!bufReserve(buf, space))
+			{
+				return Z_MEM_ERROR;
+			}
+
+			stream->next_out = (Bytef*) buf->data + buf->len;
+			stream->avail_out = (uInt) space;
+
+			result = deflate(stream, len > 0 ? Z_NO_FLUSH : flush);
+
+			buf->len += space - stream->avail_out;
+
+			if(result == Z_STREAM_ERROR)
+			{
+				return result;
+			}
+		}
+		while(stream->avail_out == 0 || (
+			len == 0 && flush == Z_FINISH && result != Z_STREAM_END
+		));
+	}
+	while(len > 0);
+
+	return result;
+}
+
+/**
+ * chooses the compression format for the given value of the Accept-Encoding
+ * header. gzip is preferred over deflate, codings with q=0 are not used.
+ * returns the format or -1 if the client does not accept compressed data.
+ */
+int compNegotiate(const char *header, size_t len)
+{
+	/* -1 means not mentioned, 0 refused and 1 accepted */
+	int gzip = -1, deflate = -1, any = -1, accepted;
+	size_t pos = 0, start, end, i;
+
+	while(pos < len)
+	{
+		/* the name of the coding */
+		while(pos < len && (header[pos] == ' ' || header[pos] == '\t'
+			|| header[pos] == ','))
+		{
+			++pos;
+		}
+
+		for(start=pos;pos<len && header[pos]!=',' && header[pos]!=';'
+			&& header[pos]!=' ' && header[pos]!='\t';)
+		{
+			++pos;
+		}
+
+		end = pos;
+
+		/* the coding is refused if the quality value is 0 */
+		accepted = 1;
+
+		while(pos < len && header[pos] != ',')
+		{
+			if((header[pos] == 'q' || header[pos] == 'Q')
+				&& pos + 1 < len && header[pos + 1] == '='
+				&& (pos == 0 || header[pos - 1] == ';'
+					|| header[pos - 1] == ' '))
+			{
+				for(i=pos+2,accepted=0;i<len && header[i]!=','
+					&& header[i]!=';' && header[i]!=' ';++i)
+				{
+					if(header[i] != '0' && header[i] != '.')
+					{
+						accepted = 1;
+					}
+				}
+			}
+
+			++pos;
+		}
+
+		if(end - start == 4 && strncasecmp(header + start, "gzip", 4) == 0)
+		{
+			gzip = accepted;
+		}
+		else if(end - start == 6
+			&& strncasecmp(header + start, "x-gzip", 6) == 0)
+		{
+			gzip = gzip == -1 ? accepted : gzip;
+		}
+		else if(end - start == 7
+			&& strncasecmp(header + start, "deflate", 7) == 0)
+		{
+			deflate = accepted;
+		}
+		else if(end - start == 1 && header[start] == '*')
+		{
+			any = accepted;
+		}
+	}
+
+	if(gzip == 1 || (gzip == -1 && any == 1))
+	{
+		return COMP_GZIP;
+	}
+
+	if(deflate == 1 || (deflate == -1 && any == 1))
+	{
+		return COMP_DEFLATE;
+	}
+
+	return -1;
+}
+
+/**
+ * compresses the given data with the format and level and appends the result
+ * to the buffer. if the last parameter is set the result is kept in the
+ * compression cache and identical data is not compressed again. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int compCompress(
+	buf_t *buf, const void *data, size_t len, compFormat_t format, int level,
+	int cache
+)
+{
+	unsigned long crc = 0;
+	size_t start = buf->len;
+	_entry_t *entry;
+	z_stream *stream;
+
+	if(format != COMP_GZIP && format != COMP_DEFLATE)
+	{
+		return 0;
+	}
+
+	level = level < 1 ? 1 : (level > 9 ? 9 : level);
+	cache = cache && _cacheMax > 0;
+
+	/* the checksum finds the data, a hit is compared byte by byte */
+	if(cache)
+	{
+		crc = hashCrc32c(0, data, len);
+
+		if((entry = _lookup(crc, data, len, format, level)) != NULL)
+		{
+			++_hits;
+
+			_unlink(entry);
+			_link(entry);
+
+			return bufAppend(
+				buf, (const char*) entry->data.data + len,
+				entry->data.len - len
+			);
+		}
+
+		++_misses;
+	}
+
+	/* reuse the stream of the format */
+	if((stream = _streams[format]) == NULL)
+	{
+		if((stream = _newStream(format, level)) == NULL)
+		{
+			return 0;
+		}
+
+		_streams[format] = stream;
+		_levels[format] = level;
+	}
+	else
+	{
+		deflateReset(stream);
+
+		if(_levels[format] != level)
+		{
+			deflateParams(stream, level, Z_DEFAULT_STRATEGY);
+			_levels[format] = level;
+		}
+	}
+
+	if(_deflate(stream, buf, data, len, Z_FINISH) != Z_STREAM_END)
+	{
+		buf->len = start;
+
+		return 0;
+	}
+
+	if(cache)
+	{
+		_store(
+			crc, data, len, format, level,
+			(const char*) buf->data + start, buf->len - start
+		);
+	}
+
+	return 1;
+}
+
+/**
+ * sets the maximum size of the compression cache in bytes, the least recently
+ * used entries are removed if necessary. 0 disables the cache.
+ */
+void compSetCacheSize(size_t size)
+{
+	_cacheMax = size;
+
+	_shrink(size);
+}
+
+/**
+ * stores the number of cache hits and misses and the current size of the
+ * cache in bytes.
+ */
+void compGetCacheStats(size_t *hits, size_t *misses, size_t *size)
+{
+	*hits = _hits;
+	*misses = _misses;
+	*size = _cacheSize;
+}
+
+/**
+ * frees the compression cache and the internal compression state.
+ */
+void compCleanup(void)
+{
+	_shrink(0);
+
+	_freeStream(_streams[COMP_GZIP]);
+	_freeStream(_streams[COMP_DEFLATE]);
+
+	_streams[COMP_GZIP] = NULL;
+	_streams[COMP_DEFLATE] = NULL;
+}
+
+/**
+ * initializes the given compression filter with the format and the level.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int compInit(compFilter_t *filter, compFormat_t format, int level)
+{
+	level = level < 1 ? 1 : (level > 9 ? 9 : level);
+
+	filter->stream = format == COMP_GZIP || format == COMP_DEFLATE
+		? _newStream(format, level) : NULL;
+
+	return filter->stream != NULL;
+}
+
+/**
+ * compresses the given data and appends the output to the buffer. the data
+ * may be passed in arbitrary pieces, see compFlush_t for the last parameter.
+ * returns 0 in case of an error or if the filter was finished already and 1
+ * if everything is ok.
+ */
+int compWrite(
+	compFilter_t *filter, buf_t *buf, const void *data, size_t len,
+	compFlush_t flush
+)
+{
+	size_t start = buf->len;
+	int result;
+
+	if(filter->stream == NULL)
+	{
+		return 0;
+	}
+
+	result = _deflate(
+		(z_stream*) filter->stream, buf, data, len,
+		flush == COMP_FINISH ? Z_FINISH
+			: (flush == COMP_FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH)
+	);
+
+	/* the stream is not needed anymore once it is finished */
+	if(result == Z_STREAM_END)
+	{
+		compClear(filter);
+
+		return 1;
+	}
+
+	/* Z_BUF_ERROR only means that there was nothing to do */
+	if(result != Z_OK && result != Z_BUF_ERROR)
+	{
+		buf->len = start;
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * frees the resources of the given compression filter.
+ */
+void compClear(compFilter_t *filter)
+{
+	_freeStream((z_stream*) filter->stream);
+
+	filter->stream = NULL;
+}
@@ -0,0 +1,444 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+
+/**
+ * checks whether the given character needs special treatment when url
+ * decoding. everything else is copied as it is.
+ */
+#define _isUrlDecodeSpecial(c) ((c) == '%' || (c) == '+')
+
+/**
+ * defines how every character is treated when url encoding. 0 means the
+ * character is copied as it is (letters and digits), 1 means it is replaced by
+ * a '+' (space) and 2 means it is escaped with a %XX sequence.
+ */
+static const unsigned char _urlEncodeTable[256] = {
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2,
+	2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2,
+	2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2
+};
+
+/**
+ * defines the hex digits used for escape sequences.
+ */
+static const char _hexDigits[] = "0123456789ABCDEF";
+
+/**
+ * converts the given hex digit into its value. returns -1 if the character is
+ * not a hex digit.
+ */
+static int _hexValue(unsigned char c)
+{
+	if(c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	else if(c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	else if(c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+/**
+ * url encodes the given data and appends the result to the buffer. letters and
+ * digits are copied, a space is turned into '+' and everything else into a
+ * %XX sequence. returns 1 if everything is ok and 0 if not.
+ */
+int encUrlEncode(buf_t *dst, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned char tmp[3 * 64];
+	size_t start = 0, i = 0, n;
+
+	while(i < len)
+	{
+		/* skip over the run of characters that can be copied as they are */
+		while(i < len && _urlEncodeTable[src[i]] == 0)
+		{
+			++i;
+		}
+
+		/* copy the run at once */
+		if(i > start && !bufAppend(dst, src + start, i - start))
+		{
+			return 0;
+		}
+
+		/* encode the following characters into the temporary buffer until a
+		 * character shows up which can be copied */
+		for(n=0;i<len && _urlEncodeTable[src[i]] != 0
+			&& n + 3 <= sizeof(tmp);++i)
+		{
+			if(_urlEncodeTable[src[i]] == 1)
+			{
+				tmp[n++] = '+';
+			}
+			else
+			{
+				tmp[n++] = '%';
+				tmp[n++] = _hexDigits[src[i] >> 4];
+				tmp[n++] = _hexDigits[src[i] & 0x0f];
+			}
+		}
+
+		/* append the encoded characters at once */
+		if(n > 0 && !bufAppend(dst, tmp, n))
+		{
+			return 0;
+		}
+
+		start = i;
+	}
+
+	return 1;
+}
+
+/**
+ * decodes the given url encoded data and appends the result to the buffer.
+ * '+' is turned into a space and every valid %XX sequence into the character
+ * it represents; invalid sequences are left untouched. returns 1 if everything
+ * is ok and 0 if not.
+ */
+int encUrlDecode(buf_t *dst, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	size_t start = 0, i = 0;
+	int high, low;
+	char c;
+
+	while(i < len)
+	{
+		/* skip over the run of characters that can be copied as they are */
+		while(i < len && !_isUrlDecodeSpecial(src[i]))
+		{
+			++i;
+		}
+
+		/* copy the run at once */
+		if(i > start && !bufAppend(dst, src + start, i - start))
+		{
+			return 0;
+		}
+
+		/* is this the end of the data */
+		if(i >= len)
+		{
+			break;
+		}
+
+		/* decode the special character */
+		if(src[i] == '+')
+		{
+			c = ' ';
+			i += 1;
+		}
+		else if(i + 2 < len
+			&& (high = _hexValue(src[i + 1])) >= 0
+			&& (low = _hexValue(src[i + 2])) >= 0)
+		{
+			c = (char) ((high << 4) | low);
+			i += 3;
+		}
+		else
+		{
+			/* not a valid escape sequence, keep the percent sign */
+			c = '%';
+			i += 1;
+		}
+
+		/* append the decoded character */
+		if(!bufAppend(dst, &c, 1))
+		{
+			return 0;
+		}
+
+		start = i;
+	}
+
+	return 1;
+}
+
+/**
+ * defines the base64 alphabet.
+ */
+static const char _base64Digits[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * defines the value of every base64 digit, 64 means the character is not a
+ * base64 digit.
+ */
+static const unsigned char _base64Table[256] = {
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+	64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
+	64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+	64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
+};
+
+/**
+ * base64 encodes the given data (with padding) and appends the result to the
+ * buffer. returns 1 if everything is ok and 0 if not.
+ */
+int encBase64Encode(buf_t *dst, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned char tmp[4 * 64];
+	unsigned long value;
+	size_t n;
+
+	/* encode blocks of 3 bytes into the temporary buffer */
+	while(len >= 3)
+	{
+		for(n=0;len>=3 && n<sizeof(tmp);n+=4,src+=3,len-=3)
+		{
+			value = ((unsigned long) src[0] << 16)
+				| ((unsigned long) src[1] << 8) | src[2];
+
+			tmp[n] = _base64Digits[value >> 18];
+			tmp[n + 1] = _base64Digits[(value >> 12) & 0x3f];
+			tmp[n + 2] = _base64Digits[(value >> 6) & 0x3f];
+			tmp[n + 3] = _base64Digits[value & 0x3f];
+		}
+
+		if(!bufAppend(dst, tmp, n))
+		{
+			return 0;
+		}
+	}
+
+	/* the remaining 1 or 2 bytes are padded */
+	if(len > 0)
+	{
+		value = (unsigned long) src[0] << 16;
+
+		if(len == 2)
+		{
+			value |= (unsigned long) src[1] << 8;
+		}
+
+		tmp[0] = _base64Digits[value >> 18];
+		tmp[1] = _base64Digits[(value >> 12) & 0x3f];
+		tmp[2] = len == 2 ? _base64Digits[(value >> 6) & 0x3f] : '=';
+		tmp[3] = '=';
+
+		return bufAppend(dst, tmp, 4);
+	}
+
+	return 1;
+}
+
+/**
+ * decodes the given base64 data and appends the result to the buffer. the
+ * padding is optional. returns 0 if the data is invalid (the buffer is left
+ * untouched) and 1 if everything is ok.
+ */
+int encBase64Decode(buf_t *dst, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned char tmp[3 * 64], a, b, c, d;
+	unsigned long value;
+	size_t start = dst->len, n;
+
+	/* remove the padding */
+	if(len > 0 && len % 4 == 0 && src[len - 1] == '=')
+	{
+		len -= src[len - 2] == '=' ? 2 : 1;
+	}
+
+	/* a single digit can not represent a byte */
+	if(len % 4 == 1)
+	{
+		return 0;
+	}
+
+	/* decode blocks of 4 digits into the temporary buffer */
+	while(len >= 4)
+	{
+		for(n=0;len>=4 && n<sizeof(tmp);n+=3,src+=4,len-=4)
+		{
+			a = _base64Table[src[0]];
+			b = _base64Table[src[1]];
+			c = _base64Table[src[2]];
+			d = _base64Table[src[3]];
+
+			/* an invalid digit has the value 64 */
+			if(((a | b | c | d) & 64) != 0)
+			{
+				dst->len = start;
+
+				return 0;
+			}
+
+			value = ((unsigned long) a << 18) | ((unsigned long) b << 12)
+				| ((unsigned long) c << 6) | d;
+
+			tmp[n] = (unsigned char) (value >> 16);
+			tmp[n + 1] = (unsigned char) (value >> 8);
+			tmp[n + 2] = (unsigned char) value;
+		}
+
+		if(!bufAppend(dst, tmp, n))
+		{
+			dst->len = start;
+
+			return 0;
+		}
+	}
+
+	/* the remaining 2 or 3 digits */
+	if(len > 0)
+	{
+		a = _base64Table[src[0]];
+		b = _base64Table[src[1]];
+		c = len == 3 ? _base64Table[src[2]] : 0;
+
+		value = ((unsigned long) a << 18) | ((unsigned long) b << 12)
+			| ((unsigned long) c << 6);
+
+		tmp[0] = (unsigned char) (value >> 16);
+		tmp[1] = (unsigned char) (value >> 8);
+
+		if(((a | b | c) & 64) != 0 || !bufAppend(dst, tmp, len - 1))
+		{
+			dst->len = start;
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * checks whether the given data is valid utf-8 (no overlong sequences, no
+ * surrogates and nothing above U+10FFFF). returns 1 if it is valid and 0 if
+ * not.
+ */
+int encIsUtf8(const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned long word, mask;
+	size_t i = 0, n;
+	unsigned char c;
+
+	/* the high bit of every byte of the word */
+	mask = (unsigned long) -1 / 0xff * 0x80;
+
+	while(i < len)
+	{
+		/* skip ascii characters a word at a time */
+		while(i + sizeof(word) <= len)
+		{
+			memcpy(&word, src + i, sizeof(word));
+
+			if((word & mask) != 0)
+			{
+				break;
+			}
+
+			i += sizeof(word);
+		}
+
+		while(i < len && src[i] < 0x80)
+		{
+			++i;
+		}
+
+		if(i >= len)
+		{
+			break;
+		}
+
+		/* get the length of the sequence and check the second byte, which
+		 * has a restricted range after some lead bytes */
+		c = src[i];
+
+		if(c < 0xc2 || c > 0xf4)
+		{
+			return 0;
+		}
+
+		n = c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+
+		if(i + n > len)
+		{
+			return 0;
+		}
+
+		if((c == 0xe0 && src[i + 1] < 0xa0)
+			|| (c == 0xed && src[i + 1] > 0x9f)
+			|| (c == 0xf0 && src[i + 1] < 0x90)
+			|| (c == 0xf4 && src[i + 1] > 0x8f))
+		{
+			return 0;
+		}
+
+		/* all continuation bytes are 10xxxxxx */
+		for(++i,--n;n>0;++i,--n)
+		{
+			if((src[i] & 0xc0) != 0x80)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,1183 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/**
+ * defines the initial number of buckets, the table doubles when it holds more
+ * entries than buckets.
+ */
+#define _BUCKETS_MIN (64)
+
+/**
+ * defines the number of seconds after which a cached file is checked with
+ * stat() again if it is not watched with inotify.
+ */
+#define _CHECK_INTERVAL (1)
+
+/**
+ * defines the content type of files with an unknown extension.
+ */
+#define _MIME_DEFAULT "application/octet-stream"
+
+#ifdef __linux__
+/**
+ * defines the inotify events which invalidate the files of a directory.
+ */
+#define _NOTIFY_MASK (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+	| IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+/**
+ * returns the request path and the file path of an entry, they are stored
+ * behind it (null terminated).
+ */
+#define _getPath(e) ((char*) ((e) + 1))
+#define _getFile(e) (_getPath(e) + (e)->pathLen + 1)
+
+/**
+ * stores the content types of common extensions, used if there is no mapping
+ * set with fileSetMime().
+ */
+static const char *_mimeTypes[] = {
+	"html", "text/html; charset=utf-8",
+	"htm", "text/html; charset=utf-8",
+	"css", "text/css; charset=utf-8",
+	"js", "text/javascript; charset=utf-8",
+	"mjs", "text/javascript; charset=utf-8",
+	"json", "application/json",
+	"txt", "text/plain; charset=utf-8",
+	"xml", "application/xml",
+	"svg", "image/svg+xml",
+	"png", "image/png",
+	"jpg", "image/jpeg",
+	"jpeg", "image/jpeg",
+	"gif", "image/gif",
+	"webp", "image/webp",
+	"ico", "image/x-icon",
+	"woff", "font/woff",
+	"woff2", "font/woff2",
+	"wasm", "application/wasm",
+	"pdf", "application/pdf",
+	"zip", "application/zip",
+	"gz", "application/gzip",
+	"mp4", "video/mp4",
+	"webm", "video/webm",
+	"mp3", "audio/mpeg",
+	NULL
+};
+
+/**
+ * stores the names used in http dates, independent of the locale.
+ */
+static const char *_days[] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char *_months[] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/**
+ * returns the hash of the given request path.
+ */
+static unsigned long _hash(const void *path, size_t len)
+{
+	return hashCrc32c(0, path, len);
+}
+
+/**
+ * appends the given string to the buffer. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _appendString(buf_t *buf, const char *str)
+{
+	return bufAppend(buf, str, strlen(str));
+}
+
+/**
+ * appends the given number to the buffer. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _appendNumber(buf_t *buf, unsigned long number)
+{
+	char tmp[24], *pos = tmp + sizeof(tmp);
+
+	do
+	{
+		*--pos = '0' + (char) (number % 10);
+		number /= 10;
+	}
+	while(number > 0);
+
+	return bufAppend(buf, pos, tmp + sizeof(tmp) - pos);
+}
+
+/**
+ * appends a header line to the buffer. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _appendHeader(buf_t *buf, const char *name, const char *value)
+{
+	return _appendString(buf, name)
+		&& bufAppend(buf, ": ", 2)
+		&& _appendString(buf, value)
+		&& bufAppend(buf, "\r\n", 2);
+}
+
+/**
+ * returns the content type of the given file, the mappings of the server are
+ * checked before the built in ones.
+ */
+static const char *_getMime(fileServer_t *fs, const char *file)
+{
+	const char *ext = strrchr(file, '.'), *pos, *end;
+	int i;
+
+	/* no extension in the last part of the path */
+	if(ext == NULL || strchr(ext, '/') != NULL)
+	{
+		return _MIME_DEFAULT;
+	}
+
+	++ext;
+
+	/* the mappings are stored as pairs of null terminated strings */
+	pos = (const char*) fs->mime.data;
+	end = pos + fs->mime.len;
+
+	while(pos < end)
+	{
+		if(strcasecmp(pos, ext) == 0)
+		{
+			return pos + strlen(pos) + 1;
+		}
+
+		pos += strlen(pos) + 1;
+		pos += strlen(pos) + 1;
+	}
+
+	for(i=0;_mimeTypes[i]!=NULL;i+=2)
+	{
+		if(strcasecmp(_mimeTypes[i], ext) == 0)
+		{
+			return _mimeTypes[i + 1];
+		}
+	}
+
+	return _MIME_DEFAULT;
+}
+
+/**
+ * formats the given time as http date (IMF-fixdate).
+ */
+static void _formatDate(char *dst, time_t time)
+{
+	struct tm *tm = gmtime(&time);
+
+	if(tm == NULL)
+	{
+		*dst = '\0';
+		return;
+	}
+
+	sprintf(
+		dst, "%s, %02d %s %04d %02d:%02d:%02d GMT", _days[tm->tm_wday],
+		tm->tm_mday, _months[tm->tm_mon], tm->tm_year + 1900, tm->tm_hour,
+		tm->tm_min, tm->tm_sec
+	);
+}
+
+/**
+ * parses a http date (IMF-fixdate) and stores it in the second parameter.
+ * returns 1 if everything is ok and 0 if the date is invalid.
+ */
+static int _parseDate(const char *str, time_t *dst)
+{
+	char month[4];
+	int day, year, hour, min, sec, m;
+	long days;
+
+	/* skip the name of the day */
+	if((str = strchr(str, ',')) == NULL
+		|| sscanf(
+			str + 1, "%2d %3s %4d %2d:%2d:%2d GMT",
+			&day, month, &year, &hour, &min, &sec
+		) != 6)
+	{
+		return 0;
+	}
+
+	for(m=0;m<12 && strcmp(_months[m], month) != 0;++m);
+
+	if(m == 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60)
+	{
+		return 0;
+	}
+
+	/* count the days since 1970-01-01 (the year starts in march here, so
+	 * the leap day is the last day of the year) */
+	m += 1;
+	year -= m <= 2;
+	days = (long) year * 365 + year / 4 - year / 100 + year / 400
+		+ (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1 - 719468L;
+
+	*dst = (time_t) days * 86400 + hour * 3600 + min * 60 + sec;
+
+	return 1;
+}
+
+/**
+ * parses a decimal number and stores it in the second parameter. returns the
+ * position behind the number or null if there is none.
+ */
+static const char *_parseNumber(const char *str, off_t *dst)
+{
+	off_t number = 0;
+
+	if(*str < '0' || *str > '9')
+	{
+		return NULL;
+	}
+
+	for(;*str>='0' && *str<='9';++str)
+	{
+		/* larger than any file anyway */
+		if(number > ((off_t) 1 << 52))
+		{
+			return NULL;
+		}
+
+		number = number * 10 + (*str - '0');
+	}
+
+	*dst = number;
+
+	return str;
+}
+
+/**
+ * parses a Range header for a file of the given size. the first and the last
+ * byte of the range are stored in the last two parameters. returns 1 if the
+ * range is valid, -1 if it can not be satisfied and 0 if it must be ignored
+ * (invalid or more than one range).
+ */
+static int _parseRange(const char *range, off_t size, off_t *first, off_t *last)
+{
+	off_t suffix;
+
+	if(strncasecmp(range, "bytes=", 6) != 0 || strchr(range, ',') != NULL)
+	{
+		return 0;
+	}
+
+	range += 6;
+
+	/* the last bytes of the file */
+	if(*range == '-')
+	{
+		if((range = _parseNumber(range + 1, &suffix)) == NULL || *range != '\0')
+		{
+			return 0;
+		}
+
+		if(suffix == 0 || size == 0)
+		{
+			return -1;
+		}
+
+		*first = suffix < size ? size - suffix : 0;
+		*last = size - 1;
+
+		return 1;
+	}
+
+	if((range = _parseNumber(range, first)) == NULL || *range++ != '-')
+	{
+		return 0;
+	}
+
+	/* an open range ends with the file */
+	if(*range == '\0')
+	{
+		*last = size - 1;
+	}
+	else if((range = _parseNumber(range, last)) == NULL || *range != '\0'
+		|| *last < *first)
+	{
+		return 0;
+	}
+
+	if(*first >= size)
+	{
+		return -1;
+	}
+
+	if(*last >= size)
+	{
+		*last = size - 1;
+	}
+
+	return 1;
+}
+
+/**
+ * checks an If-None-Match header against the entity tag of the file (weak
+ * comparison). returns 1 if it matches and 0 if not.
+ */
+static int _matchEtag(const char *header, const char *etag)
+{
+	while(*header == ' ' || *header == '\t')
+	{
+		++header;
+	}
+
+	/* the quotes are part of the tag, so it can not match a part of another
+	 * tag of the list */
+	return *header == '*' || strstr(header, etag) != NULL;
+}
+
+/**
+ * returns the value of the given hex digit or -1 if it is none.
+ */
+static int _hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+
+	if(c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+
+	if(c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+/**
+ * decodes the path of the given request uri into the buffer (which must hold
+ * FILE_PATH_MAX bytes). paths leaving the root directory are rejected. returns
+ * the length of the path or 0 if it is invalid.
+ */
+static size_t _decodePath(const char *uri, char *dst)
+{
+	size_t len = 0, segment = 0;
+	int hi, lo;
+
+	if(*uri != '/')
+	{
+		return 0;
+	}
+
+	for(;*uri!='\0' && *uri!='?' && *uri!='#';++uri)
+	{
+		if(len + 1 >= FILE_PATH_MAX)
+		{
+			return 0;
+		}
+
+		if(*uri != '%')
+		{
+			dst[len++] = *uri;
+		}
+		else
+		{
+			hi = _hexValue(uri[1]);
+			lo = hi < 0 ? -1 : _hexValue(uri[2]);
+
+			/* invalid escapes and null bytes are rejected */
+			if(lo < 0 || (hi == 0 && lo == 0))
+			{
+				return 0;
+			}
+
+			dst[len++] = (char) (hi * 16 + lo);
+			uri += 2;
+		}
+
+		/* reject ".." segments once a segment is complete */
+		if(dst[len - 1] == '/')
+		{
+			if(len - 1 - segment == 2 && dst[segment] == '.'
+				&& dst[segment + 1] == '.')
+			{
+				return 0;
+			}
+
+			segment = len;
+		}
+	}
+
+	if(len - segment == 2 && dst[segment] == '.' && dst[segment + 1] == '.')
+	{
+		return 0;
+	}
+
+	dst[len] = '\0';
+
+	return len;
+}
+
+/**
+ * adds the entry as most recently used entry.
+ */
+static void _link(fileServer_t *fs, fileEntry_t *entry)
+{
+	entry->newer = NULL;
+	entry->older = fs->newest;
+
+	if(fs->newest != NULL)
+	{
+		fs->newest->newer = entry;
+	}
+	else
+	{
+		fs->oldest = entry;
+	}
+
+	fs->newest = entry;
+}
+
+/**
+ * removes the entry from the lru list.
+ */
+static void _unlink(fileServer_t *fs, fileEntry_t *entry)
+{
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		fs->newest = entry->older;
+	}
+
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		fs->oldest = entry->newer;
+	}
+}
+
+/**
+ * removes the entry from the cache, closes the file and frees the entry.
+ */
+static void _remove(fileServer_t *fs, fileEntry_t *entry)
+{
+	fileEntry_t **link = fs->buckets
+		+ (entry->hash & (fs->bucketCount - 1));
+
+	while(*link != entry)
+	{
+		link = &((*link)->next);
+	}
+
+	*link = entry->next;
+
+	_unlink(fs, entry);
+
+	--fs->count;
+
+	close(entry->fd);
+	free(entry);
+}
+
+/**
+ * removes all entries from the cache.
+ */
+static void _flush(fileServer_t *fs)
+{
+	while(fs->oldest != NULL)
+	{
+		_remove(fs, fs->oldest);
+	}
+}
+
+/**
+ * doubles the number of buckets. returns 1 if everything is ok and 0 if not.
+ */
+static int _grow(fileServer_t *fs)
+{
+	size_t count = fs->bucketCount > 0 ? fs->bucketCount * 2 : _BUCKETS_MIN, i;
+	fileEntry_t **buckets, *entry, *next;
+
+	buckets = (fileEntry_t**) calloc(count, sizeof(fileEntry_t*));
+
+	if(buckets == NULL)
+	{
+		return 0;
+	}
+
+	/* move the entries into the new table */
+	for(i=0;i<fs->bucketCount;++i)
+	{
+		for(entry=fs->buckets[i];entry!=NULL;entry=next)
+		{
+			next = entry->next;
+			entry->next = buckets[entry->hash & (count - 1)];
+			buckets[entry->hash & (count - 1)] = entry;
+		}
+	}
+
+	free(fs->buckets);
+
+	fs->buckets = buckets;
+	fs->bucketCount = count;
+
+	return 1;
+}
+
+/**
+ * returns the entry of the given request path or null if there is none.
+ */
+static fileEntry_t *_find(
+	fileServer_t *fs, unsigned long hash, const char *path, size_t len
+)
+{
+	fileEntry_t *entry;
+
+	if(fs->buckets == NULL)
+	{
+		return NULL;
+	}
+
+	for(entry=fs->buckets[hash & (fs->bucketCount - 1)];entry!=NULL;
+		entry=entry->next)
+	{
+		if(entry->hash == hash && entry->pathLen == len
+			&& memcmp(_getPath(entry), path, len) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * removes the entries invalidated by the pending inotify events.
+ */
+static void _processEvents(fileServer_t *fs)
+{
+#ifdef __linux__
+	union {
+		struct inotify_event event;
+		char data[4096];
+	} events;
+	struct inotify_event *event;
+	fileEntry_t *entry, *older;
+	ssize_t len;
+	char *pos;
+
+	if(fs->notifyFd < 0)
+	{
+		return;
+	}
+
+	while((len = read(fs->notifyFd, &events, sizeof(events))) > 0)
+	{
+		for(pos=events.data;pos<events.data+len;
+			pos+=sizeof(struct inotify_event)+event->len)
+		{
+			event = (struct inotify_event*) pos;
+
+			/* events were lost, nothing can be trusted anymore */
+			if(event->mask & IN_Q_OVERFLOW)
+			{
+				_flush(fs);
+				continue;
+			}
+
+			/* every file of the directory is opened again */
+			for(entry=fs->oldest;entry!=NULL;entry=older)
+			{
+				older = entry->newer;
+
+				if(entry->wd == event->wd)
+				{
+					_remove(fs, entry);
+				}
+			}
+		}
+	}
+#else
+	(void) fs;
+#endif
+}
+
+/**
+ * checks whether the file of the entry is still the same, used for entries
+ * which are not watched with inotify. returns 1 if it is and 0 if not.
+ */
+static int _isValid(fileServer_t *fs, fileEntry_t *entry)
+{
+	struct stat st;
+	time_t now;
+
+	if(entry->wd >= 0 || (now = time(NULL)) - entry->checked < _CHECK_INTERVAL)
+	{
+		return 1;
+	}
+
+	if(fstatat(fs->rootFd, _getFile(entry), &st, 0) != 0
+		|| st.st_ino != entry->ino || st.st_size != entry->size
+		|| st.st_mtime != entry->mtime)
+	{
+		return 0;
+	}
+
+	entry->checked = now;
+
+	return 1;
+}
+
+/**
+ * opens the given file relative to the root directory, only regular files are
+ * accepted. returns the descriptor or -1 if there is no such file.
+ */
+static int _openFile(fileServer_t *fs, const char *file, struct stat *st)
+{
+	int fd = openat(fs->rootFd, file, O_RDONLY | O_NOCTTY);
+
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	if(fstat(fd, st) != 0 || !S_ISREG(st->st_mode))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * watches the directory of the given file for changes. returns the watch
+ * descriptor or -1 if the directory is not watched.
+ */
+static int _watch(fileServer_t *fs, const char *file)
+{
+#ifdef __linux__
+	const char *slash = strrchr(file, '/');
+	size_t len = slash != NULL ? (size_t) (slash - file) : 0;
+	char dir[FILE_PATH_MAX * 2];
+	int wd;
+
+	if(fs->notifyFd < 0 || fs->root.len + len + 2 > sizeof(dir))
+	{
+		return -1;
+	}
+
+	/* the directory of the file below the root */
+	memcpy(dir, fs->root.data, fs->root.len);
+	dir[fs->root.len] = '/';
+	memcpy(dir + fs->root.len + 1, file, len);
+	dir[fs->root.len + 1 + len] = '\0';
+
+	wd = inotify_add_watch(fs->notifyFd, dir, _NOTIFY_MASK);
+
+	return wd >= 0 ? wd : -1;
+#else
+	(void) fs;
+	(void) file;
+
+	return -1;
+#endif
+}
+
+/**
+ * opens the file of the given request path and adds it to the cache. returns
+ * the entry or null if there is no file.
+ */
+static fileEntry_t *_load(
+	fileServer_t *fs, unsigned long hash, const char *path, size_t pathLen
+)
+{
+	char file[FILE_PATH_MAX * 2];
+	const char *index = (const char*) fs->index.data;
+	size_t fileLen, indexLen;
+	fileEntry_t *entry, **bucket;
+	struct stat st;
+	int fd, highFd;
+
+	/* the path relative to the root */
+	if(pathLen > 1)
+	{
+		memcpy(file, path + 1, pathLen);
+		fileLen = pathLen - 1;
+	}
+	else
+	{
+		memcpy(file, ".", 2);
+		fileLen = 1;
+	}
+
+	if((fd = openat(fs->rootFd, file, O_RDONLY | O_NOCTTY)) < 0)
+	{
+		return NULL;
+	}
+
+	if(fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	/* a directory is answered with the first index file present */
+	if(S_ISDIR(st.st_mode))
+	{
+		close(fd);
+		fd = -1;
+
+		if(file[fileLen - 1] != '/')
+		{
+			file[fileLen++] = '/';
+		}
+
+		for(;index<(const char*)fs->index.data+fs->index.len;
+			index+=indexLen+1)
+		{
+			indexLen = strlen(index);
+
+			if(fileLen + indexLen + 1 > sizeof(file))
+			{
+				continue;
+			}
+
+			memcpy(file + fileLen, index, indexLen + 1);
+
+			if((fd = _openFile(fs, file, &st)) >= 0)
+			{
+				fileLen += indexLen;
+				break;
+			}
+		}
+
+		if(fd < 0)
+		{
+			return NULL;
+		}
+	}
+	else if(!S_ISREG(st.st_mode))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	/* keep the descriptor out of the range usable with select() */
+	if((highFd = fcntl(fd, F_DUPFD, SOCKET_MAX)) >= 0)
+	{
+		close(fd);
+		fd = highFd;
+	}
+
+	if(fs->count >= fs->bucketCount && !_grow(fs))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	entry = (fileEntry_t*) malloc(sizeof(fileEntry_t) + pathLen + fileLen + 2);
+
+	if(entry == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	entry->hash = hash;
+	entry->fd = fd;
+	entry->wd = _watch(fs, file);
+	entry->size = st.st_size;
+	entry->mtime = st.st_mtime;
+	entry->ino = st.st_ino;
+	entry->checked = time(NULL);
+	entry->mime = _getMime(fs, file);
+	entry->pathLen = pathLen;
+	entry->fileLen = fileLen;
+
+	sprintf(
+		entry->etag, "\"%lx-%lx\"", (unsigned long) entry->mtime,
+		(unsigned long) entry->size
+	);
+	_formatDate(entry->lastModified, entry->mtime);
+
+	memcpy(_getPath(entry), path, pathLen + 1);
+	memcpy(_getFile(entry), file, fileLen + 1);
+
+	bucket = fs->buckets + (hash & (fs->bucketCount - 1));
+	entry->next = *bucket;
+	*bucket = entry;
+
+	_link(fs, entry);
+
+	/* close the least recently used file */
+	if(++fs->count > FILE_CACHE_MAX)
+	{
+		_remove(fs, fs->oldest);
+	}
+
+	return entry;
+}
+
+/**
+ * appends the given part of the file to the buffer, used if the file can not
+ * be queued on the socket. returns 1 if everything is ok and 0 if not.
+ */
+static int _readFile(buf_t *buf, int fd, off_t offset, size_t len)
+{
+	size_t oldLen = buf->len;
+	ssize_t result;
+
+	if(!bufReserve(buf, len))
+	{
+		return 0;
+	}
+
+	while(len > 0)
+	{
+		result = pread(fd, (char*) buf->data + buf->len, len, offset);
+
+		if(result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		/* the file was truncated in the meantime */
+		if(result <= 0)
+		{
+			buf->len = oldLen;
+			return 0;
+		}
+
+		buf->len += result;
+		offset += result;
+		len -= result;
+	}
+
+	return 1;
+}
+
+/**
+ * initializes the given static file server with its root directory. returns
+ * 1 if everything is ok and 0 if the directory can not be opened.
+ */
+int fileInit(fileServer_t *fs, const char *root)
+{
+	memset(fs, 0, sizeof(*fs));
+
+	fs->maxAge = -1;
+	fs->notifyFd = -1;
+
+	if((fs->rootFd = open(root, O_RDONLY | O_DIRECTORY)) < 0)
+	{
+		return 0;
+	}
+
+	if(!bufAppend(&fs->root, root, strlen(root) + 1))
+	{
+		close(fs->rootFd);
+		fs->rootFd = -1;
+		return 0;
+	}
+
+	--fs->root.len;
+
+#ifdef __linux__
+	fs->notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	return 1;
+}
+
+/**
+ * adds an index file name, which is served for requests to a directory.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int fileAddIndex(fileServer_t *fs, const char *name)
+{
+	/* directories may be answered differently now */
+	_flush(fs);
+
+	return *name != '\0' && strchr(name, '/') == NULL
+		&& bufAppend(&fs->index, name, strlen(name) + 1);
+}
+
+/**
+ * sets the content type of the given file name extension (without the dot).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int fileSetMime(fileServer_t *fs, const char *ext, const char *type)
+{
+	size_t oldLen = fs->mime.len;
+
+	/* the entries point into the mappings, which may be moved */
+	_flush(fs);
+
+	if(!bufAppend(&fs->mime, ext, strlen(ext) + 1)
+		|| !bufAppend(&fs->mime, type, strlen(type) + 1))
+	{
+		fs->mime.len = oldLen;
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * sets the max-age of the Cache-Control header, a negative value omits the
+ * header.
+ */
+void fileSetMaxAge(fileServer_t *fs, long maxAge)
+{
+	fs->maxAge = maxAge;
+}
+
+/**
+ * answers a GET or HEAD request for a file below the root directory. the
+ * response header is appended to the buffer and the content is queued with
+ * serverSendFile() for the given client socket. conditional requests
+ * (If-None-Match, If-Modified-Since) and single byte ranges (Range, If-Range)
+ * are supported. returns the status code of the response or 0 if the request
+ * was not answered (other method, invalid path or file not found).
+ */
+int fileServe(fileServer_t *fs, int cFd, buf_t *oBuf, const fileRequest_t *req)
+{
+	char path[FILE_PATH_MAX];
+	int isHead, status = 200, range = 0;
+	size_t oldLen = oBuf->len, pathLen;
+	off_t first = 0, last = 0;
+	fileEntry_t *entry;
+	unsigned long hash;
+	time_t since;
+
+	if(req->method == NULL || req->path == NULL)
+	{
+		return 0;
+	}
+
+	isHead = strcasecmp(req->method, "HEAD") == 0;
+
+	if((!isHead && strcasecmp(req->method, "GET") != 0)
+		|| (pathLen = _decodePath(req->path, path)) == 0)
+	{
+		return 0;
+	}
+
+	_processEvents(fs);
+
+	hash = _hash(path, pathLen);
+
+	/* use the open file if it did not change */
+	if((entry = _find(fs, hash, path, pathLen)) != NULL)
+	{
+		if(_isValid(fs, entry))
+		{
+			_unlink(fs, entry);
+			_link(fs, entry);
+
+			++fs->hits;
+		}
+		else
+		{
+			_remove(fs, entry);
+			entry = NULL;
+		}
+	}
+
+	if(entry == NULL)
+	{
+		if((entry = _load(fs, hash, path, pathLen)) == NULL)
+		{
+			return 0;
+		}
+
+		++fs->misses;
+	}
+
+	/* If-None-Match takes precedence over If-Modified-Since */
+	if(req->ifNoneMatch != NULL)
+	{
+		if(_matchEtag(req->ifNoneMatch, entry->etag))
+		{
+			status = 304;
+		}
+	}
+	else if(req->ifModifiedSince != NULL
+		&& _parseDate(req->ifModifiedSince, &since) && entry->mtime <= since)
+	{
+		status = 304;
+	}
+
+	/* a range is only used if the file matches the one of If-Range */
+	if(status == 200 && req->range != NULL
+		&& (req->ifRange == NULL || strcmp(req->ifRange, entry->etag) == 0
+			|| strcmp(req->ifRange, entry->lastModified) == 0))
+	{
+		if((range = _parseRange(req->range, entry->size, &first, &last)) > 0)
+		{
+			status = 206;
+		}
+		else if(range < 0)
+		{
+			status = 416;
+		}
+	}
+
+	if(status == 200)
+	{
+		last = entry->size - 1;
+	}
+
+	/* the status line */
+	if(!_appendString(
+			oBuf, status == 200 ? "HTTP/1.1 200 OK\r\n"
+				: status == 206 ? "HTTP/1.1 206 Partial Content\r\n"
+				: status == 304 ? "HTTP/1.1 304 Not Modified\r\n"
+				: "HTTP/1.1 416 Range Not Satisfiable\r\n"
+		))
+	{
+		oBuf->len = oldLen;
+		return 0;
+	}
+
+	if(status == 416)
+	{
+		if(!_appendString(oBuf, "Content-Range: bytes */")
+			|| !_appendNumber(oBuf, (unsigned long) entry->size)
+			|| !_appendString(oBuf, "\r\nContent-Length: 0\r\n\r\n"))
+		{
+			oBuf->len = oldLen;
+			return 0;
+		}
+
+		return status;
+	}
+
+	/* the headers of the file */
+	if((status != 304 && (
+			!_appendHeader(oBuf, "Content-Type", entry->mime)
+			|| !_appendString(oBuf, "Content-Length: ")
+			|| !_appendNumber(oBuf, (unsigned long) (last - first + 1))
+			|| !_appendString(oBuf, "\r\nAccept-Ranges: bytes\r\n")))
+		|| (status == 206 && (
+			!_appendString(oBuf, "Content-Range: bytes ")
+			|| !_appendNumber(oBuf, (unsigned long) first)
+			|| !bufAppend(oBuf, "-", 1)
+			|| !_appendNumber(oBuf, (unsigned long) last)
+			|| !bufAppend(oBuf, "/", 1)
+			|| !_appendNumber(oBuf, (unsigned long) entry->size)
+			|| !bufAppend(oBuf, "\r\n", 2)))
+		|| !_appendHeader(oBuf, "Last-Modified", entry->lastModified)
+		|| !_appendHeader(oBuf, "ETag", entry->etag)
+		|| (fs->maxAge >= 0 && (
+			!_appendString(oBuf, "Cache-Control: max-age=")
+			|| !_appendNumber(oBuf, (unsigned long) fs->maxAge)
+			|| !bufAppend(oBuf, "\r\n", 2)))
+		|| !bufAppend(oBuf, "\r\n", 2))
+	{
+		oBuf->len = oldLen;
+		return 0;
+	}
+
+	/* the content is sent from the file directly, the buffer is only used if
+	 * another file is queued on the socket already */
+	if(status != 304 && !isHead && last >= first
+		&& !serverSendFile(cFd, entry->fd, first, last - first + 1)
+		&& !_readFile(oBuf, entry->fd, first, last - first + 1))
+	{
+		oBuf->len = oldLen;
+		return 0;
+	}
+
+	return status;
+}
+
+/**
+ * stores the number of requests answered from the cache, the number of files
+ * opened and the number of files currently open in the given parameters.
+ */
+void fileGetStats(
+	fileServer_t *fs, unsigned long *hits, unsigned long *misses, size_t *count
+)
+{
+	*hits = fs->hits;
+	*misses = fs->misses;
+	*count = fs->count;
+}
+
+/**
+ * frees the resources of the given static file server.
+ */
+void fileClear(fileServer_t *fs)
+{
+	_flush(fs);
+
+	free(fs->buckets);
+
+	bufClear(&fs->root);
+	bufClear(&fs->index);
+	bufClear(&fs->mime);
+
+	if(fs->notifyFd >= 0)
+	{
+		close(fs->notifyFd);
+	}
+
+	if(fs->rootFd >= 0)
+	{
+		close(fs->rootFd);
+	}
+
+	memset(fs, 0, sizeof(*fs));
+
+	fs->rootFd = -1;
+	fs->notifyFd = -1;
+}
@@ -0,0 +1,334 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * defines the initial number of buckets, the table doubles when it holds more
+ * flights than buckets.
+ */
+#define _BUCKETS_MIN (64)
+
+/**
+ * returns the key of a flight, it is stored behind it.
+ */
+#define _getKey(f) ((char*) ((f) + 1))
+
+/**
+ * returns the hash of the given key.
+ */
+static unsigned long _hash(const void *key, size_t len)
+{
+	return hashCrc32c(0, key, len);
+}
+
+/**
+ * returns the pointer to the flight of the given key in its bucket, the
+ * pointer refers to null if there is no such flight.
+ */
+static flightEntry_t **_findLink(
+	flight_t *flight, unsigned long hash, const void *key, size_t len
+)
+{
+	flightEntry_t **link = flight->buckets
+		+ (hash & (flight->bucketCount - 1));
+
+	while(*link != NULL && ((*link)->hash != hash || (*link)->keyLen != len
+		|| memcmp(_getKey(*link), key, len) != 0))
+	{
+		link = &((*link)->next);
+	}
+
+	return link;
+}
+
+/**
+ * doubles the number of buckets. returns 1 if everything is ok and 0 if not.
+ */
+static int _grow(flight_t *flight)
+{
+	size_t count = flight->bucketCount > 0
+		? flight->bucketCount * 2 : _BUCKETS_MIN, i;
+	flightEntry_t **buckets, *entry, *next;
+
+	buckets = (flightEntry_t**) calloc(count, sizeof(flightEntry_t*));
+
+	if(buckets == NULL)
+	{
+		return 0;
+	}
+
+	/* move the flights into the new table */
+	for(i=0;i<flight->bucketCount;++i)
+	{
+		for(entry=flight->buckets[i];entry!=NULL;entry=next)
+		{
+			next = entry->next;
+			entry->next = buckets[entry->hash & (count - 1)];
+			buckets[entry->hash & (count - 1)] = entry;
+		}
+	}
+
+	free(flight->buckets);
+
+	flight->buckets = buckets;
+	flight->bucketCount = count;
+
+	return 1;
+}
+
+/**
+ * frees the given flight and its waiters.
+ */
+static void _free(flightEntry_t *entry)
+{
+	flightWaiter_t *waiter, *next;
+
+	for(waiter=entry->first;waiter!=NULL;waiter=next)
+	{
+		next = waiter->next;
+		free(waiter);
+	}
+
+	free(entry);
+}
+
+/**
+ * initializes the given group of flights.
+ */
+void flightInit(flight_t *flight)
+{
+	memset(flight, 0, sizeof(*flight));
+}
+
+/**
+ * joins the flight of the given key with the client socket. the first socket
+ * becomes the leader and must compute the value, every other socket is parked
+ * (reading is paused) until flightFinish() is called for the key.
+ */
+flightResult_t flightJoin(
+	flight_t *flight, const void *key, size_t len, int cFd
+)
+{
+	unsigned long hash = _hash(key, len);
+	flightEntry_t **link, *entry;
+	flightWaiter_t *waiter;
+
+	if(flight->count >= flight->bucketCount && !_grow(flight))
+	{
+		return FLIGHT_ERROR;
+	}
+
+	link = _findLink(flight, hash, key, len);
+
+	/* the first one computes the value */
+	if(*link == NULL)
+	{
+		entry = (flightEntry_t*) malloc(sizeof(flightEntry_t) + len);
+
+		if(entry == NULL)
+		{
+			return FLIGHT_ERROR;
+		}
+
+		entry->next = NULL;
+		entry->hash = hash;
+		entry->keyLen = len;
+		entry->first = NULL;
+		entry->last = NULL;
+
+		memcpy(_getKey(entry), key, len);
+
+		*link = entry;
+
+		++flight->count;
+		++flight->leaders;
+
+		return FLIGHT_LEADER;
+	}
+
+	/* everyone else waits for it */
+	if((waiter = (flightWaiter_t*) malloc(sizeof(flightWaiter_t))) == NULL)
+	{
+		return FLIGHT_ERROR;
+	}
+
+	waiter->next = NULL;
+	waiter->cFd = cFd;
+	waiter->id = serverGetSocketId(cFd);
+
+	if((*link)->last != NULL)
+	{
+		(*link)->last->next = waiter;
+	}
+	else
+	{
+		(*link)->first = waiter;
+	}
+
+	(*link)->last = waiter;
+
+	++flight->waiters;
+
+	serverPauseRead(cFd);
+
+	return FLIGHT_WAITING;
+}
+
+/**
+ * finishes the flight of the given key. reading is resumed on every parked
+ * socket and the callback is invoked with the socket, its output buffer and
+ * the given argument. the flight is removed before, so the callback may start
+ * a new one. returns the number of sockets woken.
+ */
+size_t flightFinish(
+	flight_t *flight, const void *key, size_t len, flightCallback_t callback,
+	void *arg
+)
+{
+	flightEntry_t **link, *entry;
+	flightWaiter_t *waiter;
+	size_t count = 0;
+	buf_t *oBuf;
+
+	if(flight->buckets == NULL
+		|| *(link = _findLink(flight, _hash(key, len), key, len)) == NULL)
+	{
+		return 0;
+	}
+
+	entry = *link;
+	*link = entry->next;
+
+	--flight->count;
+
+	/* wake the parked sockets in the order they joined. a socket closed in
+	 * the meantime has a different id (or none), its descriptor may belong
+	 * to another connection which must not get the answer */
+	for(waiter=entry->first;waiter!=NULL;waiter=waiter->next)
+	{
+		oBuf = NULL;
+
+		if(waiter->id != 0 && serverGetSocketId(waiter->cFd) == waiter->id)
+		{
+			serverResumeRead(waiter->cFd);
+			oBuf = serverGetOutput(waiter->cFd);
+		}
+
+		if(callback != NULL)
+		{
+			callback(waiter->cFd, waiter->id, oBuf, arg);
+		}
+
+		count += oBuf != NULL ? 1 : 0;
+	}
+
+	_free(entry);
+
+	return count;
+}
+
+/**
+ * removes the given client socket from every flight it is parked on, used
+ * when the socket is closed (calling it is optional, see flightFinish()).
+ * returns 1 if it was parked and 0 if not.
+ */
+int flightCancel(flight_t *flight, int cFd)
+{
+	flightWaiter_t **link, *waiter, *last;
+	flightEntry_t *entry;
+	unsigned long id = serverGetSocketId(cFd);
+	int found = 0;
+	size_t i;
+
+	for(i=0;i<flight->bucketCount;++i)
+	{
+		for(entry=flight->buckets[i];entry!=NULL;entry=entry->next)
+		{
+			last = NULL;
+			link = &(entry->first);
+
+			while((waiter = *link) != NULL)
+			{
+				/* a waiter of an earlier connection with the same descriptor
+				 * is left to flightFinish() */
+				if(waiter->cFd == cFd && waiter->id == id)
+				{
+					*link = waiter->next;
+					free(waiter);
+					found = 1;
+				}
+				else
+				{
+					last = waiter;
+					link = &(waiter->next);
+				}
+			}
+
+			entry->last = last;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * stores the number of flights started, the number of sockets parked and the
+ * number of flights in progress in the given parameters.
+ */
+void flightGetStats(
+	flight_t *flight, unsigned long *leaders, unsigned long *waiters,
+	size_t *count
+)
+{
+	*leaders = flight->leaders;
+	*waiters = flight->waiters;
+	*count = flight->count;
+}
+
+/**
+ * frees all flights without waking the parked sockets.
+ */
+void flightClear(flight_t *flight)
+{
+	flightEntry_t *entry, *next;
+	size_t i;
+
+	for(i=0;i<flight->bucketCount;++i)
+	{
+		for(entry=flight->buckets[i];entry!=NULL;entry=next)
+		{
+			next = entry->next;
+			_free(entry);
+		}
+	}
+
+	free(flight->buckets);
+
+	flightInit(flight);
+}
@@ -0,0 +1,807 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+
+/**
+ * defines the possible states of a form parser.
+ */
+enum {
+
+	/* urlencoded: collecting the current field */
+	_STATE_FIELD,
+
+	/* multipart: skipping everything before the first delimiter */
+	_STATE_PREAMBLE,
+
+	/* multipart: a delimiter was found, waiting for the line break or the
+	 * closing "--" */
+	_STATE_DELIMITER,
+
+	/* multipart: reading the headers of a part */
+	_STATE_HEADER,
+
+	/* multipart: reading the data of a part */
+	_STATE_BODY,
+
+	/* the form is complete, everything else is ignored */
+	_STATE_DONE,
+
+	/* the parser encountered an error */
+	_STATE_ERROR
+};
+
+/**
+ * resets the given scratch buffer without freeing its memory.
+ */
+#define _resetScratch(b) bufConsume((b), (b)->len)
+
+/**
+ * checks whether the given character is a space or a tab.
+ */
+#define _isBlank(c) ((c) == ' ' || (c) == '\t')
+
+/**
+ * compares the given string with the null terminated string ignoring the case
+ * of the characters. returns 1 if they are equal and 0 if not.
+ */
+static int _equalsNoCase(const char *str, size_t len, const char *cmp)
+{
+	size_t i;
+	char a, b;
+
+	for(i=0;i<len;++i)
+	{
+		/* the compared string is shorter */
+		if(cmp[i] == '\0')
+		{
+			return 0;
+		}
+
+		a = str[i];
+		b = cmp[i];
+
+		/* convert both characters to lower case */
+		if(a >= 'A' && a <= 'Z')
+		{
+			a += 'a' - 'A';
+		}
+
+		if(b >= 'A' && b <= 'Z')
+		{
+			b += 'a' - 'A';
+		}
+
+		if(a != b)
+		{
+			return 0;
+		}
+	}
+
+	return cmp[len] == '\0';
+}
+
+/**
+ * removes leading and trailing blanks from the given string.
+ */
+static void _trim(const char **str, size_t *len)
+{
+	while(*len > 0 && _isBlank((*str)[0]))
+	{
+		++(*str);
+		--(*len);
+	}
+
+	while(*len > 0 && _isBlank((*str)[*len - 1]))
+	{
+		--(*len);
+	}
+}
+
+/**
+ * reads the next parameter of a header value like 'x; key=value; key="v"'.
+ * everything up to the first semicolon is skipped. returns 1 if a parameter
+ * was found and 0 if the end of the value was reached.
+ */
+static int _nextParam(
+	const char **cur, const char *end,
+	const char **key, size_t *keyLen,
+	const char **val, size_t *valLen
+)
+{
+	const char *pos = *cur, *quote;
+
+	/* find the beginning of the next parameter */
+	if((pos = memchr(pos, ';', end - pos)) == NULL)
+	{
+		*cur = end;
+
+		return 0;
+	}
+
+	/* the key is everything up to the equal sign */
+	*key = ++pos;
+
+	while(pos < end && *pos != '=' && *pos != ';')
+	{
+		++pos;
+	}
+
+	*keyLen = pos - *key;
+	_trim(key, keyLen);
+
+	/* default to an empty value */
+	*val = pos;
+	*valLen = 0;
+
+	/* is there a value */
+	if(pos < end && *pos == '=')
+	{
+		/* skip the equal sign and leading blanks */
+		for(++pos;pos<end && _isBlank(*pos);++pos);
+
+		/* is this a quoted value */
+		if(pos < end && *pos == '"')
+		{
+			*val = ++pos;
+
+			/* find the closing quote */
+			if((quote = memchr(pos, '"', end - pos)) == NULL)
+			{
+				quote = end;
+			}
+
+			*valLen = quote - pos;
+			pos = quote < end ? quote + 1 : end;
+		}
+		else
+		{
+			*val = pos;
+
+			while(pos < end && *pos != ';')
+			{
+				++pos;
+			}
+
+			*valLen = pos - *val;
+			_trim(val, valLen);
+		}
+	}
+
+	*cur = pos;
+
+	return 1;
+}
+
+/**
+ * invokes the callback with the given event and data. the scratch buffers are
+ * used for the name, value and type of the event. returns 1 if the parser
+ * should continue and 0 if not.
+ */
+static int _emit(
+	formParser_t *parser, formEvent_t event,
+	const char *value, size_t valueLen,
+	formCallback_t callback, void *userData
+)
+{
+	formData_t data;
+
+	data.event = event;
+
+	/* use the scratch buffers for the name and type */
+	data.name = (const char*) parser->name.data;
+	data.nameLen = parser->name.len;
+	data.type = (const char*) parser->mime.data;
+	data.typeLen = parser->mime.len;
+
+	/* the value is either given or taken from the scratch buffer */
+	if(value != NULL)
+	{
+		data.value = value;
+		data.valueLen = valueLen;
+	}
+	else
+	{
+		data.value = (const char*) parser->value.data;
+		data.valueLen = parser->value.len;
+	}
+
+	/* never pass null pointers to the callback */
+	data.name = data.name != NULL ? data.name : "";
+	data.value = data.value != NULL ? data.value : "";
+	data.type = data.type != NULL ? data.type : "";
+
+	return callback(&data, userData);
+}
+
+/**
+ * decodes the given urlencoded field and reports it to the callback. empty
+ * fields are skipped. returns 1 if everything is ok and 0 if not.
+ */
+static int _emitField(
+	formParser_t *parser, const char *field, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	const char *eq;
+	size_t nameLen;
+
+	/* empty fields are skipped ("a=1&&b=2") */
+	if(len == 0)
+	{
+		return 1;
+	}
+
+	_resetScratch(&(parser->name));
+	_resetScratch(&(parser->value));
+
+	/* split the field at the first equal sign */
+	eq = memchr(field, '=', len);
+	nameLen = eq != NULL ? (size_t) (eq - field) : len;
+
+	/* decode the name and the value */
+	if(!encUrlDecode(&(parser->name), field, nameLen))
+	{
+		return 0;
+	}
+
+	if(eq != NULL && !encUrlDecode(&(parser->value), eq + 1, len - nameLen - 1))
+	{
+		return 0;
+	}
+
+	return _emit(parser, FORM_EVENT_FIELD, NULL, 0, callback, userData);
+}
+
+/**
+ * parses urlencoded data. returns the number of bytes consumed.
+ */
+static size_t _execUrlEncoded(
+	formParser_t *parser, const char *data, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	const char *amp;
+	size_t used = 0;
+
+	/* report every complete field */
+	while((amp = memchr(data + used, '&', len - used)) != NULL)
+	{
+		if(!_emitField(
+			parser, data + used, amp - data - used, callback, userData
+		))
+		{
+			parser->state = _STATE_ERROR;
+
+			return used;
+		}
+
+		used = amp - data + 1;
+	}
+
+	/* the rest is an incomplete field, make sure it does not get too big */
+	if(len - used > FORM_FIELD_MAX)
+	{
+		parser->state = _STATE_ERROR;
+	}
+
+	return used;
+}
+
+/**
+ * searches the multipart delimiter in the given data. returns the offset of
+ * the delimiter and sets the last parameter to 1 if it was found. otherwise
+ * the offset of a possible beginning of the delimiter at the end of the data
+ * is returned (or the length of the data if there is none).
+ */
+static size_t _findDelimiter(
+	formParser_t *parser, const char *data, size_t len, int *found
+)
+{
+	const char *cur = data, *end = data + len;
+	size_t rest;
+
+	*found = 0;
+
+	/* every delimiter starts with a carriage return, memchr() is usually
+	 * vectorized which makes skipping the data cheap */
+	while(cur < end && (cur = memchr(cur, '\r', end - cur)) != NULL)
+	{
+		rest = end - cur;
+
+		if(rest >= parser->delimLen)
+		{
+			/* is this the complete delimiter */
+			if(memcmp(cur, parser->delim, parser->delimLen) == 0)
+			{
+				*found = 1;
+
+				return cur - data;
+			}
+		}
+		/* this might be the beginning of the delimiter */
+		else if(memcmp(cur, parser->delim, rest) == 0)
+		{
+			return cur - data;
+		}
+
+		++cur;
+	}
+
+	return len;
+}
+
+/**
+ * parses a header line of a part. only the content disposition and the
+ * content type are used. returns 1 if everything is ok and 0 if not.
+ */
+static int _parsePartHeader(formParser_t *parser, const char *line, size_t len)
+{
+	const char *colon, *name, *value, *end, *key, *val;
+	size_t nameLen, valueLen, keyLen, valLen;
+
+	/* split the line into name and value */
+	if((colon = memchr(line, ':', len)) == NULL)
+	{
+		return 0;
+	}
+
+	name = line;
+	nameLen = colon - line;
+	_trim(&name, &nameLen);
+
+	value = colon + 1;
+	valueLen = line + len - value;
+	_trim(&value, &valueLen);
+
+	if(_equalsNoCase(name, nameLen, "content-type"))
+	{
+		return bufAppend(&(parser->mime), value, valueLen);
+	}
+	else if(_equalsNoCase(name, nameLen, "content-disposition"))
+	{
+		end = value + valueLen;
+
+		/* go through all the parameters */
+		while(_nextParam(&value, end, &key, &keyLen, &val, &valLen))
+		{
+			if(_equalsNoCase(key, keyLen, "name"))
+			{
+				_resetScratch(&(parser->name));
+
+				if(!bufAppend(&(parser->name), val, valLen))
+				{
+					return 0;
+				}
+			}
+			else if(_equalsNoCase(key, keyLen, "filename"))
+			{
+				_resetScratch(&(parser->value));
+
+				if(!bufAppend(&(parser->value), val, valLen))
+				{
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * handles the data after a delimiter. returns the number of bytes consumed.
+ */
+static size_t _execDelimiter(formParser_t *parser, const char *data, size_t len)
+{
+	size_t i = 0;
+
+	if(len < 2)
+	{
+		return 0;
+	}
+
+	/* is this the closing delimiter */
+	if(data[0] == '-' && data[1] == '-')
+	{
+		parser->state = _STATE_DONE;
+
+		return 2;
+	}
+
+	/* skip the transport padding */
+	while(i < len && _isBlank(data[i]))
+	{
+		++i;
+	}
+
+	/* wait for the line break */
+	if(len - i < 2)
+	{
+		return 0;
+	}
+
+	if(data[i] == '\r' && data[i + 1] == '\n')
+	{
+		/* a new part begins, forget everything of the previous one */
+		_resetScratch(&(parser->name));
+		_resetScratch(&(parser->value));
+		_resetScratch(&(parser->mime));
+
+		parser->headerLen = 0;
+		parser->state = _STATE_HEADER;
+
+		return i + 2;
+	}
+
+	parser->state = _STATE_ERROR;
+
+	return 0;
+}
+
+/**
+ * handles a header line of a part. returns the number of bytes consumed.
+ */
+static size_t _execHeader(
+	formParser_t *parser, const char *data, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	const char *nl = memchr(data, '\n', len);
+	size_t lineLen;
+
+	/* is the line complete */
+	if(nl == NULL)
+	{
+		if(parser->headerLen + len > FORM_HEADER_MAX)
+		{
+			parser->state = _STATE_ERROR;
+		}
+
+		return 0;
+	}
+
+	/* make sure the headers do not get too big */
+	parser->headerLen += nl - data + 1;
+
+	if(parser->headerLen > FORM_HEADER_MAX)
+	{
+		parser->state = _STATE_ERROR;
+
+		return 0;
+	}
+
+	/* remove the carriage return from the line */
+	lineLen = nl - data;
+
+	if(lineLen > 0 && data[lineLen - 1] == '\r')
+	{
+		--lineLen;
+	}
+
+	/* an empty line ends the headers */
+	if(lineLen == 0)
+	{
+		if(!_emit(parser, FORM_EVENT_PART, NULL, 0, callback, userData))
+		{
+			parser->state = _STATE_ERROR;
+
+			return 0;
+		}
+
+		parser->state = _STATE_BODY;
+	}
+	else if(!_parsePartHeader(parser, data, lineLen))
+	{
+		parser->state = _STATE_ERROR;
+
+		return 0;
+	}
+
+	return nl - data + 1;
+}
+
+/**
+ * handles the data of a part. returns the number of bytes consumed.
+ */
+static size_t _execBody(
+	formParser_t *parser, const char *data, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	int found;
+	size_t offset = _findDelimiter(parser, data, len, &found);
+
+	/* report the data in front of the delimiter */
+	if(offset > 0
+		&& !_emit(parser, FORM_EVENT_DATA, data, offset, callback, userData))
+	{
+		parser->state = _STATE_ERROR;
+
+		return 0;
+	}
+
+	/* is the part complete */
+	if(found)
+	{
+		if(!_emit(parser, FORM_EVENT_END, NULL, 0, callback, userData))
+		{
+			parser->state = _STATE_ERROR;
+
+			return 0;
+		}
+
+		parser->state = _STATE_DELIMITER;
+
+		return offset + parser->delimLen;
+	}
+
+	return offset;
+}
+
+/**
+ * parses multipart data. returns the number of bytes consumed.
+ */
+static size_t _execMultipart(
+	formParser_t *parser, const char *data, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	int found;
+	size_t used = 0, n = 0;
+
+	do
+	{
+		used += n;
+
+		switch(parser->state)
+		{
+			case _STATE_PREAMBLE:
+
+				/* skip everything up to the first delimiter */
+				n = _findDelimiter(parser, data + used, len - used, &found);
+
+				if(found)
+				{
+					n += parser->delimLen;
+					parser->state = _STATE_DELIMITER;
+				}
+
+				break;
+
+			case _STATE_DELIMITER:
+				n = _execDelimiter(parser, data + used, len - used);
+				break;
+
+			case _STATE_HEADER:
+				n = _execHeader(
+					parser, data + used, len - used, callback, userData
+				);
+				break;
+
+			case _STATE_BODY:
+				n = _execBody(
+					parser, data + used, len - used, callback, userData
+				);
+				break;
+
+			case _STATE_DONE:
+
+				/* the epilogue is ignored */
+				n = len - used;
+				break;
+
+			default:
+				n = 0;
+				break;
+		}
+	}
+	while(n > 0);
+
+	return used;
+}
+
+/**
+ * initializes the form parser for the given content type. supported are
+ * "application/x-www-form-urlencoded" and "multipart/form-data" with a
+ * boundary parameter. returns 1 if the content type is supported and 0 if
+ * not.
+ */
+int formInit(formParser_t *parser, const char *contentType)
+{
+	const char *cur, *end, *semicolon, *key, *val;
+	size_t typeLen, keyLen, valLen;
+
+	memset(parser, 0, sizeof(*parser));
+
+	end = contentType + strlen(contentType);
+
+	/* the media type is everything in front of the parameters */
+	semicolon = memchr(contentType, ';', end - contentType);
+	cur = contentType;
+	typeLen = (semicolon != NULL ? semicolon : end) - contentType;
+	_trim(&cur, &typeLen);
+
+	if(_equalsNoCase(cur, typeLen, "application/x-www-form-urlencoded"))
+	{
+		parser->type = FORM_URLENCODED;
+		parser->state = _STATE_FIELD;
+
+		return 1;
+	}
+	else if(_equalsNoCase(cur, typeLen, "multipart/form-data"))
+	{
+		/* find the boundary parameter */
+		while(_nextParam(&cur, end, &key, &keyLen, &val, &valLen))
+		{
+			if(_equalsNoCase(key, keyLen, "boundary")
+				&& valLen > 0 && valLen <= FORM_BOUNDARY_MAX)
+			{
+				parser->type = FORM_MULTIPART;
+				parser->state = _STATE_PREAMBLE;
+
+				/* the delimiter always starts on a new line */
+				memcpy(parser->delim, "\r\n--", 4);
+				memcpy(parser->delim + 4, val, valLen);
+				parser->delimLen = valLen + 4;
+
+				/* the first delimiter may be at the very beginning of the
+				 * data, pretend there was a line break in front of it */
+				return bufAppend(&(parser->pending), "\r\n", 2);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * feeds the given data into the form parser. the callback is invoked for
+ * every event found in the data. returns 1 if more data is required, 2 if the
+ * form is complete and 0 in case of an error.
+ */
+int formExec(
+	formParser_t *parser, const void *data, size_t len,
+	formCallback_t callback, void *userData
+)
+{
+	const char *cur = (const char*) data;
+	size_t curLen = len, used;
+
+	/* there is nothing to do after an error or after the end of the form */
+	if(parser->state == _STATE_ERROR || parser->state == _STATE_DONE)
+	{
+		return parser->state == _STATE_DONE ? 2 : 0;
+	}
+
+	/* data left over from the last call has to be parsed first */
+	if(bufHasData(&(parser->pending)))
+	{
+		if(!bufAppend(&(parser->pending), data, len))
+		{
+			parser->state = _STATE_ERROR;
+
+			return 0;
+		}
+
+		cur = (const char*) parser->pending.data;
+		curLen = parser->pending.len;
+	}
+
+	/* parse the data */
+	used = parser->type == FORM_URLENCODED
+		? _execUrlEncoded(parser, cur, curLen, callback, userData)
+		: _execMultipart(parser, cur, curLen, callback, userData);
+
+	if(parser->state == _STATE_ERROR)
+	{
+		bufClear(&(parser->pending));
+
+		return 0;
+	}
+
+	/* keep the data that was not consumed */
+	if(cur == (const char*) parser->pending.data)
+	{
+		bufConsume(&(parser->pending), used);
+	}
+	else if(!bufAppend(&(parser->pending), cur + used, curLen - used))
+	{
+		parser->state = _STATE_ERROR;
+
+		return 0;
+	}
+
+	return parser->state == _STATE_DONE ? 2 : 1;
+}
+
+/**
+ * tells the form parser that there is no more data. the last field of an
+ * urlencoded form is reported at this point. returns 2 if the form is
+ * complete and 0 if not.
+ */
+int formFinish(formParser_t *parser, formCallback_t callback, void *userData)
+{
+	/* the last field of an urlencoded form has no terminator */
+	if(parser->state == _STATE_FIELD)
+	{
+		if(_emitField(
+			parser,
+			(const char*) parser->pending.data,
+			parser->pending.len,
+			callback,
+			userData
+		))
+		{
+			parser->state = _STATE_DONE;
+		}
+		else
+		{
+			parser->state = _STATE_ERROR;
+		}
+
+		_resetScratch(&(parser->pending));
+	}
+
+	return parser->state == _STATE_DONE ? 2 : 0;
+}
+
+/**
+ * frees all resources of the form parser.
+ */
+void formClear(formParser_t *parser)
+{
+	bufClear(&(parser->pending));
+	bufClear(&(parser->name));
+	bufClear(&(parser->value));
+	bufClear(&(parser->mime));
+}
+
+/**
+ * parses the given query string (without the leading '?'). the callback is
+ * invoked for every field. returns 1 if everything is ok and 0 if not.
+ */
+int formParseQuery(
+	const void *data, size_t len, formCallback_t callback, void *userData
+)
+{
+	formParser_t parser;
+	int result;
+
+	/* use a temporary urlencoded parser */
+	memset(&parser, 0, sizeof(parser));
+	parser.type = FORM_URLENCODED;
+	parser.state = _STATE_FIELD;
+
+	/* parse everything at once */
+	result = formExec(&parser, data, len, callback, userData)
+		&& formFinish(&parser, callback, userData);
+
+	formClear(&parser);
+
+	return result;
+}
@@ -0,0 +1,433 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+
+/**
+ * defines a 32 bit unsigned integer. the compile time check below makes sure
+ * that unsigned int really has 32 bits.
+ */
+typedef unsigned int _u32;
+
+typedef char _checkU32[sizeof(_u32) == 4 ? 1 : -1];
+
+/**
+ * rotates the given 32 bit value to the left.
+ */
+#define _rotl(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * rotates the given 32 bit value to the right.
+ */
+#define _rotr(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * reads a big endian 32 bit value.
+ */
+#define _readBe32(p) ( \
+	((_u32) (p)[0] << 24) | ((_u32) (p)[1] << 16) \
+	| ((_u32) (p)[2] << 8) | (_u32) (p)[3] \
+)
+
+/**
+ * defines the round functions of sha-1.
+ */
+#define _sha1F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define _sha1F2(b, c, d) ((b) ^ (c) ^ (d))
+#define _sha1F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+/**
+ * performs one step of sha-1. instead of shifting the variables the caller
+ * rotates the arguments.
+ */
+#define _sha1Step(a, b, c, d, e, f, k, i) \
+	(e) += _rotl(a, 5) + f(b, c, d) + (k) + w[i]; \
+	(b) = _rotl(b, 30)
+
+/**
+ * defines the function signature of the block functions of the digests.
+ */
+typedef void (*_block_t)(_u32*, const unsigned char*);
+
+/**
+ * stores the lookup tables for the crc32c calculation (slicing by 8).
+ */
+static _u32 _crcTable[8][256];
+
+/**
+ * used to check whether the lookup tables are initialized.
+ */
+static int _crcTableReady = 0;
+
+/**
+ * defines the round constants of sha-256.
+ */
+static const _u32 _sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ * initializes the lookup tables for the crc32c calculation.
+ */
+static void _initCrcTable(void)
+{
+	_u32 crc;
+	int i, j;
+
+	/* the reflected castagnoli polynomial */
+	for(i=0;i<256;++i)
+	{
+		crc = (_u32) i;
+
+		for(j=0;j<8;++j)
+		{
+			crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+		}
+
+		_crcTable[0][i] = crc;
+	}
+
+	/* the tables for the following bytes of a 64 bit block */
+	for(i=0;i<256;++i)
+	{
+		for(j=1;j<8;++j)
+		{
+			_crcTable[j][i] = (_crcTable[j - 1][i] >> 8)
+				^ _crcTable[0][_crcTable[j - 1][i] & 0xff];
+		}
+	}
+
+	_crcTableReady = 1;
+}
+
+/**
+ * calculates the crc32c checksum with lookup tables, 8 bytes at a time.
+ */
+static _u32 _crc32cTable(_u32 crc, const unsigned char *src, size_t len)
+{
+	_u32 low, high;
+
+	if(!_crcTableReady)
+	{
+		_initCrcTable();
+	}
+
+	for(;len>=8;len-=8,src+=8)
+	{
+		low = crc ^ ((_u32) src[0] | ((_u32) src[1] << 8)
+			| ((_u32) src[2] << 16) | ((_u32) src[3] << 24));
+		high = (_u32) src[4] | ((_u32) src[5] << 8)
+			| ((_u32) src[6] << 16) | ((_u32) src[7] << 24);
+
+		crc = _crcTable[7][low & 0xff] ^ _crcTable[6][(low >> 8) & 0xff]
+			^ _crcTable[5][(low >> 16) & 0xff] ^ _crcTable[4][low >> 24]
+			^ _crcTable[3][high & 0xff] ^ _crcTable[2][(high >> 8) & 0xff]
+			^ _crcTable[1][(high >> 16) & 0xff] ^ _crcTable[0][high >> 24];
+	}
+
+	while(len-- > 0)
+	{
+		crc = (crc >> 8) ^ _crcTable[0][(crc ^ *src++) & 0xff];
+	}
+
+	return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+/**
+ * calculates the crc32c checksum with the crc32 instruction (sse4.2), 8 bytes
+ * at a time.
+ */
+__attribute__((target("sse4.2")))
+static _u32 _crc32cHw(_u32 crc, const unsigned char *src, size_t len)
+{
+	unsigned long crc64, word;
+
+	/* align the data for the 64 bit loads */
+	for(;len>0 && ((size_t) src & 7) != 0;--len)
+	{
+		crc = __builtin_ia32_crc32qi(crc, *src++);
+	}
+
+	for(crc64=crc;len>=8;len-=8,src+=8)
+	{
+		memcpy(&word, src, 8);
+		crc64 = __builtin_ia32_crc32di(crc64, word);
+	}
+
+	for(crc=(_u32)crc64;len>0;--len)
+	{
+		crc = __builtin_ia32_crc32qi(crc, *src++);
+	}
+
+	return crc;
+}
+
+#endif
+
+/**
+ * updates the given crc32c (castagnoli) checksum with the data and returns
+ * the new checksum. the initial checksum is 0. uses the crc32 instruction of
+ * the cpu if it is available.
+ */
+unsigned long hashCrc32c(unsigned long crc, const void *data, size_t len)
+{
+	/* the checksum is stored inverted while calculating */
+	_u32 value = ~((_u32) crc);
+
+#if defined(__GNUC__) && defined(__x86_64__)
+	if(__builtin_cpu_supports("sse4.2"))
+	{
+		return ~_crc32cHw(value, (const unsigned char*) data, len);
+	}
+#endif
+
+	return ~_crc32cTable(value, (const unsigned char*) data, len);
+}
+
+/**
+ * processes one 64 byte block of sha-1.
+ */
+static void _sha1Block(_u32 *h, const unsigned char *block)
+{
+	_u32 w[80], a, b, c, d, e, t;
+	int i;
+
+	for(i=0;i<16;++i)
+	{
+		w[i] = _readBe32(block + i * 4);
+	}
+
+	for(;i<80;++i)
+	{
+		t = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+		w[i] = _rotl(t, 1);
+	}
+
+	a = h[0];
+	b = h[1];
+	c = h[2];
+	d = h[3];
+	e = h[4];
+
+	/* the four rounds differ in their function and constant. the steps are
+	 * unrolled 5 times, so the variables rotate instead of being copied. */
+	for(i=0;i<20;i+=5)
+	{
+		_sha1Step(a, b, c, d, e, _sha1F1, 0x5a827999, i);
+		_sha1Step(e, a, b, c, d, _sha1F1, 0x5a827999, i + 1);
+		_sha1Step(d, e, a, b, c, _sha1F1, 0x5a827999, i + 2);
+		_sha1Step(c, d, e, a, b, _sha1F1, 0x5a827999, i + 3);
+		_sha1Step(b, c, d, e, a, _sha1F1, 0x5a827999, i + 4);
+	}
+
+	for(;i<40;i+=5)
+	{
+		_sha1Step(a, b, c, d, e, _sha1F2, 0x6ed9eba1, i);
+		_sha1Step(e, a, b, c, d, _sha1F2, 0x6ed9eba1, i + 1);
+		_sha1Step(d, e, a, b, c, _sha1F2, 0x6ed9eba1, i + 2);
+		_sha1Step(c, d, e, a, b, _sha1F2, 0x6ed9eba1, i + 3);
+		_sha1Step(b, c, d, e, a, _sha1F2, 0x6ed9eba1, i + 4);
+	}
+
+	for(;i<60;i+=5)
+	{
+		_sha1Step(a, b, c, d, e, _sha1F3, 0x8f1bbcdc, i);
+		_sha1Step(e, a, b, c, d, _sha1F3, 0x8f1bbcdc, i + 1);
+		_sha1Step(d, e, a, b, c, _sha1F3, 0x8f1bbcdc, i + 2);
+		_sha1Step(c, d, e, a, b, _sha1F3, 0x8f1bbcdc, i + 3);
+		_sha1Step(b, c, d, e, a, _sha1F3, 0x8f1bbcdc, i + 4);
+	}
+
+	for(;i<80;i+=5)
+	{
+		_sha1Step(a, b, c, d, e, _sha1F2, 0xca62c1d6, i);
+		_sha1Step(e, a, b, c, d, _sha1F2, 0xca62c1d6, i + 1);
+		_sha1Step(d, e, a, b, c, _sha1F2, 0xca62c1d6, i + 2);
+		_sha1Step(c, d, e, a, b, _sha1F2, 0xca62c1d6, i + 3);
+		_sha1Step(b, c, d, e, a, _sha1F2, 0xca62c1d6, i + 4);
+	}
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+/**
+ * processes one 64 byte block of sha-256.
+ */
+static void _sha256Block(_u32 *h, const unsigned char *block)
+{
+	_u32 w[64], s[8], t1, t2;
+	int i;
+
+	for(i=0;i<16;++i)
+	{
+		w[i] = _readBe32(block + i * 4);
+	}
+
+	for(;i<64;++i)
+	{
+		t1 = _rotr(w[i - 2], 17) ^ _rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		t2 = _rotr(w[i - 15], 7) ^ _rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		w[i] = t1 + w[i - 7] + t2 + w[i - 16];
+	}
+
+	memcpy(s, h, sizeof(s));
+
+	for(i=0;i<64;++i)
+	{
+		t1 = s[7] + (_rotr(s[4], 6) ^ _rotr(s[4], 11) ^ _rotr(s[4], 25))
+			+ (s[6] ^ (s[4] & (s[5] ^ s[6]))) + _sha256K[i] + w[i];
+		t2 = (_rotr(s[0], 2) ^ _rotr(s[0], 13) ^ _rotr(s[0], 22))
+			+ ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+
+		s[7] = s[6];
+		s[6] = s[5];
+		s[5] = s[4];
+		s[4] = s[3] + t1;
+		s[3] = s[2];
+		s[2] = s[1];
+		s[1] = s[0];
+		s[0] = t1 + t2;
+	}
+
+	for(i=0;i<8;++i)
+	{
+		h[i] += s[i];
+	}
+}
+
+/**
+ * runs the merkle-damgard construction shared by sha-1 and sha-256 over the
+ * data and stores the given number of state words big endian in the dest.
+ */
+static void _digest(
+	_block_t block, _u32 *h, int words, const void *data, size_t len,
+	unsigned char *dest
+)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned char tail[128];
+	size_t rest, tailLen, i;
+
+	/* full blocks are processed directly from the data */
+	for(i=0;i+64<=len;i+=64)
+	{
+		block(h, src + i);
+	}
+
+	/* pad the remaining data with 0x80, zeros and the length in bits */
+	rest = len - i;
+	tailLen = rest < 56 ? 64 : 128;
+
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, src + i, rest);
+	tail[rest] = 0x80;
+
+	/* the length in bits as 64 bit big endian value (the size_t is split
+	 * because it may have only 32 bits) */
+	tail[tailLen - 1] = (unsigned char) (len << 3);
+	tail[tailLen - 2] = (unsigned char) (len >> 5);
+	tail[tailLen - 3] = (unsigned char) (len >> 13);
+	tail[tailLen - 4] = (unsigned char) (len >> 21);
+	tail[tailLen - 5] = (unsigned char) ((len >> 29) & 0xff);
+	tail[tailLen - 6] = (unsigned char) ((len >> 16 >> 21) & 0xff);
+	tail[tailLen - 7] = (unsigned char) ((len >> 16 >> 29) & 0xff);
+	tail[tailLen - 8] = (unsigned char) ((len >> 16 >> 16 >> 21) & 0xff);
+
+	block(h, tail);
+
+	if(tailLen == 128)
+	{
+		block(h, tail + 64);
+	}
+
+	/* store the state big endian */
+	for(i=0;i<(size_t) words;++i)
+	{
+		dest[i * 4] = (unsigned char) (h[i] >> 24);
+		dest[i * 4 + 1] = (unsigned char) (h[i] >> 16);
+		dest[i * 4 + 2] = (unsigned char) (h[i] >> 8);
+		dest[i * 4 + 3] = (unsigned char) h[i];
+	}
+}
+
+/**
+ * computes the sha-1 digest of the given data and stores it in the third
+ * parameter, which must be able to hold HASH_SHA1_SIZE bytes.
+ */
+void hashSha1(const void *data, size_t len, unsigned char *dest)
+{
+	_u32 h[5];
+
+	h[0] = 0x67452301;
+	h[1] = 0xefcdab89;
+	h[2] = 0x98badcfe;
+	h[3] = 0x10325476;
+	h[4] = 0xc3d2e1f0;
+
+	_digest(_sha1Block, h, 5, data, len, dest);
+}
+
+/**
+ * computes the sha-256 digest of the given data and stores it in the third
+ * parameter, which must be able to hold HASH_SHA256_SIZE bytes.
+ */
+void hashSha256(const void *data, size_t len, unsigned char *dest)
+{
+	_u32 h[8];
+
+	h[0] = 0x6a09e667;
+	h[1] = 0xbb67ae85;
+	h[2] = 0x3c6ef372;
+	h[3] = 0xa54ff53a;
+	h[4] = 0x510e527f;
+	h[5] = 0x9b05688c;
+	h[6] = 0x1f83d9ab;
+	h[7] = 0x5be0cd19;
+
+	_digest(_sha256Block, h, 8, data, len, dest);
+}
@@ -0,0 +1,719 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * defines the number of entries of the static table.
+ */
+#define _STATIC_COUNT (61)
+
+/**
+ * defines the number of symbols of the huffman code (256 is end of string).
+ */
+#define _HUFFMAN_SYMBOLS (257)
+
+/**
+ * defines the maximum length of a huffman code.
+ */
+#define _HUFFMAN_LEN_MAX (30)
+
+/**
+ * defines the largest integer accepted by the decoder.
+ */
+#define _INT_MAX (1UL << 28)
+
+/**
+ * gets the entry with the given index of the dynamic table (0 is the newest
+ * entry).
+ */
+#define _dynamicEntry(d, i) \
+	((d)->entries + ((d)->first + (i)) % HPACK_ENTRIES_MAX)
+
+/**
+ * defines the structure of an entry of the static table.
+ */
+typedef struct {
+
+	const char *name;
+	const char *value;
+
+} _staticEntry_t;
+
+/**
+ * defines the static table (see rfc 7541, appendix a).
+ */
+static const _staticEntry_t _staticTable[_STATIC_COUNT] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""}
+};
+
+/**
+ * defines the length of the huffman code of every symbol (see rfc 7541,
+ * appendix b). the code is canonical, so the codes follow from the lengths.
+ */
+static const unsigned char _huffmanLengths[_HUFFMAN_SYMBOLS] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30
+};
+
+/**
+ * stores the first code, the number of codes and the offset into the sorted
+ * symbols for every code length.
+ */
+static unsigned long _huffmanFirst[_HUFFMAN_LEN_MAX + 1];
+static unsigned int _huffmanCount[_HUFFMAN_LEN_MAX + 1];
+static unsigned int _huffmanOffset[_HUFFMAN_LEN_MAX + 1];
+
+/**
+ * stores the symbols sorted by the length of their code.
+ */
+static unsigned short _huffmanSymbols[_HUFFMAN_SYMBOLS];
+
+/**
+ * used to check whether the huffman tables are initialized.
+ */
+static int _huffmanReady = 0;
+
+/**
+ * initializes the tables of the canonical huffman decoder.
+ */
+static void _initHuffman(void)
+{
+	unsigned long code = 0;
+	unsigned int len, n = 0, i;
+
+	for(len=1;len<=_HUFFMAN_LEN_MAX;++len)
+	{
+		/* the codes of every length follow the codes of the shorter ones */
+		_huffmanFirst[len] = code;
+		_huffmanOffset[len] = n;
+		_huffmanCount[len] = 0;
+
+		for(i=0;i<_HUFFMAN_SYMBOLS;++i)
+		{
+			if(_huffmanLengths[i] == len)
+			{
+				_huffmanSymbols[n++] = (unsigned short) i;
+				++_huffmanCount[len];
+			}
+		}
+
+		code = (code + _huffmanCount[len]) << 1;
+	}
+
+	_huffmanReady = 1;
+}
+
+/**
+ * decodes the given huffman encoded string and appends it to the buffer.
+ * returns 1 if everything is ok and 0 if not.
+ */
+static int _decodeHuffman(buf_t *dst, const unsigned char *src, size_t len)
+{
+	unsigned char tmp[256];
+	unsigned long code = 0, index;
+	unsigned int bits = 0, n = 0;
+	size_t i;
+	int bit;
+
+	if(!_huffmanReady)
+	{
+		_initHuffman();
+	}
+
+	for(i=0;i<len;++i)
+	{
+		for(bit=7;bit>=0;--bit)
+		{
+			code = (code << 1) | ((src[i] >> bit) & 1);
+			++bits;
+
+			/* is the code complete */
+			index = code - _huffmanFirst[bits];
+
+			if(code >= _huffmanFirst[bits] && index < _huffmanCount[bits])
+			{
+				/* the end of string symbol must not be encoded */
+				if(_huffmanSymbols[_huffmanOffset[bits] + index] == 256)
+				{
+					return 0;
+				}
+
+				tmp[n++] = (unsigned char)
+					_huffmanSymbols[_huffmanOffset[bits] + index];
+
+				code = 0;
+				bits = 0;
+
+				if(n == sizeof(tmp))
+				{
+					if(!bufAppend(dst, tmp, n))
+					{
+						return 0;
+					}
+
+					n = 0;
+				}
+			}
+			else if(bits >= _HUFFMAN_LEN_MAX)
+			{
+				return 0;
+			}
+		}
+	}
+
+	/* the padding are at most 7 bits of the end of string code (all ones) */
+	if(bits > 7 || code != (1UL << bits) - 1)
+	{
+		return 0;
+	}
+
+	return n == 0 || bufAppend(dst, tmp, n);
+}
+
+/**
+ * decodes an integer with the given prefix size. returns 1 if everything is
+ * ok and 0 if not.
+ */
+static int _decodeInt(
+	const unsigned char *src, size_t len, size_t *pos, int prefix,
+	unsigned long *value
+)
+{
+	unsigned long max = (1UL << prefix) - 1;
+	unsigned int shift = 0;
+
+	*value = src[(*pos)++] & max;
+
+	if(*value < max)
+	{
+		return 1;
+	}
+
+	/* the value continues with 7 bits per byte */
+	while(*pos < len)
+	{
+		*value += (unsigned long) (src[*pos] & 0x7f) << shift;
+		shift += 7;
+
+		if(*value > _INT_MAX || shift > 28)
+		{
+			return 0;
+		}
+
+		if((src[(*pos)++] & 0x80) == 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * decodes a string. the result points either into the source or into the
+ * given buffer (for huffman encoded strings). returns 1 if everything is ok
+ * and 0 if not.
+ */
+static int _decodeString(
+	const unsigned char *src, size_t len, size_t *pos, buf_t *buf,
+	const char **str, size_t *strLen
+)
+{
+	unsigned long n;
+	int huffman;
+
+	if(*pos >= len)
+	{
+		return 0;
+	}
+
+	huffman = (src[*pos] & 0x80) != 0;
+
+	if(!_decodeInt(src, len, pos, 7, &n) || n > len - *pos)
+	{
+		return 0;
+	}
+
+	if(huffman)
+	{
+		bufConsume(buf, buf->len);
+
+		if(!_decodeHuffman(buf, src + *pos, n))
+		{
+			return 0;
+		}
+
+		*str = buf->len > 0 ? (const char*) buf->data : "";
+		*strLen = buf->len;
+	}
+	else
+	{
+		*str = (const char*) src + *pos;
+		*strLen = n;
+	}
+
+	*pos += n;
+
+	return 1;
+}
+
+/**
+ * removes the oldest entries of the dynamic table until its size does not
+ * exceed the given size.
+ */
+static void _evict(hpackDecoder_t *decoder, size_t size)
+{
+	hpackEntry_t *entry;
+
+	while(decoder->count > 0 && decoder->size > size)
+	{
+		entry = _dynamicEntry(decoder, decoder->count - 1);
+
+		decoder->size -= entry->nameLen + entry->valueLen + 32;
+		--decoder->count;
+
+		free(entry->data);
+		entry->data = NULL;
+	}
+}
+
+/**
+ * inserts the given header field into the dynamic table. returns 1 if
+ * everything is ok and 0 if not.
+ */
+static int _insert(
+	hpackDecoder_t *decoder, const char *name, size_t nameLen,
+	const char *value, size_t valueLen
+)
+{
+	size_t size = nameLen + valueLen + 32;
+	hpackEntry_t *entry;
+	char *data;
+
+	/* an entry larger than the table empties it */
+	if(size > decoder->maxSize)
+	{
+		_evict(decoder, 0);
+
+		return 1;
+	}
+
+	/* make room for the new entry. the caller makes sure that the name and
+	 * the value do not point into an evicted entry. */
+	_evict(decoder, decoder->maxSize - size);
+
+	if((data = (char*) malloc(nameLen + valueLen + 1)) == NULL)
+	{
+		return 0;
+	}
+
+	memcpy(data, name, nameLen);
+	memcpy(data + nameLen, value, valueLen);
+
+	/* the new entry becomes the first one */
+	decoder->first = (decoder->first + HPACK_ENTRIES_MAX - 1)
+		% HPACK_ENTRIES_MAX;
+	++decoder->count;
+	decoder->size += size;
+
+	entry = _dynamicEntry(decoder, 0);
+	entry->data = data;
+	entry->nameLen = nameLen;
+	entry->valueLen = valueLen;
+
+	return 1;
+}
+
+/**
+ * looks up the given index of the static and dynamic table. returns 1 if the
+ * index exists and 0 if not.
+ */
+static int _lookup(
+	hpackDecoder_t *decoder, unsigned long index, const char **name,
+	size_t *nameLen, const char **value, size_t *valueLen
+)
+{
+	hpackEntry_t *entry;
+
+	if(index == 0)
+	{
+		return 0;
+	}
+
+	if(index <= _STATIC_COUNT)
+	{
+		*name = _staticTable[index - 1].name;
+		*nameLen = strlen(*name);
+		*value = _staticTable[index - 1].value;
+		*valueLen = strlen(*value);
+
+		return 1;
+	}
+
+	index -= _STATIC_COUNT + 1;
+
+	if(index >= decoder->count)
+	{
+		return 0;
+	}
+
+	entry = _dynamicEntry(decoder, index);
+
+	*name = entry->data;
+	*nameLen = entry->nameLen;
+	*value = entry->data + entry->nameLen;
+	*valueLen = entry->valueLen;
+
+	return 1;
+}
+
+/**
+ * initializes the given hpack decoder.
+ */
+void hpackInit(hpackDecoder_t *decoder)
+{
+	memset(decoder, 0, sizeof(*decoder));
+
+	decoder->maxSize = HPACK_TABLE_SIZE;
+}
+
+/**
+ * decodes the given header block and invokes the callback for every header
+ * field. returns 1 if everything is ok and 0 if the block is invalid (this is
+ * a connection error, the state of the decoder is undefined afterwards).
+ */
+int hpackDecode(
+	hpackDecoder_t *decoder, const void *data, size_t len,
+	hpackCallback_t callback, void *userData
+)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	const char *name, *value;
+	size_t pos = 0, nameLen, valueLen;
+	unsigned long index;
+	int fields = 0, prefix;
+	unsigned char type;
+
+	while(pos < len)
+	{
+		type = src[pos];
+
+		/* indexed header field */
+		if(type & 0x80)
+		{
+			if(!_decodeInt(src, len, &pos, 7, &index)
+				|| !_lookup(
+					decoder, index, &name, &nameLen, &value, &valueLen
+				))
+			{
+				return 0;
+			}
+		}
+		/* dynamic table size update, only allowed before the first field */
+		else if((type & 0xe0) == 0x20)
+		{
+			if(fields > 0 || !_decodeInt(src, len, &pos, 5, &index)
+				|| index > HPACK_TABLE_SIZE)
+			{
+				return 0;
+			}
+
+			decoder->maxSize = (size_t) index;
+			_evict(decoder, decoder->maxSize);
+
+			continue;
+		}
+		/* literal header field (with incremental indexing, without indexing
+		 * or never indexed) */
+		else
+		{
+			prefix = (type & 0x40) ? 6 : 4;
+
+			if(!_decodeInt(src, len, &pos, prefix, &index))
+			{
+				return 0;
+			}
+
+			/* the name is either indexed or a literal */
+			if(index > 0)
+			{
+				if(!_lookup(
+					decoder, index, &name, &nameLen, &value, &valueLen
+				))
+				{
+					return 0;
+				}
+
+				/* copy indexed names, the insert could evict them */
+				if(prefix == 6)
+				{
+					bufConsume(&(decoder->name), decoder->name.len);
+
+					if(nameLen > 0
+						&& !bufAppend(&(decoder->name), name, nameLen))
+					{
+						return 0;
+					}
+
+					name = nameLen > 0 ? (const char*) decoder->name.data : "";
+				}
+			}
+			else if(!_decodeString(
+				src, len, &pos, &(decoder->name), &name, &nameLen
+			))
+			{
+				return 0;
+			}
+
+			if(!_decodeString(
+				src, len, &pos, &(decoder->value), &value, &valueLen
+			))
+			{
+				return 0;
+			}
+
+			if(prefix == 6
+				&& !_insert(decoder, name, nameLen, value, valueLen))
+			{
+				return 0;
+			}
+		}
+
+		++fields;
+
+		if(!callback(name, nameLen, value, valueLen, userData))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * appends an integer with the given prefix size and the bits of the first
+ * byte to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+static int _encodeInt(
+	buf_t *buf, unsigned char bits, int prefix, unsigned long value
+)
+{
+	unsigned long max = (1UL << prefix) - 1;
+	unsigned char tmp[8];
+	size_t n = 1;
+
+	if(value < max)
+	{
+		tmp[0] = (unsigned char) (bits | value);
+
+		return bufAppend(buf, tmp, 1);
+	}
+
+	tmp[0] = (unsigned char) (bits | max);
+
+	for(value-=max;value>=0x80;value>>=7)
+	{
+		tmp[n++] = (unsigned char) (0x80 | (value & 0x7f));
+	}
+
+	tmp[n++] = (unsigned char) value;
+
+	return bufAppend(buf, tmp, n);
+}
+
+/**
+ * copies the given name converted to lower case into the destination.
+ */
+static void _toLower(char *dst, const char *src, size_t len)
+{
+	size_t i;
+
+	for(i=0;i<len;++i)
+	{
+		dst[i] = (src[i] >= 'A' && src[i] <= 'Z')
+			? (char) (src[i] + ('a' - 'A')) : src[i];
+	}
+}
+
+/**
+ * appends the given header field to the buffer (without using the dynamic
+ * table). returns 1 if everything is ok and 0 if not.
+ */
+int hpackEncode(
+	buf_t *buf, const char *name, size_t nameLen, const char *value,
+	size_t valueLen
+)
+{
+	unsigned long index = 0;
+	char lower[64];
+	size_t i, n;
+
+	/* look for the name (and the value) in the static table, all of its
+	 * names are shorter than the temporary buffer */
+	if(nameLen <= sizeof(lower))
+	{
+		_toLower(lower, name, nameLen);
+
+		for(i=0;i<_STATIC_COUNT;++i)
+		{
+			if(strlen(_staticTable[i].name) != nameLen
+				|| memcmp(_staticTable[i].name, lower, nameLen) != 0)
+			{
+				continue;
+			}
+
+			if(strlen(_staticTable[i].value) == valueLen
+				&& memcmp(_staticTable[i].value, value, valueLen) == 0)
+			{
+				return _encodeInt(buf, 0x80, 7, (unsigned long) i + 1);
+			}
+
+			if(index == 0)
+			{
+				index = (unsigned long) i + 1;
+			}
+		}
+	}
+
+	/* literal header field without indexing */
+	if(!_encodeInt(buf, 0x00, 4, index))
+	{
+		return 0;
+	}
+
+	/* names must be lower case in http/2 */
+	if(index == 0)
+	{
+		if(!_encodeInt(buf, 0x00, 7, (unsigned long) nameLen))
+		{
+			return 0;
+		}
+
+		for(i=0;i<nameLen;i+=n)
+		{
+			n = nameLen - i < sizeof(lower) ? nameLen - i : sizeof(lower);
+
+			_toLower(lower, name + i, n);
+
+			if(!bufAppend(buf, lower, n))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return _encodeInt(buf, 0x00, 7, (unsigned long) valueLen)
+		&& (valueLen == 0 || bufAppend(buf, value, valueLen));
+}
+
+/**
+ * frees the resources of the given hpack decoder.
+ */
+void hpackClear(hpackDecoder_t *decoder)
+{
+	_evict(decoder, 0);
+
+	bufClear(&(decoder->name));
+	bufClear(&(decoder->value));
+}
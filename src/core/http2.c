@@ -0,0 +1,1479 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+
+/**
+ * defines the client connection preface.
+ */
+#define _PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define _PREFACE_LEN (sizeof(_PREFACE) - 1)
+
+/**
+ * defines the size of a frame header.
+ */
+#define _HEADER_SIZE (9)
+
+/**
+ * defines the frame types.
+ */
+#define _DATA (0x0)
+#define _HEADERS (0x1)
+#define _PRIORITY (0x2)
+#define _RST_STREAM (0x3)
+#define _SETTINGS (0x4)
+#define _PUSH_PROMISE (0x5)
+#define _PING (0x6)
+#define _GOAWAY (0x7)
+#define _WINDOW_UPDATE (0x8)
+#define _CONTINUATION (0x9)
+
+/**
+ * defines the frame flags.
+ */
+#define _FLAG_END_STREAM (0x1)
+#define _FLAG_ACK (0x1)
+#define _FLAG_END_HEADERS (0x4)
+#define _FLAG_PADDED (0x8)
+#define _FLAG_PRIORITY (0x20)
+
+/**
+ * defines the settings.
+ */
+#define _SETTINGS_ENABLE_PUSH (0x2)
+#define _SETTINGS_MAX_CONCURRENT_STREAMS (0x3)
+#define _SETTINGS_INITIAL_WINDOW_SIZE (0x4)
+#define _SETTINGS_MAX_FRAME_SIZE (0x5)
+#define _SETTINGS_MAX_HEADER_LIST_SIZE (0x6)
+
+/**
+ * defines the largest flow control window.
+ */
+#define _WINDOW_MAX (0x7fffffffL)
+
+/**
+ * defines the states of a connection.
+ */
+#define _STATE_PREFACE (0)
+#define _STATE_SETTINGS (1)
+#define _STATE_OPEN (2)
+#define _STATE_CLOSED (3)
+
+/**
+ * used by the frame handlers to indicate that the processing should stop
+ * without sending GOAWAY (the callback stopped it or there is no memory).
+ */
+#define _ABORT (-1)
+
+/**
+ * reads a big endian 32 bit value.
+ */
+#define _readUint32(p) ( \
+	((unsigned long) (p)[0] << 24) | ((unsigned long) (p)[1] << 16) \
+	| ((unsigned long) (p)[2] << 8) | (unsigned long) (p)[3] \
+)
+
+/**
+ * defines the structure of a received frame.
+ */
+typedef struct {
+
+	/* stores the type, the flags and the stream of the frame */
+	int type, flags;
+	unsigned long stream;
+
+	/* stores the payload */
+	const unsigned char *payload;
+	size_t len;
+
+} _frame_t;
+
+/**
+ * defines the data used while decoding a header block.
+ */
+typedef struct {
+
+	/* stores the connection */
+	h2Conn_t *conn;
+
+	/* stores the size of the header list (see SETTINGS_MAX_HEADER_LIST_SIZE) */
+	size_t size;
+
+} _collector_t;
+
+/**
+ * stores a 32 bit value big endian.
+ */
+static void _writeUint32(unsigned char *dst, unsigned long value)
+{
+	dst[0] = (unsigned char) (value >> 24);
+	dst[1] = (unsigned char) (value >> 16);
+	dst[2] = (unsigned char) (value >> 8);
+	dst[3] = (unsigned char) value;
+}
+
+/**
+ * stores a frame header.
+ */
+static void _setHeader(
+	unsigned char *dst, size_t len, int type, int flags, unsigned long stream
+)
+{
+	dst[0] = (unsigned char) (len >> 16);
+	dst[1] = (unsigned char) (len >> 8);
+	dst[2] = (unsigned char) len;
+	dst[3] = (unsigned char) type;
+	dst[4] = (unsigned char) flags;
+
+	_writeUint32(dst + 5, stream);
+}
+
+/**
+ * appends a frame to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+static int _writeFrame(
+	buf_t *buf, int type, int flags, unsigned long stream, const void *data,
+	size_t len
+)
+{
+	unsigned char header[_HEADER_SIZE];
+	size_t start = buf->len;
+
+	_setHeader(header, len, type, flags, stream);
+
+	if(bufAppend(buf, header, sizeof(header))
+		&& (len == 0 || bufAppend(buf, data, len)))
+	{
+		return 1;
+	}
+
+	buf->len = start;
+
+	return 0;
+}
+
+/**
+ * appends a frame with a 32 bit value as payload (RST_STREAM and
+ * WINDOW_UPDATE) to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+static int _writeUintFrame(
+	buf_t *buf, int type, unsigned long stream, unsigned long value
+)
+{
+	unsigned char payload[4];
+
+	_writeUint32(payload, value);
+
+	return _writeFrame(buf, type, 0, stream, payload, sizeof(payload));
+}
+
+/**
+ * appends the settings of the server to the buffer. returns 1 if everything
+ * is ok and 0 if not.
+ */
+static int _writeSettings(buf_t *buf)
+{
+	unsigned char payload[12];
+
+	payload[0] = 0;
+	payload[1] = _SETTINGS_MAX_CONCURRENT_STREAMS;
+	_writeUint32(payload + 2, H2_STREAMS_MAX);
+
+	payload[6] = 0;
+	payload[7] = _SETTINGS_MAX_HEADER_LIST_SIZE;
+	_writeUint32(payload + 8, H2_HEADER_LIST_MAX);
+
+	return _writeFrame(buf, _SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+/**
+ * returns the stream with the given id or null if it is not open.
+ */
+static h2Stream_t *_findStream(h2Conn_t *conn, unsigned long id)
+{
+	int i;
+
+	for(i=0;i<H2_STREAMS_MAX;++i)
+	{
+		if(conn->streams[i].id == id)
+		{
+			return conn->streams + i;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * opens a new stream with the given id. returns null if there are too many
+ * open streams.
+ */
+static h2Stream_t *_openStream(h2Conn_t *conn, unsigned long id)
+{
+	h2Stream_t *stream = _findStream(conn, 0);
+
+	if(stream != NULL)
+	{
+		stream->id = id;
+		stream->sendWindow = conn->initialWindow;
+		stream->recvWindow = H2_WINDOW;
+		stream->remoteClosed = 0;
+		stream->localClosed = 0;
+		stream->pendingEnd = 0;
+	}
+
+	return stream;
+}
+
+/**
+ * removes the given stream, the slot can be reused afterwards.
+ */
+static void _removeStream(h2Stream_t *stream)
+{
+	bufClear(&(stream->pending));
+
+	stream->id = 0;
+}
+
+/**
+ * removes the given stream if both sides ended it.
+ */
+static void _checkStream(h2Stream_t *stream)
+{
+	if(stream->remoteClosed && stream->localClosed)
+	{
+		_removeStream(stream);
+	}
+}
+
+/**
+ * resets the given stream. returns 0 if everything is ok and _ABORT if not.
+ */
+static int _resetStream(
+	h2Conn_t *conn, buf_t *oBuf, unsigned long id, h2Error_t code
+)
+{
+	h2Stream_t *stream = _findStream(conn, id);
+
+	if(stream != NULL)
+	{
+		_removeStream(stream);
+	}
+
+	return _writeUintFrame(oBuf, _RST_STREAM, id, (unsigned long) code)
+		? 0 : _ABORT;
+}
+
+/**
+ * sends as much of the given data as the flow control windows allow. if end
+ * is set the last frame ends the stream. returns the number of bytes sent or
+ * (size_t) -1 if the buffer could not be written.
+ */
+static size_t _sendData(
+	h2Conn_t *conn, h2Stream_t *stream, buf_t *buf, const char *data,
+	size_t len, int end
+)
+{
+	size_t sent = 0, n;
+	long allowed;
+
+	/* an empty frame does not need any window */
+	if(len == 0)
+	{
+		return !end || _writeFrame(
+			buf, _DATA, _FLAG_END_STREAM, stream->id, NULL, 0
+		) ? 0 : (size_t) -1;
+	}
+
+	while(sent < len)
+	{
+		allowed = conn->sendWindow < stream->sendWindow
+			? conn->sendWindow : stream->sendWindow;
+
+		if(allowed <= 0)
+		{
+			break;
+		}
+
+		n = len - sent;
+		n = n < conn->maxFrame ? n : conn->maxFrame;
+		n = n < (size_t) allowed ? n : (size_t) allowed;
+
+		if(!_writeFrame(
+			buf, _DATA, end && sent + n == len ? _FLAG_END_STREAM : 0,
+			stream->id, data + sent, n
+		))
+		{
+			return (size_t) -1;
+		}
+
+		conn->sendWindow -= (long) n;
+		stream->sendWindow -= (long) n;
+		sent += n;
+	}
+
+	return sent;
+}
+
+/**
+ * sends the pending data of the given stream as far as the flow control
+ * windows allow. returns 1 if everything is ok and 0 if not.
+ */
+static int _flushStream(h2Conn_t *conn, h2Stream_t *stream, buf_t *buf)
+{
+	size_t sent;
+
+	if(stream->pending.len == 0 && !stream->pendingEnd)
+	{
+		return 1;
+	}
+
+	sent = _sendData(
+		conn, stream, buf, (const char*) stream->pending.data,
+		stream->pending.len, stream->pendingEnd
+	);
+
+	if(sent == (size_t) -1)
+	{
+		return 0;
+	}
+
+	bufConsume(&(stream->pending), sent);
+
+	/* everything is sent, the last frame ended the stream */
+	if(stream->pending.len == 0 && stream->pendingEnd)
+	{
+		stream->pendingEnd = 0;
+		stream->localClosed = 1;
+
+		_checkStream(stream);
+	}
+
+	return 1;
+}
+
+/**
+ * sends the pending data of all streams. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _flushAll(h2Conn_t *conn, buf_t *buf)
+{
+	int i;
+
+	for(i=0;i<H2_STREAMS_MAX && conn->sendWindow>0;++i)
+	{
+		if(conn->streams[i].id != 0
+			&& !_flushStream(conn, conn->streams + i, buf))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * applies the given settings of the client. returns 0 if everything is ok
+ * and an error code if not.
+ */
+static int _applySettings(
+	h2Conn_t *conn, const unsigned char *data, size_t len
+)
+{
+	unsigned long value;
+	long delta;
+	size_t i;
+	int j;
+
+	if(len % 6 != 0)
+	{
+		return H2_FRAME_SIZE_ERROR;
+	}
+
+	for(i=0;i<len;i+=6)
+	{
+		value = _readUint32(data + i + 2);
+
+		switch((data[i] << 8) | data[i + 1])
+		{
+			case _SETTINGS_ENABLE_PUSH:
+				if(value > 1)
+				{
+					return H2_PROTOCOL_ERROR;
+				}
+
+				break;
+
+			case _SETTINGS_INITIAL_WINDOW_SIZE:
+				if(value > (unsigned long) _WINDOW_MAX)
+				{
+					return H2_FLOW_CONTROL_ERROR;
+				}
+
+				/* the change applies to all open streams */
+				delta = (long) value - conn->initialWindow;
+				conn->initialWindow = (long) value;
+
+				for(j=0;j<H2_STREAMS_MAX;++j)
+				{
+					if(conn->streams[j].id == 0)
+					{
+						continue;
+					}
+
+					if(delta > 0
+						&& conn->streams[j].sendWindow > _WINDOW_MAX - delta)
+					{
+						return H2_FLOW_CONTROL_ERROR;
+					}
+
+					conn->streams[j].sendWindow += delta;
+				}
+
+				break;
+
+			case _SETTINGS_MAX_FRAME_SIZE:
+				if(value < 16384 || value > 16777215)
+				{
+					return H2_PROTOCOL_ERROR;
+				}
+
+				conn->maxFrame = (size_t) value;
+				break;
+
+			default:
+				/* unknown settings and settings that do not affect the
+				 * server are ignored */
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * stores a decoded header field in the fields buffer, the lengths are
+ * followed by the name and the value.
+ */
+static int _collectField(
+	const char *name, size_t nameLen, const char *value, size_t valueLen,
+	void *userData
+)
+{
+	_collector_t *collector = (_collector_t*) userData;
+	buf_t *fields = &(collector->conn->fields);
+	size_t lens[2];
+
+	/* fields exceeding the limit are decoded but not stored */
+	collector->size += nameLen + valueLen + 32;
+
+	if(collector->size > H2_HEADER_LIST_MAX)
+	{
+		return 1;
+	}
+
+	lens[0] = nameLen;
+	lens[1] = valueLen;
+
+	return bufAppend(fields, lens, sizeof(lens))
+		&& (nameLen == 0 || bufAppend(fields, name, nameLen))
+		&& (valueLen == 0 || bufAppend(fields, value, valueLen));
+}
+
+/**
+ * checks whether the name equals the given string.
+ */
+static int _isName(const h2Header_t *header, const char *name)
+{
+	return header->nameLen == strlen(name)
+		&& memcmp(header->name, name, header->nameLen) == 0;
+}
+
+/**
+ * checks whether the header fields form a valid request (or valid trailers).
+ * returns 1 if they are valid and 0 if the request is malformed.
+ */
+static int _isValidRequest(
+	const h2Header_t *headers,
+	size_t count,
+	int trailers
+)
+{
+	int method = 0, scheme = 0, path = 0, connect = 0, regular = 0;
+	size_t i, j;
+
+	for(i=0;i<count;++i)
+	{
+		if(headers[i].nameLen == 0)
+		{
+			return 0;
+		}
+
+		/* names must be lower case */
+		for(j=0;j<headers[i].nameLen;++j)
+		{
+			if(headers[i].name[j] >= 'A' && headers[i].name[j] <= 'Z')
+			{
+				return 0;
+			}
+		}
+
+		/* regular fields */
+		if(headers[i].name[0] != ':')
+		{
+			/* connection specific fields are not allowed */
+			if(_isName(headers + i, "connection")
+				|| _isName(headers + i, "keep-alive")
+				|| _isName(headers + i, "proxy-connection")
+				|| _isName(headers + i, "transfer-encoding")
+				|| _isName(headers + i, "upgrade")
+				|| (_isName(headers + i, "te") && (headers[i].valueLen != 8
+					|| memcmp(headers[i].value, "trailers", 8) != 0)))
+			{
+				return 0;
+			}
+
+			regular = 1;
+			continue;
+		}
+
+		/* pseudo fields must precede the regular ones and are not allowed in
+		 * trailers */
+		if(regular || trailers)
+		{
+			return 0;
+		}
+
+		if(_isName(headers + i, ":method") && !method++)
+		{
+			connect = headers[i].valueLen == 7
+				&& memcmp(headers[i].value, "CONNECT", 7) == 0;
+		}
+		else if(_isName(headers + i, ":scheme") && !scheme++)
+		{
+			continue;
+		}
+		else if(_isName(headers + i, ":path") && !path++)
+		{
+			if(headers[i].valueLen == 0)
+			{
+				return 0;
+			}
+		}
+		else if(!_isName(headers + i, ":authority"))
+		{
+			return 0;
+		}
+	}
+
+	return trailers || (method && (connect || (scheme && path)));
+}
+
+/**
+ * decodes the complete header block and passes the request to the callback.
+ * returns 0 if everything is ok, _ABORT if the processing should stop and an
+ * error code in case of a connection error.
+ */
+static int _finishHeaders(
+	h2Conn_t *conn, buf_t *oBuf, h2Callback_t callback, void *userData
+)
+{
+	unsigned long id = conn->headerStream;
+	const unsigned char *fields;
+	_collector_t collector;
+	h2Stream_t *stream;
+	h2Header_t header;
+	h2Event_t event;
+	size_t pos, lens[2];
+	int trailers;
+
+	collector.conn = conn;
+	collector.size = 0;
+
+	bufConsume(&(conn->fields), conn->fields.len);
+	conn->headerStream = 0;
+
+	/* the block is decoded even if the stream is refused, the state of the
+	 * decoder must stay in sync with the client */
+	if(!hpackDecode(
+		&(conn->hpack), conn->block.data, conn->block.len, _collectField,
+		&collector
+	))
+	{
+		return H2_COMPRESSION_ERROR;
+	}
+
+	/* find or open the stream */
+	if((stream = _findStream(conn, id)) != NULL)
+	{
+		trailers = 1;
+	}
+	else
+	{
+		trailers = 0;
+		conn->lastStream = id;
+
+		if((stream = _openStream(conn, id)) == NULL)
+		{
+			return _resetStream(conn, oBuf, id, H2_REFUSED_STREAM);
+		}
+	}
+
+	/* build the list of header fields, the memory of the block is reused */
+	bufConsume(&(conn->block), conn->block.len);
+	fields = (const unsigned char*) conn->fields.data;
+
+	for(pos=0;pos<conn->fields.len;)
+	{
+		memcpy(lens, fields + pos, sizeof(lens));
+		pos += sizeof(lens);
+
+		header.name = (const char*) fields + pos;
+		header.nameLen = lens[0];
+		header.value = (const char*) fields + pos + lens[0];
+		header.valueLen = lens[1];
+		pos += lens[0] + lens[1];
+
+		if(!bufAppend(&(conn->block), &header, sizeof(header)))
+		{
+			return _ABORT;
+		}
+	}
+
+	event.headers = (const h2Header_t*) conn->block.data;
+	event.count = conn->block.len / sizeof(header);
+
+	/* malformed requests only reset the stream */
+	if(collector.size > H2_HEADER_LIST_MAX
+		|| !_isValidRequest(event.headers, event.count, trailers))
+	{
+		return _resetStream(conn, oBuf, id, H2_PROTOCOL_ERROR);
+	}
+
+	stream->remoteClosed = conn->headerEnd;
+
+	event.type = H2_EVENT_HEADERS;
+	event.stream = id;
+	event.data = NULL;
+	event.len = 0;
+	event.endStream = conn->headerEnd;
+	event.code = 0;
+
+	if(!callback(&event, userData))
+	{
+		return _ABORT;
+	}
+
+	/* the callback may have sent the complete response */
+	if(stream->id == id)
+	{
+		_checkStream(stream);
+	}
+
+	return 0;
+}
+
+/**
+ * removes the padding (and the priority) from the payload of DATA and
+ * HEADERS frames. returns 0 if everything is ok and an error code if not.
+ */
+static int _removePadding(_frame_t *frame, int priority)
+{
+	size_t pad = 0;
+
+	if(frame->flags & _FLAG_PADDED)
+	{
+		if(frame->len < 1)
+		{
+			return H2_FRAME_SIZE_ERROR;
+		}
+
+		pad = frame->payload[0];
+		++frame->payload;
+		--frame->len;
+	}
+
+	if(priority && (frame->flags & _FLAG_PRIORITY))
+	{
+		if(frame->len < 5)
+		{
+			return H2_FRAME_SIZE_ERROR;
+		}
+
+		frame->payload += 5;
+		frame->len -= 5;
+	}
+
+	if(pad > frame->len)
+	{
+		return H2_PROTOCOL_ERROR;
+	}
+
+	frame->len -= pad;
+
+	return 0;
+}
+
+/**
+ * handles HEADERS and CONTINUATION frames. returns 0 if everything is ok,
+ * _ABORT if the processing should stop and an error code in case of a
+ * connection error.
+ */
+static int _handleHeaders(
+	h2Conn_t *conn, buf_t *oBuf, _frame_t *frame, h2Callback_t callback,
+	void *userData
+)
+{
+	h2Stream_t *stream;
+	int result;
+
+	if(frame->type == _HEADERS)
+	{
+		/* client streams have odd ids */
+		if(frame->stream % 2 == 0)
+		{
+			return H2_PROTOCOL_ERROR;
+		}
+
+		if((result = _removePadding(frame, 1)) != 0)
+		{
+			return result;
+		}
+
+		/* either a new stream or trailers of an open stream */
+		stream = _findStream(conn, frame->stream);
+
+		if(stream == NULL && frame->stream <= conn->lastStream)
+		{
+			return H2_STREAM_CLOSED;
+		}
+
+		if(stream != NULL && (stream->remoteClosed
+			|| !(frame->flags & _FLAG_END_STREAM)))
+		{
+			return stream->remoteClosed ? H2_STREAM_CLOSED : H2_PROTOCOL_ERROR;
+		}
+
+		bufConsume(&(conn->block), conn->block.len);
+
+		conn->headerStream = frame->stream;
+		conn->headerEnd = (frame->flags & _FLAG_END_STREAM) != 0;
+	}
+
+	/* collect the fragments of the header block */
+	if(conn->block.len + frame->len > H2_HEADER_LIST_MAX)
+	{
+		return H2_PROTOCOL_ERROR;
+	}
+
+	if(frame->len > 0
+		&& !bufAppend(&(conn->block), frame->payload, frame->len))
+	{
+		return _ABORT;
+	}
+
+	if(frame->flags & _FLAG_END_HEADERS)
+	{
+		return _finishHeaders(conn, oBuf, callback, userData);
+	}
+
+	return 0;
+}
+
+/**
+ * handles DATA frames. returns 0 if everything is ok, _ABORT if the
+ * processing should stop and an error code in case of a connection error.
+ */
+static int _handleData(
+	h2Conn_t *conn, buf_t *oBuf, _frame_t *frame, h2Callback_t callback,
+	void *userData
+)
+{
+	h2Stream_t *stream;
+	h2Event_t event;
+	size_t len = frame->len;
+	int result;
+
+	if(frame->stream == 0 || frame->stream > conn->lastStream)
+	{
+		return H2_PROTOCOL_ERROR;
+	}
+
+	/* the whole frame including the padding counts for flow control */
+	if((long) len > conn->recvWindow)
+	{
+		return H2_FLOW_CONTROL_ERROR;
+	}
+
+	conn->recvWindow -= (long) len;
+
+	/* give the window back when half of it is used */
+	if(conn->recvWindow < H2_WINDOW / 2)
+	{
+		if(!_writeUintFrame(
+			oBuf, _WINDOW_UPDATE, 0, H2_WINDOW - conn->recvWindow
+		))
+		{
+			return _ABORT;
+		}
+
+		conn->recvWindow = H2_WINDOW;
+	}
+
+	if((result = _removePadding(frame, 0)) != 0)
+	{
+		return result;
+	}
+
+	stream = _findStream(conn, frame->stream);
+
+	if(stream == NULL || stream->remoteClosed)
+	{
+		return _resetStream(conn, oBuf, frame->stream, H2_STREAM_CLOSED);
+	}
+
+	if((long) len > stream->recvWindow)
+	{
+		return _resetStream(
+			conn, oBuf, frame->stream, H2_FLOW_CONTROL_ERROR
+		);
+	}
+
+	stream->recvWindow -= (long) len;
+	stream->remoteClosed = (frame->flags & _FLAG_END_STREAM) != 0;
+
+	/* the stream window is only needed if more data follows */
+	if(!stream->remoteClosed && stream->recvWindow < H2_WINDOW / 2)
+	{
+		if(!_writeUintFrame(
+			oBuf, _WINDOW_UPDATE, stream->id, H2_WINDOW - stream->recvWindow
+		))
+		{
+			return _ABORT;
+		}
+
+		stream->recvWindow = H2_WINDOW;
+	}
+
+	event.type = H2_EVENT_DATA;
+	event.stream = frame->stream;
+	event.headers = NULL;
+	event.count = 0;
+	event.data = frame->len > 0 ? (const char*) frame->payload : "";
+	event.len = frame->len;
+	event.endStream = stream->remoteClosed;
+	event.code = 0;
+
+	if(!callback(&event, userData))
+	{
+		return _ABORT;
+	}
+
+	if(stream->id == event.stream)
+	{
+		_checkStream(stream);
+	}
+
+	return 0;
+}
+
+/**
+ * handles all frames except HEADERS, CONTINUATION and DATA. returns 0 if
+ * everything is ok, _ABORT if the processing should stop and an error code in
+ * case of a connection error.
+ */
+static int _handleControl(
+	h2Conn_t *conn, buf_t *oBuf, _frame_t *frame, h2Callback_t callback,
+	void *userData
+)
+{
+	h2Stream_t *stream;
+	h2Event_t event;
+	unsigned long value;
+	int result;
+
+	switch(frame->type)
+	{
+		case _SETTINGS:
+			if(frame->stream != 0)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			if(frame->flags & _FLAG_ACK)
+			{
+				return frame->len == 0 ? 0 : H2_FRAME_SIZE_ERROR;
+			}
+
+			if((result = _applySettings(
+				conn, frame->payload, frame->len
+			)) != 0)
+			{
+				return result;
+			}
+
+			/* acknowledge the settings, a larger window may allow to send
+			 * pending data */
+			return _writeFrame(oBuf, _SETTINGS, _FLAG_ACK, 0, NULL, 0)
+				&& _flushAll(conn, oBuf) ? 0 : _ABORT;
+
+		case _PING:
+			if(frame->stream != 0)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			if(frame->len != 8)
+			{
+				return H2_FRAME_SIZE_ERROR;
+			}
+
+			return (frame->flags & _FLAG_ACK) || _writeFrame(
+				oBuf, _PING, _FLAG_ACK, 0, frame->payload, 8
+			) ? 0 : _ABORT;
+
+		case _GOAWAY:
+			if(frame->stream != 0)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			if(frame->len < 8)
+			{
+				return H2_FRAME_SIZE_ERROR;
+			}
+
+			conn->state = _STATE_CLOSED;
+
+			return 0;
+
+		case _WINDOW_UPDATE:
+			if(frame->len != 4)
+			{
+				return H2_FRAME_SIZE_ERROR;
+			}
+
+			value = _readUint32(frame->payload) & 0x7fffffffUL;
+
+			/* the window of the connection */
+			if(frame->stream == 0)
+			{
+				if(value == 0)
+				{
+					return H2_PROTOCOL_ERROR;
+				}
+
+				if(conn->sendWindow > _WINDOW_MAX - (long) value)
+				{
+					return H2_FLOW_CONTROL_ERROR;
+				}
+
+				conn->sendWindow += (long) value;
+
+				return _flushAll(conn, oBuf) ? 0 : _ABORT;
+			}
+
+			/* the window of a stream */
+			if(frame->stream > conn->lastStream)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			if((stream = _findStream(conn, frame->stream)) == NULL)
+			{
+				return 0;
+			}
+
+			if(value == 0)
+			{
+				return _resetStream(
+					conn, oBuf, frame->stream, H2_PROTOCOL_ERROR
+				);
+			}
+
+			if(stream->sendWindow > _WINDOW_MAX - (long) value)
+			{
+				return _resetStream(
+					conn, oBuf, frame->stream, H2_FLOW_CONTROL_ERROR
+				);
+			}
+
+			stream->sendWindow += (long) value;
+
+			return _flushStream(conn, stream, oBuf) ? 0 : _ABORT;
+
+		case _RST_STREAM:
+			if(frame->stream == 0 || frame->stream > conn->lastStream)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			if(frame->len != 4)
+			{
+				return H2_FRAME_SIZE_ERROR;
+			}
+
+			if((stream = _findStream(conn, frame->stream)) == NULL)
+			{
+				return 0;
+			}
+
+			_removeStream(stream);
+
+			event.type = H2_EVENT_RESET;
+			event.stream = frame->stream;
+			event.headers = NULL;
+			event.count = 0;
+			event.data = NULL;
+			event.len = 0;
+			event.endStream = 1;
+			event.code = _readUint32(frame->payload);
+
+			return callback(&event, userData) ? 0 : _ABORT;
+
+		case _PRIORITY:
+			if(frame->stream == 0)
+			{
+				return H2_PROTOCOL_ERROR;
+			}
+
+			return frame->len == 5 ? 0 : H2_FRAME_SIZE_ERROR;
+
+		case _PUSH_PROMISE:
+		case _CONTINUATION:
+			/* clients must not push, continuations are only allowed after
+			 * HEADERS */
+			return H2_PROTOCOL_ERROR;
+
+		default:
+			/* unknown frames are ignored */
+			return 0;
+	}
+}
+
+/**
+ * appends GOAWAY with the given error code to the buffer. returns 1 if
+ * everything is ok and 0 if not.
+ */
+static int _writeGoaway(h2Conn_t *conn, buf_t *buf, h2Error_t code)
+{
+	unsigned char payload[8];
+
+	_writeUint32(payload, conn->lastStream);
+	_writeUint32(payload + 4, (unsigned long) code);
+
+	conn->state = _STATE_CLOSED;
+
+	return _writeFrame(buf, _GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+/**
+ * initializes the given http/2 connection. the connection expects the client
+ * connection preface (prior knowledge).
+ */
+void h2Init(h2Conn_t *conn)
+{
+	memset(conn, 0, sizeof(*conn));
+
+	conn->state = _STATE_PREFACE;
+	conn->sendWindow = H2_WINDOW;
+	conn->recvWindow = H2_WINDOW;
+	conn->initialWindow = H2_WINDOW;
+	conn->maxFrame = H2_FRAME_MAX;
+
+	hpackInit(&(conn->hpack));
+}
+
+/**
+ * upgrades a http/1.1 connection. the 101 response and the settings of the
+ * server are appended to the buffer. the second parameter is the value of the
+ * HTTP2-Settings header. the request of the upgrade becomes stream 1, its
+ * response must be sent with h2SendHeaders() and h2SendData(). returns 1 if
+ * everything is ok and 0 if the settings are invalid.
+ */
+int h2Upgrade(h2Conn_t *conn, buf_t *buf, const char *settings, size_t len)
+{
+	static const char response[] =
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Connection: Upgrade\r\n"
+		"Upgrade: h2c\r\n"
+		"\r\n";
+
+	char tmp[256];
+	h2Stream_t *stream;
+	size_t i;
+
+	/* the settings are encoded with the url safe base64 alphabet without
+	 * padding */
+	if(conn->state != _STATE_PREFACE || len + 3 > sizeof(tmp))
+	{
+		return 0;
+	}
+
+	for(i=0;i<len;++i)
+	{
+		tmp[i] = settings[i] == '-' ? '+'
+			: settings[i] == '_' ? '/' : settings[i];
+	}
+
+	for(;i%4!=0;++i)
+	{
+		tmp[i] = '=';
+	}
+
+	bufConsume(&(conn->block), conn->block.len);
+
+	if(!encBase64Decode(&(conn->block), tmp, i)
+		|| _applySettings(
+			conn, (const unsigned char*) conn->block.data, conn->block.len
+		) != 0)
+	{
+		return 0;
+	}
+
+	bufConsume(&(conn->block), conn->block.len);
+
+	/* the request of the upgrade is stream 1, it is half closed already */
+	stream = _openStream(conn, 1);
+	stream->remoteClosed = 1;
+	conn->lastStream = 1;
+
+	conn->settingsSent = 1;
+
+	return bufAppend(buf, response, sizeof(response) - 1)
+		&& _writeSettings(buf);
+}
+
+/**
+ * processes all complete frames of the input buffer and removes them from it.
+ * settings, pings and flow control are handled directly, requests are passed
+ * to the callback stream by stream. returns 1 if the connection is still
+ * open, 2 if the client sent GOAWAY and 0 in case of an error (GOAWAY is
+ * appended to the output buffer). in the last two cases the socket should be
+ * closed after the output buffer is flushed.
+ */
+int h2Exec(
+	h2Conn_t *conn, buf_t *iBuf, buf_t *oBuf, h2Callback_t callback,
+	void *userData
+)
+{
+	const unsigned char *data;
+	size_t len, pos = 0;
+	_frame_t frame;
+	int result = 0;
+
+	if(!bufHasData(iBuf) || conn->state == _STATE_CLOSED)
+	{
+		return conn->state == _STATE_CLOSED ? 2 : 1;
+	}
+
+	data = (const unsigned char*) bufPeek(iBuf, &len);
+
+	/* the connection starts with the preface of the client */
+	if(conn->state == _STATE_PREFACE)
+	{
+		if(memcmp(data, _PREFACE, len < _PREFACE_LEN ? len : _PREFACE_LEN))
+		{
+			result = H2_PROTOCOL_ERROR;
+		}
+		else if(len >= _PREFACE_LEN)
+		{
+			pos = _PREFACE_LEN;
+			conn->state = _STATE_SETTINGS;
+
+			if(!conn->settingsSent)
+			{
+				conn->settingsSent = 1;
+				result = _writeSettings(oBuf) ? 0 : _ABORT;
+			}
+		}
+	}
+
+	/* handle all complete frames, the frames are removed at once at the
+	 * end */
+	while(result == 0 && conn->state != _STATE_PREFACE
+		&& conn->state != _STATE_CLOSED && len - pos >= _HEADER_SIZE)
+	{
+		frame.len = ((size_t) data[pos] << 16) | ((size_t) data[pos + 1] << 8)
+			| data[pos + 2];
+		frame.type = data[pos + 3];
+		frame.flags = data[pos + 4];
+		frame.stream = _readUint32(data + pos + 5) & 0x7fffffffUL;
+		frame.payload = data + pos + _HEADER_SIZE;
+
+		if(frame.len > H2_FRAME_MAX)
+		{
+			result = H2_FRAME_SIZE_ERROR;
+			break;
+		}
+
+		/* wait for the rest of the frame */
+		if(len - pos - _HEADER_SIZE < frame.len)
+		{
+			break;
+		}
+
+		pos += _HEADER_SIZE + frame.len;
+
+		/* the first frame must be SETTINGS and a header block must not be
+		 * interrupted */
+		if((conn->state == _STATE_SETTINGS && frame.type != _SETTINGS)
+			|| (conn->headerStream != 0 && (frame.type != _CONTINUATION
+				|| frame.stream != conn->headerStream)))
+		{
+			result = H2_PROTOCOL_ERROR;
+			break;
+		}
+
+		conn->state = _STATE_OPEN;
+
+		switch(frame.type)
+		{
+			case _HEADERS:
+				result = _handleHeaders(
+					conn, oBuf, &frame, callback, userData
+				);
+				break;
+
+			case _CONTINUATION:
+				result = conn->headerStream != 0 ? _handleHeaders(
+					conn, oBuf, &frame, callback, userData
+				) : H2_PROTOCOL_ERROR;
+				break;
+
+			case _DATA:
+				result = _handleData(conn, oBuf, &frame, callback, userData);
+				break;
+
+			default:
+				result = _handleControl(
+					conn, oBuf, &frame, callback, userData
+				);
+				break;
+		}
+	}
+
+	bufConsume(iBuf, pos);
+
+	if(result == _ABORT)
+	{
+		return 0;
+	}
+
+	/* close the connection with the error code */
+	if(result > 0)
+	{
+		(void) _writeGoaway(conn, oBuf, (h2Error_t) result);
+
+		return 0;
+	}
+
+	return conn->state == _STATE_CLOSED ? 2 : 1;
+}
+
+/**
+ * appends the given header fields of a response to the buffer. names are
+ * converted to lower case. returns 0 if the stream is not open and 1 if
+ * everything is ok.
+ */
+int h2SendHeaders(
+	h2Conn_t *conn, buf_t *buf, unsigned long id, const h2Header_t *headers,
+	size_t count, int endStream
+)
+{
+	h2Stream_t *stream = _findStream(conn, id);
+	size_t start = buf->len, len, frames, i, n;
+	unsigned char *data;
+
+	/* headers can not be sent after data that is still pending */
+	if(id == 0 || stream == NULL || stream->localClosed
+		|| stream->pending.len > 0 || stream->pendingEnd)
+	{
+		return 0;
+	}
+
+	/* encode the header block behind the space for the frame header */
+	if(!bufAppend(buf, "\0\0\0\0\0\0\0\0\0", _HEADER_SIZE))
+	{
+		return 0;
+	}
+
+	for(i=0;i<count;++i)
+	{
+		if(!hpackEncode(
+			buf, headers[i].name, headers[i].nameLen, headers[i].value,
+			headers[i].valueLen
+		))
+		{
+			buf->len = start;
+
+			return 0;
+		}
+	}
+
+	/* blocks larger than a frame are split into CONTINUATION frames, the
+	 * space for their headers is inserted from the end */
+	len = buf->len - start - _HEADER_SIZE;
+	frames = len > 0 ? (len - 1) / conn->maxFrame : 0;
+
+	for(i=0;i<frames;++i)
+	{
+		if(!bufAppend(buf, "\0\0\0\0\0\0\0\0\0", _HEADER_SIZE))
+		{
+			buf->len = start;
+
+			return 0;
+		}
+	}
+
+	data = (unsigned char*) buf->data + start;
+
+	for(i=frames;i>0;--i)
+	{
+		n = len - i * conn->maxFrame;
+		n = n < conn->maxFrame ? n : conn->maxFrame;
+
+		memmove(
+			data + i * (conn->maxFrame + _HEADER_SIZE) + _HEADER_SIZE,
+			data + _HEADER_SIZE + i * conn->maxFrame,
+			n
+		);
+
+		_setHeader(
+			data + i * (conn->maxFrame + _HEADER_SIZE), n, _CONTINUATION,
+			i == frames ? _FLAG_END_HEADERS : 0, id
+		);
+	}
+
+	_setHeader(
+		data, len < conn->maxFrame ? len : conn->maxFrame, _HEADERS,
+		(frames == 0 ? _FLAG_END_HEADERS : 0)
+			| (endStream ? _FLAG_END_STREAM : 0),
+		id
+	);
+
+	if(endStream)
+	{
+		stream->localClosed = 1;
+
+		_checkStream(stream);
+	}
+
+	return 1;
+}
+
+/**
+ * appends data of a response to the buffer. data exceeding the flow control
+ * windows is kept and sent as soon as the client allows it. returns 0 if the
+ * stream is not open and 1 if everything is ok.
+ */
+int h2SendData(
+	h2Conn_t *conn, buf_t *buf, unsigned long id, const void *data,
+	size_t len, int endStream
+)
+{
+	h2Stream_t *stream = _findStream(conn, id);
+	size_t sent = 0;
+
+	if(id == 0 || stream == NULL || stream->localClosed || stream->pendingEnd)
+	{
+		return 0;
+	}
+
+	/* without pending data as much as possible is sent directly */
+	if(stream->pending.len == 0)
+	{
+		sent = _sendData(
+			conn, stream, buf, (const char*) data, len, endStream
+		);
+
+		if(sent == (size_t) -1)
+		{
+			return 0;
+		}
+
+		if(sent == len)
+		{
+			stream->localClosed = endStream;
+
+			_checkStream(stream);
+
+			return 1;
+		}
+	}
+
+	/* keep the rest until the client opens the window */
+	if(!bufAppend(&(stream->pending), (const char*) data + sent, len - sent))
+	{
+		return 0;
+	}
+
+	stream->pendingEnd = endStream;
+
+	return _flushStream(conn, stream, buf);
+}
+
+/**
+ * resets the given stream with the error code. returns 0 if the stream is not
+ * open and 1 if everything is ok.
+ */
+int h2Reset(h2Conn_t *conn, buf_t *buf, unsigned long id, h2Error_t code)
+{
+	if(id == 0 || _findStream(conn, id) == NULL)
+	{
+		return 0;
+	}
+
+	return _resetStream(conn, buf, id, code) == 0;
+}
+
+/**
+ * appends GOAWAY with the given error code to the buffer. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int h2Close(h2Conn_t *conn, buf_t *buf, h2Error_t code)
+{
+	return _writeGoaway(conn, buf, code);
+}
+
+/**
+ * frees the resources of the given http/2 connection.
+ */
+void h2Clear(h2Conn_t *conn)
+{
+	int i;
+
+	for(i=0;i<H2_STREAMS_MAX;++i)
+	{
+		bufClear(&(conn->streams[i].pending));
+	}
+
+	bufClear(&(conn->block));
+	bufClear(&(conn->fields));
+
+	hpackClear(&(conn->hpack));
+}
@@ -0,0 +1,790 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * defines what the reader expects next.
+ */
+enum {
+
+	/* a value (beginning of the document, after a colon or a comma in an
+	 * array) */
+	_EXPECT_VALUE,
+
+	/* a value or the end of an array (after '[') */
+	_EXPECT_VALUE_OR_END,
+
+	/* a key (after a comma in an object) */
+	_EXPECT_KEY,
+
+	/* a key or the end of an object (after '{') */
+	_EXPECT_KEY_OR_END,
+
+	/* a comma or the end of the current container */
+	_EXPECT_COMMA_OR_END,
+
+	/* the end of the document */
+	_EXPECT_EOF
+};
+
+/**
+ * defines the maximum length of a number in the input.
+ */
+#define _NUMBER_MAX (64)
+
+/**
+ * checks whether the given character is json whitespace.
+ */
+#define _isSpace(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/**
+ * checks whether the given character is a decimal digit.
+ */
+#define _isDigit(c) ((c) >= '0' && (c) <= '9')
+
+/**
+ * defines the characters which end a run of plain characters inside a string.
+ * these are the quote, the backslash and all control characters. the writer
+ * escapes exactly these characters.
+ */
+static const unsigned char _special[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ * defines the escape sequences of the control characters that have a short
+ * form. a value of 0 means the \u00XX form is used.
+ */
+static const char _shortEscape[32] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 'b', 't', 'n', 0, 'f', 'r', 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/**
+ * defines the hex digits used for escape sequences.
+ */
+static const char _hexDigits[] = "0123456789abcdef";
+
+/**
+ * puts the reader into the error state with the given message. always returns
+ * JSON_ERROR.
+ */
+static jsonToken_t _error(jsonReader_t *reader, const char *msg)
+{
+	reader->error = msg;
+
+	return JSON_ERROR;
+}
+
+/**
+ * skips all whitespace in front of the next token.
+ */
+static void _skipSpace(jsonReader_t *reader)
+{
+	while(reader->pos < reader->len && _isSpace(reader->data[reader->pos]))
+	{
+		++(reader->pos);
+	}
+}
+
+/**
+ * reads four hex digits at the current position. returns the value or -1 if
+ * there are no valid hex digits.
+ */
+static long _readHex4(jsonReader_t *reader)
+{
+	long value = 0;
+	int i;
+	char c;
+
+	if(reader->len - reader->pos < 4)
+	{
+		return -1;
+	}
+
+	for(i=0;i<4;++i)
+	{
+		c = reader->data[reader->pos++];
+		value <<= 4;
+
+		if(_isDigit(c))
+		{
+			value |= c - '0';
+		}
+		else if(c >= 'a' && c <= 'f')
+		{
+			value |= c - 'a' + 10;
+		}
+		else if(c >= 'A' && c <= 'F')
+		{
+			value |= c - 'A' + 10;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+
+	return value;
+}
+
+/**
+ * decodes an \uXXXX escape sequence (the position is after the 'u') and
+ * appends the character as utf-8 to the string buffer. surrogate pairs are
+ * combined. returns 1 if everything is ok and 0 if not.
+ */
+static int _readUnicodeEscape(jsonReader_t *reader)
+{
+	unsigned char utf8[4];
+	long code = _readHex4(reader), low;
+	size_t len;
+
+	if(code < 0)
+	{
+		return 0;
+	}
+
+	/* a high surrogate must be followed by a low surrogate */
+	if(code >= 0xd800 && code <= 0xdbff)
+	{
+		if(reader->len - reader->pos < 6
+			|| reader->data[reader->pos] != '\\'
+			|| reader->data[reader->pos + 1] != 'u')
+		{
+			return 0;
+		}
+
+		reader->pos += 2;
+		low = _readHex4(reader);
+
+		if(low < 0xdc00 || low > 0xdfff)
+		{
+			return 0;
+		}
+
+		code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+	}
+	else if(code >= 0xdc00 && code <= 0xdfff)
+	{
+		/* a low surrogate on its own */
+		return 0;
+	}
+
+	/* encode the character as utf-8 */
+	if(code < 0x80)
+	{
+		utf8[0] = (unsigned char) code;
+		len = 1;
+	}
+	else if(code < 0x800)
+	{
+		utf8[0] = (unsigned char) (0xc0 | (code >> 6));
+		utf8[1] = (unsigned char) (0x80 | (code & 0x3f));
+		len = 2;
+	}
+	else if(code < 0x10000)
+	{
+		utf8[0] = (unsigned char) (0xe0 | (code >> 12));
+		utf8[1] = (unsigned char) (0x80 | ((code >> 6) & 0x3f));
+		utf8[2] = (unsigned char) (0x80 | (code & 0x3f));
+		len = 3;
+	}
+	else
+	{
+		utf8[0] = (unsigned char) (0xf0 | (code >> 18));
+		utf8[1] = (unsigned char) (0x80 | ((code >> 12) & 0x3f));
+		utf8[2] = (unsigned char) (0x80 | ((code >> 6) & 0x3f));
+		utf8[3] = (unsigned char) (0x80 | (code & 0x3f));
+		len = 4;
+	}
+
+	return bufAppend(&(reader->string), utf8, len);
+}
+
+/**
+ * reads a string (the position is at the opening quote). strings without
+ * escape sequences are not copied, the result points into the input data
+ * then. returns 1 if everything is ok and 0 if not.
+ */
+static int _readString(jsonReader_t *reader)
+{
+	const unsigned char *data = (const unsigned char*) reader->data;
+	size_t start = ++(reader->pos), pos = start;
+	int escaped = 0;
+	char c;
+
+	for(;;)
+	{
+		/* skip over the run of plain characters */
+		while(pos < reader->len && !_special[data[pos]])
+		{
+			++pos;
+		}
+
+		if(pos >= reader->len)
+		{
+			return 0;
+		}
+
+		/* control characters must be escaped */
+		if(data[pos] < 0x20)
+		{
+			return 0;
+		}
+
+		/* the end of the string */
+		if(data[pos] == '"')
+		{
+			break;
+		}
+
+		/* the first escape sequence, from now on the string is copied */
+		if(!escaped)
+		{
+			bufConsume(&(reader->string), reader->string.len);
+			escaped = 1;
+		}
+
+		/* copy the run in front of the escape sequence */
+		if(!bufAppend(&(reader->string), data + start, pos - start))
+		{
+			return 0;
+		}
+
+		if(pos + 1 >= reader->len)
+		{
+			return 0;
+		}
+
+		/* decode the escape sequence */
+		switch(data[pos + 1])
+		{
+			case '"': c = '"'; break;
+			case '\\': c = '\\'; break;
+			case '/': c = '/'; break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+
+			case 'u':
+				reader->pos = pos + 2;
+
+				if(!_readUnicodeEscape(reader))
+				{
+					return 0;
+				}
+
+				start = pos = reader->pos;
+				continue;
+
+			default:
+				return 0;
+		}
+
+		if(!bufAppend(&(reader->string), &c, 1))
+		{
+			return 0;
+		}
+
+		start = pos = pos + 2;
+	}
+
+	if(escaped)
+	{
+		/* copy the last run */
+		if(!bufAppend(&(reader->string), data + start, pos - start))
+		{
+			return 0;
+		}
+
+		reader->str = reader->string.data != NULL
+			? (const char*) reader->string.data : "";
+		reader->strLen = reader->string.len;
+	}
+	else
+	{
+		/* no escape sequences, use the input directly */
+		reader->str = reader->data + start;
+		reader->strLen = pos - start;
+	}
+
+	/* skip the closing quote */
+	reader->pos = pos + 1;
+
+	return 1;
+}
+
+/**
+ * reads a number. returns 1 if everything is ok and 0 if not.
+ */
+static int _readNumber(jsonReader_t *reader)
+{
+	const char *data = reader->data;
+	size_t start = reader->pos, pos = start, len = reader->len;
+	char tmp[_NUMBER_MAX];
+
+	/* validate the number according to the json grammar */
+	if(pos < len && data[pos] == '-')
+	{
+		++pos;
+	}
+
+	if(pos < len && data[pos] == '0')
+	{
+		++pos;
+	}
+	else if(pos < len && _isDigit(data[pos]))
+	{
+		while(pos < len && _isDigit(data[pos]))
+		{
+			++pos;
+		}
+	}
+	else
+	{
+		return 0;
+	}
+
+	/* fraction */
+	if(pos < len && data[pos] == '.')
+	{
+		if(++pos >= len || !_isDigit(data[pos]))
+		{
+			return 0;
+		}
+
+		while(pos < len && _isDigit(data[pos]))
+		{
+			++pos;
+		}
+	}
+
+	/* exponent */
+	if(pos < len && (data[pos] == 'e' || data[pos] == 'E'))
+	{
+		if(++pos < len && (data[pos] == '+' || data[pos] == '-'))
+		{
+			++pos;
+		}
+
+		if(pos >= len || !_isDigit(data[pos]))
+		{
+			return 0;
+		}
+
+		while(pos < len && _isDigit(data[pos]))
+		{
+			++pos;
+		}
+	}
+
+	/* the input is not null terminated, convert a copy */
+	if(pos - start >= sizeof(tmp))
+	{
+		return 0;
+	}
+
+	memcpy(tmp, data + start, pos - start);
+	tmp[pos - start] = '\0';
+
+	reader->number = strtod(tmp, NULL);
+	reader->pos = pos;
+
+	return 1;
+}
+
+/**
+ * reads the given literal. returns 1 if it is there and 0 if not.
+ */
+static int _readLiteral(jsonReader_t *reader, const char *literal)
+{
+	size_t len = strlen(literal);
+
+	if(reader->len - reader->pos < len
+		|| memcmp(reader->data + reader->pos, literal, len) != 0)
+	{
+		return 0;
+	}
+
+	reader->pos += len;
+
+	return 1;
+}
+
+/**
+ * enters a new array or object. returns the given token or JSON_ERROR if the
+ * document is nested too deep.
+ */
+static jsonToken_t _enter(jsonReader_t *reader, jsonToken_t token)
+{
+	if(reader->depth >= JSON_DEPTH_MAX)
+	{
+		return _error(reader, "nested too deep");
+	}
+
+	++(reader->pos);
+
+	/* remember the type of the container */
+	reader->stack[reader->depth++] = token == JSON_OBJECT_BEGIN;
+	reader->state = token == JSON_OBJECT_BEGIN
+		? _EXPECT_KEY_OR_END : _EXPECT_VALUE_OR_END;
+
+	return token;
+}
+
+/**
+ * leaves the current array or object. returns the given token.
+ */
+static jsonToken_t _leave(jsonReader_t *reader, jsonToken_t token)
+{
+	++(reader->pos);
+	--(reader->depth);
+
+	reader->state = reader->depth > 0 ? _EXPECT_COMMA_OR_END : _EXPECT_EOF;
+
+	return token;
+}
+
+/**
+ * reads a value at the current position.
+ */
+static jsonToken_t _readValue(jsonReader_t *reader)
+{
+	jsonToken_t token;
+
+	if(reader->pos >= reader->len)
+	{
+		return _error(reader, "unexpected end of data");
+	}
+
+	switch(reader->data[reader->pos])
+	{
+		case '{':
+			return _enter(reader, JSON_OBJECT_BEGIN);
+
+		case '[':
+			return _enter(reader, JSON_ARRAY_BEGIN);
+
+		case '"':
+			if(!_readString(reader))
+			{
+				return _error(reader, "invalid string");
+			}
+
+			token = JSON_STRING;
+			break;
+
+		case 't':
+			if(!_readLiteral(reader, "true"))
+			{
+				return _error(reader, "invalid literal");
+			}
+
+			token = JSON_TRUE;
+			break;
+
+		case 'f':
+			if(!_readLiteral(reader, "false"))
+			{
+				return _error(reader, "invalid literal");
+			}
+
+			token = JSON_FALSE;
+			break;
+
+		case 'n':
+			if(!_readLiteral(reader, "null"))
+			{
+				return _error(reader, "invalid literal");
+			}
+
+			token = JSON_NULL;
+			break;
+
+		default:
+			if(!_readNumber(reader))
+			{
+				return _error(reader, "invalid value");
+			}
+
+			token = JSON_NUMBER;
+			break;
+	}
+
+	/* a scalar value is complete */
+	reader->state = reader->depth > 0 ? _EXPECT_COMMA_OR_END : _EXPECT_EOF;
+
+	return token;
+}
+
+/**
+ * reads a key of an object including the following colon.
+ */
+static jsonToken_t _readKey(jsonReader_t *reader)
+{
+	if(reader->pos >= reader->len || reader->data[reader->pos] != '"')
+	{
+		return _error(reader, "expected key");
+	}
+
+	if(!_readString(reader))
+	{
+		return _error(reader, "invalid string");
+	}
+
+	/* the key is followed by a colon */
+	_skipSpace(reader);
+
+	if(reader->pos >= reader->len || reader->data[reader->pos] != ':')
+	{
+		return _error(reader, "expected ':'");
+	}
+
+	++(reader->pos);
+	reader->state = _EXPECT_VALUE;
+
+	return JSON_KEY;
+}
+
+/**
+ * initializes the reader with the given document. the data must stay valid as
+ * long as the reader is used.
+ */
+void jsonReaderInit(jsonReader_t *reader, const void *data, size_t len)
+{
+	memset(reader, 0, sizeof(*reader));
+
+	reader->data = (const char*) data;
+	reader->len = len;
+	reader->state = _EXPECT_VALUE;
+}
+
+/**
+ * reads the next token of the document. the reader validates the structure of
+ * the document, keys are reported as JSON_KEY. after JSON_STRING and JSON_KEY
+ * the str and strLen fields contain the decoded string, after JSON_NUMBER the
+ * number field contains the value. returns JSON_END at the end of the
+ * document and JSON_ERROR in case of an error (the error field contains a
+ * message then).
+ */
+jsonToken_t jsonNext(jsonReader_t *reader)
+{
+	char c;
+
+	/* an error is permanent */
+	if(reader->error != NULL)
+	{
+		return JSON_ERROR;
+	}
+
+	for(;;)
+	{
+		_skipSpace(reader);
+
+		c = reader->pos < reader->len ? reader->data[reader->pos] : '\0';
+
+		switch(reader->state)
+		{
+			case _EXPECT_VALUE:
+				return _readValue(reader);
+
+			case _EXPECT_VALUE_OR_END:
+				return c == ']'
+					? _leave(reader, JSON_ARRAY_END)
+					: _readValue(reader);
+
+			case _EXPECT_KEY:
+				return _readKey(reader);
+
+			case _EXPECT_KEY_OR_END:
+				return c == '}'
+					? _leave(reader, JSON_OBJECT_END)
+					: _readKey(reader);
+
+			case _EXPECT_COMMA_OR_END:
+
+				/* the end of the current container */
+				if(c == (reader->stack[reader->depth - 1] ? '}' : ']'))
+				{
+					return _leave(reader, reader->stack[reader->depth - 1]
+						? JSON_OBJECT_END : JSON_ARRAY_END);
+				}
+
+				if(c != ',')
+				{
+					return _error(reader, "expected ',' or end of container");
+				}
+
+				/* a comma is followed by a key or a value */
+				++(reader->pos);
+				reader->state = reader->stack[reader->depth - 1]
+					? _EXPECT_KEY : _EXPECT_VALUE;
+				break;
+
+			default:
+				return reader->pos >= reader->len
+					? JSON_END
+					: _error(reader, "unexpected data after the document");
+		}
+	}
+}
+
+/**
+ * frees all resources of the reader.
+ */
+void jsonReaderClear(jsonReader_t *reader)
+{
+	bufClear(&(reader->string));
+}
+
+/**
+ * appends the given string as json string (including the quotes) to the
+ * buffer. returns 1 if everything is ok and 0 if not.
+ */
+int jsonWriteString(buf_t *buf, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	unsigned char esc[6] = {'\\', 'u', '0', '0', 0, 0};
+	size_t start = 0, i = 0, n;
+
+	if(!bufAppend(buf, "\"", 1))
+	{
+		return 0;
+	}
+
+	while(i < len)
+	{
+		/* skip over the run of characters that do not need escaping */
+		while(i < len && !_special[src[i]])
+		{
+			++i;
+		}
+
+		/* copy the run at once */
+		if(i > start && !bufAppend(buf, src + start, i - start))
+		{
+			return 0;
+		}
+
+		if(i >= len)
+		{
+			break;
+		}
+
+		/* build the escape sequence */
+		if(src[i] >= 0x20)
+		{
+			esc[1] = src[i];
+			n = 2;
+		}
+		else if(_shortEscape[src[i]] != 0)
+		{
+			esc[1] = _shortEscape[src[i]];
+			n = 2;
+		}
+		else
+		{
+			esc[1] = 'u';
+			esc[4] = _hexDigits[src[i] >> 4];
+			esc[5] = _hexDigits[src[i] & 0x0f];
+			n = 6;
+		}
+
+		if(!bufAppend(buf, esc, n))
+		{
+			return 0;
+		}
+
+		start = ++i;
+	}
+
+	return bufAppend(buf, "\"", 1);
+}
+
+/**
+ * appends the given number to the buffer. integral values are written without
+ * fraction, all other values with the given number of significant digits.
+ * returns 0 if the number can not be represented in json (nan and infinity)
+ * or in case of an error and 1 otherwise.
+ */
+int jsonWriteNumber(buf_t *buf, double number, int precision)
+{
+	char tmp[64];
+
+	/* nan and infinity are not allowed in json */
+	if(number != number || number - number != 0)
+	{
+		return 0;
+	}
+
+	/* limit the precision to something useful */
+	if(precision < 1 || precision > 17)
+	{
+		precision = JSON_PRECISION;
+	}
+
+	/* integral values are written without fraction and exponent as long as
+	 * they can be represented exactly */
+	if(number > -9007199254740992.0 && number < 9007199254740992.0
+		&& number == floor(number))
+	{
+		sprintf(tmp, "%.0f", number);
+	}
+	/* larger integral values (e.g. ids) must not lose digits to a smaller
+	 * precision, 17 digits round-trip every double */
+	else if(number == floor(number))
+	{
+		sprintf(tmp, "%.17g", number);
+	}
+	else
+	{
+		sprintf(tmp, "%.*g", precision, number);
+	}
+
+	return bufAppend(buf, tmp, strlen(tmp));
+}
@@ -28,8 +28,12 @@
 #include "../lua/lauxlib.h"
 #include "../lua/lualib.h"
 
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 
 /**
  * defines the prefix used for all values stored in the registry.
@@ -51,16 +55,203 @@
  */
 #define _LOG_CALLBACK_INDEX _SERVER_REGISTRY_PREFIX "lcb"
 
+/**
+ * defines the index for the table of the callbacks of watched descriptors in
+ * the lua registry.
+ */
+#define _WATCH_INDEX _SERVER_REGISTRY_PREFIX "wcb"
+
+/**
+ * defines the index for the table of the signal handlers in the lua registry.
+ */
+#define _SIGNAL_INDEX _SERVER_REGISTRY_PREFIX "sig"
+
 /**
  * defines the type name for all buffer objects.
  */
 #define _BUF_TYPE_NAME _SERVER_REGISTRY_PREFIX "buf"
 
+/**
+ * defines the type name for all form parser objects.
+ */
+#define _FORM_TYPE_NAME _SERVER_REGISTRY_PREFIX "form"
+
+/**
+ * defines the type name for all websocket connection objects.
+ */
+#define _WS_TYPE_NAME _SERVER_REGISTRY_PREFIX "websocket"
+
+/**
+ * defines the type name for all http/2 connection objects.
+ */
+#define _H2_TYPE_NAME _SERVER_REGISTRY_PREFIX "http2"
+
+/**
+ * defines the type name for all compression filter objects.
+ */
+#define _COMP_TYPE_NAME _SERVER_REGISTRY_PREFIX "compress"
+
+/**
+ * defines the type name for all cache objects.
+ */
+#define _CACHE_TYPE_NAME _SERVER_REGISTRY_PREFIX "cache"
+
+/**
+ * defines the type name for all static file server objects.
+ */
+#define _FILES_TYPE_NAME _SERVER_REGISTRY_PREFIX "files"
+
+/**
+ * defines the type name for all router objects.
+ */
+#define _ROUTER_TYPE_NAME _SERVER_REGISTRY_PREFIX "router"
+
+/**
+ * defines the type name for all flight objects.
+ */
+#define _FLIGHT_TYPE_NAME _SERVER_REGISTRY_PREFIX "flight"
+
+/**
+ * defines the type name for all hash ring objects.
+ */
+#define _RING_TYPE_NAME _SERVER_REGISTRY_PREFIX "ring"
+
+/**
+ * defines the maximum length of a method in a route.
+ */
+#define _ROUTER_METHOD_MAX (32)
+
+/**
+ * defines the data passed to the callbacks of the form, websocket and http/2
+ * api.
+ */
+typedef struct {
+
+	/* stores the lua state the handler lives in */
+	lua_State *state;
+
+	/* stores the stack index of the handler function */
+	int handler;
+
+	/* used to check whether the handler raised an error, the error object
+	 * is left on the stack */
+	unsigned int hasError : 1;
+
+} _handler_t;
+
+/**
+ * defines a lookup of server.resolve() waiting for its callback.
+ */
+typedef struct {
+
+	/* stores the lua state the callback is invoked in */
+	lua_State *state;
+
+	/* stores the reference of the callback in the registry */
+	int ref;
+
+} _resolveRequest_t;
+
+/**
+ * defines the maximum number of arguments and environment variables passed to
+ * server.spawn().
+ */
+#define _SPAWN_ARGS_MAX (256)
+
+/**
+ * defines the signature of the functions of the encoding api.
+ */
+typedef int (*_encoder_t)(buf_t*, const void*, size_t);
+
+/**
+ * defines the type name for all messagepack decoder objects.
+ */
+#define _MPACK_TYPE_NAME _SERVER_REGISTRY_PREFIX "mpack"
+
+/**
+ * defines the options of the messagepack encoder.
+ */
+typedef struct {
+
+	/* used to check whether empty tables are encoded as array or map */
+	int emptyArray;
+
+	/* used to check whether strings are encoded as binaries */
+	int binary;
+
+} _mpackOptions_t;
+
+/**
+ * defines the options of the json encoder.
+ */
+typedef struct {
+
+	/* used to check whether empty tables are encoded as array or object */
+	int emptyArray;
+
+	/* stores the number of significant digits of numbers */
+	int precision;
+
+} _jsonOptions_t;
+
 /**
  * stores the used lua state.
  */
 static lua_State *_state;
 
+/**
+ * stores the scratch buffer used for results which are returned as strings.
+ */
+static buf_t _scratch;
+
+/**
+ * stores the original allocator of the lua state and its user data.
+ */
+static lua_Alloc _luaAlloc;
+static void *_luaAllocData;
+
+/**
+ * stores the number of memory allocations done by the lua state.
+ */
+static size_t _allocCount;
+
+/**
+ * the address of this variable is used as null value by the json and the
+ * messagepack api.
+ */
+static char _null;
+
+/**
+ * stores the error message of the json encoder.
+ */
+static const char *_jsonError;
+
+/**
+ * stores the number of allocations of the last json document.
+ */
+static size_t _jsonAllocations;
+
+/**
+ * stores the error message of the messagepack encoder and decoder.
+ */
+static const char *_mpackError;
+
+/**
+ * allocator function of the lua state which counts the allocations and passes
+ * them on to the original allocator.
+ */
+static void *_countingAlloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	/* count every new block and every growing block. if ptr is null osize
+	 * contains the type of the object and not a size. */
+	if(nsize > 0 && (ptr == NULL || nsize > osize))
+	{
+		++_allocCount;
+	}
+
+	return _luaAlloc(ud, ptr, osize, nsize);
+}
+
 /**
  * lua wrapper function for bufPeek().
  */
@@ -367,15 +558,125 @@ static int _luaServerSetCallback(lua_State *state)
 }
 
 /**
- * lua wrapper function for serverOpenSocket().
+ * feeds synthetic events through the server callback the same way the event
+ * loop does, without any sockets. expects the event name, the data appended to
+ * the input buffer before every event (may be nil), the number of events
+ * (default 1) and the client descriptor (default 0). the output is discarded.
+ * returns the number of events the callback returned true for, the number of
+ * bytes written to the output buffer and the number of allocations of the lua
+ * state. used by ./bench/dispatch.lua.
+ */
+static int _luaServerDispatch(lua_State *state)
+{
+	const char *data = luaL_optstring(state, 2, "");
+	size_t len = lua_rawlen(state, 2), allocCount = _allocCount, bytes = 0;
+	int count = luaL_optint(state, 3, 1), fd = luaL_optint(state, 4, 0);
+	int accepted = 0, i;
+	serverCallback_t callback = serverGetCallback();
+	eventContext_t context;
+	buf_t iBuf, oBuf;
+
+	/* find the event */
+	for(i=0;i<EVENT_COUNT;++i)
+	{
+		if(strcmp(luaL_checkstring(state, 1), _getEventStr((event_t) i)) == 0)
+		{
+			break;
+		}
+	}
+
+	luaL_argcheck(state, i < EVENT_COUNT, 1, "invalid event");
+	luaL_argcheck(state, callback != NULL, 1, "no callback");
+	luaL_argcheck(state, fd >= 0 && fd < SOCKET_MAX, 4, "invalid socket");
+
+	context.event = (event_t) i;
+	context.sFd = INVALID_SOCKET;
+
+	/* only socket events have a client and buffers */
+	if(context.event == EVENT_SOCKET_ACCEPT
+		|| context.event == EVENT_SOCKET_READ
+		|| context.event == EVENT_SOCKET_WRITE)
+	{
+		context.cFd = fd;
+		context.iBuf = &iBuf;
+		context.oBuf = &oBuf;
+	}
+	else
+	{
+		context.cFd = context.event == EVENT_SOCKET_CLOSE ? fd : INVALID_SOCKET;
+		context.iBuf = NULL;
+		context.oBuf = NULL;
+	}
+
+	memset(&iBuf, 0, sizeof(iBuf));
+	memset(&oBuf, 0, sizeof(oBuf));
+
+	for(i=0;i<count;++i)
+	{
+		if(!bufAppend(&iBuf, data, len))
+		{
+			bufClear(&iBuf);
+			bufClear(&oBuf);
+
+			return luaL_error(state, "out of memory");
+		}
+
+		accepted += callback(&context) ? 1 : 0;
+
+		bytes += oBuf.len;
+		bufConsume(&oBuf, oBuf.len);
+	}
+
+	bufClear(&iBuf);
+	bufClear(&oBuf);
+
+	lua_pushinteger(state, (lua_Integer) accepted);
+	lua_pushinteger(state, (lua_Integer) bytes);
+	lua_pushinteger(state, (lua_Integer) (_allocCount - allocCount));
+
+	return 3;
+}
+
+/**
+ * lua wrapper function for serverOpenSocket(). the optional third parameter is
+ * a table of listener options, supported is proxyProtocol (boolean).
  */
 static int _luaServerOpenSocket(lua_State *state)
 {
-	/* add the server to the system and push the result onto the lua stack */
-	_pushSocketFd(state, serverOpenSocket(
+	int fd, useProxy = 0, isStats = 0;
+
+	/* get the options before the socket is opened */
+	if(!lua_isnoneornil(state, 3))
+	{
+		luaL_checktype(state, 3, LUA_TTABLE);
+
+		lua_getfield(state, 3, "proxyProtocol");
+		useProxy = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+
+		lua_getfield(state, 3, "stats");
+		isStats = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+	}
+
+	/* add the server to the system */
+	fd = serverOpenSocket(
 		luaL_checkstring(state, 1),
 		luaL_checkstring(state, 2)
-	));
+	);
+
+	if(fd != INVALID_SOCKET && useProxy)
+	{
+		serverSetProxyProtocol(fd, 1);
+	}
+
+	if(fd != INVALID_SOCKET && isStats)
+	{
+		serverSetStatsEndpoint(fd, 1);
+	}
+
+	/* push the result onto the lua stack */
+	_pushSocketFd(state, fd);
 
 	return 1;
 }
@@ -392,197 +693,4313 @@ static int _luaServerCloseSocket(lua_State *state)
 }
 
 /**
- * lua wrapper function for serverGetSocketAddr().
+ * lua wrapper function for serverPauseRead().
  */
-static int _luaServerGetSocketAddr(lua_State *state)
+static int _luaServerPauseRead(lua_State *state)
 {
-	int port;
-	const char *host;
-
-	/* get the address */
-	if(serverGetSocketAddr(luaL_checkint(state, 1), &host, &port))
-	{
-		/* push the address and port onto the stack */
-		lua_pushstring(state, host);
-		lua_pushinteger(state, (lua_Integer) port);
-
-		return 2;
-	}
+	/* stop reading from the socket */
+	serverPauseRead(luaL_checkint(state, 1));
 
 	return 0;
 }
 
 /**
- * lua wrapper function for serverChangeDir().
+ * lua wrapper function for serverResumeRead().
  */
-static int _luaServerChangeDir(lua_State *state)
+static int _luaServerResumeRead(lua_State *state)
 {
-	/* change the current working directory */
-	lua_pushboolean(state, serverChangeDir(luaL_checkstring(state, 1)));
+	/* continue reading from the socket */
+	serverResumeRead(luaL_checkint(state, 1));
 
-	return 1;
+	return 0;
 }
 
 /**
- * lua wrapper function for serverIsPrivileged().
+ * returns the number field of the table at the given index or 0 if it is not
+ * a number.
  */
-static int _luaServerIsPrivileged(lua_State *state)
+static lua_Number _getNumberField(lua_State *state, int idx, const char *name)
 {
-	/* check if the process has privileged rights */
-	lua_pushboolean(state, serverIsPrivileged());
+	lua_Number value;
 
-	return 1;
+	lua_getfield(state, idx, name);
+	value = lua_tonumber(state, -1);
+	lua_pop(state, 1);
+
+	return value;
 }
 
 /**
- * lua wrapper function for serverChangeUser().
+ * lua wrapper function for serverSetAdmission(). expects a table with the
+ * limits or nil to disable the admission control.
  */
-static int _luaServerChangeUser(lua_State *state)
+static int _luaServerSetAdmission(lua_State *state)
 {
-	/* try to change the user of the process */
-	lua_pushboolean(state, serverChangeUser(luaL_checkstring(state, 1)));
+	admitConfig_t config;
 
-	return 1;
-}
+	if(lua_isnoneornil(state, 1))
+	{
+		lua_pushboolean(state, serverSetAdmission(NULL));
 
-/**
- * lua wrapper function for serverJail().
- */
-static int _luaServerJail(lua_State *state)
-{
-	/* create the jail */
-	lua_pushboolean(state, serverJail(luaL_checkstring(state, 1)));
+		return 1;
+	}
+
+	luaL_checktype(state, 1, LUA_TTABLE);
+
+	config.ipv4Prefix = (int) _getNumberField(state, 1, "ipv4Prefix");
+	config.ipv6Prefix = (int) _getNumberField(state, 1, "ipv6Prefix");
+	config.maxConnections = (unsigned int) _getNumberField(
+		state, 1, "maxConnections"
+	);
+	config.rate = _getNumberField(state, 1, "rate");
+	config.burst = _getNumberField(state, 1, "burst");
+	config.byteRate = _getNumberField(state, 1, "byteRate");
+	config.byteBurst = _getNumberField(state, 1, "byteBurst");
+
+	lua_pushboolean(state, serverSetAdmission(&config));
 
 	return 1;
 }
 
 /**
- * lua wrapper function for serverChangeUserAndJail().
+ * lua wrapper function for serverAdmitRequest().
  */
-static int _luaServerChangeUserAndJail(lua_State *state)
+static int _luaServerAdmitRequest(lua_State *state)
 {
-	/* change the user and establish a root jail */
-	lua_pushboolean(state, serverChangeUserAndJail(
-		luaL_checkstring(state, 1),
-		luaL_checkstring(state, 2)
+	lua_pushboolean(state, serverAdmitRequest(
+		luaL_checkint(state, 1), luaL_optnumber(state, 2, 1)
 	));
 
 	return 1;
 }
 
 /**
- * lua wrapper function for serverDaemonize().
+ * lua wrapper function for serverGetAdmitStats(). returns a table or nil if
+ * the admission control is disabled.
  */
-static int _luaServerDaemonize(lua_State *state)
+static int _luaServerAdmitStats(lua_State *state)
 {
-	/* turn the process into a daemon */
-	lua_pushboolean(state, serverDaemonize());
+	const admitStats_t *stats = serverGetAdmitStats();
+
+	if(stats == NULL)
+	{
+		lua_pushnil(state);
+
+		return 1;
+	}
+
+	lua_createtable(state, 0, 6);
+
+	lua_pushnumber(state, (lua_Number) stats->accepted);
+	lua_setfield(state, -2, "accepted");
+
+	lua_pushnumber(state, (lua_Number) stats->rejectedConnections);
+	lua_setfield(state, -2, "rejectedConnections");
+
+	lua_pushnumber(state, (lua_Number) stats->rejectedRate);
+	lua_setfield(state, -2, "rejectedRate");
+
+	lua_pushnumber(state, (lua_Number) stats->rejectedRequests);
+	lua_setfield(state, -2, "rejectedRequests");
+
+	lua_pushnumber(state, (lua_Number) stats->throttled);
+	lua_setfield(state, -2, "throttled");
+
+	lua_pushnumber(state, (lua_Number) stats->evictions);
+	lua_setfield(state, -2, "evictions");
 
 	return 1;
 }
 
 /**
- * registers the server api with lua.
+ * invokes the lua callback of a lookup with the name, a list of the addresses
+ * (nil if the lookup failed) and the error message.
  */
-static void _registerServerApi(void)
+static void _luaResolveCallback(
+	const char *name,
+	const struct sockaddr_storage *addrs,
+	size_t count,
+	int error,
+	void *arg
+)
 {
-	/* possible lua server functions */
-	const luaL_Reg funcs[] = {
-		{"setCallback", _luaServerSetCallback},
-		{"openSocket", _luaServerOpenSocket},
-		{"closeSocket", _luaServerCloseSocket},
-		{"getSocketAddr", _luaServerGetSocketAddr},
-		{"changeDir", _luaServerChangeDir},
-		{"isPrivileged", _luaServerIsPrivileged},
-		{"changeUser", _luaServerChangeUser},
-		{"jail", _luaServerJail},
-		{"changeUserAndJail", _luaServerChangeUserAndJail},
-		{"daemonize", _luaServerDaemonize},
-		{NULL, NULL}
-	};
+	_resolveRequest_t *request = (_resolveRequest_t*) arg;
+	lua_State *state = request->state;
+	const char *host;
+	int port;
+	size_t i;
 
-	/* create the server api and make it accessible */
-	luaL_newlib(_state, funcs);
-	lua_setglobal(_state, "server");
-}
+	luaL_checkstack(state, 5, NULL);
 
-/**
- * function that is used as the lua log function. calls internally the script
- * defined log function.
- */
-static void _luaLogCallback(const char *msg)
-{
-	/* get the callback function from the registry */
-	lua_pushliteral(_state, _LOG_CALLBACK_INDEX);
-	lua_rawget(_state, LUA_REGISTRYINDEX);
+	/* get the callback and release it */
+	lua_rawgeti(state, LUA_REGISTRYINDEX, request->ref);
+	luaL_unref(state, LUA_REGISTRYINDEX, request->ref);
+	free(request);
 
-	/* push the context onto the stack */
-	lua_pushstring(_state, msg);
+	lua_pushstring(state, name);
 
-	/* invoke the callback function */
-	if(lua_pcall(_state, 1, 0, 0) != LUA_OK)
+	if(error == 0)
 	{
-		/* just remove the error message from the stack to prevent an endless
-		 * loop. calling logWrite() at this point would produce the same error
-		 * over and over again. */
-		lua_pop(_state, 1);
-	}
-}
+		lua_createtable(state, (int) count, 0);
 
-/**
- * lua wrapper function for logSetCallback().
- */
-static int _luaLogSetCallback(lua_State *state)
-{
+		for(i=0;i<count;++i)
+		{
+			if(socketFormatAddr(addrs + i, &host, &port))
+			{
+				lua_pushstring(state, host);
+				lua_rawseti(state, -2, (int) lua_rawlen(state, -2) + 1);
+			}
+		}
+
+		lua_pushnil(state);
+	}
+	else
+	{
+		lua_pushnil(state);
+		lua_pushstring(state, gai_strerror(error));
+	}
+
+	if(lua_pcall(state, 3, 0, 0) != LUA_OK)
+	{
+		logWrite("ERROR lua_pcall()");
+		logWrite(lua_tostring(state, -1));
+
+		lua_pop(state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for serverResolve(). expects the name and the callback,
+ * which is invoked with the name, the list of addresses and an error message.
+ * returns true if the callback was invoked already (cached or numeric), false
+ * if it is invoked later and nil if the lookup failed to start.
+ */
+static int _luaServerResolve(lua_State *state)
+{
+	const char *name = luaL_checkstring(state, 1);
+	_resolveRequest_t *request;
+	resolveResult_t result;
+
+	luaL_checktype(state, 2, LUA_TFUNCTION);
+
+	request = (_resolveRequest_t*) malloc(sizeof(_resolveRequest_t));
+
+	if(request == NULL)
+	{
+		return luaL_error(state, "not enough memory");
+	}
+
+	/* a cached name is answered right away in the calling state */
+	lua_pushvalue(state, 2);
+	request->ref = luaL_ref(state, LUA_REGISTRYINDEX);
+	request->state = state;
+
+	result = serverResolve(name, _luaResolveCallback, request);
+
+	if(result == RESOLVE_ERROR)
+	{
+		luaL_unref(state, LUA_REGISTRYINDEX, request->ref);
+		free(request);
+
+		lua_pushnil(state);
+	}
+	else
+	{
+		/* later the callback is invoked from the event loop */
+		if(result == RESOLVE_PENDING)
+		{
+			request->state = _state;
+		}
+
+		lua_pushboolean(state, result == RESOLVE_CACHED);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverSetResolveTtl(). expects the ttl and the
+ * optional ttl of failures in seconds.
+ */
+static int _luaServerSetResolveTtl(lua_State *state)
+{
+	double ttl = luaL_checknumber(state, 1);
+
+	lua_pushboolean(state, serverSetResolveTtl(
+		ttl, luaL_optnumber(state, 2, RESOLVE_NEGATIVE_TTL)
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverGetResolveStats(). returns nil if the
+ * resolver was not used yet.
+ */
+static int _luaServerResolveStats(lua_State *state)
+{
+	const resolveStats_t *stats = serverGetResolveStats();
+
+	if(stats == NULL)
+	{
+		lua_pushnil(state);
+
+		return 1;
+	}
+
+	lua_createtable(state, 0, 5);
+
+	lua_pushnumber(state, (lua_Number) stats->hits);
+	lua_setfield(state, -2, "hits");
+
+	lua_pushnumber(state, (lua_Number) stats->misses);
+	lua_setfield(state, -2, "misses");
+
+	lua_pushnumber(state, (lua_Number) stats->coalesced);
+	lua_setfield(state, -2, "coalesced");
+
+	lua_pushnumber(state, (lua_Number) stats->failures);
+	lua_setfield(state, -2, "failures");
+
+	lua_pushnumber(state, (lua_Number) stats->pending);
+	lua_setfield(state, -2, "pending");
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverGetStats(). returns the counters as table or
+ * in the prometheus text format if the argument is "prometheus".
+ */
+static int _luaServerStats(lua_State *state)
+{
+	const serverStats_t *stats;
+	int i;
+
+	if(!lua_isnoneornil(state, 1))
+	{
+		luaL_argcheck(
+			state, strcmp(luaL_checkstring(state, 1), "prometheus") == 0, 1,
+			"invalid format"
+		);
+
+		bufConsume(&_scratch, _scratch.len);
+
+		if(!serverFormatStats(&_scratch))
+		{
+			return luaL_error(state, "out of memory");
+		}
+
+		lua_pushlstring(state, (const char*) _scratch.data, _scratch.len);
+
+		return 1;
+	}
+
+	stats = serverGetStats();
+
+	lua_createtable(state, 0, 10);
+
+	lua_pushnumber(state, (lua_Number) stats->accepts);
+	lua_setfield(state, -2, "accepts");
+
+	lua_pushnumber(state, (lua_Number) stats->closes);
+	lua_setfield(state, -2, "closes");
+
+	lua_pushnumber(state, (lua_Number) stats->connections);
+	lua_setfield(state, -2, "connections");
+
+	lua_pushnumber(state, (lua_Number) stats->bytesIn);
+	lua_setfield(state, -2, "bytesIn");
+
+	lua_pushnumber(state, (lua_Number) stats->bytesOut);
+	lua_setfield(state, -2, "bytesOut");
+
+	lua_pushnumber(state, (lua_Number) stats->bufferMemory);
+	lua_setfield(state, -2, "bufferMemory");
+
+	lua_pushnumber(state, (lua_Number) stats->wakeups);
+	lua_setfield(state, -2, "wakeups");
+
+	lua_pushnumber(state, (lua_Number) stats->timeouts);
+	lua_setfield(state, -2, "timeouts");
+
+	/* the callbacks per event */
+	lua_createtable(state, 0, EVENT_COUNT);
+
+	for(i=0;i<EVENT_COUNT;++i)
+	{
+		lua_pushnumber(state, (lua_Number) stats->events[i]);
+		lua_setfield(state, -2, _getEventStr((event_t) i));
+	}
+
+	lua_setfield(state, -2, "events");
+
+	/* the failures */
+	lua_createtable(state, 0, 3);
+
+	lua_pushnumber(state, (lua_Number) stats->selectErrors);
+	lua_setfield(state, -2, "select");
+
+	lua_pushnumber(state, (lua_Number) stats->acceptErrors);
+	lua_setfield(state, -2, "accept");
+
+	lua_pushnumber(state, (lua_Number) stats->writeErrors);
+	lua_setfield(state, -2, "write");
+
+	lua_setfield(state, -2, "errors");
+
+	return 1;
+}
+
+/**
+ * names of the metrics the connections can be sorted by, in the order of
+ * connMetric_t.
+ */
+static const char *_connMetricNames[] = {
+	"age",
+	"bytesIn",
+	"bytesOut",
+	"events",
+	"callbackTime",
+	"rtt",
+	"retransmits",
+	"cwnd",
+	NULL
+};
+
+/**
+ * pushes the accounting of a connection as table onto the stack.
+ */
+static void _pushConnStats(lua_State *state, const connStats_t *stats)
+{
+	lua_createtable(state, 0, 9);
+
+	lua_pushinteger(state, stats->fd);
+	lua_setfield(state, -2, "fd");
+
+	lua_pushnumber(state, (lua_Number) stats->age);
+	lua_setfield(state, -2, "age");
+
+	lua_pushnumber(state, (lua_Number) stats->bytesIn);
+	lua_setfield(state, -2, "bytesIn");
+
+	lua_pushnumber(state, (lua_Number) stats->bytesOut);
+	lua_setfield(state, -2, "bytesOut");
+
+	lua_pushnumber(state, (lua_Number) stats->events);
+	lua_setfield(state, -2, "events");
+
+	lua_pushnumber(state, (lua_Number) stats->callbackTime);
+	lua_setfield(state, -2, "callbackTime");
+
+	lua_pushnumber(state, (lua_Number) stats->tcpInfo.rtt);
+	lua_setfield(state, -2, "rtt");
+
+	lua_pushnumber(state, (lua_Number) stats->tcpInfo.retransmits);
+	lua_setfield(state, -2, "retransmits");
+
+	lua_pushnumber(state, (lua_Number) stats->tcpInfo.cwnd);
+	lua_setfield(state, -2, "cwnd");
+}
+
+/**
+ * lua wrapper function for serverSetAccounting(). the tcp information is not
+ * sampled if the interval is omitted. returns true if everything is ok and
+ * false if not.
+ */
+static int _luaServerSetAccounting(lua_State *state)
+{
+	int enabled = lua_toboolean(state, 1);
+	double interval = (double) luaL_optnumber(state, 2, 0);
+
+	lua_pushboolean(state, serverSetAccounting(enabled, interval));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverGetConnStats(). returns the accounting of the
+ * given client socket as table or nil if there is no such client.
+ */
+static int _luaServerConnStats(lua_State *state)
+{
+	connStats_t stats;
+
+	if(!serverGetConnStats((int) luaL_checkinteger(state, 1), &stats))
+	{
+		lua_pushnil(state);
+
+		return 1;
+	}
+
+	_pushConnStats(state, &stats);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverGetTopConns(). the arguments are the metric
+ * and the number of connections (10 by default). returns an array of the
+ * accounting tables in descending order of the metric.
+ */
+static int _luaServerTopConnections(lua_State *state)
+{
+	connMetric_t metric = (connMetric_t) luaL_checkoption(
+		state, 1, NULL, _connMetricNames
+	);
+	lua_Integer count = luaL_optinteger(state, 2, 10);
+	connStats_t *stats;
+	size_t len, i;
+
+	luaL_argcheck(state, count >= 0 && count <= SOCKET_MAX, 2,
+		"invalid count"
+	);
+
+	/* the scratch buffer holds the result of the query */
+	bufConsume(&_scratch, _scratch.len);
+
+	if(!bufReserve(&_scratch, (size_t) count * sizeof(connStats_t)))
+	{
+		return luaL_error(state, "out of memory");
+	}
+
+	stats = (connStats_t*) _scratch.data;
+	len = serverGetTopConns(metric, stats, (size_t) count);
+
+	lua_createtable(state, (int) len, 0);
+
+	for(i=0;i<len;++i)
+	{
+		_pushConnStats(state, stats + i);
+		lua_rawseti(state, -2, (lua_Integer) i + 1);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverFormatTopConns(). the arguments are the
+ * metric ("bytesOut" by default) and the number of connections (10 by
+ * default). returns the table of the connections as string.
+ */
+static int _luaServerDumpConnections(lua_State *state)
+{
+	connMetric_t metric = (connMetric_t) luaL_checkoption(
+		state, 1, "bytesOut", _connMetricNames
+	);
+	lua_Integer count = luaL_optinteger(state, 2, 10);
+
+	luaL_argcheck(state, count >= 0, 2, "invalid count");
+
+	bufConsume(&_scratch, _scratch.len);
+
+	if(!serverFormatTopConns(&_scratch, metric, (size_t) count))
+	{
+		return luaL_error(state, "out of memory");
+	}
+
+	lua_pushlstring(state, (const char*) _scratch.data, _scratch.len);
+
+	return 1;
+}
+
+/**
+ * invokes the lua callback of a child process started with server.spawn(). the
+ * callback is stored in the registry, its reference is the argument.
+ */
+static void _luaProcessCallback(
+	process_t *process,
+	processEvent_t event,
+	buf_t *buf,
+	void *arg
+)
+{
+	static const char *events[] = {"stdout", "stderr", "drain", "exit"};
+	int *ref = (int*) arg, count = 2, status;
+	size_t len;
+	void *data;
+
+	luaL_checkstack(_state, 5, NULL);
+
+	lua_rawgeti(_state, LUA_REGISTRYINDEX, *ref);
+	lua_pushinteger(_state, (lua_Integer) processGetPid(process));
+	lua_pushstring(_state, events[event]);
+
+	if(buf != NULL)
+	{
+		/* hand the whole output to lua */
+		data = bufPeek(buf, &len);
+		lua_pushlstring(_state, (const char*) data, len);
+		bufConsume(buf, len);
+
+		++count;
+	}
+	else if(event == PROCESS_EXIT)
+	{
+		/* the exit code or nil and the signal which terminated the child */
+		status = processGetStatus(process);
+
+		if(WIFEXITED(status))
+		{
+			lua_pushinteger(_state, WEXITSTATUS(status));
+			lua_pushnil(_state);
+		}
+		else
+		{
+			lua_pushnil(_state);
+			lua_pushinteger(_state, WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+		}
+
+		count += 2;
+
+		/* the process is freed after this callback */
+		luaL_unref(_state, LUA_REGISTRYINDEX, *ref);
+		free(ref);
+	}
+
+	if(lua_pcall(_state, count, 0, 0) != LUA_OK)
+	{
+		logWrite("ERROR lua_pcall()");
+		logWrite(lua_tostring(_state, -1));
+
+		lua_pop(_state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for processSpawn(). expects the argument vector, the
+ * environment as table (nil for the environment of the server) and the
+ * callback. returns the process id or nil.
+ */
+static int _luaServerSpawn(lua_State *state)
+{
+	const char *argv[_SPAWN_ARGS_MAX + 1];
+	char *envp[_SPAWN_ARGS_MAX + 1];
+	size_t count = 0, i, keyLen, valueLen;
+	const char *key, *value, *error;
+	process_t *process;
+	int *ref;
+
+	luaL_checktype(state, 1, LUA_TTABLE);
+	luaL_checktype(state, 3, LUA_TFUNCTION);
+
+	/* the strings stay referenced by the table while spawning */
+	for(i=0;i<_SPAWN_ARGS_MAX;++i)
+	{
+		lua_rawgeti(state, 1, (int) i + 1);
+
+		if(lua_isnil(state, -1))
+		{
+			lua_pop(state, 1);
+			break;
+		}
+
+		if(lua_type(state, -1) != LUA_TSTRING)
+		{
+			return luaL_argerror(state, 1, "arguments must be strings");
+		}
+
+		argv[i] = lua_tostring(state, -1);
+		lua_pop(state, 1);
+	}
+
+	argv[i] = NULL;
+	luaL_argcheck(state, i > 0 && i < _SPAWN_ARGS_MAX, 1, "invalid arguments");
+
+	/* build the environment from name value pairs */
+	if(!lua_isnil(state, 2))
+	{
+		luaL_checktype(state, 2, LUA_TTABLE);
+
+		for(lua_pushnil(state);lua_next(state, 2);lua_pop(state, 1))
+		{
+			if(lua_type(state, -2) != LUA_TSTRING
+				|| lua_type(state, -1) != LUA_TSTRING)
+			{
+				error = "variables must be strings";
+			}
+			else if(count == _SPAWN_ARGS_MAX)
+			{
+				error = "too many variables";
+			}
+			else
+			{
+				key = lua_tolstring(state, -2, &keyLen);
+				value = lua_tolstring(state, -1, &valueLen);
+
+				envp[count] = (char*) malloc(keyLen + valueLen + 2);
+				error = envp[count] == NULL ? "out of memory" : NULL;
+			}
+
+			/* an incomplete environment is an error, the strings built so
+			 * far are freed first */
+			if(error != NULL)
+			{
+				for(i=0;i<count;++i)
+				{
+					free(envp[i]);
+				}
+
+				return luaL_argerror(state, 2, error);
+			}
+
+			memcpy(envp[count], key, keyLen);
+			envp[count][keyLen] = '=';
+			memcpy(envp[count] + keyLen + 1, value, valueLen + 1);
+
+			++count;
+		}
+
+		envp[count] = NULL;
+	}
+
+	if((ref = (int*) malloc(sizeof(int))) != NULL)
+	{
+		lua_pushvalue(state, 3);
+		*ref = luaL_ref(state, LUA_REGISTRYINDEX);
+	}
+
+	process = ref == NULL ? NULL : processSpawn(
+		(char *const*) argv, lua_isnil(state, 2) ? NULL : envp,
+		_luaProcessCallback, ref
+	);
+
+	for(i=0;i<count;++i)
+	{
+		free(envp[i]);
+	}
+
+	if(process == NULL)
+	{
+		if(ref != NULL)
+		{
+			luaL_unref(state, LUA_REGISTRYINDEX, *ref);
+			free(ref);
+		}
+
+		lua_pushnil(state);
+
+		return 1;
+	}
+
+	lua_pushinteger(state, (lua_Integer) processGetPid(process));
+
+	return 1;
+}
+
+/**
+ * returns the running process of the process id at the given stack index or
+ * raises an error.
+ */
+static process_t *_checkProcess(lua_State *state, int index)
+{
+	process_t *process = processFind((pid_t) luaL_checkinteger(state, index));
+
+	if(process == NULL)
+	{
+		luaL_argerror(state, index, "no such process");
+	}
+
+	return process;
+}
+
+/**
+ * lua wrapper function for processWrite(). returns true if the data was
+ * queued.
+ */
+static int _luaServerWriteProcess(lua_State *state)
+{
+	size_t len;
+	process_t *process = _checkProcess(state, 1);
+	const char *data = luaL_checklstring(state, 2, &len);
+
+	lua_pushboolean(state, processWrite(process, data, len));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for processCloseInput().
+ */
+static int _luaServerCloseProcessInput(lua_State *state)
+{
+	processCloseInput(_checkProcess(state, 1));
+
+	return 0;
+}
+
+/**
+ * lua wrapper function for processKill(). the signal is SIGTERM by default.
+ */
+static int _luaServerKillProcess(lua_State *state)
+{
+	process_t *process = _checkProcess(state, 1);
+
+	lua_pushboolean(state, processKill(
+		process, (int) luaL_optinteger(state, 2, SIGTERM)
+	));
+
+	return 1;
+}
+
+/**
+ * invokes the lua callback of a descriptor watched with server.watchFd().
+ */
+static void _luaWatchCallback(int fd, int events, void *arg)
+{
+	luaL_checkstack(_state, 4, NULL);
+
+	/* get the callback of the descriptor */
+	luaL_getsubtable(_state, LUA_REGISTRYINDEX, _WATCH_INDEX);
+	lua_rawgeti(_state, -1, fd);
+	lua_remove(_state, -2);
+
+	lua_pushinteger(_state, fd);
+	lua_pushstring(_state, events == WATCH_READ ? "read" : "write");
+
+	if(lua_pcall(_state, 2, 0, 0) != LUA_OK)
+	{
+		logWrite("ERROR lua_pcall()");
+		logWrite(lua_tostring(_state, -1));
+
+		lua_pop(_state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for serverWatchFd(). expects the descriptor, the events
+ * ("r", "w" or "rw") and the callback, which is invoked with the descriptor
+ * and "read" or "write". returns true if the descriptor is watched.
+ */
+static int _luaServerWatchFd(lua_State *state)
+{
+	int fd = luaL_checkint(state, 1);
+	const char *mode = luaL_checkstring(state, 2);
+	int events = (strchr(mode, 'r') != NULL ? WATCH_READ : 0)
+		| (strchr(mode, 'w') != NULL ? WATCH_WRITE : 0);
+	int result;
+
+	/* a descriptor without events would keep the server running but never
+	 * fire, only c modules may park a descriptor like this */
+	luaL_argcheck(state, events != 0, 2, "invalid events");
+	luaL_checktype(state, 3, LUA_TFUNCTION);
+
+	if((result = serverWatchFd(fd, events, _luaWatchCallback, NULL)))
+	{
+		luaL_getsubtable(state, LUA_REGISTRYINDEX, _WATCH_INDEX);
+		lua_pushvalue(state, 3);
+		lua_rawseti(state, -2, fd);
+		lua_pop(state, 1);
+	}
+
+	lua_pushboolean(state, result);
+
+	return 1;
+}
+
+/**
+ * maps the names of the signals lua may handle to their numbers.
+ */
+static const struct {
+	const char *name;
+	int sigNo;
+} _signalNames[] = {
+	{"HUP", SIGHUP},
+	{"INT", SIGINT},
+	{"QUIT", SIGQUIT},
+	{"TERM", SIGTERM},
+	{"USR1", SIGUSR1},
+	{"USR2", SIGUSR2},
+	{"ALRM", SIGALRM},
+	{"WINCH", SIGWINCH},
+	{NULL, 0}
+};
+
+/**
+ * invokes the lua handler of a signal registered with server.onSignal().
+ */
+static void _luaSignalCallback(int sigNo, void *arg)
+{
+	int i;
+
+	luaL_checkstack(_state, 3, NULL);
+
+	/* get the handler of the signal */
+	luaL_getsubtable(_state, LUA_REGISTRYINDEX, _SIGNAL_INDEX);
+	lua_rawgeti(_state, -1, sigNo);
+	lua_remove(_state, -2);
+
+	/* pass the name if there is one */
+	for(i=0;_signalNames[i].name!=NULL&&_signalNames[i].sigNo!=sigNo;++i)
+	{
+	}
+
+	if(_signalNames[i].name != NULL)
+	{
+		lua_pushstring(_state, _signalNames[i].name);
+	}
+	else
+	{
+		lua_pushinteger(_state, sigNo);
+	}
+
+	if(lua_pcall(_state, 1, 0, 0) != LUA_OK)
+	{
+		logWrite("ERROR lua_pcall()");
+		logWrite(lua_tostring(_state, -1));
+
+		lua_pop(_state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for signalWatch() and signalUnwatch(). expects the
+ * signal (a number or a name like "HUP" or "SIGHUP") and the handler, which is
+ * invoked from the event loop with the name of the signal. nil as handler
+ * restores the default behaviour of the server. returns true if everything is
+ * ok.
+ */
+static int _luaServerOnSignal(lua_State *state)
+{
+	const char *name;
+	int sigNo = 0, result = 1, i;
+
+	lua_settop(state, 2);
+
+	if(lua_type(state, 1) == LUA_TNUMBER)
+	{
+		sigNo = lua_tointeger(state, 1);
+	}
+	else
+	{
+		name = luaL_checkstring(state, 1);
+		name += strncmp(name, "SIG", 3) == 0 ? 3 : 0;
+
+		for(i=0;_signalNames[i].name!=NULL;++i)
+		{
+			if(strcmp(name, _signalNames[i].name) == 0)
+			{
+				sigNo = _signalNames[i].sigNo;
+			}
+		}
+	}
+
+	/* SIGCHLD belongs to server.spawn() */
+	luaL_argcheck(state, sigNo > 0 && sigNo != SIGCHLD, 1, "invalid signal");
+
+	if(lua_isnoneornil(state, 2))
+	{
+		signalUnwatch(sigNo);
+	}
+	else
+	{
+		luaL_checktype(state, 2, LUA_TFUNCTION);
+
+		result = signalWatch(sigNo, _luaSignalCallback, NULL);
+	}
+
+	if(result)
+	{
+		luaL_getsubtable(state, LUA_REGISTRYINDEX, _SIGNAL_INDEX);
+		lua_pushvalue(state, 2);
+		lua_rawseti(state, -2, sigNo);
+		lua_pop(state, 1);
+	}
+
+	lua_pushboolean(state, result);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverUnwatchFd(). only descriptors watched with
+ * server.watchFd() are affected.
+ */
+static int _luaServerUnwatchFd(lua_State *state)
+{
+	int fd = luaL_checkint(state, 1);
+
+	luaL_getsubtable(state, LUA_REGISTRYINDEX, _WATCH_INDEX);
+	lua_rawgeti(state, -1, fd);
+
+	if(!lua_isnil(state, -1))
+	{
+		serverUnwatchFd(fd);
+
+		lua_pushnil(state);
+		lua_rawseti(state, -3, fd);
+	}
+
+	lua_pop(state, 2);
+
+	return 0;
+}
+
+/**
+ * lua wrapper function for serverGetSocketAddr().
+ */
+static int _luaServerGetSocketAddr(lua_State *state)
+{
+	int port;
+	const char *host;
+
+	/* get the address */
+	if(serverGetSocketAddr(luaL_checkint(state, 1), &host, &port))
+	{
+		/* push the address and port onto the stack */
+		lua_pushstring(state, host);
+		lua_pushinteger(state, (lua_Integer) port);
+
+		return 2;
+	}
+
+	return 0;
+}
+
+/**
+ * lua wrapper function for serverChangeDir().
+ */
+static int _luaServerChangeDir(lua_State *state)
+{
+	/* change the current working directory */
+	lua_pushboolean(state, serverChangeDir(luaL_checkstring(state, 1)));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverIsPrivileged().
+ */
+static int _luaServerIsPrivileged(lua_State *state)
+{
+	/* check if the process has privileged rights */
+	lua_pushboolean(state, serverIsPrivileged());
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverChangeUser().
+ */
+static int _luaServerChangeUser(lua_State *state)
+{
+	/* try to change the user of the process */
+	lua_pushboolean(state, serverChangeUser(luaL_checkstring(state, 1)));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverJail().
+ */
+static int _luaServerJail(lua_State *state)
+{
+	/* create the jail */
+	lua_pushboolean(state, serverJail(luaL_checkstring(state, 1)));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverChangeUserAndJail().
+ */
+static int _luaServerChangeUserAndJail(lua_State *state)
+{
+	/* change the user and establish a root jail */
+	lua_pushboolean(state, serverChangeUserAndJail(
+		luaL_checkstring(state, 1),
+		luaL_checkstring(state, 2)
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for serverDaemonize().
+ */
+static int _luaServerDaemonize(lua_State *state)
+{
+	/* turn the process into a daemon */
+	lua_pushboolean(state, serverDaemonize());
+
+	return 1;
+}
+
+/**
+ * registers the server api with lua.
+ */
+static void _registerServerApi(void)
+{
+	/* possible lua server functions */
+	const luaL_Reg funcs[] = {
+		{"setCallback", _luaServerSetCallback},
+		{"dispatch", _luaServerDispatch},
+		{"openSocket", _luaServerOpenSocket},
+		{"closeSocket", _luaServerCloseSocket},
+		{"pauseRead", _luaServerPauseRead},
+		{"resumeRead", _luaServerResumeRead},
+		{"setAdmission", _luaServerSetAdmission},
+		{"admitRequest", _luaServerAdmitRequest},
+		{"admissionStats", _luaServerAdmitStats},
+		{"watchFd", _luaServerWatchFd},
+		{"unwatchFd", _luaServerUnwatchFd},
+		{"onSignal", _luaServerOnSignal},
+		{"spawn", _luaServerSpawn},
+		{"writeProcess", _luaServerWriteProcess},
+		{"closeProcessInput", _luaServerCloseProcessInput},
+		{"killProcess", _luaServerKillProcess},
+		{"resolve", _luaServerResolve},
+		{"setResolveTtl", _luaServerSetResolveTtl},
+		{"resolveStats", _luaServerResolveStats},
+		{"stats", _luaServerStats},
+		{"setAccounting", _luaServerSetAccounting},
+		{"connStats", _luaServerConnStats},
+		{"topConnections", _luaServerTopConnections},
+		{"dumpConnections", _luaServerDumpConnections},
+		{"getSocketAddr", _luaServerGetSocketAddr},
+		{"changeDir", _luaServerChangeDir},
+		{"isPrivileged", _luaServerIsPrivileged},
+		{"changeUser", _luaServerChangeUser},
+		{"jail", _luaServerJail},
+		{"changeUserAndJail", _luaServerChangeUserAndJail},
+		{"daemonize", _luaServerDaemonize},
+		{NULL, NULL}
+	};
+
+	/* create the server api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "server");
+}
+
+/**
+ * function that is used as the lua log function. calls internally the script
+ * defined log function.
+ */
+static void _luaLogCallback(const char *msg)
+{
+	/* get the callback function from the registry */
+	lua_pushliteral(_state, _LOG_CALLBACK_INDEX);
+	lua_rawget(_state, LUA_REGISTRYINDEX);
+
+	/* push the context onto the stack */
+	lua_pushstring(_state, msg);
+
+	/* invoke the callback function */
+	if(lua_pcall(_state, 1, 0, 0) != LUA_OK)
+	{
+		/* just remove the error message from the stack to prevent an endless
+		 * loop. calling logWrite() at this point would produce the same error
+		 * over and over again. */
+		lua_pop(_state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for logSetCallback().
+ */
+static int _luaLogSetCallback(lua_State *state)
+{
 	/* if nothing was given, disable logging */
 	if(lua_isnoneornil(state, 1))
 	{
-		/* disable logging with NULL */
-		logSetCallback(NULL);
+		/* disable logging with NULL */
+		logSetCallback(NULL);
+	}
+	else
+	{
+		/* the first argument of this function must be a lua function */
+		luaL_checktype(state, 1, LUA_TFUNCTION);
+
+		/* store the function in the lua registry */
+		lua_pushliteral(state, _LOG_CALLBACK_INDEX);
+		lua_pushvalue(state, 1);
+		lua_rawset(state, LUA_REGISTRYINDEX);
+
+		/* set the callback */
+		logSetCallback(_luaLogCallback);
+	}
+
+	return 0;
+}
+
+/**
+ * lua wrapper function for logWrite().
+ */
+static int _luaLogWrite(lua_State *state)
+{
+	/* write the log message */
+	logWrite(luaL_checkstring(state, 1));
+
+	return 0;
+}
+
+/**
+ * registers the log api with lua.
+ */
+static void _registerLogApi(void)
+{
+	/* possible lua server functions */
+	const luaL_Reg funcs[] = {
+		{"setCallback", _luaLogSetCallback},
+		{"write", _luaLogWrite},
+		{NULL, NULL}
+	};
+
+	/* create the log api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "log");
+}
+
+/**
+ * form callback used by form.parseQuery(). stores the fields in the table on
+ * top of the stack. repeated fields are collected in a table.
+ */
+static int _luaFormQueryCallback(formData_t *data, void *userData)
+{
+	lua_State *state = (lua_State*) userData;
+
+	/* get the current value of the field */
+	lua_pushlstring(state, data->name, data->nameLen);
+	lua_pushvalue(state, -1);
+	lua_rawget(state, -3);
+
+	switch(lua_type(state, -1))
+	{
+		/* the first occurence of the field, store the value */
+		case LUA_TNIL:
+			lua_pop(state, 1);
+			lua_pushlstring(state, data->value, data->valueLen);
+			lua_rawset(state, -3);
+			break;
+
+		/* there are already multiple values, append the new one */
+		case LUA_TTABLE:
+			lua_pushlstring(state, data->value, data->valueLen);
+			lua_rawseti(state, -2, lua_rawlen(state, -2) + 1);
+			lua_pop(state, 2);
+			break;
+
+		/* the second occurence, replace the value with a table */
+		default:
+			lua_createtable(state, 2, 0);
+			lua_insert(state, -2);
+			lua_rawseti(state, -2, 1);
+			lua_pushlstring(state, data->value, data->valueLen);
+			lua_rawseti(state, -2, 2);
+			lua_rawset(state, -3);
+			break;
+	}
+
+	return 1;
+}
+
+/**
+ * invokes the handler function with the given number of arguments in
+ * protected mode. an error is not raised right away, the parser stops first
+ * (the callback returns 0) and the caller raises it once the parser is in a
+ * consistent state. returns 1 if everything is ok and 0 if not.
+ */
+static int _callHandler(_handler_t *handler, int argCount)
+{
+	if(lua_pcall(handler->state, argCount, 0, 0) != 0)
+	{
+		handler->hasError = 1;
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * form callback used by the form parser objects. invokes the lua handler with
+ * the name of the event and its data.
+ */
+static int _luaFormCallback(formData_t *data, void *userData)
+{
+	_handler_t *handler = (_handler_t*) userData;
+	lua_State *state = handler->state;
+
+	/* push the handler function */
+	lua_pushvalue(state, handler->handler);
+
+	switch(data->event)
+	{
+		case FORM_EVENT_FIELD:
+			lua_pushliteral(state, "field");
+			lua_pushlstring(state, data->name, data->nameLen);
+			lua_pushlstring(state, data->value, data->valueLen);
+			return _callHandler(handler, 3);
+
+		case FORM_EVENT_PART:
+			lua_pushliteral(state, "part");
+			lua_pushlstring(state, data->name, data->nameLen);
+			lua_pushlstring(state, data->value, data->valueLen);
+			lua_pushlstring(state, data->type, data->typeLen);
+			return _callHandler(handler, 4);
+
+		case FORM_EVENT_DATA:
+			lua_pushliteral(state, "data");
+			lua_pushlstring(state, data->value, data->valueLen);
+			return _callHandler(handler, 2);
+
+		default:
+			lua_pushliteral(state, "end");
+			return _callHandler(handler, 1);
+	}
+}
+
+/**
+ * lua wrapper function for formExec().
+ */
+static int _luaFormExec(lua_State *state)
+{
+	size_t len;
+	const char *data;
+	_handler_t handler;
+	int result;
+
+	/* get the parser, the data and the handler from the arguments */
+	formParser_t *parser = luaL_checkudata(state, 1, _FORM_TYPE_NAME);
+	data = luaL_checklstring(state, 2, &len);
+	luaL_checktype(state, 3, LUA_TFUNCTION);
+
+	handler.state = state;
+	handler.handler = 3;
+	handler.hasError = 0;
+
+	/* parse the data; true means more data is required, false means the form
+	 * is complete and nil indicates an error */
+	result = formExec(parser, data, len, _luaFormCallback, &handler);
+
+	/* an error of the handler is raised once the parser stopped */
+	if(handler.hasError)
+	{
+		return lua_error(state);
+	}
+
+	switch(result)
+	{
+		case 1:
+			lua_pushboolean(state, 1);
+			break;
+
+		case 2:
+			lua_pushboolean(state, 0);
+			break;
+
+		default:
+			lua_pushnil(state);
+			break;
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for formFinish().
+ */
+static int _luaFormFinish(lua_State *state)
+{
+	_handler_t handler;
+	int result;
+
+	/* get the parser and the handler from the arguments */
+	formParser_t *parser = luaL_checkudata(state, 1, _FORM_TYPE_NAME);
+	luaL_checktype(state, 2, LUA_TFUNCTION);
+
+	handler.state = state;
+	handler.handler = 2;
+	handler.hasError = 0;
+
+	/* finish the form and push whether it is complete */
+	result = formFinish(parser, _luaFormCallback, &handler);
+
+	if(handler.hasError)
+	{
+		return lua_error(state);
+	}
+
+	lua_pushboolean(state, result == 2);
+
+	return 1;
+}
+
+/**
+ * frees the resources of a form parser object.
+ */
+static int _luaFormGc(lua_State *state)
+{
+	/* free the parser */
+	formClear(luaL_checkudata(state, 1, _FORM_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new form parser for the given content type. returns nil if the
+ * content type is not supported.
+ */
+static int _luaFormNewParser(lua_State *state)
+{
+	/* create the parser object */
+	formParser_t *parser = (formParser_t*) lua_newuserdata(
+		state, sizeof(formParser_t)
+	);
+
+	/* initialize the parser with the content type */
+	if(formInit(parser, luaL_checkstring(state, 1)))
+	{
+		/* assign the metatable to the parser object */
+		luaL_setmetatable(state, _FORM_TYPE_NAME);
+	}
+	else
+	{
+		/* the content type is not supported */
+		formClear(parser);
+		lua_pushnil(state);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for formParseQuery().
+ */
+static int _luaFormParseQuery(lua_State *state)
+{
+	size_t len;
+	const char *data = luaL_checklstring(state, 1, &len);
+
+	/* the fields are stored in a new table */
+	lua_newtable(state);
+
+	if(!formParseQuery(data, len, _luaFormQueryCallback, state))
+	{
+		lua_pushnil(state);
+	}
+
+	return 1;
+}
+
+/**
+ * registers the form api with lua.
+ */
+static void _registerFormApi(void)
+{
+	/* possible lua form parser functions */
+	const luaL_Reg methods[] = {
+		{"exec", _luaFormExec},
+		{"finish", _luaFormFinish},
+		{"__gc", _luaFormGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua form functions */
+	const luaL_Reg funcs[] = {
+		{"newParser", _luaFormNewParser},
+		{"parseQuery", _luaFormParseQuery},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the form parser types */
+	luaL_newmetatable(_state, _FORM_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the form api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "form");
+}
+
+/**
+ * invokes the given encoding function with the data of the first argument. if
+ * the second argument is a buffer the result is appended to it and true is
+ * pushed, otherwise the result is pushed as string. nil is pushed if the
+ * encoding failed.
+ */
+static int _luaEncode(lua_State *state, _encoder_t encoder)
+{
+	size_t len;
+	buf_t **bufPtr;
+
+	/* get the data from the arguments */
+	const char *data = luaL_checklstring(state, 1, &len);
+
+	/* append the result directly to the given buffer */
+	if(!lua_isnoneornil(state, 2))
+	{
+		bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+		lua_pushboolean(state, encoder(*bufPtr, data, len));
+
+		return 1;
+	}
+
+	/* reuse the memory of the scratch buffer */
+	bufConsume(&_scratch, _scratch.len);
+
+	if(encoder(&_scratch, data, len))
+	{
+		/* push the result, an empty buffer has no data */
+		lua_pushlstring(
+			state,
+			_scratch.data != NULL ? (const char*) _scratch.data : "",
+			_scratch.len
+		);
+	}
+	else
+	{
+		lua_pushnil(state);
+	}
+
+	return 1;
+}
+
+/**
+ * returns the data of the string or buffer at the given index. the length is
+ * stored in the last parameter.
+ */
+static const char *_checkData(lua_State *state, int index, size_t *len)
+{
+	buf_t **bufPtr;
+
+	if(lua_type(state, index) == LUA_TUSERDATA)
+	{
+		bufPtr = luaL_checkudata(state, index, _BUF_TYPE_NAME);
+		*len = 0;
+
+		return bufHasData(*bufPtr) ? bufPeek(*bufPtr, len) : "";
+	}
+
+	return luaL_checklstring(state, index, len);
+}
+
+/**
+ * lua wrapper function for encUrlEncode().
+ */
+static int _luaEncodingUrlEncode(lua_State *state)
+{
+	return _luaEncode(state, encUrlEncode);
+}
+
+/**
+ * lua wrapper function for encUrlDecode().
+ */
+static int _luaEncodingUrlDecode(lua_State *state)
+{
+	return _luaEncode(state, encUrlDecode);
+}
+
+/**
+ * lua wrapper function for encIsUtf8().
+ */
+static int _luaEncodingIsUtf8(lua_State *state)
+{
+	size_t len;
+	const char *data = _checkData(state, 1, &len);
+
+	lua_pushboolean(state, encIsUtf8(data, len));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for encBase64Encode().
+ */
+static int _luaEncodingBase64Encode(lua_State *state)
+{
+	return _luaEncode(state, encBase64Encode);
+}
+
+/**
+ * lua wrapper function for encBase64Decode().
+ */
+static int _luaEncodingBase64Decode(lua_State *state)
+{
+	return _luaEncode(state, encBase64Decode);
+}
+
+/**
+ * registers the encoding api with lua.
+ */
+static void _registerEncodingApi(void)
+{
+	/* possible lua encoding functions */
+	const luaL_Reg funcs[] = {
+		{"urlEncode", _luaEncodingUrlEncode},
+		{"urlDecode", _luaEncodingUrlDecode},
+		{"base64Encode", _luaEncodingBase64Encode},
+		{"base64Decode", _luaEncodingBase64Decode},
+		{"isUtf8", _luaEncodingIsUtf8},
+		{NULL, NULL}
+	};
+
+	/* create the encoding api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "encoding");
+}
+
+/**
+ * lua wrapper function for hashCrc32c(). the data is either a string or a
+ * buffer, the optional second argument is the checksum to continue.
+ */
+static int _luaHashCrc32c(lua_State *state)
+{
+	size_t len;
+	const char *data = _checkData(state, 1, &len);
+	lua_Number crc = luaL_optnumber(state, 2, 0);
+
+	lua_pushnumber(
+		state, (lua_Number) hashCrc32c((unsigned long) crc, data, len)
+	);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for hashSha1(). returns the binary digest.
+ */
+static int _luaHashSha1(lua_State *state)
+{
+	unsigned char digest[HASH_SHA1_SIZE];
+	size_t len;
+	const char *data = _checkData(state, 1, &len);
+
+	hashSha1(data, len, digest);
+	lua_pushlstring(state, (const char*) digest, sizeof(digest));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for hashSha256(). returns the binary digest.
+ */
+static int _luaHashSha256(lua_State *state)
+{
+	unsigned char digest[HASH_SHA256_SIZE];
+	size_t len;
+	const char *data = _checkData(state, 1, &len);
+
+	hashSha256(data, len, digest);
+	lua_pushlstring(state, (const char*) digest, sizeof(digest));
+
+	return 1;
+}
+
+/**
+ * registers the hash api with lua.
+ */
+static void _registerHashApi(void)
+{
+	/* possible lua hash functions */
+	const luaL_Reg funcs[] = {
+		{"crc32c", _luaHashCrc32c},
+		{"sha1", _luaHashSha1},
+		{"sha256", _luaHashSha256},
+		{NULL, NULL}
+	};
+
+	/* create the hash api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "hash");
+}
+
+/**
+ * passes a websocket message to the lua handler.
+ */
+static int _luaWsCallback(wsMessage_t *message, void *userData)
+{
+	_handler_t *handler = (_handler_t*) userData;
+	lua_State *state = handler->state;
+
+	/* push the handler function */
+	lua_pushvalue(state, handler->handler);
+
+	switch(message->opcode)
+	{
+		case WS_TEXT:
+			lua_pushliteral(state, "text");
+			break;
+
+		case WS_BINARY:
+			lua_pushliteral(state, "binary");
+			break;
+
+		case WS_PONG:
+			lua_pushliteral(state, "pong");
+			break;
+
+		default:
+			lua_pushliteral(state, "close");
+			break;
+	}
+
+	lua_pushlstring(state, message->data, message->len);
+
+	/* close messages also pass their status code, an error of the handler
+	 * aborts the connection */
+	if(message->opcode == WS_CLOSE)
+	{
+		lua_pushinteger(state, (lua_Integer) message->code);
+
+		return _callHandler(handler, 3);
+	}
+
+	return _callHandler(handler, 2);
+}
+
+/**
+ * lua wrapper function for wsExec().
+ */
+static int _luaWsRead(lua_State *state)
+{
+	_handler_t handler;
+	int result;
+
+	/* get the connection, the buffers and the handler from the arguments */
+	wsConn_t *conn = luaL_checkudata(state, 1, _WS_TYPE_NAME);
+	buf_t **iBufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	buf_t **oBufPtr = luaL_checkudata(state, 3, _BUF_TYPE_NAME);
+	luaL_checktype(state, 4, LUA_TFUNCTION);
+
+	handler.state = state;
+	handler.handler = 4;
+	handler.hasError = 0;
+
+	/* true means the connection is open, false means it was closed and nil
+	 * indicates an error */
+	result = wsExec(conn, *iBufPtr, *oBufPtr, _luaWsCallback, &handler);
+
+	/* an error of the handler is raised once the frames were consumed */
+	if(handler.hasError)
+	{
+		return lua_error(state);
+	}
+
+	switch(result)
+	{
+		case 1:
+			lua_pushboolean(state, 1);
+			break;
+
+		case 2:
+			lua_pushboolean(state, 0);
+			break;
+
+		default:
+			lua_pushnil(state);
+			break;
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for wsSend(). sends a text message unless the third
+ * argument is true.
+ */
+static int _luaWsSend(lua_State *state)
+{
+	size_t len;
+	wsConn_t *conn = luaL_checkudata(state, 1, _WS_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *data = _checkData(state, 3, &len);
+
+	lua_pushboolean(state, wsSend(
+		conn, *bufPtr, lua_toboolean(state, 4) ? WS_BINARY : WS_TEXT, data, len
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for wsSend() with ping frames.
+ */
+static int _luaWsPing(lua_State *state)
+{
+	size_t len = 0;
+	wsConn_t *conn = luaL_checkudata(state, 1, _WS_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *data = luaL_optlstring(state, 3, "", &len);
+
+	lua_pushboolean(state, wsSend(conn, *bufPtr, WS_PING, data, len));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for wsClose().
+ */
+static int _luaWsClose(lua_State *state)
+{
+	size_t len = 0;
+	wsConn_t *conn = luaL_checkudata(state, 1, _WS_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	int code = (int) luaL_optinteger(state, 3, 1000);
+	const char *reason = luaL_optlstring(state, 4, "", &len);
+
+	lua_pushboolean(state, wsClose(conn, *bufPtr, code, reason, len));
+
+	return 1;
+}
+
+/**
+ * frees the resources of a websocket connection object.
+ */
+static int _luaWsGc(lua_State *state)
+{
+	wsClear((wsConn_t*) luaL_checkudata(state, 1, _WS_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new websocket connection object.
+ */
+static int _luaWsNew(lua_State *state)
+{
+	wsConn_t *conn = (wsConn_t*) lua_newuserdata(state, sizeof(wsConn_t));
+
+	wsInit(conn);
+	luaL_setmetatable(state, _WS_TYPE_NAME);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for wsHandshake().
+ */
+static int _luaWsHandshake(lua_State *state)
+{
+	size_t len;
+	const char *key = luaL_checklstring(state, 1, &len);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *protocol = luaL_optstring(state, 3, NULL);
+
+	lua_pushboolean(state, wsHandshake(*bufPtr, key, len, protocol));
+
+	return 1;
+}
+
+/**
+ * registers the websocket api with lua.
+ */
+static void _registerWsApi(void)
+{
+	/* possible lua connection functions */
+	const luaL_Reg methods[] = {
+		{"read", _luaWsRead},
+		{"send", _luaWsSend},
+		{"ping", _luaWsPing},
+		{"close", _luaWsClose},
+		{"__gc", _luaWsGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua websocket functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaWsNew},
+		{"handshake", _luaWsHandshake},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the connection types */
+	luaL_newmetatable(_state, _WS_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the websocket api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "websocket");
+}
+
+/**
+ * passes a http/2 event to the lua handler.
+ */
+static int _luaH2Callback(h2Event_t *event, void *userData)
+{
+	_handler_t *handler = (_handler_t*) userData;
+	lua_State *state = handler->state;
+	const h2Header_t *header;
+	size_t i;
+
+	/* push the handler function */
+	lua_pushvalue(state, handler->handler);
+
+	switch(event->type)
+	{
+		case H2_EVENT_HEADERS:
+			lua_pushliteral(state, "headers");
+			lua_pushinteger(state, (lua_Integer) event->stream);
+
+			/* repeated fields are joined, cookies with a semicolon */
+			lua_createtable(state, 0, (int) event->count);
+
+			for(i=0;i<event->count;++i)
+			{
+				header = event->headers + i;
+
+				lua_pushlstring(state, header->name, header->nameLen);
+				lua_pushvalue(state, -1);
+				lua_rawget(state, -3);
+
+				if(lua_isnil(state, -1))
+				{
+					lua_pop(state, 1);
+					lua_pushlstring(state, header->value, header->valueLen);
+				}
+				else
+				{
+					if(header->nameLen == 6
+						&& memcmp(header->name, "cookie", 6) == 0)
+					{
+						lua_pushliteral(state, "; ");
+					}
+					else
+					{
+						lua_pushliteral(state, ", ");
+					}
+
+					lua_pushlstring(state, header->value, header->valueLen);
+					lua_concat(state, 3);
+				}
+
+				lua_rawset(state, -3);
+			}
+
+			lua_pushboolean(state, event->endStream);
+
+			return _callHandler(handler, 4);
+
+		case H2_EVENT_DATA:
+			lua_pushliteral(state, "data");
+			lua_pushinteger(state, (lua_Integer) event->stream);
+			lua_pushlstring(state, event->data, event->len);
+			lua_pushboolean(state, event->endStream);
+
+			return _callHandler(handler, 4);
+
+		default:
+			lua_pushliteral(state, "reset");
+			lua_pushinteger(state, (lua_Integer) event->stream);
+			lua_pushinteger(state, (lua_Integer) event->code);
+
+			return _callHandler(handler, 3);
+	}
+}
+
+/**
+ * lua wrapper function for h2Upgrade().
+ */
+static int _luaH2Upgrade(lua_State *state)
+{
+	size_t len;
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *settings = luaL_checklstring(state, 3, &len);
+
+	lua_pushboolean(state, h2Upgrade(conn, *bufPtr, settings, len));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for h2Exec().
+ */
+static int _luaH2Read(lua_State *state)
+{
+	_handler_t handler;
+	int result;
+
+	/* get the connection, the buffers and the handler from the arguments */
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **iBufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	buf_t **oBufPtr = luaL_checkudata(state, 3, _BUF_TYPE_NAME);
+	luaL_checktype(state, 4, LUA_TFUNCTION);
+
+	handler.state = state;
+	handler.handler = 4;
+	handler.hasError = 0;
+
+	/* true means the connection is open, false means it was closed and nil
+	 * indicates an error */
+	result = h2Exec(conn, *iBufPtr, *oBufPtr, _luaH2Callback, &handler);
+
+	/* an error of the handler is raised once the frames were consumed */
+	if(handler.hasError)
+	{
+		return lua_error(state);
+	}
+
+	switch(result)
+	{
+		case 1:
+			lua_pushboolean(state, 1);
+			break;
+
+		case 2:
+			lua_pushboolean(state, 0);
+			break;
+
+		default:
+			lua_pushnil(state);
+			break;
+	}
+
+	return 1;
+}
+
+/**
+ * appends a header field to the scratch buffer. the strings are anchored in
+ * the table at the given index so they stay valid.
+ */
+static void _addH2Header(lua_State *state, int anchor, int name, int value)
+{
+	h2Header_t header;
+
+	/* numbers are converted on a copy, the original must not change */
+	lua_pushvalue(state, name);
+	header.name = lua_tolstring(state, -1, &(header.nameLen));
+	lua_rawseti(state, anchor, (int) lua_rawlen(state, anchor) + 1);
+
+	lua_pushvalue(state, value);
+	header.value = lua_tolstring(state, -1, &(header.valueLen));
+	lua_rawseti(state, anchor, (int) lua_rawlen(state, anchor) + 1);
+
+	if(header.name == NULL || header.value == NULL)
+	{
+		luaL_error(state, "invalid header field");
+	}
+
+	if(!bufAppend(&_scratch, &header, sizeof(header)))
+	{
+		luaL_error(state, "out of memory");
+	}
+}
+
+/**
+ * lua wrapper function for h2SendHeaders(). the header fields are passed as
+ * table, a table as value sends the field once per element. the status is
+ * sent first.
+ */
+static int _luaH2SendHeaders(lua_State *state)
+{
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	lua_Integer stream = luaL_checkinteger(state, 3);
+	h2Header_t *headers, header;
+	size_t count, pseudo = 0, i;
+	int j;
+
+	luaL_checktype(state, 4, LUA_TTABLE);
+	lua_settop(state, 5);
+
+	/* the anchor for the converted strings */
+	lua_newtable(state);
+
+	bufConsume(&_scratch, _scratch.len);
+	lua_pushnil(state);
+
+	while(lua_next(state, 4) != 0)
+	{
+		if(lua_istable(state, -1))
+		{
+			for(j=1;j<=(int) lua_rawlen(state, -1);++j)
+			{
+				lua_rawgeti(state, -1, j);
+				_addH2Header(state, 6, -3, -1);
+				lua_pop(state, 1);
+			}
+		}
+		else
+		{
+			_addH2Header(state, 6, -2, -1);
+		}
+
+		lua_pop(state, 1);
+	}
+
+	headers = (h2Header_t*) _scratch.data;
+	count = _scratch.len / sizeof(h2Header_t);
+
+	/* pseudo fields must come first, the order of the others is kept */
+	for(i=0;i<count;++i)
+	{
+		if(headers[i].nameLen > 0 && headers[i].name[0] == ':')
+		{
+			header = headers[i];
+			memmove(
+				headers + pseudo + 1, headers + pseudo,
+				(i - pseudo) * sizeof(h2Header_t)
+			);
+			headers[pseudo++] = header;
+		}
+	}
+
+	lua_pushboolean(state, h2SendHeaders(
+		conn, *bufPtr, (unsigned long) stream, headers, count,
+		lua_toboolean(state, 5)
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for h2SendData().
+ */
+static int _luaH2SendData(lua_State *state)
+{
+	size_t len;
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	lua_Integer stream = luaL_checkinteger(state, 3);
+	const char *data = _checkData(state, 4, &len);
+
+	lua_pushboolean(state, h2SendData(
+		conn, *bufPtr, (unsigned long) stream, data, len,
+		lua_toboolean(state, 5)
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for h2Reset().
+ */
+static int _luaH2Reset(lua_State *state)
+{
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	lua_Integer stream = luaL_checkinteger(state, 3);
+	lua_Integer code = luaL_optinteger(state, 4, H2_CANCEL);
+
+	lua_pushboolean(state, h2Reset(
+		conn, *bufPtr, (unsigned long) stream, (h2Error_t) code
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for h2Close().
+ */
+static int _luaH2Close(lua_State *state)
+{
+	h2Conn_t *conn = luaL_checkudata(state, 1, _H2_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	lua_Integer code = luaL_optinteger(state, 3, H2_NO_ERROR);
+
+	lua_pushboolean(state, h2Close(conn, *bufPtr, (h2Error_t) code));
+
+	return 1;
+}
+
+/**
+ * frees the resources of a http/2 connection object.
+ */
+static int _luaH2Gc(lua_State *state)
+{
+	h2Clear((h2Conn_t*) luaL_checkudata(state, 1, _H2_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new http/2 connection object.
+ */
+static int _luaH2New(lua_State *state)
+{
+	h2Conn_t *conn = (h2Conn_t*) lua_newuserdata(state, sizeof(h2Conn_t));
+
+	h2Init(conn);
+	luaL_setmetatable(state, _H2_TYPE_NAME);
+
+	return 1;
+}
+
+/**
+ * registers the http/2 api with lua.
+ */
+static void _registerH2Api(void)
+{
+	/* possible lua connection functions */
+	const luaL_Reg methods[] = {
+		{"upgrade", _luaH2Upgrade},
+		{"read", _luaH2Read},
+		{"sendHeaders", _luaH2SendHeaders},
+		{"sendData", _luaH2SendData},
+		{"reset", _luaH2Reset},
+		{"close", _luaH2Close},
+		{"__gc", _luaH2Gc},
+		{NULL, NULL}
+	};
+
+	/* possible lua http/2 functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaH2New},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the connection types */
+	luaL_newmetatable(_state, _H2_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the http/2 api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "http2");
+}
+
+/**
+ * reads the format and the level from the options table at the given index.
+ */
+static void _checkCompOptions(
+	lua_State *state, int index, compFormat_t *format, int *level
+)
+{
+	static const char *const formats[] = {"gzip", "deflate", NULL};
+
+	*format = COMP_GZIP;
+	*level = COMP_LEVEL_DEFAULT;
+
+	if(lua_istable(state, index))
+	{
+		lua_getfield(state, index, "format");
+		*format = (compFormat_t) luaL_checkoption(state, -1, "gzip", formats);
+		lua_pop(state, 1);
+
+		lua_getfield(state, index, "level");
+		*level = (int) luaL_optinteger(state, -1, COMP_LEVEL_DEFAULT);
+		lua_pop(state, 1);
+	}
+}
+
+/**
+ * lua wrapper function for compNegotiate(). returns "gzip", "deflate" or nil.
+ */
+static int _luaCompNegotiate(lua_State *state)
+{
+	size_t len;
+	const char *header = luaL_optlstring(state, 1, "", &len);
+
+	switch(compNegotiate(header, len))
+	{
+		case COMP_GZIP:
+			lua_pushliteral(state, "gzip");
+			break;
+
+		case COMP_DEFLATE:
+			lua_pushliteral(state, "deflate");
+			break;
+
+		default:
+			lua_pushnil(state);
+			break;
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for compCompress(). the data is either a string or a
+ * buffer, the result is appended to the optional buffer. data smaller than
+ * the minimum size of the options is not compressed.
+ */
+static int _luaCompEncode(lua_State *state)
+{
+	buf_t *buf = &_scratch;
+	compFormat_t format;
+	int optionsIndex = 2, level, cache = 0;
+	size_t len, minSize = 0;
+	const char *data = _checkData(state, 1, &len);
+
+	/* is there a buffer to append to */
+	if(lua_type(state, 2) == LUA_TUSERDATA)
+	{
+		buf = *((buf_t**) luaL_checkudata(state, 2, _BUF_TYPE_NAME));
+		optionsIndex = 3;
+
+		/* growing the buffer would move the data while it is compressed */
+		luaL_argcheck(
+			state, lua_type(state, 1) != LUA_TUSERDATA
+				|| *((buf_t**) lua_touserdata(state, 1)) != buf,
+			2, "buffer is the source"
+		);
+	}
+	else
+	{
+		bufConsume(&_scratch, _scratch.len);
+	}
+
+	/* read the options */
+	_checkCompOptions(state, optionsIndex, &format, &level);
+
+	if(lua_istable(state, optionsIndex))
+	{
+		lua_getfield(state, optionsIndex, "minSize");
+		minSize = (size_t) luaL_optinteger(state, -1, 0);
+		lua_pop(state, 1);
+
+		lua_getfield(state, optionsIndex, "cache");
+		cache = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+	}
+
+	/* small data is sent as it is */
+	if(len < minSize)
+	{
+		if(buf == &_scratch)
+		{
+			lua_pushnil(state);
+		}
+		else
+		{
+			lua_pushboolean(state, 0);
+		}
+
+		return 1;
+	}
+
+	if(!compCompress(buf, data, len, format, level, cache))
+	{
+		return luaL_error(state, "out of memory");
+	}
+
+	/* push the result */
+	if(buf == &_scratch)
+	{
+		lua_pushlstring(
+			state, _scratch.data != NULL ? (const char*) _scratch.data : "",
+			_scratch.len
+		);
+	}
+	else
+	{
+		lua_pushboolean(state, 1);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for compWrite(), the mode is defined by the upvalue.
+ */
+static int _luaCompWrite(lua_State *state)
+{
+	size_t len = 0;
+	compFilter_t *filter = luaL_checkudata(state, 1, _COMP_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *data = lua_isnoneornil(state, 3)
+		? "" : _checkData(state, 3, &len);
+
+	lua_pushboolean(state, compWrite(
+		filter, *bufPtr, data, len,
+		(compFlush_t) lua_tointeger(state, lua_upvalueindex(1))
+	));
+
+	return 1;
+}
+
+/**
+ * frees the resources of a compression filter object.
+ */
+static int _luaCompGc(lua_State *state)
+{
+	compClear((compFilter_t*) luaL_checkudata(state, 1, _COMP_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new compression filter object.
+ */
+static int _luaCompNewFilter(lua_State *state)
+{
+	compFilter_t *filter;
+	compFormat_t format;
+	int level;
+
+	_checkCompOptions(state, 1, &format, &level);
+
+	filter = (compFilter_t*) lua_newuserdata(state, sizeof(compFilter_t));
+	filter->stream = NULL;
+	luaL_setmetatable(state, _COMP_TYPE_NAME);
+
+	if(!compInit(filter, format, level))
+	{
+		return luaL_error(state, "out of memory");
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for compSetCacheSize().
+ */
+static int _luaCompSetCacheSize(lua_State *state)
+{
+	compSetCacheSize((size_t) luaL_checkinteger(state, 1));
+
+	return 0;
+}
+
+/**
+ * lua wrapper function for compGetCacheStats(). returns the hits, the misses
+ * and the size of the cache.
+ */
+static int _luaCompCacheStats(lua_State *state)
+{
+	size_t hits, misses, size;
+
+	compGetCacheStats(&hits, &misses, &size);
+
+	lua_pushnumber(state, (lua_Number) hits);
+	lua_pushnumber(state, (lua_Number) misses);
+	lua_pushnumber(state, (lua_Number) size);
+
+	return 3;
+}
+
+/**
+ * registers the compression api with lua.
+ */
+static void _registerCompApi(void)
+{
+	/* possible lua compression functions */
+	const luaL_Reg funcs[] = {
+		{"negotiate", _luaCompNegotiate},
+		{"encode", _luaCompEncode},
+		{"newFilter", _luaCompNewFilter},
+		{"setCacheSize", _luaCompSetCacheSize},
+		{"cacheStats", _luaCompCacheStats},
+		{NULL, NULL}
+	};
+
+	/* the write functions of the filter and their modes */
+	const char *names[] = {"write", "flush", "finish"};
+	int i;
+
+	/* create the new meta table for the filter types */
+	luaL_newmetatable(_state, _COMP_TYPE_NAME);
+
+	for(i=0;i<3;++i)
+	{
+		lua_pushinteger(_state, i == 0 ? COMP_NONE
+			: (i == 1 ? COMP_FLUSH : COMP_FINISH));
+		lua_pushcclosure(_state, _luaCompWrite, 1);
+		lua_setfield(_state, -2, names[i]);
+	}
+
+	lua_pushcfunction(_state, _luaCompGc);
+	lua_setfield(_state, -2, "__gc");
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the compression api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "compress");
+}
+
+/**
+ * lua wrapper function for cacheSet(). the value is either a string or a
+ * buffer.
+ */
+static int _luaCacheSet(lua_State *state)
+{
+	size_t keyLen, valueLen;
+	cache_t *cache = luaL_checkudata(state, 1, _CACHE_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &keyLen);
+	const char *value = _checkData(state, 3, &valueLen);
+	long ttl = (long) luaL_optinteger(state, 4, 0);
+	long stale = (long) luaL_optinteger(state, 5, 0);
+
+	lua_pushboolean(
+		state, cacheSet(cache, key, keyLen, value, valueLen, ttl, stale)
+	);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for cacheGet(). returns the value and whether it is
+ * stale or nil.
+ */
+static int _luaCacheGet(lua_State *state)
+{
+	size_t keyLen, valueLen;
+	const void *value;
+	cacheResult_t result;
+	cache_t *cache = luaL_checkudata(state, 1, _CACHE_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &keyLen);
+
+	result = cacheGet(cache, key, keyLen, &value, &valueLen);
+
+	if(result == CACHE_MISS)
+	{
+		lua_pushnil(state);
+
+		return 1;
+	}
+
+	lua_pushlstring(state, (const char*) value, valueLen);
+	lua_pushboolean(state, result == CACHE_STALE);
+
+	return 2;
+}
+
+/**
+ * lua wrapper function for cacheWrite(). returns whether the value was found
+ * and whether it is stale. no lua string is created for the value.
+ */
+static int _luaCacheWrite(lua_State *state)
+{
+	size_t keyLen;
+	cacheResult_t result;
+	cache_t *cache = luaL_checkudata(state, 1, _CACHE_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 3, &keyLen);
+
+	result = cacheWrite(cache, *bufPtr, key, keyLen);
+
+	lua_pushboolean(state, result != CACHE_MISS);
+	lua_pushboolean(state, result == CACHE_STALE);
+
+	return 2;
+}
+
+/**
+ * lua wrapper function for cacheDelete().
+ */
+static int _luaCacheDelete(lua_State *state)
+{
+	size_t keyLen;
+	cache_t *cache = luaL_checkudata(state, 1, _CACHE_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &keyLen);
+
+	lua_pushboolean(state, cacheDelete(cache, key, keyLen));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for cacheGetStats(). returns a table.
+ */
+static int _luaCacheStats(lua_State *state)
+{
+	cache_t *cache = luaL_checkudata(state, 1, _CACHE_TYPE_NAME);
+	const cacheStats_t *stats = cacheGetStats(cache);
+
+	lua_createtable(state, 0, 6);
+
+	lua_pushnumber(state, (lua_Number) stats->hits);
+	lua_setfield(state, -2, "hits");
+
+	lua_pushnumber(state, (lua_Number) stats->misses);
+	lua_setfield(state, -2, "misses");
+
+	lua_pushnumber(state, (lua_Number) stats->stale);
+	lua_setfield(state, -2, "stale");
+
+	lua_pushnumber(state, (lua_Number) stats->evictions);
+	lua_setfield(state, -2, "evictions");
+
+	lua_pushnumber(state, (lua_Number) stats->count);
+	lua_setfield(state, -2, "count");
+
+	lua_pushnumber(state, (lua_Number) stats->size);
+	lua_setfield(state, -2, "size");
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for cacheClear(), also used to free the resources of
+ * a cache object.
+ */
+static int _luaCacheClear(lua_State *state)
+{
+	cacheClear((cache_t*) luaL_checkudata(state, 1, _CACHE_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new cache object with the given maximum size in bytes.
+ */
+static int _luaCacheNew(lua_State *state)
+{
+	lua_Integer maxSize = luaL_checkinteger(state, 1);
+	cache_t *cache = (cache_t*) lua_newuserdata(state, sizeof(cache_t));
+
+	cacheInit(cache, maxSize > 0 ? (size_t) maxSize : 0);
+	luaL_setmetatable(state, _CACHE_TYPE_NAME);
+
+	return 1;
+}
+
+/**
+ * registers the cache api with lua.
+ */
+static void _registerCacheApi(void)
+{
+	/* possible lua cache object functions */
+	const luaL_Reg methods[] = {
+		{"set", _luaCacheSet},
+		{"get", _luaCacheGet},
+		{"write", _luaCacheWrite},
+		{"delete", _luaCacheDelete},
+		{"stats", _luaCacheStats},
+		{"clear", _luaCacheClear},
+		{"__gc", _luaCacheClear},
+		{NULL, NULL}
+	};
+
+	/* possible lua cache functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaCacheNew},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the cache types */
+	luaL_newmetatable(_state, _CACHE_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the cache api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "cache");
+}
+
+/**
+ * returns the string field of the table at the given index or null if it is
+ * not a string. the value is left on the stack.
+ */
+static const char *_getStringField(lua_State *state, int idx, const char *name)
+{
+	lua_getfield(state, idx, name);
+
+	return lua_type(state, -1) == LUA_TSTRING ? lua_tostring(state, -1) : NULL;
+}
+
+/**
+ * lua wrapper function for fileServe(). expects the client socket, the output
+ * buffer, the method, the uri and the headers (lower case names) of the
+ * request. returns the status code or nil if the request was not answered.
+ */
+static int _luaFilesServe(lua_State *state)
+{
+	fileServer_t *fs = luaL_checkudata(state, 1, _FILES_TYPE_NAME);
+	int cFd = luaL_checkint(state, 2);
+	buf_t **bufPtr = luaL_checkudata(state, 3, _BUF_TYPE_NAME);
+	fileRequest_t request;
+	int status;
+
+	memset(&request, 0, sizeof(request));
+
+	request.method = luaL_checkstring(state, 4);
+	request.path = luaL_checkstring(state, 5);
+
+	if(lua_istable(state, 6))
+	{
+		request.ifNoneMatch = _getStringField(state, 6, "if-none-match");
+		request.ifModifiedSince = _getStringField(
+			state, 6, "if-modified-since"
+		);
+		request.range = _getStringField(state, 6, "range");
+		request.ifRange = _getStringField(state, 6, "if-range");
+	}
+
+	/* the header values stay on the stack while they are used */
+	if((status = fileServe(fs, cFd, *bufPtr, &request)) == 0)
+	{
+		lua_pushnil(state);
+	}
+	else
+	{
+		lua_pushinteger(state, status);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for fileGetStats(). returns a table.
+ */
+static int _luaFilesStats(lua_State *state)
+{
+	fileServer_t *fs = luaL_checkudata(state, 1, _FILES_TYPE_NAME);
+	unsigned long hits, misses;
+	size_t count;
+
+	fileGetStats(fs, &hits, &misses, &count);
+
+	lua_createtable(state, 0, 3);
+
+	lua_pushnumber(state, (lua_Number) hits);
+	lua_setfield(state, -2, "hits");
+
+	lua_pushnumber(state, (lua_Number) misses);
+	lua_setfield(state, -2, "misses");
+
+	lua_pushnumber(state, (lua_Number) count);
+	lua_setfield(state, -2, "count");
+
+	return 1;
+}
+
+/**
+ * frees the resources of a static file server object.
+ */
+static int _luaFilesGc(lua_State *state)
+{
+	fileClear((fileServer_t*) luaL_checkudata(state, 1, _FILES_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new static file server object. expects a table with the root
+ * directory (root) and optionally a list of index files (index), a table of
+ * content types by extension (mime) and the max-age of the Cache-Control
+ * header (maxAge). returns nil and an error message if the root directory
+ * can not be opened.
+ */
+static int _luaFilesNew(lua_State *state)
+{
+	fileServer_t *fs;
+	const char *root;
+	int i;
+
+	luaL_checktype(state, 1, LUA_TTABLE);
+
+	lua_getfield(state, 1, "root");
+	root = luaL_checkstring(state, -1);
+
+	fs = (fileServer_t*) lua_newuserdata(state, sizeof(fileServer_t));
+
+	if(!fileInit(fs, root))
+	{
+		lua_pushnil(state);
+		lua_pushfstring(state, "%s: %s", root, strerror(errno));
+
+		return 2;
+	}
+
+	luaL_setmetatable(state, _FILES_TYPE_NAME);
+
+	lua_getfield(state, 1, "index");
+
+	if(lua_istable(state, -1))
+	{
+		for(i=1;lua_rawgeti(state, -1, i), lua_isstring(state, -1);++i)
+		{
+			if(!fileAddIndex(fs, lua_tostring(state, -1)))
+			{
+				return luaL_error(state, "invalid index file");
+			}
+
+			lua_pop(state, 1);
+		}
+
+		lua_pop(state, 1);
+	}
+
+	lua_pop(state, 1);
+
+	lua_getfield(state, 1, "mime");
+
+	if(lua_istable(state, -1))
+	{
+		for(lua_pushnil(state);lua_next(state, -2);lua_pop(state, 1))
+		{
+			if(lua_type(state, -2) == LUA_TSTRING
+				&& lua_type(state, -1) == LUA_TSTRING
+				&& !fileSetMime(
+					fs, lua_tostring(state, -2), lua_tostring(state, -1)
+				))
+			{
+				return luaL_error(state, "not enough memory");
+			}
+		}
+	}
+
+	lua_pop(state, 1);
+
+	lua_getfield(state, 1, "maxAge");
+
+	if(lua_isnumber(state, -1))
+	{
+		fileSetMaxAge(fs, (long) lua_tointeger(state, -1));
+	}
+
+	lua_pop(state, 1);
+
+	return 1;
+}
+
+/**
+ * registers the static file api with lua.
+ */
+static void _registerFilesApi(void)
+{
+	/* possible lua static file server object functions */
+	const luaL_Reg methods[] = {
+		{"serve", _luaFilesServe},
+		{"stats", _luaFilesStats},
+		{"__gc", _luaFilesGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua static file functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaFilesNew},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the static file server types */
+	luaL_newmetatable(_state, _FILES_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the static file api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "files");
+}
+
+/**
+ * lua wrapper function for routerMatch(). expects the method and the uri (the
+ * query is ignored). returns the handler and a table of the parameters (nil
+ * if the route has none), nil if no route matches the path or false if no
+ * route for the method matches it.
+ */
+static int _luaRouterMatch(lua_State *state)
+{
+	size_t len, i;
+	routeMatch_t match;
+	routeResult_t result;
+	router_t *router = luaL_checkudata(state, 1, _ROUTER_TYPE_NAME);
+	const char *method = luaL_checkstring(state, 2);
+	const char *uri = luaL_checklstring(state, 3, &len);
+	const char *query = (const char*) memchr(uri, '?', len);
+
+	if(query != NULL)
+	{
+		len = query - uri;
+	}
+
+	result = routerMatch(router, method, uri, len, &match);
+
+	if(result != ROUTE_FOUND)
+	{
+		if(result == ROUTE_NOT_FOUND)
+		{
+			lua_pushnil(state);
+		}
+		else
+		{
+			lua_pushboolean(state, 0);
+		}
+
+		return 1;
+	}
+
+	/* the handlers are stored in the user value */
+	lua_getuservalue(state, 1);
+	lua_rawgeti(state, -1, match.handler);
+
+	if(match.paramCount == 0)
+	{
+		return 1;
+	}
+
+	lua_createtable(state, 0, (int) match.paramCount);
+
+	for(i=0;i<match.paramCount;++i)
+	{
+		lua_pushlstring(state, match.values[i], match.lengths[i]);
+		lua_setfield(state, -2, match.names[i]);
+	}
+
+	return 2;
+}
+
+/**
+ * frees the routes of a router object.
+ */
+static int _luaRouterGc(lua_State *state)
+{
+	routerClear((router_t*) luaL_checkudata(state, 1, _ROUTER_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new router object from a table of routes. the keys are patterns
+ * optionally preceded by a method and a space (e.g. "GET /users/:id"), the
+ * values are the handlers returned by match().
+ */
+static int _luaRouterNew(lua_State *state)
+{
+	char method[_ROUTER_METHOD_MAX];
+	const char *key, *pattern;
+	router_t *router;
+	int handler = 0;
+	size_t len;
+
+	luaL_checktype(state, 1, LUA_TTABLE);
+
+	router = (router_t*) lua_newuserdata(state, sizeof(router_t));
+	routerInit(router);
+	luaL_setmetatable(state, _ROUTER_TYPE_NAME);
+
+	/* the handlers by number */
+	lua_newtable(state);
+
+	for(lua_pushnil(state);lua_next(state, 1);lua_pop(state, 1))
+	{
+		if(lua_type(state, -2) != LUA_TSTRING)
+		{
+			return luaL_error(state, "route must be a string");
+		}
+
+		key = lua_tostring(state, -2);
+
+		/* split the method from the pattern */
+		if((pattern = strchr(key, ' ')) != NULL)
+		{
+			len = pattern - key;
+
+			if(len >= sizeof(method))
+			{
+				return luaL_error(state, "invalid route: %s", key);
+			}
+
+			memcpy(method, key, len);
+			method[len] = '\0';
+
+			while(*pattern == ' ')
+			{
+				++pattern;
+			}
+		}
+		else
+		{
+			pattern = key;
+		}
+
+		if(!routerAdd(
+			router, pattern != key ? method : NULL, pattern, ++handler
+		))
+		{
+			return luaL_error(state, "invalid or duplicate route: %s", key);
+		}
+
+		lua_pushvalue(state, -1);
+		lua_rawseti(state, -4, handler);
+	}
+
+	lua_setuservalue(state, -2);
+
+	return 1;
+}
+
+/**
+ * registers the router api with lua.
+ */
+static void _registerRouterApi(void)
+{
+	/* possible lua router object functions */
+	const luaL_Reg methods[] = {
+		{"match", _luaRouterMatch},
+		{"__gc", _luaRouterGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua router functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaRouterNew},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the router types */
+	luaL_newmetatable(_state, _ROUTER_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the router api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "router");
+}
+
+/**
+ * defines the data passed to the callback of flightFinish(), the values are
+ * the arguments of finish() after the key.
+ */
+typedef struct {
+
+	/* stores the lua state and the index of the flight object */
+	lua_State *state;
+	int index;
+
+	/* stores the index of the first value and the number of values */
+	int first, count;
+
+} _flightWake_t;
+
+/**
+ * pushes the data given to join() for the connection of the given id, which
+ * keys the data since descriptors are reused. the user value of the flight
+ * object must be on top of the stack.
+ */
+static void _pushFlightData(lua_State *state, unsigned long id)
+{
+	lua_pushnumber(state, (lua_Number) id);
+	lua_rawget(state, -2);
+}
+
+/**
+ * forgets the data given to join() for the connection of the given id. the
+ * user value of the flight object must be on top of the stack.
+ */
+static void _clearFlightData(lua_State *state, unsigned long id)
+{
+	lua_pushnumber(state, (lua_Number) id);
+	lua_pushnil(state);
+	lua_rawset(state, -3);
+}
+
+/**
+ * invokes the handler of the flight object for a parked socket with the
+ * socket, its output buffer, the data given to join() and the values. the
+ * data of a socket closed in the meantime is only forgotten.
+ */
+static void _luaFlightCallback(
+	int cFd,
+	unsigned long id,
+	buf_t *oBuf,
+	void *arg
+)
+{
+	_flightWake_t *wake = (_flightWake_t*) arg;
+	lua_State *state = wake->state;
+	int i;
+
+	luaL_checkstack(state, 8 + wake->count, NULL);
+
+	/* the handler and the data of the socket are stored in the user value */
+	lua_getuservalue(state, wake->index);
+
+	if(oBuf == NULL)
+	{
+		_clearFlightData(state, id);
+		lua_pop(state, 1);
+
+		return;
+	}
+
+	lua_getfield(state, -1, "handler");
+	lua_pushinteger(state, cFd);
+	*((buf_t**) lua_newuserdata(state, sizeof(buf_t*))) = oBuf;
+	luaL_setmetatable(state, _BUF_TYPE_NAME);
+	lua_pushvalue(state, -4);
+	_pushFlightData(state, id);
+	lua_remove(state, -2);
+
+	/* forget the data of the socket */
+	lua_pushvalue(state, -5);
+	_clearFlightData(state, id);
+	lua_pop(state, 1);
+
+	for(i=0;i<wake->count;++i)
+	{
+		lua_pushvalue(state, wake->first + i);
+	}
+
+	if(lua_pcall(state, 3 + wake->count, 0, 0) != LUA_OK)
+	{
+		logWrite("ERROR lua_pcall()");
+		logWrite(lua_tostring(state, -1));
+
+		lua_pop(state, 1);
+
+		serverCloseSocket(cFd);
+	}
+
+	/* remove the user value from the stack */
+	lua_pop(state, 1);
+}
+
+/**
+ * lua wrapper function for flightJoin(). expects the key, the client socket
+ * and optionally data passed to the handler when the socket is woken (e.g.
+ * the request). returns true if the caller must compute the value and false
+ * if the socket is parked.
+ */
+static int _luaFlightJoin(lua_State *state)
+{
+	size_t keyLen;
+	flightResult_t result;
+	flight_t *flight = luaL_checkudata(state, 1, _FLIGHT_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &keyLen);
+	int cFd = luaL_checkint(state, 3);
+
+	result = flightJoin(flight, key, keyLen, cFd);
+
+	if(result == FLIGHT_ERROR)
+	{
+		return luaL_error(state, "not enough memory");
+	}
+
+	/* keep the data until the socket is woken */
+	if(result == FLIGHT_WAITING)
+	{
+		lua_getuservalue(state, 1);
+
+		if(lua_isnoneornil(state, 4))
+		{
+			lua_pushboolean(state, 1);
+		}
+		else
+		{
+			lua_pushvalue(state, 4);
+		}
+
+		lua_pushnumber(state, (lua_Number) serverGetSocketId(cFd));
+		lua_insert(state, -2);
+		lua_rawset(state, -3);
+	}
+
+	lua_pushboolean(state, result == FLIGHT_LEADER);
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for flightFinish(). expects the key and any number of
+ * values, which are passed to the handler for every parked socket. returns
+ * the number of sockets woken.
+ */
+static int _luaFlightFinish(lua_State *state)
+{
+	size_t keyLen;
+	_flightWake_t wake;
+	flight_t *flight = luaL_checkudata(state, 1, _FLIGHT_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &keyLen);
+
+	wake.state = state;
+	wake.index = 1;
+	wake.first = 3;
+	wake.count = lua_gettop(state) - 2;
+
+	lua_pushinteger(state, (lua_Integer) flightFinish(
+		flight, key, keyLen, _luaFlightCallback, &wake
+	));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for flightCancel(), to be called when a socket is
+ * closed. returns whether the socket was parked.
+ */
+static int _luaFlightCancel(lua_State *state)
+{
+	flight_t *flight = luaL_checkudata(state, 1, _FLIGHT_TYPE_NAME);
+	int cFd = luaL_checkint(state, 2);
+
+	lua_getuservalue(state, 1);
+	_clearFlightData(state, serverGetSocketId(cFd));
+
+	lua_pushboolean(state, flightCancel(flight, cFd));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for flightGetStats(). returns a table.
+ */
+static int _luaFlightStats(lua_State *state)
+{
+	flight_t *flight = luaL_checkudata(state, 1, _FLIGHT_TYPE_NAME);
+	unsigned long leaders, waiters;
+	size_t count;
+
+	flightGetStats(flight, &leaders, &waiters, &count);
+
+	lua_createtable(state, 0, 3);
+
+	lua_pushnumber(state, (lua_Number) leaders);
+	lua_setfield(state, -2, "leaders");
+
+	lua_pushnumber(state, (lua_Number) waiters);
+	lua_setfield(state, -2, "waiters");
+
+	lua_pushnumber(state, (lua_Number) count);
+	lua_setfield(state, -2, "pending");
+
+	return 1;
+}
+
+/**
+ * frees the resources of a flight object.
+ */
+static int _luaFlightGc(lua_State *state)
+{
+	flightClear((flight_t*) luaL_checkudata(state, 1, _FLIGHT_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new flight object. expects the handler invoked for every parked
+ * socket when a flight is finished.
+ */
+static int _luaFlightNew(lua_State *state)
+{
+	flight_t *flight;
+
+	luaL_checktype(state, 1, LUA_TFUNCTION);
+
+	flight = (flight_t*) lua_newuserdata(state, sizeof(flight_t));
+	flightInit(flight);
+	luaL_setmetatable(state, _FLIGHT_TYPE_NAME);
+
+	/* the handler and the data of the parked sockets */
+	lua_newtable(state);
+	lua_pushvalue(state, 1);
+	lua_setfield(state, -2, "handler");
+	lua_setuservalue(state, -2);
+
+	return 1;
+}
+
+/**
+ * registers the flight api with lua.
+ */
+static void _registerFlightApi(void)
+{
+	/* possible lua flight object functions */
+	const luaL_Reg methods[] = {
+		{"join", _luaFlightJoin},
+		{"finish", _luaFlightFinish},
+		{"cancel", _luaFlightCancel},
+		{"stats", _luaFlightStats},
+		{"__gc", _luaFlightGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua flight functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaFlightNew},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the flight types */
+	luaL_newmetatable(_state, _FLIGHT_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the flight api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "flight");
+}
+
+/**
+ * lua wrapper function for ringAdd(). expects the name of the node and an
+ * optional weight (default 1). returns true if everything is ok.
+ */
+static int _luaRingAdd(lua_State *state)
+{
+	size_t len;
+	ring_t *ring = luaL_checkudata(state, 1, _RING_TYPE_NAME);
+	const char *name = luaL_checklstring(state, 2, &len);
+	lua_Integer weight = luaL_optinteger(state, 3, 1);
+
+	luaL_argcheck(
+		state, weight >= 1 && weight <= RING_WEIGHT_MAX, 3, "invalid weight"
+	);
+
+	lua_pushboolean(state, ringAdd(ring, name, len, (unsigned int) weight));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for ringRemove(). returns true if the node was removed
+ * and false if there is no such node.
+ */
+static int _luaRingRemove(lua_State *state)
+{
+	size_t len;
+	ring_t *ring = luaL_checkudata(state, 1, _RING_TYPE_NAME);
+	const char *name = luaL_checklstring(state, 2, &len);
+
+	lua_pushboolean(state, ringRemove(ring, name, len));
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for ringLookup(). returns the name of the node the key
+ * belongs to or nil if the ring is empty.
+ */
+static int _luaRingLookup(lua_State *state)
+{
+	size_t len, nameLen;
+	ring_t *ring = luaL_checkudata(state, 1, _RING_TYPE_NAME);
+	const char *key = luaL_checklstring(state, 2, &len);
+	const char *name = ringLookup(ring, key, len, &nameLen);
+
+	if(name != NULL)
+	{
+		lua_pushlstring(state, name, nameLen);
+	}
+	else
+	{
+		lua_pushnil(state);
+	}
+
+	return 1;
+}
+
+/**
+ * lua wrapper function for ringGetCount().
+ */
+static int _luaRingCount(lua_State *state)
+{
+	lua_pushinteger(state, (lua_Integer) ringGetCount(
+		(ring_t*) luaL_checkudata(state, 1, _RING_TYPE_NAME)
+	));
+
+	return 1;
+}
+
+/**
+ * frees the nodes of a hash ring object.
+ */
+static int _luaRingGc(lua_State *state)
+{
+	ringClear((ring_t*) luaL_checkudata(state, 1, _RING_TYPE_NAME));
+
+	return 0;
+}
+
+/**
+ * creates a new hash ring object. the optional table contains either the names
+ * of the nodes (weight 1) or the names as keys and the weights as values.
+ */
+static int _luaRingNew(lua_State *state)
+{
+	const char *name;
+	lua_Integer weight;
+	ring_t *ring;
+	size_t len;
+
+	if(lua_isnoneornil(state, 1))
+	{
+		lua_settop(state, 0);
+		lua_newtable(state);
+	}
+
+	luaL_checktype(state, 1, LUA_TTABLE);
+
+	ring = (ring_t*) lua_newuserdata(state, sizeof(ring_t));
+	ringInit(ring);
+	luaL_setmetatable(state, _RING_TYPE_NAME);
+
+	for(lua_pushnil(state);lua_next(state, 1);lua_pop(state, 1))
+	{
+		if(lua_type(state, -2) == LUA_TSTRING)
+		{
+			name = lua_tolstring(state, -2, &len);
+			weight = lua_tointeger(state, -1);
+		}
+		else if(lua_type(state, -1) == LUA_TSTRING)
+		{
+			name = lua_tolstring(state, -1, &len);
+			weight = 1;
+		}
+		else
+		{
+			return luaL_error(state, "node must be a string");
+		}
+
+		if(weight < 1 || weight > RING_WEIGHT_MAX
+			|| !ringAdd(ring, name, len, (unsigned int) weight))
+		{
+			return luaL_error(state, "invalid node: %s", name);
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * registers the hash ring api with lua.
+ */
+static void _registerRingApi(void)
+{
+	/* possible lua hash ring object functions */
+	const luaL_Reg methods[] = {
+		{"add", _luaRingAdd},
+		{"remove", _luaRingRemove},
+		{"lookup", _luaRingLookup},
+		{"count", _luaRingCount},
+		{"__gc", _luaRingGc},
+		{NULL, NULL}
+	};
+
+	/* possible lua hash ring functions */
+	const luaL_Reg funcs[] = {
+		{"new", _luaRingNew},
+		{NULL, NULL}
+	};
+
+	/* create the new meta table for the hash ring types */
+	luaL_newmetatable(_state, _RING_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the hash ring api and make it accessible */
+	luaL_newlib(_state, funcs);
+	lua_setglobal(_state, "ring");
+}
+
+static int _jsonEncode(lua_State*, buf_t*, int, int, const _jsonOptions_t*);
+
+/**
+ * encodes the table at the given index. tables with the keys 1..n are encoded
+ * as arrays, all other tables as objects. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _jsonEncodeTable(
+	lua_State *state, buf_t *buf, int index, int depth,
+	const _jsonOptions_t *options
+)
+{
+	size_t len = lua_rawlen(state, index), count = 0, i, keyLen;
+	const char *key;
+
+	if(!lua_checkstack(state, 4))
+	{
+		_jsonError = "nested too deep";
+
+		return 0;
+	}
+
+	/* count the keys of the table */
+	lua_pushnil(state);
+
+	while(lua_next(state, index))
+	{
+		++count;
+		lua_pop(state, 1);
+	}
+
+	/* empty tables can be either an array or an object */
+	if(count == 0)
+	{
+		return options->emptyArray
+			? bufAppend(buf, "[]", 2)
+			: bufAppend(buf, "{}", 2);
+	}
+
+	/* a sequence is encoded as array */
+	if(count == len)
+	{
+		if(!bufAppend(buf, "[", 1))
+		{
+			return 0;
+		}
+
+		for(i=1;i<=len;++i)
+		{
+			lua_rawgeti(state, index, (int) i);
+
+			if((i > 1 && !bufAppend(buf, ",", 1))
+				|| !_jsonEncode(state, buf, -1, depth + 1, options))
+			{
+				return 0;
+			}
+
+			lua_pop(state, 1);
+		}
+
+		return bufAppend(buf, "]", 1);
+	}
+
+	/* everything else is encoded as object */
+	if(!bufAppend(buf, "{", 1))
+	{
+		return 0;
+	}
+
+	lua_pushnil(state);
+
+	for(i=0;lua_next(state, index);++i)
+	{
+		/* only strings and numbers can be used as keys. numbers are converted
+		 * on a copy, converting the key itself would confuse lua_next() */
+		if(lua_type(state, -2) != LUA_TSTRING
+			&& lua_type(state, -2) != LUA_TNUMBER)
+		{
+			_jsonError = "invalid key type";
+
+			return 0;
+		}
+
+		lua_pushvalue(state, -2);
+		key = lua_tolstring(state, -1, &keyLen);
+
+		if((i > 0 && !bufAppend(buf, ",", 1))
+			|| !jsonWriteString(buf, key, keyLen)
+			|| !bufAppend(buf, ":", 1))
+		{
+			return 0;
+		}
+
+		lua_pop(state, 1);
+
+		/* encode the value */
+		if(!_jsonEncode(state, buf, -1, depth + 1, options))
+		{
+			return 0;
+		}
+
+		lua_pop(state, 1);
+	}
+
+	return bufAppend(buf, "}", 1);
+}
+
+/**
+ * encodes the value at the given index and appends the result to the buffer.
+ * returns 1 if everything is ok and 0 if not.
+ */
+static int _jsonEncode(
+	lua_State *state, buf_t *buf, int index, int depth,
+	const _jsonOptions_t *options
+)
+{
+	size_t len;
+	const char *str;
+
+	/* the index must not change when values are pushed */
+	index = lua_absindex(state, index);
+
+	if(depth > JSON_DEPTH_MAX)
+	{
+		_jsonError = "nested too deep";
+
+		return 0;
+	}
+
+	switch(lua_type(state, index))
+	{
+		case LUA_TNIL:
+			return bufAppend(buf, "null", 4);
+
+		case LUA_TBOOLEAN:
+			return lua_toboolean(state, index)
+				? bufAppend(buf, "true", 4)
+				: bufAppend(buf, "false", 5);
+
+		case LUA_TNUMBER:
+			if(!jsonWriteNumber(
+				buf, lua_tonumber(state, index), options->precision
+			))
+			{
+				_jsonError = "number can not be represented";
+
+				return 0;
+			}
+
+			return 1;
+
+		case LUA_TSTRING:
+			str = lua_tolstring(state, index, &len);
+
+			return jsonWriteString(buf, str, len);
+
+		case LUA_TTABLE:
+			return _jsonEncodeTable(state, buf, index, depth, options);
+
+		case LUA_TLIGHTUSERDATA:
+			if(lua_touserdata(state, index) == &_null)
+			{
+				return bufAppend(buf, "null", 4);
+			}
+
+			break;
+	}
+
+	_jsonError = "unsupported type";
+
+	return 0;
+}
+
+/**
+ * encodes the given value as json. if a buffer is given the result is
+ * appended to it and true is returned, otherwise the result is returned as
+ * string. returns nil and an error message in case of an error.
+ */
+static int _luaJsonEncode(lua_State *state)
+{
+	_jsonOptions_t options;
+	buf_t *buf = &_scratch;
+	size_t allocCount = _allocCount, len;
+	int optionsIndex = 2, top;
+
+	/* the default options */
+	options.emptyArray = 0;
+	options.precision = JSON_PRECISION;
+
+	/* is there a buffer to append to */
+	if(lua_type(state, 2) == LUA_TUSERDATA)
+	{
+		buf = *((buf_t**) luaL_checkudata(state, 2, _BUF_TYPE_NAME));
+		optionsIndex = 3;
+	}
+	else
+	{
+		bufConsume(&_scratch, _scratch.len);
+	}
+
+	/* read the options */
+	if(lua_istable(state, optionsIndex))
+	{
+		lua_getfield(state, optionsIndex, "emptyArray");
+		options.emptyArray = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+
+		lua_getfield(state, optionsIndex, "precision");
+		options.precision = lua_isnumber(state, -1)
+			? (int) lua_tointeger(state, -1) : JSON_PRECISION;
+		lua_pop(state, 1);
+	}
+
+	/* remember the state in case of an error */
+	len = buf->len;
+	top = lua_gettop(state);
+	_jsonError = NULL;
+
+	if(!_jsonEncode(state, buf, 1, 0, &options))
+	{
+		/* remove the partially encoded value from the buffer */
+		buf->len = len;
+		lua_settop(state, top);
+
+		lua_pushnil(state);
+		lua_pushstring(
+			state, _jsonError != NULL ? _jsonError : "out of memory"
+		);
+
+		return 2;
+	}
+
+	/* push the result */
+	if(buf == &_scratch)
+	{
+		lua_pushlstring(state, (const char*) _scratch.data, _scratch.len);
+	}
+	else
+	{
+		lua_pushboolean(state, 1);
+	}
+
+	_jsonAllocations = _allocCount - allocCount;
+
+	return 1;
+}
+
+/**
+ * decodes the given json document which is either a string or a buffer.
+ * returns the value or nil and an error message.
+ */
+static int _luaJsonDecode(lua_State *state)
+{
+	jsonReader_t reader;
+	jsonToken_t token;
+	lua_Integer index[JSON_DEPTH_MAX];
+	size_t allocCount = _allocCount, len;
+	int top;
+
+	/* get the document from the arguments */
+	const char *data = _checkData(state, 1, &len);
+
+	jsonReaderInit(&reader, data, len);
+	top = lua_gettop(state);
+
+	/* build the value token by token */
+	while((token = jsonNext(&reader)) != JSON_END && token != JSON_ERROR)
+	{
+		if(!lua_checkstack(state, 3))
+		{
+			reader.error = "nested too deep";
+			token = JSON_ERROR;
+
+			break;
+		}
+
+		switch(token)
+		{
+			/* a new container, it is stored when it ends */
+			case JSON_ARRAY_BEGIN:
+			case JSON_OBJECT_BEGIN:
+				lua_newtable(state);
+				index[reader.depth - 1] = 0;
+				continue;
+
+			/* the key stays on the stack until the value is complete */
+			case JSON_KEY:
+				lua_pushlstring(state, reader.str, reader.strLen);
+				continue;
+
+			case JSON_NULL:
+				lua_pushlightuserdata(state, &_null);
+				break;
+
+			case JSON_FALSE:
+			case JSON_TRUE:
+				lua_pushboolean(state, token == JSON_TRUE);
+				break;
+
+			case JSON_NUMBER:
+				lua_pushnumber(state, (lua_Number) reader.number);
+				break;
+
+			case JSON_STRING:
+				lua_pushlstring(state, reader.str, reader.strLen);
+				break;
+
+			/* the end of a container, the table is on top of the stack */
+			default:
+				break;
+		}
+
+		/* store the completed value in its container */
+		if(reader.depth > 0)
+		{
+			if(reader.stack[reader.depth - 1])
+			{
+				lua_rawset(state, -3);
+			}
+			else
+			{
+				lua_rawseti(state, -2, (int) ++index[reader.depth - 1]);
+			}
+		}
+	}
+
+	if(token == JSON_ERROR)
+	{
+		lua_settop(state, top);
+		lua_pushnil(state);
+		lua_pushfstring(
+			state, "%s at position %d", reader.error, (int) reader.pos
+		);
+		jsonReaderClear(&reader);
+
+		return 2;
 	}
-	else
+
+	jsonReaderClear(&reader);
+	_jsonAllocations = _allocCount - allocCount;
+
+	return 1;
+}
+
+/**
+ * returns the number of memory allocations made by the lua state during the
+ * last call of json.encode() or json.decode().
+ */
+static int _luaJsonAllocations(lua_State *state)
+{
+	lua_pushinteger(state, (lua_Integer) _jsonAllocations);
+
+	return 1;
+}
+
+/**
+ * registers the json api with lua.
+ */
+static void _registerJsonApi(void)
+{
+	/* possible lua json functions */
+	const luaL_Reg funcs[] = {
+		{"encode", _luaJsonEncode},
+		{"decode", _luaJsonDecode},
+		{"allocations", _luaJsonAllocations},
+		{NULL, NULL}
+	};
+
+	/* create the json api */
+	luaL_newlib(_state, funcs);
+
+	/* store the null value */
+	lua_pushliteral(_state, "null");
+	lua_pushlightuserdata(_state, &_null);
+	lua_rawset(_state, -3);
+
+	/* make the api accessible */
+	lua_setglobal(_state, "json");
+}
+
+/**
+ * encodes the value at the given index as messagepack and appends the result
+ * to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+static int _mpackEncode(
+	lua_State *state, buf_t *buf, int index, int depth,
+	const _mpackOptions_t *options
+)
+{
+	size_t len, count = 0, i;
+	const char *str;
+
+	/* the index must not change when values are pushed */
+	index = lua_absindex(state, index);
+
+	if(depth > MPACK_DEPTH_MAX || !lua_checkstack(state, 3))
 	{
-		/* the first argument of this function must be a lua function */
-		luaL_checktype(state, 1, LUA_TFUNCTION);
+		_mpackError = "nested too deep";
 
-		/* store the function in the lua registry */
-		lua_pushliteral(state, _LOG_CALLBACK_INDEX);
-		lua_pushvalue(state, 1);
-		lua_rawset(state, LUA_REGISTRYINDEX);
+		return 0;
+	}
 
-		/* set the callback */
-		logSetCallback(_luaLogCallback);
+	switch(lua_type(state, index))
+	{
+		case LUA_TNIL:
+			return mpackWriteNil(buf);
+
+		case LUA_TBOOLEAN:
+			return mpackWriteBoolean(buf, lua_toboolean(state, index));
+
+		case LUA_TNUMBER:
+			return mpackWriteNumber(buf, (double) lua_tonumber(state, index));
+
+		case LUA_TSTRING:
+			str = lua_tolstring(state, index, &len);
+
+			return mpackWriteString(buf, str, len, options->binary);
+
+		case LUA_TLIGHTUSERDATA:
+			if(lua_touserdata(state, index) == &_null)
+			{
+				return mpackWriteNil(buf);
+			}
+
+			break;
+
+		case LUA_TTABLE:
+			len = lua_rawlen(state, index);
+
+			/* count the keys of the table */
+			lua_pushnil(state);
+
+			while(lua_next(state, index))
+			{
+				++count;
+				lua_pop(state, 1);
+			}
+
+			/* a sequence is encoded as array */
+			if(count == len && (count > 0 || options->emptyArray))
+			{
+				if(!mpackWriteArray(buf, (unsigned long) len))
+				{
+					return 0;
+				}
+
+				for(i=1;i<=len;++i)
+				{
+					lua_rawgeti(state, index, (int) i);
+
+					if(!_mpackEncode(state, buf, -1, depth + 1, options))
+					{
+						return 0;
+					}
+
+					lua_pop(state, 1);
+				}
+
+				return 1;
+			}
+
+			/* everything else is encoded as map */
+			if(!mpackWriteMap(buf, (unsigned long) count))
+			{
+				return 0;
+			}
+
+			lua_pushnil(state);
+
+			while(lua_next(state, index))
+			{
+				if(!_mpackEncode(state, buf, -2, depth + 1, options)
+					|| !_mpackEncode(state, buf, -1, depth + 1, options))
+				{
+					return 0;
+				}
+
+				lua_pop(state, 1);
+			}
+
+			return 1;
 	}
 
+	_mpackError = "unsupported type";
+
 	return 0;
 }
 
 /**
- * lua wrapper function for logWrite().
+ * decodes the message of the given reader and pushes the value onto the stack.
+ * the message must be complete. returns 1 if everything is ok and 0 if not.
  */
-static int _luaLogWrite(lua_State *state)
+static int _mpackDecode(lua_State *state, mpackReader_t *reader)
 {
-	/* write the log message */
-	logWrite(luaL_checkstring(state, 1));
+	unsigned long remaining[MPACK_DEPTH_MAX];
+	lua_Integer index[MPACK_DEPTH_MAX];
+	int isMap[MPACK_DEPTH_MAX], depth = 0;
+	mpackToken_t token;
 
-	return 0;
+	for(;;)
+	{
+		if(!lua_checkstack(state, 3))
+		{
+			_mpackError = "nested too deep";
+
+			return 0;
+		}
+
+		switch(token = mpackNext(reader))
+		{
+			case MPACK_NIL:
+				lua_pushlightuserdata(state, &_null);
+				break;
+
+			case MPACK_FALSE:
+			case MPACK_TRUE:
+				lua_pushboolean(state, token == MPACK_TRUE);
+				break;
+
+			case MPACK_NUMBER:
+				lua_pushnumber(state, (lua_Number) reader->number);
+				break;
+
+			case MPACK_STRING:
+			case MPACK_BINARY:
+				lua_pushlstring(state, reader->str, reader->strLen);
+				break;
+
+			case MPACK_EXT:
+				/* extensions are represented by their type and data */
+				lua_createtable(state, 0, 2);
+				lua_pushinteger(state, (lua_Integer) reader->extType);
+				lua_setfield(state, -2, "type");
+				lua_pushlstring(state, reader->str, reader->strLen);
+				lua_setfield(state, -2, "data");
+				break;
+
+			case MPACK_ARRAY:
+			case MPACK_MAP:
+				/* the message is complete, so the number of elements can not
+				 * exceed the number of bytes */
+				lua_createtable(
+					state,
+					token == MPACK_ARRAY ? (int) reader->count : 0,
+					token == MPACK_MAP ? (int) reader->count : 0
+				);
+
+				/* the elements follow, the table is stored when complete */
+				if(reader->count > 0)
+				{
+					if(depth >= MPACK_DEPTH_MAX)
+					{
+						_mpackError = "nested too deep";
+
+						return 0;
+					}
+
+					isMap[depth] = token == MPACK_MAP;
+					remaining[depth] = reader->count * (isMap[depth] ? 2 : 1);
+					index[depth] = 0;
+					++depth;
+
+					continue;
+				}
+
+				break;
+
+			default:
+				_mpackError = "invalid message";
+
+				return 0;
+		}
+
+		/* store the completed values in their containers */
+		while(depth > 0)
+		{
+			if(isMap[depth - 1] && remaining[depth - 1] % 2 == 0)
+			{
+				/* this is a key, it stays on the stack until the value is
+				 * complete. nan can not be used as key. */
+				if(lua_type(state, -1) == LUA_TNUMBER
+					&& lua_tonumber(state, -1) != lua_tonumber(state, -1))
+				{
+					_mpackError = "invalid key";
+
+					return 0;
+				}
+
+				--remaining[depth - 1];
+
+				break;
+			}
+
+			if(isMap[depth - 1])
+			{
+				lua_rawset(state, -3);
+			}
+			else
+			{
+				lua_rawseti(state, -2, (int) ++index[depth - 1]);
+			}
+
+			/* are there elements left in the container */
+			if(--remaining[depth - 1] > 0)
+			{
+				break;
+			}
+
+			/* the container is complete and on top of the stack */
+			--depth;
+		}
+
+		if(depth == 0)
+		{
+			return 1;
+		}
+	}
 }
 
 /**
- * registers the log api with lua.
+ * encodes the given value as messagepack. if a buffer is given the result is
+ * appended to it and true is returned, otherwise the result is returned as
+ * string. returns nil and an error message in case of an error.
  */
-static void _registerLogApi(void)
+static int _luaMpackPack(lua_State *state)
 {
-	/* possible lua server functions */
+	_mpackOptions_t options;
+	buf_t *buf = &_scratch;
+	int optionsIndex = 2, top;
+	size_t len;
+
+	/* the default options */
+	options.emptyArray = 0;
+	options.binary = 0;
+
+	/* is there a buffer to append to */
+	if(lua_type(state, 2) == LUA_TUSERDATA)
+	{
+		buf = *((buf_t**) luaL_checkudata(state, 2, _BUF_TYPE_NAME));
+		optionsIndex = 3;
+	}
+	else
+	{
+		bufConsume(&_scratch, _scratch.len);
+	}
+
+	/* read the options */
+	if(lua_istable(state, optionsIndex))
+	{
+		lua_getfield(state, optionsIndex, "emptyArray");
+		options.emptyArray = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+
+		lua_getfield(state, optionsIndex, "binary");
+		options.binary = lua_toboolean(state, -1);
+		lua_pop(state, 1);
+	}
+
+	/* remember the state in case of an error */
+	len = buf->len;
+	top = lua_gettop(state);
+	_mpackError = NULL;
+
+	if(!_mpackEncode(state, buf, 1, 0, &options))
+	{
+		/* remove the partially encoded value from the buffer */
+		buf->len = len;
+		lua_settop(state, top);
+
+		lua_pushnil(state);
+		lua_pushstring(
+			state, _mpackError != NULL ? _mpackError : "out of memory"
+		);
+
+		return 2;
+	}
+
+	/* push the result */
+	if(buf == &_scratch)
+	{
+		lua_pushlstring(state, (const char*) _scratch.data, _scratch.len);
+	}
+	else
+	{
+		lua_pushboolean(state, 1);
+	}
+
+	return 1;
+}
+
+/**
+ * decodes the message at the given position (default 1) of the string.
+ * returns the value and the position after the message or nil and an error
+ * message.
+ */
+static int _luaMpackUnpack(lua_State *state)
+{
+	mpackScanner_t scanner;
+	mpackReader_t reader;
+	size_t len, pos;
+	int top;
+
+	/* get the data and the position from the arguments */
+	const char *data = luaL_checklstring(state, 1, &len);
+	pos = (size_t) luaL_optinteger(state, 2, 1);
+
+	if(pos < 1 || pos > len + 1)
+	{
+		return luaL_argerror(state, 2, "position out of range");
+	}
+
+	data += pos - 1;
+	len -= pos - 1;
+
+	/* make sure the message is complete before decoding it */
+	mpackScanInit(&scanner);
+
+	switch(mpackScan(&scanner, data, len))
+	{
+		case 2:
+			break;
+
+		case 1:
+			lua_pushnil(state);
+			lua_pushliteral(state, "incomplete message");
+			return 2;
+
+		default:
+			lua_pushnil(state);
+			lua_pushliteral(state, "invalid message");
+			return 2;
+	}
+
+	mpackReaderInit(&reader, data, scanner.pos);
+	top = lua_gettop(state);
+
+	if(!_mpackDecode(state, &reader))
+	{
+		lua_settop(state, top);
+		lua_pushnil(state);
+		lua_pushstring(state, _mpackError);
+
+		return 2;
+	}
+
+	/* push the position after the message */
+	lua_pushinteger(state, (lua_Integer) (pos + scanner.pos));
+
+	return 2;
+}
+
+/**
+ * decodes the next message of the given buffer and removes it from the
+ * buffer. returns true and the value if a message was decoded, false if the
+ * message is not complete yet and nil and an error message if the message is
+ * invalid.
+ */
+static int _luaMpackDecoderRead(lua_State *state)
+{
+	mpackReader_t reader;
+	const void *data;
+	size_t len = 0;
+	int top;
+
+	/* get the decoder and the buffer from the arguments */
+	mpackScanner_t *scanner = luaL_checkudata(state, 1, _MPACK_TYPE_NAME);
+	buf_t **bufPtr = luaL_checkudata(state, 2, _BUF_TYPE_NAME);
+
+	data = bufHasData(*bufPtr) ? bufPeek(*bufPtr, &len) : "";
+
+	/* the buffer was changed by someone else, start over */
+	if(len < scanner->pos)
+	{
+		mpackScanInit(scanner);
+	}
+
+	/* check whether the message is complete, the scanner continues where it
+	 * stopped the last time */
+	switch(mpackScan(scanner, data, len))
+	{
+		case 2:
+			break;
+
+		case 1:
+			lua_pushboolean(state, 0);
+			return 1;
+
+		default:
+			mpackScanInit(scanner);
+			lua_pushnil(state);
+			lua_pushliteral(state, "invalid message");
+			return 2;
+	}
+
+	mpackReaderInit(&reader, data, scanner->pos);
+	top = lua_gettop(state);
+
+	lua_pushboolean(state, 1);
+
+	if(!_mpackDecode(state, &reader))
+	{
+		mpackScanInit(scanner);
+		lua_settop(state, top);
+		lua_pushnil(state);
+		lua_pushstring(state, _mpackError);
+
+		return 2;
+	}
+
+	/* remove the message from the buffer */
+	bufConsume(*bufPtr, scanner->pos);
+	mpackScanInit(scanner);
+
+	return 2;
+}
+
+/**
+ * creates a new messagepack decoder object.
+ */
+static int _luaMpackNewDecoder(lua_State *state)
+{
+	/* create the decoder object */
+	mpackScanner_t *scanner = (mpackScanner_t*) lua_newuserdata(
+		state, sizeof(mpackScanner_t)
+	);
+
+	mpackScanInit(scanner);
+	luaL_setmetatable(state, _MPACK_TYPE_NAME);
+
+	return 1;
+}
+
+/**
+ * registers the messagepack api with lua.
+ */
+static void _registerMpackApi(void)
+{
+	/* possible lua decoder functions */
+	const luaL_Reg methods[] = {
+		{"read", _luaMpackDecoderRead},
+		{NULL, NULL}
+	};
+
+	/* possible lua messagepack functions */
 	const luaL_Reg funcs[] = {
-		{"setCallback", _luaLogSetCallback},
-		{"write", _luaLogWrite},
+		{"pack", _luaMpackPack},
+		{"unpack", _luaMpackUnpack},
+		{"newDecoder", _luaMpackNewDecoder},
 		{NULL, NULL}
 	};
 
-	/* create the log api and make it accessible */
+	/* create the new meta table for the decoder types */
+	luaL_newmetatable(_state, _MPACK_TYPE_NAME);
+	luaL_setfuncs(_state, methods, 0);
+
+	/* allow accessing the functions through the index meta field */
+	lua_pushliteral(_state, "__index");
+	lua_pushvalue(_state, -2);
+	lua_rawset(_state, -3);
+
+	/* remove the metatable from the stack */
+	lua_pop(_state, 1);
+
+	/* create the messagepack api */
 	luaL_newlib(_state, funcs);
-	lua_setglobal(_state, "log");
+
+	/* store the null value */
+	lua_pushliteral(_state, "null");
+	lua_pushlightuserdata(_state, &_null);
+	lua_rawset(_state, -3);
+
+	/* make the api accessible */
+	lua_setglobal(_state, "msgpack");
 }
 
 /**
@@ -598,6 +5015,45 @@ static void _registerApi(void)
 
 	/* register the log api */
 	_registerLogApi();
+
+	/* register the form api */
+	_registerFormApi();
+
+	/* register the encoding api */
+	_registerEncodingApi();
+
+	/* register the hash api */
+	_registerHashApi();
+
+	/* register the websocket api */
+	_registerWsApi();
+
+	/* register the http/2 api */
+	_registerH2Api();
+
+	/* register the compression api */
+	_registerCompApi();
+
+	/* register the cache api */
+	_registerCacheApi();
+
+	/* register the static file api */
+	_registerFilesApi();
+
+	/* register the router api */
+	_registerRouterApi();
+
+	/* register the flight api */
+	_registerFlightApi();
+
+	/* register the hash ring api */
+	_registerRingApi();
+
+	/* register the json api */
+	_registerJsonApi();
+
+	/* register the messagepack api */
+	_registerMpackApi();
 }
 
 /**
@@ -612,6 +5068,10 @@ int providerPrepare(int argc, char **argv)
 		/* create a new lua state */
 		if((_state = luaL_newstate()) != NULL)
 		{
+			/* count the allocations of the state */
+			_luaAlloc = lua_getallocf(_state, &_luaAllocData);
+			lua_setallocf(_state, _countingAlloc, _luaAllocData);
+
 			/* open the default lua libraries */
 			luaL_openlibs(_state);
 
@@ -658,4 +5118,10 @@ void providerShutdown(void)
 		/* close the lua state */
 		lua_close(_state);
 	}
+
+	/* free the scratch buffer */
+	bufClear(&_scratch);
+
+	/* free the compression cache */
+	compCleanup();
 }
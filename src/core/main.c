@@ -78,15 +78,20 @@ static void _restartSignalHandler(int sigNo)
  */
 static void _prepareSignals(void)
 {
-	/* register the signal handlers */
+	/* register the signal handlers, the provider may replace them with
+	 * handlers invoked by the event loop (see signalWatch()) */
 	signal(SIGTERM, _termSignalHandler);
 	signal(SIGINT, _termSignalHandler);
 	signal(SIGHUP, _termSignalHandler);
 	signal(SIGUSR1, _restartSignalHandler);
 	signal(SIGUSR2, _restartSignalHandler);
 
-	/* ignore SIGCHLD, it is absolutely not needed */
+	/* ignore SIGCHLD, it is absolutely not needed (unless a child process
+	 * is started with processSpawn(), which watches it with signalWatch()) */
 	signal(SIGCHLD, SIG_IGN);
+
+	/* writing to a closed socket or pipe must not terminate the server */
+	signal(SIGPIPE, SIG_IGN);
 }
 
 /**
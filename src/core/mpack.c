@@ -0,0 +1,623 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * defines 2^32 as double, used to split numbers into 32 bit halves.
+ */
+#define _TWO_POW_32 (4294967296.0)
+
+/**
+ * defines the structure of a decoded header.
+ */
+typedef struct {
+
+	/* stores the token of the value */
+	mpackToken_t token;
+
+	/* stores the number of child values (arrays and maps) */
+	unsigned long count;
+
+	/* stores the length of the payload following the header */
+	unsigned long payload;
+
+	/* stores the value of numbers */
+	double number;
+
+	/* stores the type of extensions */
+	int extType;
+
+} _header_t;
+
+/**
+ * checks whether the machine stores numbers in little endian byte order.
+ */
+static int _isLittleEndian(void)
+{
+	unsigned int one = 1;
+
+	return *((unsigned char*) &one) == 1;
+}
+
+/**
+ * reads a big endian unsigned integer with the given number of bytes (at most
+ * four).
+ */
+static unsigned long _readUint(const unsigned char *data, size_t len)
+{
+	unsigned long value = 0;
+	size_t i;
+
+	for(i=0;i<len;++i)
+	{
+		value = (value << 8) | data[i];
+	}
+
+	return value & 0xffffffffUL;
+}
+
+/**
+ * reads a big endian 64 bit integer as double. the second parameter tells
+ * whether it is signed or not.
+ */
+static double _readUint64(const unsigned char *data, int isSigned)
+{
+	unsigned long hi = _readUint(data, 4), lo = _readUint(data + 4, 4);
+
+	/* negative numbers are stored in two's complement */
+	if(isSigned && (hi & 0x80000000UL))
+	{
+		hi = ~hi & 0xffffffffUL;
+		lo = ~lo & 0xffffffffUL;
+
+		return -((double) hi * _TWO_POW_32 + (double) lo + 1.0);
+	}
+
+	return (double) hi * _TWO_POW_32 + (double) lo;
+}
+
+/**
+ * reads a big endian ieee 754 floating point number with the given size (4 or
+ * 8 bytes).
+ */
+static double _readFloat(const unsigned char *data, size_t len)
+{
+	unsigned char tmp[8];
+	float f;
+	double d;
+	size_t i;
+
+	/* bring the bytes into the order of the machine */
+	for(i=0;i<len;++i)
+	{
+		tmp[i] = _isLittleEndian() ? data[len - 1 - i] : data[i];
+	}
+
+	if(len == 4)
+	{
+		memcpy(&f, tmp, 4);
+
+		return (double) f;
+	}
+
+	memcpy(&d, tmp, 8);
+
+	return d;
+}
+
+/**
+ * sets up a header of a scalar value with a payload.
+ */
+static size_t _payload(
+	_header_t *header, mpackToken_t token, const unsigned char *data,
+	size_t lenSize, size_t headerSize
+)
+{
+	header->token = token;
+	header->payload = _readUint(data + 1, lenSize);
+
+	return headerSize;
+}
+
+/**
+ * decodes the header of the next value. returns the size of the header, 0 if
+ * there is not enough data and (size_t) -1 if the data is invalid.
+ */
+static size_t _readHeader(
+	const unsigned char *data, size_t len, _header_t *header
+)
+{
+	/* defines the size of the headers starting at 0xc0 (0 means invalid) */
+	static const unsigned char sizes[32] = {
+		1, 0, 1, 1, 2, 3, 5, 3, 4, 6, 5, 9, 2, 3, 5, 9,
+		2, 3, 5, 9, 2, 2, 2, 2, 2, 2, 3, 5, 3, 5, 3, 5
+	};
+
+	unsigned char type;
+	size_t size;
+
+	header->count = 0;
+	header->payload = 0;
+	header->number = 0;
+	header->extType = 0;
+
+	if(len == 0)
+	{
+		return 0;
+	}
+
+	type = data[0];
+
+	/* the fixed formats which are stored in a single byte */
+	if(type < 0x80 || type >= 0xe0)
+	{
+		header->token = MPACK_NUMBER;
+		header->number = type < 0x80 ? (double) type : (double) type - 256;
+
+		return 1;
+	}
+	else if(type < 0x90)
+	{
+		header->token = MPACK_MAP;
+		header->count = type & 0x0f;
+
+		return 1;
+	}
+	else if(type < 0xa0)
+	{
+		header->token = MPACK_ARRAY;
+		header->count = type & 0x0f;
+
+		return 1;
+	}
+	else if(type < 0xc0)
+	{
+		header->token = MPACK_STRING;
+		header->payload = type & 0x1f;
+
+		return 1;
+	}
+
+	/* all the other formats have a fixed header size */
+	if((size = sizes[type - 0xc0]) == 0)
+	{
+		return (size_t) -1;
+	}
+
+	if(len < size)
+	{
+		return 0;
+	}
+
+	switch(type)
+	{
+		case 0xc0:
+			header->token = MPACK_NIL;
+			return size;
+
+		case 0xc2:
+		case 0xc3:
+			header->token = type == 0xc3 ? MPACK_TRUE : MPACK_FALSE;
+			return size;
+
+		case 0xc4:
+			return _payload(header, MPACK_BINARY, data, 1, size);
+
+		case 0xc5:
+			return _payload(header, MPACK_BINARY, data, 2, size);
+
+		case 0xc6:
+			return _payload(header, MPACK_BINARY, data, 4, size);
+
+		case 0xc7:
+		case 0xc8:
+		case 0xc9:
+			/* the length is followed by the type of the extension */
+			_payload(header, MPACK_EXT, data, size - 2, size);
+			header->extType = (signed char) data[size - 1];
+			return size;
+
+		case 0xca:
+			header->token = MPACK_NUMBER;
+			header->number = _readFloat(data + 1, 4);
+			return size;
+
+		case 0xcb:
+			header->token = MPACK_NUMBER;
+			header->number = _readFloat(data + 1, 8);
+			return size;
+
+		case 0xcc:
+		case 0xcd:
+		case 0xce:
+			header->token = MPACK_NUMBER;
+			header->number = (double) _readUint(data + 1, size - 1);
+			return size;
+
+		case 0xcf:
+		case 0xd3:
+			header->token = MPACK_NUMBER;
+			header->number = _readUint64(data + 1, type == 0xd3);
+			return size;
+
+		case 0xd0:
+			header->token = MPACK_NUMBER;
+			header->number = (double) (signed char) data[1];
+			return size;
+
+		case 0xd1:
+		case 0xd2:
+			header->token = MPACK_NUMBER;
+			header->number = (double) _readUint(data + 1, size - 1);
+
+			/* convert the two's complement */
+			if(data[1] & 0x80)
+			{
+				header->number -= type == 0xd1 ? 65536.0 : _TWO_POW_32;
+			}
+
+			return size;
+
+		case 0xd4:
+		case 0xd5:
+		case 0xd6:
+		case 0xd7:
+		case 0xd8:
+			/* fixed extensions only store their type */
+			header->token = MPACK_EXT;
+			header->payload = 1UL << (type - 0xd4);
+			header->extType = (signed char) data[1];
+			return size;
+
+		case 0xd9:
+			return _payload(header, MPACK_STRING, data, 1, size);
+
+		case 0xda:
+			return _payload(header, MPACK_STRING, data, 2, size);
+
+		case 0xdb:
+			return _payload(header, MPACK_STRING, data, 4, size);
+
+		case 0xdc:
+		case 0xdd:
+			header->token = MPACK_ARRAY;
+			header->count = _readUint(data + 1, size - 1);
+			return size;
+
+		default:
+			header->token = MPACK_MAP;
+			header->count = _readUint(data + 1, size - 1);
+			return size;
+	}
+}
+
+/**
+ * appends a type byte followed by a big endian unsigned integer with the given
+ * number of bytes (at most four) to the buffer.
+ */
+static int _writeUint(
+	buf_t *buf,
+	unsigned char type,
+	unsigned long value,
+	size_t len
+)
+{
+	unsigned char tmp[5];
+	size_t i;
+
+	tmp[0] = type;
+
+	for(i=len;i>0;--i)
+	{
+		tmp[i] = (unsigned char) (value & 0xff);
+		value >>= 8;
+	}
+
+	return bufAppend(buf, tmp, len + 1);
+}
+
+/**
+ * appends the header of a value with a length or count (strings, binaries,
+ * arrays and maps). the fixed type is used when the value is not bigger than
+ * the limit, the other types are used for 8, 16 and 32 bit lengths (a type of
+ * 0 means the format is not supported).
+ */
+static int _writeLength(
+	buf_t *buf, unsigned long len, unsigned char fixType, unsigned long fixMax,
+	unsigned char type8, unsigned char type16, unsigned char type32
+)
+{
+	if(fixType != 0 && len <= fixMax)
+	{
+		return _writeUint(buf, (unsigned char) (fixType | len), 0, 0);
+	}
+	else if(type8 != 0 && len <= 0xff)
+	{
+		return _writeUint(buf, type8, len, 1);
+	}
+	else if(len <= 0xffff)
+	{
+		return _writeUint(buf, type16, len, 2);
+	}
+
+	return _writeUint(buf, type32, len, 4);
+}
+
+/**
+ * initializes the scanner. a scanner is used to find out whether a complete
+ * message is available without decoding it.
+ */
+void mpackScanInit(mpackScanner_t *scanner)
+{
+	scanner->pos = 0;
+	scanner->pending = 1;
+}
+
+/**
+ * scans the given data for a complete message. the data must always start
+ * with the beginning of the message and may grow between the calls, the
+ * scanner continues where it stopped. returns 1 if more data is required, 2
+ * if the message is complete (its length is stored in the pos field of the
+ * scanner) and 0 if the data is invalid or the message is too big.
+ */
+int mpackScan(mpackScanner_t *scanner, const void *data, size_t len)
+{
+	const unsigned char *src = (const unsigned char*) data;
+	_header_t header;
+	size_t size;
+
+	while(scanner->pending > 0)
+	{
+		size = _readHeader(src + scanner->pos, len - scanner->pos, &header);
+
+		if(size == (size_t) -1)
+		{
+			return 0;
+		}
+
+		/* wait for the header and its payload */
+		if(size == 0 || len - scanner->pos - size < header.payload)
+		{
+			return scanner->pos + size + header.payload > MPACK_MESSAGE_MAX
+				? 0 : 1;
+		}
+
+		/* more children than bytes allowed can never be complete */
+		if(header.count > MPACK_MESSAGE_MAX
+			|| scanner->pending + 2 * header.count > MPACK_MESSAGE_MAX)
+		{
+			return 0;
+		}
+
+		/* the value is complete, its children are still missing */
+		scanner->pos += size + header.payload;
+		scanner->pending += (header.token == MPACK_MAP ? 2 : 1) * header.count;
+		scanner->pending -= 1;
+	}
+
+	return 2;
+}
+
+/**
+ * initializes the reader with the given data. the data must stay valid as long
+ * as the reader is used.
+ */
+void mpackReaderInit(mpackReader_t *reader, const void *data, size_t len)
+{
+	memset(reader, 0, sizeof(*reader));
+
+	reader->data = (const unsigned char*) data;
+	reader->len = len;
+}
+
+/**
+ * reads the next value. after MPACK_NUMBER the number field contains the
+ * value, after MPACK_STRING, MPACK_BINARY and MPACK_EXT the str and strLen
+ * fields contain the payload (and extType the type of the extension) and
+ * after MPACK_ARRAY and MPACK_MAP the count field contains the number of
+ * elements (a map with count n is followed by n keys and n values). returns
+ * MPACK_END if there is not enough data for the next value and MPACK_ERROR if
+ * the data is invalid.
+ */
+mpackToken_t mpackNext(mpackReader_t *reader)
+{
+	_header_t header;
+	size_t size = _readHeader(
+		reader->data + reader->pos, reader->len - reader->pos, &header
+	);
+
+	if(size == (size_t) -1)
+	{
+		return MPACK_ERROR;
+	}
+
+	/* is the value complete */
+	if(size == 0 || reader->len - reader->pos - size < header.payload)
+	{
+		return MPACK_END;
+	}
+
+	reader->number = header.number;
+	reader->count = header.count;
+	reader->extType = header.extType;
+	reader->str = (const char*) reader->data + reader->pos + size;
+	reader->strLen = header.payload;
+	reader->pos += size + header.payload;
+
+	return header.token;
+}
+
+/**
+ * appends nil to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteNil(buf_t *buf)
+{
+	return bufAppend(buf, "\xc0", 1);
+}
+
+/**
+ * appends a boolean to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteBoolean(buf_t *buf, int value)
+{
+	return bufAppend(buf, value ? "\xc3" : "\xc2", 1);
+}
+
+/**
+ * appends a number to the buffer. integral numbers are written in the
+ * smallest integer format, all other numbers as 64 bit float. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int mpackWriteNumber(buf_t *buf, double number)
+{
+	unsigned char tmp[9];
+	unsigned long hi, lo;
+	double magnitude;
+	size_t i;
+
+	/* integral numbers within the range of 64 bit integers */
+	if(number == floor(number)
+		&& number >= -9223372036854775808.0
+		&& number < 18446744073709551616.0)
+	{
+		if(number >= 0)
+		{
+			if(number < 128)
+			{
+				return _writeUint(buf, (unsigned char) number, 0, 0);
+			}
+			else if(number < 256)
+			{
+				return _writeUint(buf, 0xcc, (unsigned long) number, 1);
+			}
+			else if(number < 65536)
+			{
+				return _writeUint(buf, 0xcd, (unsigned long) number, 2);
+			}
+			else if(number < _TWO_POW_32)
+			{
+				return _writeUint(buf, 0xce, (unsigned long) number, 4);
+			}
+		}
+		else
+		{
+			if(number >= -32)
+			{
+				return _writeUint(
+					buf, (unsigned char) (256 + (int) number), 0, 0
+				);
+			}
+			else if(number >= -128)
+			{
+				return _writeUint(
+					buf, 0xd0, (unsigned long) (256 + number), 1
+				);
+			}
+			else if(number >= -32768)
+			{
+				return _writeUint(
+					buf, 0xd1, (unsigned long) (65536 + number), 2
+				);
+			}
+			else if(number >= -2147483648.0)
+			{
+				return _writeUint(
+					buf, 0xd2, (unsigned long) (_TWO_POW_32 + number), 4
+				);
+			}
+		}
+
+		/* 64 bit integers are split into two 32 bit halves */
+		magnitude = fabs(number);
+		hi = (unsigned long) floor(magnitude / _TWO_POW_32);
+		lo = (unsigned long) (magnitude - (double) hi * _TWO_POW_32);
+
+		/* negative numbers are stored in two's complement */
+		if(number < 0)
+		{
+			lo = (~lo + 1) & 0xffffffffUL;
+			hi = (~hi + (lo == 0 ? 1 : 0)) & 0xffffffffUL;
+		}
+
+		tmp[0] = number < 0 ? 0xd3 : 0xcf;
+
+		for(i=0;i<4;++i)
+		{
+			tmp[4 - i] = (unsigned char) ((hi >> (8 * i)) & 0xff);
+			tmp[8 - i] = (unsigned char) ((lo >> (8 * i)) & 0xff);
+		}
+
+		return bufAppend(buf, tmp, sizeof(tmp));
+	}
+
+	/* everything else is written as 64 bit float */
+	tmp[0] = 0xcb;
+
+	for(i=0;i<8;++i)
+	{
+		tmp[1 + i] = _isLittleEndian()
+			? ((unsigned char*) &number)[7 - i]
+			: ((unsigned char*) &number)[i];
+	}
+
+	return bufAppend(buf, tmp, sizeof(tmp));
+}
+
+/**
+ * appends a string to the buffer. the binary format is used if the last
+ * parameter is not 0. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteString(buf_t *buf, const void *data, size_t len, int binary)
+{
+	int result = binary
+		? _writeLength(buf, len, 0, 0, 0xc4, 0xc5, 0xc6)
+		: _writeLength(buf, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+
+	return result && bufAppend(buf, data, len);
+}
+
+/**
+ * appends the header of an array with the given number of elements to the
+ * buffer. the elements have to be written afterwards. returns 1 if everything
+ * is ok and 0 if not.
+ */
+int mpackWriteArray(buf_t *buf, unsigned long count)
+{
+	return _writeLength(buf, count, 0x90, 15, 0, 0xdc, 0xdd);
+}
+
+/**
+ * appends the header of a map with the given number of pairs to the buffer.
+ * the keys and values have to be written afterwards (key, value, key, ...).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteMap(buf_t *buf, unsigned long count)
+{
+	return _writeLength(buf, count, 0x80, 15, 0, 0xde, 0xdf);
+}
@@ -0,0 +1,437 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * the environment of the server, used if a child gets no environment.
+ */
+extern char **environ;
+
+/**
+ * stores the running processes.
+ */
+static process_t *_processes;
+
+/**
+ * makes the given descriptor non-blocking (optional) and closes it on exec.
+ */
+static void _prepareFd(int fd, int isNonBlocking)
+{
+	if(isNonBlocking)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+/**
+ * closes the given pipe of the process.
+ */
+static void _closePipe(process_t *process, int index)
+{
+	if(process->fds[index] >= 0)
+	{
+		serverUnwatchFd(process->fds[index]);
+		close(process->fds[index]);
+
+		process->fds[index] = -1;
+	}
+}
+
+/**
+ * invokes the exit callback and frees the process once the child exited and
+ * its output was read completely. returns 1 if the process was freed and 0 if
+ * not.
+ */
+static int _finish(process_t *process)
+{
+	process_t **link;
+	int i;
+
+	if(!process->hasExited || process->fds[1] >= 0 || process->fds[2] >= 0)
+	{
+		return 0;
+	}
+
+	for(link=&_processes;*link!=process;link=&((*link)->next))
+	{
+	}
+
+	*link = process->next;
+
+	_closePipe(process, 0);
+
+	process->callback(process, PROCESS_EXIT, NULL, process->arg);
+
+	for(i=0;i<3;++i)
+	{
+		bufClear(process->buffers + i);
+	}
+
+	free(process);
+
+	/* the server may exit without sockets if no child is running */
+	if(_processes == NULL)
+	{
+		signalUnwatch(SIGCHLD);
+	}
+
+	return 1;
+}
+
+/**
+ * reaps the exited children, invoked by the event loop on SIGCHLD.
+ */
+static void _reap(int sigNo, void *arg)
+{
+	process_t *process, *next;
+	int status;
+
+	for(process=_processes;process!=NULL;process=next)
+	{
+		next = process->next;
+
+		if(!process->hasExited
+			&& waitpid(process->pid, &status, WNOHANG) == process->pid)
+		{
+			process->hasExited = 1;
+			process->status = status;
+
+			(void) _finish(process);
+		}
+	}
+}
+
+static void _handlePipe(int, int, void*);
+
+/**
+ * writes the queued input to the child.
+ */
+static void _writeInput(process_t *process)
+{
+	buf_t *buf = process->buffers;
+	ssize_t written;
+	size_t len;
+	void *data;
+
+	data = bufPeek(buf, &len);
+
+	if(len > 0)
+	{
+		if((written = write(process->fds[0], data, len)) > 0)
+		{
+			bufConsume(buf, (size_t) written);
+		}
+		else if(written < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			/* the child closed its input, the rest is dropped */
+			bufClear(buf);
+			_closePipe(process, 0);
+
+			return;
+		}
+	}
+
+	if(bufHasData(buf))
+	{
+		return;
+	}
+
+	/* everything was written */
+	if(process->isClosingInput)
+	{
+		_closePipe(process, 0);
+	}
+	else
+	{
+		serverWatchFd(process->fds[0], 0, _handlePipe, process);
+	}
+
+	process->callback(process, PROCESS_DRAIN, NULL, process->arg);
+}
+
+/**
+ * handles the pipes of a process.
+ */
+static void _handlePipe(int fd, int events, void *arg)
+{
+	unsigned char data[IO_BUF_SIZE * 4];
+	process_t *process = (process_t*) arg;
+	ssize_t bytesRead;
+	int index;
+
+	if(fd == process->fds[0])
+	{
+		_writeInput(process);
+
+		return;
+	}
+
+	index = fd == process->fds[1] ? 1 : 2;
+	bytesRead = read(fd, data, sizeof(data));
+
+	if(bytesRead > 0)
+	{
+		if(bufAppend(process->buffers + index, data, (size_t) bytesRead))
+		{
+			process->callback(
+				process,
+				index == 1 ? PROCESS_STDOUT : PROCESS_STDERR,
+				process->buffers + index,
+				process->arg
+			);
+
+			return;
+		}
+	}
+	else if(bytesRead < 0 && (errno == EAGAIN || errno == EINTR))
+	{
+		return;
+	}
+
+	/* end of the output (or no memory to store it) */
+	_closePipe(process, index);
+	(void) _finish(process);
+}
+
+/**
+ * routes SIGCHLD into the event loop. returns 1 if everything is ok and 0 if
+ * not.
+ */
+static int _prepareSignal(void)
+{
+	/* the server ignores SIGCHLD by default, which reaps the children before
+	 * their status can be read. the disposition is restored by
+	 * signalUnwatch() once no child is running */
+	return signalWatch(SIGCHLD, _reap, NULL);
+}
+
+/**
+ * starts the program of the given argument vector (searched in PATH) with the
+ * given environment (null for the environment of the server) using
+ * posix_spawn(). the standard input, output and error of the child are pipes
+ * watched by the event loop. returns the process or null if it was not
+ * possible to start it.
+ */
+process_t *processSpawn(
+	char *const argv[],
+	char *const envp[],
+	processCallback_t callback,
+	void *arg
+)
+{
+	int pipes[3][2] = {{-1, -1}, {-1, -1}, {-1, -1}};
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attributes;
+	process_t *process;
+	sigset_t signals;
+	int i, result = -1;
+
+	if(argv == NULL || argv[0] == NULL || !_prepareSignal())
+	{
+		return NULL;
+	}
+
+	if((process = (process_t*) calloc(1, sizeof(process_t))) == NULL)
+	{
+		return NULL;
+	}
+
+	for(i=0;i<3;++i)
+	{
+		if(pipe(pipes[i]) != 0)
+		{
+			break;
+		}
+
+		/* the server keeps the write end of the input and the read ends of
+		 * the output, the other ends belong to the child */
+		_prepareFd(pipes[i][0], i != 0);
+		_prepareFd(pipes[i][1], i == 0);
+	}
+
+	/* the descriptors of the server must fit into the select() sets */
+	if(i == 3 && pipes[0][1] < SOCKET_MAX && pipes[1][0] < SOCKET_MAX
+		&& pipes[2][0] < SOCKET_MAX)
+	{
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, pipes[0][0], 0);
+		posix_spawn_file_actions_adddup2(&actions, pipes[1][1], 1);
+		posix_spawn_file_actions_adddup2(&actions, pipes[2][1], 2);
+
+		/* the child starts with the default signal handling, the server
+		 * ignores some signals (e.g. SIGPIPE) */
+		posix_spawnattr_init(&attributes);
+		posix_spawnattr_setflags(
+			&attributes, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK
+		);
+		sigfillset(&signals);
+		posix_spawnattr_setsigdefault(&attributes, &signals);
+		sigemptyset(&signals);
+		posix_spawnattr_setsigmask(&attributes, &signals);
+
+		result = posix_spawnp(
+			&(process->pid), argv[0], &actions, &attributes, argv,
+			envp != NULL ? envp : environ
+		);
+
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attributes);
+	}
+
+	/* close the ends of the child */
+	for(i=0;i<3;++i)
+	{
+		if(pipes[i][i == 0 ? 0 : 1] >= 0)
+		{
+			close(pipes[i][i == 0 ? 0 : 1]);
+		}
+	}
+
+	process->fds[0] = pipes[0][1];
+	process->fds[1] = pipes[1][0];
+	process->fds[2] = pipes[2][0];
+
+	if(result != 0
+		|| !serverWatchFd(process->fds[0], 0, _handlePipe, process)
+		|| !serverWatchFd(process->fds[1], WATCH_READ, _handlePipe, process)
+		|| !serverWatchFd(process->fds[2], WATCH_READ, _handlePipe, process))
+	{
+		for(i=0;i<3;++i)
+		{
+			if(process->fds[i] >= 0)
+			{
+				serverUnwatchFd(process->fds[i]);
+				close(process->fds[i]);
+			}
+		}
+
+		/* a child started anyway is reaped by the SIGCHLD handler */
+		if(result == 0)
+		{
+			kill(process->pid, SIGKILL);
+			waitpid(process->pid, NULL, 0);
+		}
+
+		free(process);
+
+		if(_processes == NULL)
+		{
+			signalUnwatch(SIGCHLD);
+		}
+
+		return NULL;
+	}
+
+	process->callback = callback;
+	process->arg = arg;
+
+	process->next = _processes;
+	_processes = process;
+
+	return process;
+}
+
+/**
+ * queues data for the standard input of the child. returns 1 if everything is
+ * ok and 0 if not (e.g. the input was closed).
+ */
+int processWrite(process_t *process, const void *data, size_t len)
+{
+	if(process->fds[0] < 0 || process->isClosingInput
+		|| !bufAppend(process->buffers, data, len))
+	{
+		return 0;
+	}
+
+	return serverWatchFd(process->fds[0], WATCH_WRITE, _handlePipe, process);
+}
+
+/**
+ * closes the standard input of the child once the queued data is written.
+ */
+void processCloseInput(process_t *process)
+{
+	process->isClosingInput = 1;
+
+	if(!bufHasData(process->buffers))
+	{
+		_closePipe(process, 0);
+	}
+}
+
+/**
+ * sends the given signal to the child. returns 1 if everything is ok and 0
+ * if not.
+ */
+int processKill(process_t *process, int sigNo)
+{
+	return !process->hasExited && kill(process->pid, sigNo) == 0;
+}
+
+/**
+ * returns the process id of the child.
+ */
+pid_t processGetPid(process_t *process)
+{
+	return process->pid;
+}
+
+/**
+ * returns the wait status of the child, it is only valid for PROCESS_EXIT.
+ */
+int processGetStatus(process_t *process)
+{
+	return process->status;
+}
+
+/**
+ * returns the running process with the given process id or null if there is
+ * none.
+ */
+process_t *processFind(pid_t pid)
+{
+	process_t *process;
+
+	for(process=_processes;process!=NULL;process=process->next)
+	{
+		if(process->pid == pid)
+		{
+			return process;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,346 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/**
+ * defines the signature of a proxy protocol v2 header.
+ */
+static const unsigned char _v2Signature[12] = {
+	0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d, 0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a
+};
+
+/**
+ * returns whether the given data is the start of the given prefix (or the
+ * prefix itself followed by anything).
+ */
+static int _startsWith(
+	const unsigned char *data,
+	size_t len,
+	const void *prefix,
+	size_t prefixLen
+)
+{
+	return memcmp(data, prefix, len < prefixLen ? len : prefixLen) == 0;
+}
+
+/**
+ * cuts the next field separated by a single space off the given line. returns
+ * the field or null if the line is empty.
+ */
+static char *_nextField(char **line)
+{
+	char *field = *line;
+	char *end;
+
+	if(*field == '\0')
+	{
+		return NULL;
+	}
+
+	end = strchr(field, ' ');
+
+	if(end != NULL)
+	{
+		*end = '\0';
+		*line = end + 1;
+	}
+	else
+	{
+		*line = field + strlen(field);
+	}
+
+	return field;
+}
+
+/**
+ * parses a decimal port number. returns 1 if everything is ok and 0 if not.
+ */
+static int _parsePort(const char *str, unsigned short *port)
+{
+	unsigned long value = 0;
+	size_t len = strlen(str);
+	size_t i;
+
+	if(len == 0 || len > 5)
+	{
+		return 0;
+	}
+
+	for(i=0;i<len;++i)
+	{
+		if(str[i] < '0' || str[i] > '9')
+		{
+			return 0;
+		}
+
+		value = value * 10 + (unsigned long) (str[i] - '0');
+	}
+
+	if(value > 65535)
+	{
+		return 0;
+	}
+
+	*port = (unsigned short) value;
+
+	return 1;
+}
+
+/**
+ * stores the source address of a v1 header in the given address. returns 1 if
+ * everything is ok and 0 if not.
+ */
+static int _parseV1Addr(
+	const char *proto,
+	const char *src,
+	const char *dst,
+	unsigned short port,
+	struct sockaddr_storage *addr
+)
+{
+	struct sockaddr_in *addrV4 = (struct sockaddr_in*) addr;
+	struct sockaddr_in6 *addrV6 = (struct sockaddr_in6*) addr;
+	struct in6_addr dstAddr;
+
+	/* the destination is only checked, it is the address of the proxy */
+	if(strcmp(proto, "TCP4") == 0)
+	{
+		if(inet_pton(AF_INET, src, &(addrV4->sin_addr)) != 1
+			|| inet_pton(AF_INET, dst, &dstAddr) != 1)
+		{
+			return 0;
+		}
+
+		addrV4->sin_family = AF_INET;
+		addrV4->sin_port = htons(port);
+
+		return 1;
+	}
+
+	if(strcmp(proto, "TCP6") == 0)
+	{
+		if(inet_pton(AF_INET6, src, &(addrV6->sin6_addr)) != 1
+			|| inet_pton(AF_INET6, dst, &dstAddr) != 1)
+		{
+			return 0;
+		}
+
+		addrV6->sin6_family = AF_INET6;
+		addrV6->sin6_port = htons(port);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * parses a human readable v1 header, e.g.
+ * "PROXY TCP4 192.0.2.1 192.0.2.2 56324 443\r\n".
+ */
+static proxyResult_t _parseV1(
+	const unsigned char *data,
+	size_t len,
+	struct sockaddr_storage *addr,
+	size_t *headerLen
+)
+{
+	char line[PROXY_V1_MAX + 1];
+	char *cursor = line;
+	const char *proto, *src, *dst, *srcPort, *dstPort;
+	const unsigned char *end;
+	unsigned short port, unused;
+
+	/* the header is a single line */
+	end = memchr(data, '\n', len < PROXY_V1_MAX ? len : PROXY_V1_MAX);
+
+	if(end == NULL)
+	{
+		return len < PROXY_V1_MAX ? PROXY_MORE : PROXY_ERROR;
+	}
+
+	if(end == data || end[-1] != '\r')
+	{
+		return PROXY_ERROR;
+	}
+
+	/* copy the line without the line break to split it in place */
+	memcpy(line, data, (size_t) (end - data - 1));
+	line[end - data - 1] = '\0';
+
+	*headerLen = (size_t) (end - data + 1);
+
+	/* skip the "PROXY" keyword, it was checked already */
+	_nextField(&cursor);
+	proto = _nextField(&cursor);
+
+	memset(addr, 0, sizeof(*addr));
+	addr->ss_family = AF_UNSPEC;
+
+	if(proto == NULL)
+	{
+		return PROXY_ERROR;
+	}
+
+	/* the proxy does not know the client, the rest of the line is ignored */
+	if(strcmp(proto, "UNKNOWN") == 0)
+	{
+		return PROXY_DONE;
+	}
+
+	src = _nextField(&cursor);
+	dst = _nextField(&cursor);
+	srcPort = _nextField(&cursor);
+	dstPort = _nextField(&cursor);
+
+	if(dstPort == NULL || *cursor != '\0'
+		|| !_parsePort(srcPort, &port) || !_parsePort(dstPort, &unused))
+	{
+		return PROXY_ERROR;
+	}
+
+	return _parseV1Addr(proto, src, dst, port, addr)
+		? PROXY_DONE : PROXY_ERROR;
+}
+
+/**
+ * parses a binary v2 header: the signature, the version and command, the
+ * address family and the length of the addresses (and tlvs) which follow.
+ */
+static proxyResult_t _parseV2(
+	const unsigned char *data,
+	size_t len,
+	struct sockaddr_storage *addr,
+	size_t *headerLen
+)
+{
+	struct sockaddr_in *addrV4 = (struct sockaddr_in*) addr;
+	struct sockaddr_in6 *addrV6 = (struct sockaddr_in6*) addr;
+	size_t addrLen;
+
+	if(len < 16)
+	{
+		return PROXY_MORE;
+	}
+
+	/* only version 2 is defined, the command is either LOCAL or PROXY */
+	if((data[12] & 0xf0) != 0x20 || (data[12] & 0x0f) > 1)
+	{
+		return PROXY_ERROR;
+	}
+
+	addrLen = ((size_t) data[14] << 8) | data[15];
+
+	if(len < 16 + addrLen)
+	{
+		return PROXY_MORE;
+	}
+
+	*headerLen = 16 + addrLen;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->ss_family = AF_UNSPEC;
+
+	/* a LOCAL connection (e.g. a health check) is established by the proxy
+	 * itself, the addresses are ignored */
+	if((data[12] & 0x0f) == 0)
+	{
+		return PROXY_DONE;
+	}
+
+	/* the high nibble of the family byte is the address family, the low one
+	 * the transport (stream or datagram), the source comes first. unspecified
+	 * and unix sockets carry no usable address */
+	switch(data[13] >> 4)
+	{
+		case 1:
+			if(addrLen < 12)
+			{
+				return PROXY_ERROR;
+			}
+
+			addrV4->sin_family = AF_INET;
+			memcpy(&(addrV4->sin_addr), data + 16, 4);
+			memcpy(&(addrV4->sin_port), data + 24, 2);
+			break;
+
+		case 2:
+			if(addrLen < 36)
+			{
+				return PROXY_ERROR;
+			}
+
+			addrV6->sin6_family = AF_INET6;
+			memcpy(&(addrV6->sin6_addr), data + 16, 16);
+			memcpy(&(addrV6->sin6_port), data + 48, 2);
+			break;
+
+		default:
+			break;
+	}
+
+	return PROXY_DONE;
+}
+
+/**
+ * parses the proxy protocol header (v1 or v2) at the start of the given data.
+ * if the header is complete the source address is stored in the third
+ * parameter and the length of the header in the fourth parameter. the family
+ * of the address is AF_UNSPEC if the header carries none (e.g. health checks
+ * of the proxy), the address of the connection must be used then.
+ */
+proxyResult_t proxyParse(
+	const void *data,
+	size_t len,
+	struct sockaddr_storage *addr,
+	size_t *headerLen
+)
+{
+	const unsigned char *bytes = (const unsigned char*) data;
+
+	if(len == 0)
+	{
+		return PROXY_MORE;
+	}
+
+	/* the first bytes tell the versions apart */
+	if(_startsWith(bytes, len, _v2Signature, sizeof(_v2Signature)))
+	{
+		return len < sizeof(_v2Signature)
+			? PROXY_MORE : _parseV2(bytes, len, addr, headerLen);
+	}
+
+	if(_startsWith(bytes, len, "PROXY ", 6))
+	{
+		return len < 6 ? PROXY_MORE : _parseV1(bytes, len, addr, headerLen);
+	}
+
+	return PROXY_ERROR;
+}
@@ -0,0 +1,654 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/**
+ * defines the initial number of buckets, the table doubles when it holds more
+ * entries than buckets.
+ */
+#define _BUCKETS_MIN (64)
+
+/**
+ * returns the name of an entry, it is stored behind it.
+ */
+#define _getName(e) ((char*) ((e) + 1))
+
+/**
+ * returns the current time of a monotonic clock in seconds.
+ */
+static double _getTime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * resolves the entries of the queue until the resolver is stopped. runs on
+ * the helper threads.
+ */
+static void *_work(void *arg)
+{
+	resolver_t *resolver = (resolver_t*) arg;
+	struct addrinfo hints, *result, *current;
+	resolveEntry_t *entry;
+	char byte = 0;
+
+	for(;;)
+	{
+		/* wait for the next entry */
+		pthread_mutex_lock(&(resolver->lock));
+
+		while(resolver->queue == NULL && !resolver->isStopping)
+		{
+			pthread_cond_wait(&(resolver->wake), &(resolver->lock));
+		}
+
+		if(resolver->isStopping)
+		{
+			pthread_mutex_unlock(&(resolver->lock));
+
+			return NULL;
+		}
+
+		entry = resolver->queue;
+		resolver->queue = entry->nextJob;
+
+		if(resolver->queue == NULL)
+		{
+			resolver->queueTail = NULL;
+		}
+
+		pthread_mutex_unlock(&(resolver->lock));
+
+		/* the blocking part, the event loop does not touch the result of a
+		 * pending entry */
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		entry->count = 0;
+		entry->error = getaddrinfo(_getName(entry), NULL, &hints, &result);
+
+		if(entry->error == 0)
+		{
+			for(current=result;current!=NULL&&entry->count<RESOLVE_ADDR_MAX;
+				current=current->ai_next)
+			{
+				if((current->ai_family == AF_INET
+					|| current->ai_family == AF_INET6)
+					&& current->ai_addrlen <= sizeof(struct sockaddr_storage))
+				{
+					memset(entry->addrs + entry->count, 0,
+						sizeof(struct sockaddr_storage)
+					);
+					memcpy(entry->addrs + entry->count, current->ai_addr,
+						current->ai_addrlen
+					);
+					++entry->count;
+				}
+			}
+
+			freeaddrinfo(result);
+
+			if(entry->count == 0)
+			{
+				entry->error = EAI_NONAME;
+			}
+		}
+
+		/* hand the entry to the event loop */
+		pthread_mutex_lock(&(resolver->lock));
+		entry->nextJob = resolver->done;
+		resolver->done = entry;
+		pthread_mutex_unlock(&(resolver->lock));
+
+		/* the pipe may be full, the event loop is woken up anyway then */
+		if(write(resolver->notify[1], &byte, 1) < 0)
+		{
+			continue;
+		}
+	}
+}
+
+/**
+ * starts the helper threads unless they are running already. returns 1 if
+ * there is at least one thread and 0 if not.
+ */
+static int _startThreads(resolver_t *resolver)
+{
+	sigset_t all, previous;
+
+	if(resolver->threadCount > 0)
+	{
+		return 1;
+	}
+
+	/* signals are handled by the event loop, not by the helper threads */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+
+	while(resolver->threadCount < RESOLVE_THREADS && pthread_create(
+		resolver->threads + resolver->threadCount, NULL, _work, resolver
+	) == 0)
+	{
+		++resolver->threadCount;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	return resolver->threadCount > 0;
+}
+
+/**
+ * moves the entry to the front of the lru list.
+ */
+static void _link(resolver_t *resolver, resolveEntry_t *entry)
+{
+	entry->newer = NULL;
+	entry->older = resolver->newest;
+
+	if(resolver->newest != NULL)
+	{
+		resolver->newest->newer = entry;
+	}
+	else
+	{
+		resolver->oldest = entry;
+	}
+
+	resolver->newest = entry;
+}
+
+/**
+ * removes the entry from the lru list.
+ */
+static void _unlink(resolver_t *resolver, resolveEntry_t *entry)
+{
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		resolver->newest = entry->older;
+	}
+
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		resolver->oldest = entry->newer;
+	}
+}
+
+/**
+ * removes the least recently used entry which is not pending. returns 1 if
+ * there was such an entry and 0 if not.
+ */
+static int _evict(resolver_t *resolver)
+{
+	resolveEntry_t *entry, **link;
+
+	for(entry=resolver->oldest;entry!=NULL&&entry->isPending;entry=entry->newer)
+	{
+	}
+
+	if(entry == NULL)
+	{
+		return 0;
+	}
+
+	link = resolver->buckets + (entry->hash & (resolver->bucketCount - 1));
+
+	while(*link != entry)
+	{
+		link = &((*link)->next);
+	}
+
+	*link = entry->next;
+
+	_unlink(resolver, entry);
+	--resolver->count;
+
+	free(entry);
+
+	return 1;
+}
+
+/**
+ * returns the entry of the given name or null if there is none.
+ */
+static resolveEntry_t *_find(
+	resolver_t *resolver,
+	unsigned long hash,
+	const char *name
+)
+{
+	resolveEntry_t *entry;
+
+	if(resolver->buckets == NULL)
+	{
+		return NULL;
+	}
+
+	for(entry=resolver->buckets[hash & (resolver->bucketCount - 1)];
+		entry!=NULL;entry=entry->next)
+	{
+		if(entry->hash == hash && strcmp(_getName(entry), name) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * doubles the number of buckets. returns 1 if everything is ok and 0 if not.
+ */
+static int _grow(resolver_t *resolver)
+{
+	size_t count = resolver->bucketCount > 0
+		? resolver->bucketCount * 2 : _BUCKETS_MIN, i;
+	resolveEntry_t **buckets, *entry, *next;
+
+	buckets = (resolveEntry_t**) calloc(count, sizeof(resolveEntry_t*));
+
+	if(buckets == NULL)
+	{
+		return 0;
+	}
+
+	/* move the entries into the new table */
+	for(i=0;i<resolver->bucketCount;++i)
+	{
+		for(entry=resolver->buckets[i];entry!=NULL;entry=next)
+		{
+			next = entry->next;
+			entry->next = buckets[entry->hash & (count - 1)];
+			buckets[entry->hash & (count - 1)] = entry;
+		}
+	}
+
+	free(resolver->buckets);
+
+	resolver->buckets = buckets;
+	resolver->bucketCount = count;
+
+	return 1;
+}
+
+/**
+ * adds a new entry for the given name. returns the entry or null if there is
+ * not enough memory.
+ */
+static resolveEntry_t *_add(
+	resolver_t *resolver,
+	unsigned long hash,
+	const char *name
+)
+{
+	resolveEntry_t *entry;
+	size_t len = strlen(name);
+
+	/* make room for the new entry */
+	if(resolver->count >= RESOLVE_CACHE_MAX)
+	{
+		(void) _evict(resolver);
+	}
+
+	if(resolver->count >= resolver->bucketCount && !_grow(resolver))
+	{
+		return NULL;
+	}
+
+	entry = (resolveEntry_t*) calloc(1, sizeof(resolveEntry_t) + len + 1);
+
+	if(entry == NULL)
+	{
+		return NULL;
+	}
+
+	entry->hash = hash;
+	memcpy(_getName(entry), name, len + 1);
+
+	entry->next = resolver->buckets[hash & (resolver->bucketCount - 1)];
+	resolver->buckets[hash & (resolver->bucketCount - 1)] = entry;
+
+	_link(resolver, entry);
+	++resolver->count;
+
+	return entry;
+}
+
+/**
+ * answers numeric addresses without a lookup. returns 1 if the name is a
+ * numeric address and 0 if not.
+ */
+static int _resolveNumeric(
+	const char *name,
+	resolveCallback_t callback,
+	void *arg
+)
+{
+	struct sockaddr_storage addr;
+
+	memset(&addr, 0, sizeof(addr));
+
+	if(inet_pton(
+		AF_INET, name, &(((struct sockaddr_in*) &addr)->sin_addr)
+	) == 1)
+	{
+		addr.ss_family = AF_INET;
+	}
+	else if(inet_pton(
+		AF_INET6, name, &(((struct sockaddr_in6*) &addr)->sin6_addr)
+	) == 1)
+	{
+		addr.ss_family = AF_INET6;
+	}
+	else
+	{
+		return 0;
+	}
+
+	callback(name, &addr, 1, 0, arg);
+
+	return 1;
+}
+
+/**
+ * initializes the given resolver. the helper threads are started on the first
+ * lookup. returns 1 if everything is ok and 0 if not.
+ */
+int resolveInit(resolver_t *resolver)
+{
+	int i;
+
+	memset(resolver, 0, sizeof(resolver_t));
+
+	resolver->ttl = RESOLVE_TTL;
+	resolver->negativeTtl = RESOLVE_NEGATIVE_TTL;
+
+	if(pipe(resolver->notify) != 0)
+	{
+		return 0;
+	}
+
+	/* neither the helper threads nor the event loop must block on the pipe */
+	for(i=0;i<2;++i)
+	{
+		fcntl(resolver->notify[i], F_SETFL,
+			fcntl(resolver->notify[i], F_GETFL) | O_NONBLOCK);
+		fcntl(resolver->notify[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	pthread_mutex_init(&(resolver->lock), NULL);
+	pthread_cond_init(&(resolver->wake), NULL);
+
+	return 1;
+}
+
+/**
+ * changes how long results and failures are cached (in seconds).
+ */
+void resolveSetTtl(resolver_t *resolver, double ttl, double negativeTtl)
+{
+	resolver->ttl = ttl;
+	resolver->negativeTtl = negativeTtl;
+}
+
+/**
+ * resolves the given name. cached and numeric names are answered right away,
+ * every other name is resolved by a helper thread and the callback is invoked
+ * by resolvePoll(). lookups of a name being resolved already wait for the
+ * same result.
+ */
+resolveResult_t resolveLookup(
+	resolver_t *resolver,
+	const char *name,
+	resolveCallback_t callback,
+	void *arg
+)
+{
+	unsigned long hash;
+	resolveEntry_t *entry;
+	resolveWaiter_t *waiter, **link;
+
+	if(_resolveNumeric(name, callback, arg))
+	{
+		return RESOLVE_CACHED;
+	}
+
+	hash = hashCrc32c(0, name, strlen(name));
+	entry = _find(resolver, hash, name);
+
+	/* answer from the cache */
+	if(entry != NULL && !entry->isPending && entry->expires > _getTime())
+	{
+		++resolver->stats.hits;
+
+		_unlink(resolver, entry);
+		_link(resolver, entry);
+
+		callback(name, entry->addrs, entry->count, entry->error, arg);
+
+		return RESOLVE_CACHED;
+	}
+
+	if((waiter = (resolveWaiter_t*) malloc(sizeof(resolveWaiter_t))) == NULL)
+	{
+		return RESOLVE_ERROR;
+	}
+
+	waiter->next = NULL;
+	waiter->callback = callback;
+	waiter->arg = arg;
+
+	/* join the lookup in progress */
+	if(entry != NULL && entry->isPending)
+	{
+		++resolver->stats.coalesced;
+	}
+	else
+	{
+		if(!_startThreads(resolver)
+			|| (entry == NULL && (entry = _add(resolver, hash, name)) == NULL))
+		{
+			free(waiter);
+
+			return RESOLVE_ERROR;
+		}
+
+		++resolver->stats.misses;
+		++resolver->stats.pending;
+
+		entry->isPending = 1;
+		entry->nextJob = NULL;
+
+		/* queue the entry for the helper threads */
+		pthread_mutex_lock(&(resolver->lock));
+
+		if(resolver->queueTail != NULL)
+		{
+			resolver->queueTail->nextJob = entry;
+		}
+		else
+		{
+			resolver->queue = entry;
+		}
+
+		resolver->queueTail = entry;
+
+		pthread_cond_signal(&(resolver->wake));
+		pthread_mutex_unlock(&(resolver->lock));
+	}
+
+	/* the callbacks are invoked in the order of the lookups */
+	for(link=&(entry->waiters);*link!=NULL;link=&((*link)->next))
+	{
+	}
+
+	*link = waiter;
+
+	return RESOLVE_PENDING;
+}
+
+/**
+ * returns the descriptor which becomes readable when names were resolved.
+ */
+int resolveGetFd(resolver_t *resolver)
+{
+	return resolver->notify[0];
+}
+
+/**
+ * invokes the callbacks of all names resolved since the last call.
+ */
+void resolvePoll(resolver_t *resolver)
+{
+	char signals[64];
+	resolveEntry_t *entry, *next;
+	resolveWaiter_t *waiter, *nextWaiter;
+
+	/* reset the pipe */
+	while(read(resolver->notify[0], signals, sizeof(signals)) > 0)
+	{
+	}
+
+	pthread_mutex_lock(&(resolver->lock));
+	entry = resolver->done;
+	resolver->done = NULL;
+	pthread_mutex_unlock(&(resolver->lock));
+
+	for(;entry!=NULL;entry=next)
+	{
+		next = entry->nextJob;
+
+		entry->expires = _getTime()
+			+ (entry->error == 0 ? resolver->ttl : resolver->negativeTtl);
+
+		--resolver->stats.pending;
+
+		if(entry->error != 0)
+		{
+			++resolver->stats.failures;
+		}
+
+		_unlink(resolver, entry);
+		_link(resolver, entry);
+
+		/* the entry stays pending while the callbacks run, so lookups of
+		 * other names made by them cannot evict it. lookups of the same name
+		 * join the waiters and are answered in the next round */
+		while((waiter = entry->waiters) != NULL)
+		{
+			entry->waiters = NULL;
+
+			for(;waiter!=NULL;waiter=nextWaiter)
+			{
+				nextWaiter = waiter->next;
+
+				waiter->callback(
+					_getName(entry), entry->addrs, entry->count, entry->error,
+					waiter->arg
+				);
+
+				free(waiter);
+			}
+		}
+
+		/* the entry belongs to the event loop again */
+		entry->isPending = 0;
+	}
+}
+
+/**
+ * returns the counters of the given resolver.
+ */
+const resolveStats_t *resolveGetStats(resolver_t *resolver)
+{
+	return &(resolver->stats);
+}
+
+/**
+ * stops the helper threads and frees the resources of the given resolver. the
+ * callbacks still waiting are not invoked.
+ */
+void resolveClear(resolver_t *resolver)
+{
+	resolveEntry_t *entry, *next;
+	resolveWaiter_t *waiter, *nextWaiter;
+	size_t i;
+
+	/* a thread blocked in getaddrinfo() finishes its lookup first */
+	pthread_mutex_lock(&(resolver->lock));
+	resolver->isStopping = 1;
+	pthread_cond_broadcast(&(resolver->wake));
+	pthread_mutex_unlock(&(resolver->lock));
+
+	for(i=0;i<resolver->threadCount;++i)
+	{
+		pthread_join(resolver->threads[i], NULL);
+	}
+
+	for(entry=resolver->newest;entry!=NULL;entry=next)
+	{
+		next = entry->older;
+
+		for(waiter=entry->waiters;waiter!=NULL;waiter=nextWaiter)
+		{
+			nextWaiter = waiter->next;
+			free(waiter);
+		}
+
+		free(entry);
+	}
+
+	free(resolver->buckets);
+
+	close(resolver->notify[0]);
+	close(resolver->notify[1]);
+
+	pthread_mutex_destroy(&(resolver->lock));
+	pthread_cond_destroy(&(resolver->wake));
+
+	memset(resolver, 0, sizeof(resolver_t));
+}
@@ -0,0 +1,351 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * returns the name of a node, it is stored behind it.
+ */
+#define _getName(n) ((char*) ((n) + 1))
+
+/**
+ * defines the number of points taken from a single sha-1 digest.
+ */
+#define _POINTS_PER_DIGEST (HASH_SHA1_SIZE / 4)
+
+/**
+ * finds the node with the given name. returns the node or null if there is
+ * no such node. the pointer to the link pointing to the node is stored in the
+ * last parameter.
+ */
+static ringNode_t *_findNode(
+	ring_t *ring,
+	const void *name,
+	size_t len,
+	ringNode_t ***link
+)
+{
+	ringNode_t **current;
+
+	for(current=&(ring->nodes);*current!=NULL;current=&((*current)->next))
+	{
+		if((*current)->len == len && memcmp(_getName(*current), name, len) == 0)
+		{
+			break;
+		}
+	}
+
+	*link = current;
+
+	return *current;
+}
+
+/**
+ * compares two points by their position, points on the same position are
+ * ordered by the name of their nodes so the order does not depend on the
+ * order the nodes were added in.
+ */
+static int _comparePoints(const void *a, const void *b)
+{
+	const ringPoint_t *pointA = (const ringPoint_t*) a;
+	const ringPoint_t *pointB = (const ringPoint_t*) b;
+	size_t len;
+	int result;
+
+	if(pointA->hash != pointB->hash)
+	{
+		return pointA->hash < pointB->hash ? -1 : 1;
+	}
+
+	len = pointA->node->len < pointB->node->len
+		? pointA->node->len : pointB->node->len;
+
+	result = memcmp(_getName(pointA->node), _getName(pointB->node), len);
+
+	if(result != 0)
+	{
+		return result;
+	}
+
+	return (pointA->node->len > pointB->node->len)
+		- (pointA->node->len < pointB->node->len);
+}
+
+/**
+ * computes the points of all nodes and sorts them. like ketama the points of a
+ * node are taken from the sha-1 digests of its name followed by a counter.
+ * returns 1 if everything is ok and 0 if there is not enough memory.
+ */
+static int _build(ring_t *ring)
+{
+	unsigned char digest[HASH_SHA1_SIZE];
+	ringPoint_t *points;
+	ringNode_t *node;
+	size_t count = 0, maxLen = 0, total, i, len;
+	char *input;
+
+	for(node=ring->nodes;node!=NULL;node=node->next)
+	{
+		count += (size_t) node->weight * RING_POINTS;
+
+		if(node->len > maxLen)
+		{
+			maxLen = node->len;
+		}
+	}
+
+	points = (ringPoint_t*) malloc(count * sizeof(ringPoint_t) + 1);
+	input = (char*) malloc(maxLen + 24);
+
+	if(points == NULL || input == NULL)
+	{
+		free(points);
+		free(input);
+
+		return 0;
+	}
+
+	count = 0;
+
+	for(node=ring->nodes;node!=NULL;node=node->next)
+	{
+		total = (size_t) node->weight * RING_POINTS;
+
+		memcpy(input, _getName(node), node->len);
+
+		for(i=0;i<total;++i)
+		{
+			/* every digest gives several points */
+			if(i % _POINTS_PER_DIGEST == 0)
+			{
+				len = node->len + sprintf(
+					input + node->len, "-%lu",
+					(unsigned long) (i / _POINTS_PER_DIGEST)
+				);
+
+				hashSha1(input, len, digest);
+			}
+
+			len = (i % _POINTS_PER_DIGEST) * 4;
+
+			points[count].hash = ((unsigned long) digest[len] << 24)
+				| ((unsigned long) digest[len + 1] << 16)
+				| ((unsigned long) digest[len + 2] << 8)
+				| (unsigned long) digest[len + 3];
+			points[count].node = node;
+
+			++count;
+		}
+	}
+
+	free(input);
+
+	qsort(points, count, sizeof(ringPoint_t), _comparePoints);
+
+	free(ring->points);
+
+	ring->points = points;
+	ring->pointCount = count;
+	ring->isDirty = 0;
+
+	return 1;
+}
+
+/**
+ * hashes a key onto the ring. crc32c is fast (hardware accelerated on x86),
+ * the finalizer of murmur3 spreads similar keys over the whole ring.
+ */
+static unsigned long _hashKey(const void *key, size_t len)
+{
+	unsigned long hash = hashCrc32c(0, key, len);
+
+	hash ^= hash >> 16;
+	hash = (hash * 0x85ebca6bUL) & 0xffffffffUL;
+	hash ^= hash >> 13;
+	hash = (hash * 0xc2b2ae35UL) & 0xffffffffUL;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/**
+ * initializes the given hash ring without any node.
+ */
+void ringInit(ring_t *ring)
+{
+	memset(ring, 0, sizeof(ring_t));
+}
+
+/**
+ * adds the node with the given name and weight (1 to RING_WEIGHT_MAX) to the
+ * ring or changes the weight of the node if it is known already. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int ringAdd(ring_t *ring, const void *name, size_t len, unsigned int weight)
+{
+	ringNode_t **link;
+	ringNode_t *node;
+
+	if(weight < 1 || weight > RING_WEIGHT_MAX)
+	{
+		return 0;
+	}
+
+	if((node = _findNode(ring, name, len, &link)) == NULL)
+	{
+		if((node = (ringNode_t*) malloc(sizeof(ringNode_t) + len)) == NULL)
+		{
+			return 0;
+		}
+
+		node->next = NULL;
+		node->len = len;
+
+		memcpy(_getName(node), name, len);
+
+		/* append it, the order of the nodes does not matter */
+		*link = node;
+		++ring->count;
+	}
+	else if(node->weight == weight)
+	{
+		return 1;
+	}
+
+	node->weight = weight;
+	ring->isDirty = 1;
+
+	return 1;
+}
+
+/**
+ * removes the node with the given name from the ring. returns 1 if the node
+ * was removed and 0 if there is no such node.
+ */
+int ringRemove(ring_t *ring, const void *name, size_t len)
+{
+	ringNode_t **link;
+	ringNode_t *node = _findNode(ring, name, len, &link);
+
+	if(node == NULL)
+	{
+		return 0;
+	}
+
+	*link = node->next;
+	--ring->count;
+
+	free(node);
+
+	/* the points refer to the node, they must not be used anymore */
+	free(ring->points);
+
+	ring->points = NULL;
+	ring->pointCount = 0;
+	ring->isDirty = 1;
+
+	return 1;
+}
+
+/**
+ * returns the name of the node the given key belongs to and stores its length
+ * in the last parameter. returns null if the ring is empty or there is not
+ * enough memory to build it.
+ */
+const char *ringLookup(
+	ring_t *ring,
+	const void *key,
+	size_t len,
+	size_t *nameLen
+)
+{
+	unsigned long hash;
+	size_t low, high, middle;
+
+	if(ring->count == 0 || (ring->isDirty && !_build(ring)))
+	{
+		return NULL;
+	}
+
+	hash = _hashKey(key, len);
+
+	/* find the first point at or after the hash */
+	low = 0;
+	high = ring->pointCount;
+
+	while(low < high)
+	{
+		middle = low + (high - low) / 2;
+
+		if(ring->points[middle].hash < hash)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	/* behind the last point the ring starts over */
+	if(low == ring->pointCount)
+	{
+		low = 0;
+	}
+
+	*nameLen = ring->points[low].node->len;
+
+	return _getName(ring->points[low].node);
+}
+
+/**
+ * returns the number of nodes of the given ring.
+ */
+size_t ringGetCount(ring_t *ring)
+{
+	return ring->count;
+}
+
+/**
+ * frees the resources of the given ring.
+ */
+void ringClear(ring_t *ring)
+{
+	ringNode_t *node, *next;
+
+	for(node=ring->nodes;node!=NULL;node=next)
+	{
+		next = node->next;
+		free(node);
+	}
+
+	free(ring->points);
+
+	ringInit(ring);
+}
@@ -0,0 +1,611 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * defines the types of the nodes.
+ */
+#define _NODE_STATIC (0)
+#define _NODE_PARAM (1)
+#define _NODE_WILDCARD (2)
+
+/**
+ * returns the prefix of a node, it is stored behind it.
+ */
+#define _getPrefix(n) ((char*) ((n) + 1))
+
+/**
+ * returns the method of a route and the first of its parameter names, they are
+ * stored behind it.
+ */
+#define _getMethod(r) ((char*) ((r) + 1))
+
+/**
+ * checks whether the given position of the pattern starts a parameter or a
+ * wildcard, which is only the case directly after a slash.
+ */
+#define _isSpecial(pattern, pos) \
+	(((pos)[0] == ':' || (pos)[0] == '*') && (pos) > (pattern) \
+		&& (pos)[-1] == '/')
+
+/**
+ * allocates a new node with the given type and prefix. returns the node or
+ * null if there is not enough memory.
+ */
+static routeNode_t *_newNode(int type, const char *prefix, size_t len)
+{
+	routeNode_t *node = (routeNode_t*) calloc(1, sizeof(routeNode_t) + len);
+
+	if(node != NULL)
+	{
+		node->type = type;
+		node->prefixLen = len;
+
+		memcpy(_getPrefix(node), prefix, len);
+	}
+
+	return node;
+}
+
+/**
+ * frees the given node and all nodes and routes below it.
+ */
+static void _freeNode(routeNode_t *node)
+{
+	routeEntry_t *route, *next;
+	size_t i;
+
+	if(node == NULL)
+	{
+		return;
+	}
+
+	for(i=0;i<node->childCount;++i)
+	{
+		_freeNode(node->children[i]);
+	}
+
+	_freeNode(node->param);
+	_freeNode(node->wildcard);
+
+	for(route=node->routes;route!=NULL;route=next)
+	{
+		next = route->next;
+		free(route);
+	}
+
+	free(node->children);
+	free(node->indices);
+	free(node);
+}
+
+/**
+ * adds the given static child to the node. returns 1 if everything is ok and 0
+ * if not.
+ */
+static int _addChild(routeNode_t *node, routeNode_t *child)
+{
+	routeNode_t **children = (routeNode_t**) realloc(
+		node->children, (node->childCount + 1) * sizeof(routeNode_t*)
+	);
+	char *indices;
+
+	if(children == NULL)
+	{
+		return 0;
+	}
+
+	node->children = children;
+
+	if((indices = (char*) realloc(node->indices, node->childCount + 1)) == NULL)
+	{
+		return 0;
+	}
+
+	node->indices = indices;
+	node->children[node->childCount] = child;
+	node->indices[node->childCount] = *_getPrefix(child);
+
+	++node->childCount;
+
+	return 1;
+}
+
+/**
+ * returns the static child of the node starting with the given character or
+ * null if there is none.
+ */
+static routeNode_t *_findChild(routeNode_t *node, char c)
+{
+	const char *pos;
+
+	if(node->childCount == 0
+		|| (pos = (const char*) memchr(node->indices, c, node->childCount))
+			== NULL)
+	{
+		return NULL;
+	}
+
+	return node->children[pos - node->indices];
+}
+
+/**
+ * splits the prefix of a static node at the given length, the tail and
+ * everything below the node is moved to a new child. returns 1 if everything
+ * is ok and 0 if not.
+ */
+static int _split(routeNode_t *node, size_t len)
+{
+	routeNode_t *child = _newNode(
+		_NODE_STATIC, _getPrefix(node) + len, node->prefixLen - len
+	);
+
+	if(child == NULL)
+	{
+		return 0;
+	}
+
+	/* the child takes over the children and the routes */
+	child->children = node->children;
+	child->indices = node->indices;
+	child->childCount = node->childCount;
+	child->param = node->param;
+	child->wildcard = node->wildcard;
+	child->routes = node->routes;
+
+	node->children = NULL;
+	node->indices = NULL;
+	node->childCount = 0;
+	node->param = NULL;
+	node->wildcard = NULL;
+	node->routes = NULL;
+
+	if(!_addChild(node, child))
+	{
+		/* undo the split */
+		node->children = child->children;
+		node->indices = child->indices;
+		node->childCount = child->childCount;
+		node->param = child->param;
+		node->wildcard = child->wildcard;
+		node->routes = child->routes;
+
+		free(child);
+
+		return 0;
+	}
+
+	node->prefixLen = len;
+
+	return 1;
+}
+
+/**
+ * returns the length of the static part at the start of the pattern.
+ */
+static size_t _getStaticLen(const char *pattern, const char *pos)
+{
+	const char *end = pos;
+
+	while(*end != '\0' && !_isSpecial(pattern, end))
+	{
+		++end;
+	}
+
+	return end - pos;
+}
+
+/**
+ * checks the given pattern and counts its parameters. returns the number of
+ * parameters or -1 if the pattern is invalid.
+ */
+static int _checkPattern(const char *pattern)
+{
+	const char *pos;
+	int count = 0;
+
+	if(*pattern != '/')
+	{
+		return -1;
+	}
+
+	for(pos=pattern;*pos!='\0';++pos)
+	{
+		if(!_isSpecial(pattern, pos))
+		{
+			continue;
+		}
+
+		/* the name must not be empty */
+		if(pos[1] == '\0' || pos[1] == '/')
+		{
+			return -1;
+		}
+
+		/* a wildcard must be the last segment */
+		if(*pos == '*' && strchr(pos, '/') != NULL)
+		{
+			return -1;
+		}
+
+		if(++count > ROUTER_PARAM_MAX)
+		{
+			return -1;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * creates the route for the given method and pattern. returns the route or
+ * null if there is not enough memory.
+ */
+static routeEntry_t *_newRoute(
+	const char *method, const char *pattern, int handler, size_t paramCount
+)
+{
+	size_t methodLen = method != NULL ? strlen(method) : 0;
+	routeEntry_t *route;
+	const char *pos;
+	char *name;
+
+	/* the names are shorter than the pattern */
+	route = (routeEntry_t*) malloc(
+		sizeof(routeEntry_t) + methodLen + 1 + strlen(pattern) + 1
+	);
+
+	if(route == NULL)
+	{
+		return NULL;
+	}
+
+	route->next = NULL;
+	route->handler = handler;
+	route->anyMethod = method == NULL;
+	route->paramCount = paramCount;
+
+	memcpy(_getMethod(route), method != NULL ? method : "", methodLen + 1);
+
+	/* store the names of the parameters one after another */
+	name = _getMethod(route) + methodLen + 1;
+
+	for(pos=pattern;*pos!='\0';++pos)
+	{
+		if(_isSpecial(pattern, pos))
+		{
+			for(++pos;*pos!='\0' && *pos!='/';++pos)
+			{
+				*name++ = *pos;
+			}
+
+			*name++ = '\0';
+
+			if(*pos == '\0')
+			{
+				break;
+			}
+		}
+	}
+
+	return route;
+}
+
+/**
+ * returns the route of the node for the given method, routes for the method
+ * take precedence over routes for any method. returns null if there is none.
+ */
+static routeEntry_t *_findRoute(routeNode_t *node, const char *method)
+{
+	routeEntry_t *route, *any = NULL;
+
+	for(route=node->routes;route!=NULL;route=route->next)
+	{
+		if(route->anyMethod)
+		{
+			any = route;
+		}
+		else if(method != NULL && strcasecmp(_getMethod(route), method) == 0)
+		{
+			return route;
+		}
+	}
+
+	return any;
+}
+
+/**
+ * looks up the node matching the rest of the path below the given node and
+ * stores the values of the parameters on the way. backtracks if a branch does
+ * not lead to a route for the method. the last parameter is set if a route
+ * for another method matches the path. returns the route or null.
+ */
+static routeEntry_t *_match(
+	routeNode_t *node, const char *method, const char *path, size_t len,
+	routeMatch_t *match, int *pathFound
+)
+{
+	size_t count = match->paramCount, segment;
+	routeEntry_t *route;
+	routeNode_t *child;
+	const char *pos;
+
+	if(node->type == _NODE_STATIC)
+	{
+		if(len < node->prefixLen
+			|| memcmp(path, _getPrefix(node), node->prefixLen) != 0)
+		{
+			return NULL;
+		}
+
+		segment = node->prefixLen;
+	}
+	else
+	{
+		/* a parameter ends with the segment, a wildcard with the path */
+		if(node->type == _NODE_PARAM)
+		{
+			pos = (const char*) memchr(path, '/', len);
+			segment = pos != NULL ? (size_t) (pos - path) : len;
+
+			if(segment == 0)
+			{
+				return NULL;
+			}
+		}
+		else
+		{
+			segment = len;
+		}
+
+		match->values[count] = path;
+		match->lengths[count] = segment;
+		match->paramCount = count + 1;
+	}
+
+	path += segment;
+	len -= segment;
+
+	if(len == 0 && node->routes != NULL)
+	{
+		if((route = _findRoute(node, method)) != NULL)
+		{
+			return route;
+		}
+
+		*pathFound = 1;
+	}
+
+	/* static children first, then the parameter and the wildcard */
+	if(len > 0 && (child = _findChild(node, *path)) != NULL
+		&& (route = _match(child, method, path, len, match, pathFound))
+			!= NULL)
+	{
+		return route;
+	}
+
+	if(len > 0 && node->param != NULL
+		&& (route = _match(node->param, method, path, len, match, pathFound))
+			!= NULL)
+	{
+		return route;
+	}
+
+	if(node->wildcard != NULL
+		&& (route = _match(
+			node->wildcard, method, path, len, match, pathFound
+		)) != NULL)
+	{
+		return route;
+	}
+
+	match->paramCount = count;
+
+	return NULL;
+}
+
+/**
+ * initializes the given router.
+ */
+void routerInit(router_t *router)
+{
+	memset(router, 0, sizeof(*router));
+}
+
+/**
+ * adds a route for the method (null for any method) and the pattern to the
+ * router. the pattern is a path starting with a slash, a segment starting with
+ * a colon (e.g. /users/:id) matches any single path segment and a last segment
+ * starting with an asterisk (e.g. *path) matches the rest of the path. returns
+ * 1 if everything is ok and 0 if the pattern is invalid, the route exists
+ * already or there is not enough memory.
+ */
+int routerAdd(
+	router_t *router, const char *method, const char *pattern, int handler
+)
+{
+	int paramCount = _checkPattern(pattern);
+	const char *pos = pattern;
+	routeNode_t *node, *child, **link;
+	routeEntry_t *route;
+	size_t len, common;
+
+	if(paramCount < 0)
+	{
+		return 0;
+	}
+
+	if(router->root == NULL && (router->root = _newNode(
+		_NODE_STATIC, pattern, _getStaticLen(pattern, pattern)
+	)) == NULL)
+	{
+		return 0;
+	}
+
+	/* walk down the tree and add the missing nodes */
+	for(node=router->root;;node=child)
+	{
+		/* consume the part of the pattern the node stands for */
+		if(node->type == _NODE_STATIC)
+		{
+			len = _getStaticLen(pattern, pos);
+
+			for(common=0;common<len && common<node->prefixLen
+				&& pos[common]==_getPrefix(node)[common];++common);
+
+			/* the node only shares the beginning of its prefix */
+			if(common < node->prefixLen && !_split(node, common))
+			{
+				return 0;
+			}
+
+			pos += common;
+		}
+		else if(node->type == _NODE_PARAM)
+		{
+			for(++pos;*pos!='\0' && *pos!='/';++pos);
+		}
+		else
+		{
+			pos += strlen(pos);
+		}
+
+		if(*pos == '\0')
+		{
+			break;
+		}
+
+		/* continue with the parameter or the wildcard child */
+		if(_isSpecial(pattern, pos))
+		{
+			link = *pos == ':' ? &(node->param) : &(node->wildcard);
+
+			if(*link == NULL && (*link = _newNode(
+				*pos == ':' ? _NODE_PARAM : _NODE_WILDCARD, "", 0
+			)) == NULL)
+			{
+				return 0;
+			}
+
+			child = *link;
+			continue;
+		}
+
+		/* continue with the static child sharing the first character */
+		if((child = _findChild(node, *pos)) == NULL)
+		{
+			child = _newNode(_NODE_STATIC, pos, _getStaticLen(pattern, pos));
+
+			if(child == NULL || !_addChild(node, child))
+			{
+				free(child);
+				return 0;
+			}
+		}
+	}
+
+	/* only one route per method */
+	for(route=node->routes;route!=NULL;route=route->next)
+	{
+		if(method == NULL ? route->anyMethod
+			: !route->anyMethod && strcasecmp(_getMethod(route), method) == 0)
+		{
+			return 0;
+		}
+	}
+
+	if((route = _newRoute(method, pattern, handler, paramCount)) == NULL)
+	{
+		return 0;
+	}
+
+	route->next = node->routes;
+	node->routes = route;
+
+	++router->routeCount;
+
+	return 1;
+}
+
+/**
+ * looks up the route for the method and the path of the given length. static
+ * segments take precedence over parameters and parameters over wildcards. the
+ * handler and the parameters are stored in the last parameter.
+ */
+routeResult_t routerMatch(
+	router_t *router, const char *method, const char *path, size_t len,
+	routeMatch_t *match
+)
+{
+	routeEntry_t *route;
+	int pathFound = 0;
+	const char *name;
+	size_t i;
+
+	match->paramCount = 0;
+
+	if(router->root == NULL || (route = _match(
+		router->root, method, path, len, match, &pathFound
+	)) == NULL)
+	{
+		return pathFound ? ROUTE_METHOD_NOT_ALLOWED : ROUTE_NOT_FOUND;
+	}
+
+	match->handler = route->handler;
+
+	/* the names follow the method */
+	name = _getMethod(route) + strlen(_getMethod(route)) + 1;
+
+	for(i=0;i<route->paramCount;++i)
+	{
+		match->names[i] = name;
+		name += strlen(name) + 1;
+	}
+
+	return ROUTE_FOUND;
+}
+
+/**
+ * returns the number of routes of the given router.
+ */
+size_t routerGetCount(router_t *router)
+{
+	return router->routeCount;
+}
+
+/**
+ * frees all routes of the given router.
+ */
+void routerClear(router_t *router)
+{
+	_freeNode(router->root);
+
+	routerInit(router);
+}
@@ -28,6 +28,7 @@
 #include <time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -50,6 +51,54 @@ typedef struct {
 	/* used to check whether the socket is a server or not */
 	unsigned int isServer : 1;
 
+	/* stores the file queued with serverSendFile() (-1 if there is none), the
+	 * part still to send and the number of bytes of the output buffer that
+	 * must be sent before the file */
+	int fileFd;
+	off_t fileOffset;
+	size_t fileLen, filePrefix;
+
+	/* used to check whether reading was paused with serverPauseRead() */
+	unsigned int isPaused : 1;
+
+	/* stores the group of the client in the admission control (null if there
+	 * is none) and when reading resumes after the byte rate of the group was
+	 * exceeded (0 if reading is not throttled) */
+	admitEntry_t *admit;
+	double resumeAt;
+
+	/* used to check whether the connections of a server socket start with a
+	 * proxy protocol header or whether a client socket still waits for it */
+	unsigned int useProxy : 1;
+
+	/* stores the server socket of a client socket waiting for the proxy
+	 * protocol header, the accept event is invoked after the header */
+	int sFd;
+
+	/* stores the client address sent with the proxy protocol header (the
+	 * family is AF_UNSPEC if there is none) */
+	struct sockaddr_storage proxyAddr;
+
+	/* stores the callback of a descriptor watched with serverWatchFd() (null
+	 * for sockets) and its argument */
+	watchCallback_t watch;
+	void *watchArg;
+
+	/* used to check whether a server socket is a statistics endpoint or a
+	 * client socket is connected to one */
+	unsigned int isStats : 1;
+
+	/* stores how far the request of a statistics client was searched for
+	 * the end of its headers */
+	size_t statsScan;
+
+	/* stores the accounting of a client socket and when it was added */
+	connStats_t conn;
+	double addedAt;
+
+	/* stores the id of the connection, see serverGetSocketId() */
+	unsigned long id;
+
 } _socket_t;
 
 /**
@@ -62,6 +111,12 @@ static serverCallback_t _callback;
  */
 static _socket_t _sockets[SOCKET_MAX];
 
+/**
+ * stores all sockets known to the server regardless of whether they are
+ * waiting for input or not.
+ */
+static fd_set _socketSet;
+
 /**
  * the two sets sockets used for select().
  */
@@ -72,6 +127,80 @@ static fd_set _socketReadSet, _socketWriteSet;
  */
 static int _highestSocket;
 
+/**
+ * stores the admission control applied to new connections and whether it is
+ * enabled.
+ */
+static admit_t _admit;
+static int _isAdmitEnabled;
+
+/**
+ * stores the number of sockets which are throttled by the admission control.
+ */
+static int _throttledCount;
+
+/**
+ * stores the resolver used by serverResolve() and whether it was initialized.
+ */
+static resolver_t _resolver;
+static int _isResolverReady;
+
+/**
+ * stores the counters of the server.
+ */
+static serverStats_t _stats;
+
+/**
+ * stores the names of the events used by the statistics endpoint.
+ */
+static const char *_eventNames[EVENT_COUNT] = {
+	"start",
+	"stop",
+	"idle",
+	"socket_accept",
+	"socket_read",
+	"socket_write",
+	"socket_close"
+};
+
+/**
+ * stores the id of the last socket added.
+ */
+static unsigned long _lastId;
+
+/**
+ * used to check whether the time spent in the callbacks is measured per
+ * connection.
+ */
+static int _isAccounting;
+
+/**
+ * stores the interval the tcp information of the connections is sampled in
+ * (0 if it is not sampled) and when the next sample is due.
+ */
+static double _tcpInfoInterval, _nextTcpInfoAt;
+
+/**
+ * returns the current time of a monotonic clock in seconds.
+ */
+static double _getTime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * checks whether the socket descriptor is valid or not. returns 1 if it is
+ * valid and 0 if not.
+ */
+static int _isValidSocket(int fd)
+{
+	return fd > INVALID_SOCKET && fd < SOCKET_MAX;
+}
+
 /**
  * invokes the callback function with the specified context data.
  */
@@ -81,10 +210,14 @@ static int _invokeCallback(
 {
 	/* context to use for the callback */
 	static eventContext_t context;
+	double start;
+	int result;
 
 	/* is there a valid callback for the specified type */
 	if(_callback != NULL)
 	{
+		++_stats.events[event];
+
 		/* prepare the context */
 		context.event = event;
 		context.sFd = sFd;
@@ -92,23 +225,31 @@ static int _invokeCallback(
 		context.iBuf = iBuf;
 		context.oBuf = oBuf;
 
+		/* events of the server as a whole are not accounted */
+		if(!_isValidSocket(cFd))
+		{
+			return _callback(&context);
+		}
+
+		++_sockets[cFd].conn.events;
+
+		if(!_isAccounting)
+		{
+			return _callback(&context);
+		}
+
 		/* invoke the callback and return its result */
-		return _callback(&context);
+		start = _getTime();
+		result = _callback(&context);
+		_sockets[cFd].conn.callbackTime += _getTime() - start;
+
+		return result;
 	}
 
 	/* no callback means that this operation failed */
 	return 0;
 }
 
-/**
- * checks whether the socket descriptor is valid or not. returns 1 if it is
- * valid and 0 if not.
- */
-static int _isValidSocket(int fd)
-{
-	return fd > INVALID_SOCKET && fd < SOCKET_MAX;
-}
-
 /**
  * adds the given socket descriptor to the socket list and the read set.
  * returns 1 in case of success and 0 in case of error.
@@ -129,11 +270,39 @@ static int _addSocket(int fd)
 		/* by default it is not a server */
 		socket->isServer = 0;
 
+		/* there is no file to send */
+		socket->fileFd = -1;
+
+		/* reading is neither paused nor throttled */
+		socket->isPaused = 0;
+		socket->admit = NULL;
+		socket->resumeAt = 0;
+
+		/* there is no proxy protocol header */
+		socket->useProxy = 0;
+		socket->proxyAddr.ss_family = AF_UNSPEC;
+
+		/* it is a socket, not a watched descriptor */
+		socket->watch = NULL;
+
+		/* it is no statistics endpoint */
+		socket->isStats = 0;
+		socket->statsScan = 0;
+
+		/* every socket gets a new id, the descriptor may be reused */
+		socket->id = ++_lastId;
+
+		/* start the accounting from scratch */
+		memset(&(socket->conn), 0, sizeof(socket->conn));
+		socket->conn.fd = fd;
+		socket->addedAt = _getTime();
+
 		/* reset the input and output buffer */
 		bufClear(&(socket->iBuf));
 		bufClear(&(socket->oBuf));
 
-		/* add the socket to the read set */
+		/* add the socket to the set of known sockets and the read set */
+		FD_SET(fd, &_socketSet);
 		FD_SET(fd, &_socketReadSet);
 
 		/* adjust the highest socket descriptor */
@@ -159,7 +328,7 @@ static int _findHighestSocket(void)
 	/* go through all possible sockets */
 	for(i=_highestSocket-1;i>=0;--i)
 	{
-		if(FD_ISSET(i, &_socketReadSet))
+		if(FD_ISSET(i, &_socketSet))
 		{
 			return i;
 		}
@@ -189,18 +358,51 @@ static void _removeSocket(int fd)
 		cFd = fd;
 	}
 
-	/* invoke the callback for the sockets */
-	(void) _invokeCallback(EVENT_SOCKET_CLOSE, sFd, cFd, NULL, NULL);
+	/* invoke the callback for the sockets, a client socket still waiting for
+	 * the proxy protocol header or connected to the statistics endpoint was
+	 * never announced */
+	if(socket->isServer || (!socket->useProxy && !socket->isStats))
+	{
+		(void) _invokeCallback(EVENT_SOCKET_CLOSE, sFd, cFd, NULL, NULL);
+	}
+
+	if(!socket->isServer && !socket->isStats)
+	{
+		++_stats.closes;
+	}
 
 	/* remove the socket data */
 	socket->keepAlive = 0;
 	socket->isServer = 0;
+	socket->useProxy = 0;
+	socket->isStats = 0;
+
+	/* close a file that was not sent completely */
+	if(socket->fileFd >= 0)
+	{
+		close(socket->fileFd);
+		socket->fileFd = -1;
+	}
+
+	/* release the connection in the admission control */
+	if(socket->admit != NULL)
+	{
+		admitDisconnect(&_admit, socket->admit);
+		socket->admit = NULL;
+	}
+
+	if(socket->resumeAt > 0)
+	{
+		socket->resumeAt = 0;
+		--_throttledCount;
+	}
 
 	/* clear the i/o buffers */
 	bufClear(&(socket->iBuf));
 	bufClear(&(socket->oBuf));
 
 	/* remove the descriptor from all sets */
+	FD_CLR(fd, &_socketSet);
 	FD_CLR(fd, &_socketReadSet);
 	FD_CLR(fd, &_socketWriteSet);
 
@@ -225,8 +427,9 @@ static void _removeAllSockets(void)
 	/* go through all active sockets */
 	for(fd=0;fd<=_highestSocket;++fd)
 	{
-		/* is this socket active */
-		if(FD_ISSET(fd, &_socketReadSet))
+		/* is this socket active, watched descriptors belong to their owner
+		 * and stay */
+		if(FD_ISSET(fd, &_socketSet) && _sockets[fd].watch == NULL)
 		{
 			/* remove the socket from the system */
 			_removeSocket(fd);
@@ -261,7 +464,7 @@ static void _disableSocketWrite(int fd)
 static void _checkClientSocket(int cFd)
 {
 	/* if there is data to write put the socket in the write set */
-	if(bufHasData(&(_sockets[cFd].oBuf)))
+	if(bufHasData(&(_sockets[cFd].oBuf)) || _sockets[cFd].fileFd >= 0)
 	{
 		/* enable writing on this client */
 		_enableSocketWrite(cFd);
@@ -281,8 +484,26 @@ static void _checkClientSocket(int cFd)
  */
 static void _handleServerInput(int sFd)
 {
-	/* accept a new connection */
-	int cFd = socketAccept(sFd);
+	struct sockaddr_storage addr;
+	admitEntry_t *admit = NULL;
+
+	/* behind a proxy the client is only known after the proxy protocol
+	 * header, the admission control is applied then */
+	int useProxy = _sockets[sFd].useProxy;
+	int isAdmitted = _isAdmitEnabled && !useProxy;
+
+	/* accept a new connection, the address is only needed for the admission
+	 * control */
+	int cFd = socketAccept(sFd, isAdmitted ? &addr : NULL);
+
+	/* drop connections exceeding the limits of the client before anything
+	 * else happens */
+	if(cFd >= 0 && _isValidSocket(cFd) && isAdmitted
+		&& (admit = admitConnect(&_admit, (struct sockaddr*) &addr)) == NULL)
+	{
+		socketReset(cFd);
+		return;
+	}
 
 	/* is there a valid new socket descriptor */
 	if(cFd >= 0)
@@ -290,6 +511,29 @@ static void _handleServerInput(int sFd)
 		/* add the new client connection */
 		if(_addSocket(cFd))
 		{
+			_sockets[cFd].admit = admit;
+
+			/* the statistics endpoint is served without the callback, its
+			 * connections are not counted */
+			if(_sockets[sFd].isStats)
+			{
+				_sockets[cFd].isStats = 1;
+
+				return;
+			}
+
+			++_stats.accepts;
+
+			/* the accept event is delayed until the proxy protocol header
+			 * was read */
+			if(useProxy)
+			{
+				_sockets[cFd].useProxy = 1;
+				_sockets[cFd].sFd = sFd;
+
+				return;
+			}
+
 			/* invoke the callback of the new client socket */
 			if(_invokeCallback(
 				EVENT_SOCKET_ACCEPT,
@@ -316,16 +560,128 @@ static void _handleServerInput(int sFd)
 			/* it was not possible to the add the new client socket to the
 			 * system, just close it then */
 			socketClose(cFd);
+
+			if(admit != NULL)
+			{
+				admitDisconnect(&_admit, admit);
+			}
 		}
 	}
 	else
 	{
+		++_stats.acceptErrors;
+
 		/* it was not possible to accept a new connection, close the server
 		 * socket then */
 		_removeSocket(sFd);
 	}
 }
 
+/**
+ * answers the request of a client of the statistics endpoint once its headers
+ * were read completely. returns 1 if everything is ok and 0 if the socket must
+ * be removed.
+ */
+static int _serveStats(int cFd)
+{
+	_socket_t *socket = _sockets + cFd;
+	static const char header[] = "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Connection: close\r\n\r\n";
+	const char *data;
+	size_t len, i;
+
+	/* the request is answered only once */
+	if(!socket->keepAlive)
+	{
+		return 1;
+	}
+
+	data = (const char*) bufPeek(&(socket->iBuf), &len);
+
+	/* continue where the previous read stopped, so a request sent in small
+	 * pieces is not searched over and over */
+	for(i=socket->statsScan;i+4<=len;++i)
+	{
+		if(memcmp(data + i, "\r\n\r\n", 4) == 0)
+		{
+			break;
+		}
+	}
+
+	/* wait for the rest of the headers, the last three bytes may be the
+	 * start of the end */
+	if(i + 4 > len)
+	{
+		socket->statsScan = len > 3 ? len - 3 : 0;
+
+		return len < IO_BUF_SIZE * 8;
+	}
+
+	bufConsume(&(socket->iBuf), socket->iBuf.len);
+
+	if(!bufAppend(&(socket->oBuf), header, sizeof(header) - 1)
+		|| !serverFormatStats(&(socket->oBuf)))
+	{
+		return 0;
+	}
+
+	/* the connection is closed after the response */
+	socket->keepAlive = 0;
+	_enableSocketWrite(cFd);
+
+	return 1;
+}
+
+/**
+ * parses the proxy protocol header at the start of the input buffer of the
+ * given client socket, removes it and invokes the delayed accept callback.
+ * returns 1 if the header was read and the connection was accepted, 2 if the
+ * header is incomplete and 0 if the socket must be removed.
+ */
+static int _readProxyHeader(int cFd)
+{
+	_socket_t *socket = _sockets + cFd;
+	size_t len, headerLen;
+	void *data = bufPeek(&(socket->iBuf), &len);
+
+	switch(proxyParse(data, len, &(socket->proxyAddr), &headerLen))
+	{
+		case PROXY_MORE:
+			return 2;
+
+		case PROXY_ERROR:
+			socket->proxyAddr.ss_family = AF_UNSPEC;
+			return 0;
+
+		default:
+			break;
+	}
+
+	bufConsume(&(socket->iBuf), headerLen);
+
+	/* apply the admission control to the real client, connections the proxy
+	 * makes on its own (e.g. health checks) are not limited */
+	if(_isAdmitEnabled && socket->proxyAddr.ss_family != AF_UNSPEC
+		&& (socket->admit = admitConnect(
+			&_admit, (struct sockaddr*) &(socket->proxyAddr)
+		)) == NULL)
+	{
+		return 0;
+	}
+
+	/* the connection is announced now */
+	socket->useProxy = 0;
+
+	return _invokeCallback(
+		EVENT_SOCKET_ACCEPT,
+		socket->sFd,
+		cFd,
+		&(socket->iBuf),
+		&(socket->oBuf)
+	);
+}
+
 /**
  * reads data from the specified socket and stores it in the input buffer of the
  * socket. it also invokes the callback when there was data read. the socket
@@ -333,9 +689,65 @@ static void _handleServerInput(int sFd)
  */
 static void _handleClientInput(int cFd)
 {
+	size_t len = _sockets[cFd].iBuf.len;
+	long wait;
+
 	/* read data from the socket */
 	if(socketRead(cFd, &(_sockets[cFd].iBuf)))
 	{
+		/* the statistics endpoint answers by itself */
+		if(_sockets[cFd].isStats)
+		{
+			if(!_serveStats(cFd))
+			{
+				_removeSocket(cFd);
+			}
+
+			return;
+		}
+
+		_stats.bytesIn += (unsigned long) (_sockets[cFd].iBuf.len - len);
+		_sockets[cFd].conn.bytesIn +=
+			(unsigned long) (_sockets[cFd].iBuf.len - len);
+
+		/* stop reading for a while if the client exceeds its byte rate */
+		if(_sockets[cFd].admit != NULL && (wait = admitRead(
+			&_admit, _sockets[cFd].admit, _sockets[cFd].iBuf.len - len
+		)) > 0)
+		{
+			if(_sockets[cFd].resumeAt <= 0)
+			{
+				++_throttledCount;
+			}
+
+			_sockets[cFd].resumeAt = _getTime() + (double) wait / 1000;
+			FD_CLR(cFd, &_socketReadSet);
+		}
+
+		/* the connection starts with the proxy protocol header */
+		if(_sockets[cFd].useProxy)
+		{
+			switch(_readProxyHeader(cFd))
+			{
+				case 0:
+					_removeSocket(cFd);
+					return;
+
+				case 2:
+					return;
+
+				default:
+					break;
+			}
+
+			/* wait for data following the header */
+			if(!bufHasData(&(_sockets[cFd].iBuf)))
+			{
+				_checkClientSocket(cFd);
+				return;
+			}
+		}
+
 		/* invoke the callback for this socket */
 		if(_invokeCallback(
 			EVENT_SOCKET_READ,
@@ -365,8 +777,12 @@ static void _handleClientInput(int cFd)
  */
 static void _handleInput(int fd)
 {
-	/* is this a server or a client */
-	if(_sockets[fd].isServer)
+	/* is this a watched descriptor, a server or a client */
+	if(_sockets[fd].watch != NULL)
+	{
+		_sockets[fd].watch(fd, WATCH_READ, _sockets[fd].watchArg);
+	}
+	else if(_sockets[fd].isServer)
 	{
 		/* handle server input, this means accept a new connection */
 		_handleServerInput(fd);
@@ -378,6 +794,69 @@ static void _handleInput(int fd)
 	}
 }
 
+/**
+ * writes the queued file to the socket, preceded by the part of the output
+ * buffer that was there before the file was queued. returns 1 if everything
+ * is ok and 0 if not.
+ */
+static int _writeFile(int cFd, _socket_t *socket)
+{
+	ssize_t bytesWritten;
+
+	/* the output buffer may have been cleared in the meantime */
+	if(socket->filePrefix > socket->oBuf.len)
+	{
+		socket->filePrefix = socket->oBuf.len;
+	}
+
+	/* the data in front of the file */
+	if(socket->filePrefix > 0)
+	{
+		bytesWritten = socketWriteData(
+			cFd, socket->oBuf.data, socket->filePrefix, 1
+		);
+
+		if(bytesWritten < 0)
+		{
+			return 0;
+		}
+
+		bufConsume(&(socket->oBuf), (size_t) bytesWritten);
+		socket->filePrefix -= (size_t) bytesWritten;
+		_stats.bytesOut += (unsigned long) bytesWritten;
+		socket->conn.bytesOut += (unsigned long) bytesWritten;
+
+		/* wait until the socket accepts more data */
+		if(socket->filePrefix > 0)
+		{
+			return 1;
+		}
+	}
+
+	/* the file itself */
+	bytesWritten = socketSendFile(
+		cFd, socket->fileFd, &(socket->fileOffset), socket->fileLen
+	);
+
+	if(bytesWritten < 0)
+	{
+		return 0;
+	}
+
+	socket->fileLen -= (size_t) bytesWritten;
+	_stats.bytesOut += (unsigned long) bytesWritten;
+	socket->conn.bytesOut += (unsigned long) bytesWritten;
+
+	/* the file is done, the output buffer follows with the next write */
+	if(socket->fileLen == 0)
+	{
+		close(socket->fileFd);
+		socket->fileFd = -1;
+	}
+
+	return 1;
+}
+
 /**
  * writes data from the output buffer to the socket (the client). returns 1 if
  * data was sent and 0 if not.
@@ -389,21 +868,46 @@ static void _handleOutput(int cFd)
 {
 	/* get the socket data */
 	_socket_t *socket = _sockets + cFd;
+	size_t len = socket->oBuf.len;
+	int result;
 
-	/* write the data from the output buffer to the socket */
-	if(socketWrite(cFd, &(socket->oBuf)))
+	/* watched descriptors are written by their owner */
+	if(socket->watch != NULL)
 	{
-		/* invoke the socket write callback */
-		_invokeCallback(
-			EVENT_SOCKET_WRITE,
-			INVALID_SOCKET,
-			cFd,
-			&(socket->iBuf),
-			&(socket->oBuf)
-		);
+		socket->watch(cFd, WATCH_WRITE, socket->watchArg);
+
+		return;
+	}
+
+	/* write the data from the output buffer (or the queued file) to the
+	 * socket */
+	if(socket->fileFd >= 0)
+	{
+		result = _writeFile(cFd, socket);
+	}
+	else if((result = socketWrite(cFd, &(socket->oBuf))) && !socket->isStats)
+	{
+		_stats.bytesOut += (unsigned long) (len - socket->oBuf.len);
+		socket->conn.bytesOut += (unsigned long) (len - socket->oBuf.len);
+	}
+
+	if(result)
+	{
+		/* invoke the socket write callback, the statistics endpoint has
+		 * none */
+		if(!socket->isStats)
+		{
+			_invokeCallback(
+				EVENT_SOCKET_WRITE,
+				INVALID_SOCKET,
+				cFd,
+				&(socket->iBuf),
+				&(socket->oBuf)
+			);
+		}
 
 		/* is there any data left in the buffer */
-		if(!bufHasData(&(socket->oBuf)))
+		if(!bufHasData(&(socket->oBuf)) && socket->fileFd < 0)
 		{
 			/* no data left in the buffer, disable writing on this socket */
 			_disableSocketWrite(cFd);
@@ -418,6 +922,8 @@ static void _handleOutput(int cFd)
 		return;
 	}
 
+	++_stats.writeErrors;
+
 	end:
 
 	/* something went wrong or the socket should not be kept alive, in either
@@ -426,24 +932,61 @@ static void _handleOutput(int cFd)
 }
 
 /**
- * prepares the server. this means all the internal structures are reset to its
- * initial values.
+ * resumes reading from the throttled sockets whose time has come. returns the
+ * number of milliseconds until the next socket resumes or -1 if no socket is
+ * throttled anymore.
  */
-void serverPrepare(void)
+static long _resumeThrottled(void)
 {
-	/* reset the callback */
-	_callback = NULL;
-
-	/* reset the socket data */
-	memset(_sockets, 0, sizeof(_sockets));
+	double now = _getTime(), next = -1;
+	int fd;
 
-	/* clear the socket sets */
-	FD_ZERO(&_socketReadSet);
-	FD_ZERO(&_socketWriteSet);
+	for(fd=0;fd<=_highestSocket && _throttledCount>0;++fd)
+	{
+		if(_sockets[fd].resumeAt <= 0)
+		{
+			continue;
+		}
 
-	/* reset the highest socket */
-	_highestSocket = INVALID_SOCKET;
-}
+		if(_sockets[fd].resumeAt <= now)
+		{
+			_sockets[fd].resumeAt = 0;
+			--_throttledCount;
+
+			if(!_sockets[fd].isPaused)
+			{
+				FD_SET(fd, &_socketReadSet);
+			}
+		}
+		else if(next < 0 || _sockets[fd].resumeAt < next)
+		{
+			next = _sockets[fd].resumeAt;
+		}
+	}
+
+	return next < 0 ? -1 : (long) ((next - now) * 1000) + 1;
+}
+
+/**
+ * prepares the server. this means all the internal structures are reset to its
+ * initial values.
+ */
+void serverPrepare(void)
+{
+	/* reset the callback */
+	_callback = NULL;
+
+	/* reset the socket data */
+	memset(_sockets, 0, sizeof(_sockets));
+
+	/* clear the socket sets */
+	FD_ZERO(&_socketSet);
+	FD_ZERO(&_socketReadSet);
+	FD_ZERO(&_socketWriteSet);
+
+	/* reset the highest socket */
+	_highestSocket = INVALID_SOCKET;
+}
 
 /**
  * starts the server. this is basically the invocation of the start event.
@@ -457,6 +1000,33 @@ int serverStart(void)
 	);
 }
 
+/**
+ * checks whether the given descriptor is a client connection (connections to
+ * the statistics endpoint are not). returns 1 if it is and 0 if not.
+ */
+static int _isClientSocket(int fd)
+{
+	return _isValidSocket(fd) && FD_ISSET(fd, &_socketSet)
+		&& !_sockets[fd].isServer && !_sockets[fd].isStats
+		&& _sockets[fd].watch == NULL;
+}
+
+/**
+ * samples the tcp information of every client connection.
+ */
+static void _sampleTcpInfo(void)
+{
+	int fd;
+
+	for(fd=0;fd<=_highestSocket;++fd)
+	{
+		if(_isClientSocket(fd))
+		{
+			socketGetTcpInfo(fd, &(_sockets[fd].conn.tcpInfo));
+		}
+	}
+}
+
 /**
  * executes the server. returns 1 in case of success, 2 if there are no open
  * sockets and 0 in case of an error.
@@ -466,6 +1036,8 @@ int serverExec(void)
 	static int result, fd;
 	static struct timeval timeout;
 	static fd_set readSet, writeSet;
+	long wait = -1;
+	double now;
 
 	/* are there any sockets */
 	if(_highestSocket < 0)
@@ -478,6 +1050,14 @@ int serverExec(void)
 	timeout.tv_sec = DEFAULT_IDLE_TIMEOUT;
 	timeout.tv_usec = 0;
 
+	/* wake up in time for the next throttled socket */
+	if(_throttledCount > 0 && (wait = _resumeThrottled()) >= 0
+		&& wait < DEFAULT_IDLE_TIMEOUT * 1000L)
+	{
+		timeout.tv_sec = wait / 1000;
+		timeout.tv_usec = (wait % 1000) * 1000;
+	}
+
 	/* use the global socket sets */
 	readSet = _socketReadSet;
 	writeSet = _socketWriteSet;
@@ -485,6 +1065,17 @@ int serverExec(void)
 	/* wait for changes on the sockets */
 	result = select(_highestSocket + 1, &readSet, &writeSet, NULL, &timeout);
 
+	++_stats.wakeups;
+	_stats.timeouts += result == 0 ? 1 : 0;
+
+	/* sample the tcp information when it is due, this happens with the next
+	 * wake up (at least every DEFAULT_IDLE_TIMEOUT seconds) */
+	if(_tcpInfoInterval > 0 && (now = _getTime()) >= _nextTcpInfoAt)
+	{
+		_sampleTcpInfo();
+		_nextTcpInfoAt = now + _tcpInfoInterval;
+	}
+
 	/* are there any sockets with changes */
 	if(result > 0)
 	{
@@ -498,8 +1089,9 @@ int serverExec(void)
 				_handleInput(fd);
 			}
 
-			/* is this socket ready for writing */
-			if(FD_ISSET(fd, &writeSet))
+			/* is this socket ready for writing (and was not removed while
+			 * reading) */
+			if(FD_ISSET(fd, &writeSet) && FD_ISSET(fd, &_socketSet))
 			{
 				/* handle the socket writing */
 				_handleOutput(fd);
@@ -512,6 +1104,8 @@ int serverExec(void)
 		/* being interrupted by a signal is not considered an error */
 		if(errno != EINTR)
 		{
+			++_stats.selectErrors;
+
 			/* select failed, log the error */
 			logWrite("ERROR select()");
 			logWrite(strerror(errno));
@@ -520,6 +1114,11 @@ int serverExec(void)
 			return 0;
 		}
 	}
+	/* a throttled socket resumes, the server is not idle */
+	else if(wait >= 0 && wait < DEFAULT_IDLE_TIMEOUT * 1000L)
+	{
+		return 1;
+	}
 	/* nothing to do at the moment */
 	else
 	{
@@ -602,7 +1201,8 @@ int serverOpenSocket(const char *host, const char *port)
 void serverCloseSocket(int fd)
 {
 	/* is there a valid socket */
-	if(_isValidSocket(fd) && !_sockets[fd].isServer)
+	if(_isValidSocket(fd) && !_sockets[fd].isServer
+		&& _sockets[fd].watch == NULL)
 	{
 		/* set the keep-alive value to zero */
 		_sockets[fd].keepAlive = 0;
@@ -613,6 +1213,683 @@ void serverCloseSocket(int fd)
 	}
 }
 
+/**
+ * stops reading from the given client socket. the data already stored in the
+ * input buffer is left untouched and no more read events are triggered for
+ * this socket until serverResumeRead() is called. this is used to apply
+ * backpressure when the consumer of the data is slower than the client.
+ */
+void serverPauseRead(int fd)
+{
+	/* only known client sockets can be paused */
+	if(_isValidSocket(fd) && FD_ISSET(fd, &_socketSet)
+		&& !_sockets[fd].isServer && _sockets[fd].watch == NULL)
+	{
+		/* remove the socket from the read set */
+		_sockets[fd].isPaused = 1;
+		FD_CLR(fd, &_socketReadSet);
+	}
+}
+
+/**
+ * resumes reading from a client socket previously paused with
+ * serverPauseRead().
+ */
+void serverResumeRead(int fd)
+{
+	/* only known client sockets can be resumed */
+	if(_isValidSocket(fd) && FD_ISSET(fd, &_socketSet)
+		&& !_sockets[fd].isServer && _sockets[fd].watch == NULL)
+	{
+		/* put the socket back into the read set unless it is throttled */
+		_sockets[fd].isPaused = 0;
+
+		if(_sockets[fd].resumeAt <= 0)
+		{
+			FD_SET(fd, &_socketReadSet);
+		}
+	}
+}
+
+/**
+ * queues a part of a file (descriptor, offset and length) for sending on the
+ * given client socket. the data already in the output buffer is sent first,
+ * data appended later is sent after the file. the descriptor is duplicated, so
+ * the caller may close it. only one file can be queued per socket. returns 1
+ * if everything is ok and 0 if not (e.g. a file is queued already).
+ */
+int serverSendFile(int fd, int fileFd, off_t offset, size_t len)
+{
+	_socket_t *socket;
+
+	/* only known client sockets without a queued file can send files */
+	if(!_isValidSocket(fd) || !FD_ISSET(fd, &_socketSet)
+		|| _sockets[fd].isServer || _sockets[fd].watch != NULL
+		|| _sockets[fd].fileFd >= 0)
+	{
+		return 0;
+	}
+
+	/* nothing to do */
+	if(len == 0)
+	{
+		return 1;
+	}
+
+	socket = _sockets + fd;
+
+	/* keep the duplicate out of the range usable with select() if the limit
+	 * of descriptors allows it */
+	if((socket->fileFd = fcntl(fileFd, F_DUPFD, SOCKET_MAX)) < 0
+		&& (socket->fileFd = dup(fileFd)) < 0)
+	{
+		return 0;
+	}
+
+	socket->fileOffset = offset;
+	socket->fileLen = len;
+	socket->filePrefix = socket->oBuf.len;
+
+	/* enable writing on the socket */
+	_enableSocketWrite(fd);
+
+	return 1;
+}
+
+/**
+ * enables (1) or disables (0) the proxy protocol for the given server socket.
+ * new connections of the socket must start with a proxy protocol header (v1
+ * or v2), which is removed before any callback is invoked. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int serverSetProxyProtocol(int fd, int enabled)
+{
+	/* only server sockets accept the option */
+	if(_isValidSocket(fd) && FD_ISSET(fd, &_socketSet) && _sockets[fd].isServer)
+	{
+		_sockets[fd].useProxy = enabled ? 1 : 0;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * returns the counters of the server.
+ */
+const serverStats_t *serverGetStats(void)
+{
+	int fd;
+
+	_stats.connections = 0;
+	_stats.bufferMemory = 0;
+
+	/* the gauges are determined from the sockets */
+	for(fd=0;fd<=_highestSocket;++fd)
+	{
+		if(_isClientSocket(fd))
+		{
+			++_stats.connections;
+			_stats.bufferMemory += _sockets[fd].iBuf.size
+				+ _sockets[fd].oBuf.size;
+		}
+	}
+
+	return &_stats;
+}
+
+/**
+ * appends a single metric in the prometheus text format to the buffer, the
+ * help and type lines are omitted for further labels of the same metric.
+ * returns 1 if everything is ok and 0 if not.
+ */
+static int _formatMetric(
+	buf_t *buf,
+	const char *name,
+	const char *type,
+	const char *help,
+	const char *label,
+	unsigned long value
+)
+{
+	char tmp[512];
+	int len = 0;
+
+	if(help != NULL)
+	{
+		len = sprintf(tmp, "# HELP vayu_%s %s\n# TYPE vayu_%s %s\n",
+			name, help, name, type
+		);
+	}
+
+	len += sprintf(tmp + len, "vayu_%s%s %lu\n", name, label, value);
+
+	return bufAppend(buf, tmp, (size_t) len);
+}
+
+/**
+ * appends the counters of the server in the prometheus text format to the
+ * given buffer. returns 1 if everything is ok and 0 if not.
+ */
+int serverFormatStats(buf_t *buf)
+{
+	const serverStats_t *stats = serverGetStats();
+	char label[64];
+	int result = 1, i;
+
+	result &= _formatMetric(buf, "connections_accepted_total", "counter",
+		"Accepted client connections.", "", stats->accepts
+	);
+	result &= _formatMetric(buf, "connections_closed_total", "counter",
+		"Closed client connections.", "", stats->closes
+	);
+	result &= _formatMetric(buf, "connections", "gauge",
+		"Open client connections.", "", (unsigned long) stats->connections
+	);
+	result &= _formatMetric(buf, "read_bytes_total", "counter",
+		"Bytes read from client connections.", "", stats->bytesIn
+	);
+	result &= _formatMetric(buf, "written_bytes_total", "counter",
+		"Bytes written to client connections.", "", stats->bytesOut
+	);
+	result &= _formatMetric(buf, "buffer_bytes", "gauge",
+		"Memory of the buffers of the client connections.", "",
+		(unsigned long) stats->bufferMemory
+	);
+
+	for(i=0;i<EVENT_COUNT;++i)
+	{
+		sprintf(label, "{event=\"%s\"}", _eventNames[i]);
+
+		result &= _formatMetric(buf, "events_total", "counter",
+			i == 0 ? "Callbacks invoked per event." : NULL, label,
+			stats->events[i]
+		);
+	}
+
+	result &= _formatMetric(buf, "select_wakeups_total", "counter",
+		"Returns of select().", "", stats->wakeups
+	);
+	result &= _formatMetric(buf, "select_timeouts_total", "counter",
+		"Returns of select() without ready descriptors.", "",
+		stats->timeouts
+	);
+	result &= _formatMetric(buf, "errors_total", "counter",
+		"Failures of the event loop.", "{type=\"select\"}",
+		stats->selectErrors
+	);
+	result &= _formatMetric(buf, "errors_total", "counter", NULL,
+		"{type=\"accept\"}", stats->acceptErrors
+	);
+	result &= _formatMetric(buf, "errors_total", "counter", NULL,
+		"{type=\"write\"}", stats->writeErrors
+	);
+
+	return result;
+}
+
+/**
+ * enables (1) or disables (0) the statistics endpoint on the given server
+ * socket. every request to a new connection of the socket is answered with
+ * the counters in the prometheus text format (see serverFormatStats()) by the
+ * server itself, the callback is not invoked for these connections. returns 1
+ * if everything is ok and 0 if not.
+ */
+int serverSetStatsEndpoint(int fd, int enabled)
+{
+	/* only server sockets accept the option */
+	if(_isValidSocket(fd) && FD_ISSET(fd, &_socketSet) && _sockets[fd].isServer)
+	{
+		_sockets[fd].isStats = enabled ? 1 : 0;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * enables (1) or disables (0) measuring the time spent in the callbacks of
+ * every connection and sets the interval in seconds the tcp information of
+ * all connections is sampled in (0 disables it). the bytes and callbacks of
+ * the connections are always counted. returns 1 if everything is ok and 0 if
+ * not.
+ */
+int serverSetAccounting(int enabled, double tcpInfoInterval)
+{
+	int fd;
+
+	if(tcpInfoInterval < 0)
+	{
+		return 0;
+	}
+
+	_isAccounting = enabled ? 1 : 0;
+
+	/* the first sample is taken with the next wake up */
+	_tcpInfoInterval = tcpInfoInterval;
+	_nextTcpInfoAt = 0;
+
+	/* samples of a disabled sampling are of no use anymore */
+	if(tcpInfoInterval == 0)
+	{
+		for(fd=0;fd<=_highestSocket;++fd)
+		{
+			memset(&(_sockets[fd].conn.tcpInfo), 0, sizeof(tcpInfo_t));
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * fills the accounting of the given client socket. returns 1 if everything is
+ * ok and 0 if there is no such client.
+ */
+int serverGetConnStats(int fd, connStats_t *statsDst)
+{
+	if(_isClientSocket(fd))
+	{
+		*statsDst = _sockets[fd].conn;
+		statsDst->age = _getTime() - _sockets[fd].addedAt;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * returns the value of the given metric of a connection.
+ */
+static double _getConnMetric(const connStats_t *stats, connMetric_t metric)
+{
+	switch(metric)
+	{
+		case CONN_AGE:
+			return stats->age;
+		case CONN_BYTES_IN:
+			return (double) stats->bytesIn;
+		case CONN_BYTES_OUT:
+			return (double) stats->bytesOut;
+		case CONN_EVENTS:
+			return (double) stats->events;
+		case CONN_CALLBACK_TIME:
+			return stats->callbackTime;
+		case CONN_RTT:
+			return (double) stats->tcpInfo.rtt;
+		case CONN_RETRANSMITS:
+			return (double) stats->tcpInfo.retransmits;
+		case CONN_CWND:
+			return (double) stats->tcpInfo.cwnd;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * stores the accounting of up to the given number of client connections with
+ * the largest values of the given metric (in descending order). returns the
+ * number of connections stored.
+ */
+size_t serverGetTopConns(connMetric_t metric, connStats_t *dst, size_t count)
+{
+	connStats_t stats;
+	size_t len = 0, i;
+	double value;
+	int fd;
+
+	if((int) metric < 0 || metric >= CONN_METRIC_COUNT)
+	{
+		return 0;
+	}
+
+	/* the destination is kept sorted, a connection is inserted in front of
+	 * the first one with a smaller value (the last one drops out) */
+	for(fd=0;fd<=_highestSocket;++fd)
+	{
+		if(count == 0 || !serverGetConnStats(fd, &stats))
+		{
+			continue;
+		}
+
+		value = _getConnMetric(&stats, metric);
+
+		for(i=len;i>0 && _getConnMetric(dst + i - 1, metric) < value;--i)
+		{
+			if(i < count)
+			{
+				dst[i] = dst[i - 1];
+			}
+		}
+
+		if(i < count)
+		{
+			dst[i] = stats;
+			len += len < count ? 1 : 0;
+		}
+	}
+
+	return len;
+}
+
+/**
+ * appends a table of the given number of client connections with the largest
+ * values of the given metric to the buffer. returns 1 if everything is ok and
+ * 0 if not.
+ */
+int serverFormatTopConns(buf_t *buf, connMetric_t metric, size_t count)
+{
+	connStats_t stats[64];
+	const char *host;
+	char addr[64], tmp[512];
+	int port, len, result;
+	size_t n, i;
+
+	/* the table is limited to the connections that fit on the stack */
+	if(count > sizeof(stats) / sizeof(stats[0]))
+	{
+		count = sizeof(stats) / sizeof(stats[0]);
+	}
+
+	n = serverGetTopConns(metric, stats, count);
+
+	len = sprintf(tmp, "%-6s %-47s %9s %12s %12s %9s %10s %9s %7s %5s\n",
+		"fd", "address", "age", "bytesIn", "bytesOut", "events",
+		"callback", "rtt", "retrans", "cwnd"
+	);
+	result = bufAppend(buf, tmp, (size_t) len);
+
+	for(i=0;i<n;++i)
+	{
+		if(!serverGetSocketAddr(stats[i].fd, &host, &port))
+		{
+			host = "-";
+			port = 0;
+		}
+
+		sprintf(addr, "%.46s:%d", host, port);
+
+		len = sprintf(tmp, "%-6d %-47s %9.1f %12lu %12lu %9lu %10.6f "
+			"%9lu %7lu %5lu\n",
+			stats[i].fd, addr, stats[i].age, stats[i].bytesIn,
+			stats[i].bytesOut, stats[i].events, stats[i].callbackTime,
+			stats[i].tcpInfo.rtt, stats[i].tcpInfo.retransmits,
+			stats[i].tcpInfo.cwnd
+		);
+		result &= bufAppend(buf, tmp, (size_t) len);
+	}
+
+	return result;
+}
+
+/**
+ * invokes the callbacks of the resolved names. the pipe of the resolver is
+ * only watched while names are being resolved, so it does not keep the server
+ * running.
+ */
+static void _handleResolved(int fd, int events, void *arg)
+{
+	resolvePoll(&_resolver);
+
+	if(resolveGetStats(&_resolver)->pending == 0)
+	{
+		serverUnwatchFd(fd);
+	}
+}
+
+/**
+ * resolves the given name without blocking the event loop, see
+ * resolveLookup(). the resolver is created on the first call.
+ */
+resolveResult_t serverResolve(
+	const char *name,
+	resolveCallback_t callback,
+	void *arg
+)
+{
+	resolveResult_t result;
+
+	if(!_isResolverReady)
+	{
+		if(!resolveInit(&_resolver))
+		{
+			return RESOLVE_ERROR;
+		}
+
+		_isResolverReady = 1;
+	}
+
+	result = resolveLookup(&_resolver, name, callback, arg);
+
+	/* wait for the result in the event loop */
+	if(result == RESOLVE_PENDING && !serverWatchFd(
+		resolveGetFd(&_resolver), WATCH_READ, _handleResolved, NULL
+	))
+	{
+		logWrite("ERROR serverWatchFd(): resolver");
+	}
+
+	return result;
+}
+
+/**
+ * changes how long the resolver caches results and failures (in seconds).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int serverSetResolveTtl(double ttl, double negativeTtl)
+{
+	if(!_isResolverReady)
+	{
+		if(!resolveInit(&_resolver))
+		{
+			return 0;
+		}
+
+		_isResolverReady = 1;
+	}
+
+	resolveSetTtl(&_resolver, ttl, negativeTtl);
+
+	return 1;
+}
+
+/**
+ * returns the counters of the resolver or null if it was not used yet.
+ */
+const resolveStats_t *serverGetResolveStats(void)
+{
+	return _isResolverReady ? resolveGetStats(&_resolver) : NULL;
+}
+
+/**
+ * watches the given descriptor (e.g. a pipe) for the given events (WATCH_READ
+ * and WATCH_WRITE) and invokes the callback when it is ready. calling it again
+ * with the same callback changes the events and the argument. the descriptor
+ * is neither read nor closed by the server and the callback must consume the
+ * event (e.g. read the data), otherwise it is invoked again right away.
+ * watched descriptors keep the server running like sockets. returns 1 if
+ * everything is ok and 0 if the descriptor is invalid, a socket of the server
+ * or watched with another callback.
+ */
+int serverWatchFd(int fd, int events, watchCallback_t callback, void *arg)
+{
+	if(!_isValidSocket(fd) || callback == NULL)
+	{
+		return 0;
+	}
+
+	/* the descriptor takes the slot of a socket */
+	if(!FD_ISSET(fd, &_socketSet))
+	{
+		if(!_addSocket(fd))
+		{
+			return 0;
+		}
+	}
+	else if(_sockets[fd].watch != callback)
+	{
+		return 0;
+	}
+
+	_sockets[fd].watch = callback;
+	_sockets[fd].watchArg = arg;
+
+	if(events & WATCH_READ)
+	{
+		FD_SET(fd, &_socketReadSet);
+	}
+	else
+	{
+		FD_CLR(fd, &_socketReadSet);
+	}
+
+	if(events & WATCH_WRITE)
+	{
+		FD_SET(fd, &_socketWriteSet);
+	}
+	else
+	{
+		FD_CLR(fd, &_socketWriteSet);
+	}
+
+	return 1;
+}
+
+/**
+ * stops watching the given descriptor, it is not closed.
+ */
+void serverUnwatchFd(int fd)
+{
+	if(_isValidSocket(fd) && FD_ISSET(fd, &_socketSet)
+		&& _sockets[fd].watch != NULL)
+	{
+		_sockets[fd].watch = NULL;
+
+		FD_CLR(fd, &_socketSet);
+		FD_CLR(fd, &_socketReadSet);
+		FD_CLR(fd, &_socketWriteSet);
+
+		if(fd == _highestSocket)
+		{
+			_highestSocket = _findHighestSocket();
+		}
+	}
+}
+
+/**
+ * returns the output buffer of the given client socket or null if there is no
+ * such socket. the socket is put into the write set, so data appended to the
+ * buffer outside of the callback of the socket (e.g. the answer to a parked
+ * request) is sent as well.
+ */
+buf_t *serverGetOutput(int fd)
+{
+	/* only known client sockets have an output buffer */
+	if(!_isValidSocket(fd) || !FD_ISSET(fd, &_socketSet)
+		|| _sockets[fd].isServer || _sockets[fd].watch != NULL)
+	{
+		return NULL;
+	}
+
+	_enableSocketWrite(fd);
+
+	return &(_sockets[fd].oBuf);
+}
+
+/**
+ * returns the id of the given client socket or 0 if there is no such socket.
+ * unlike the descriptor, the id of a connection is never reused, it tells
+ * whether a descriptor still refers to the same connection.
+ */
+unsigned long serverGetSocketId(int fd)
+{
+	if(!_isValidSocket(fd) || !FD_ISSET(fd, &_socketSet)
+		|| _sockets[fd].isServer || _sockets[fd].watch != NULL)
+	{
+		return 0;
+	}
+
+	return _sockets[fd].id;
+}
+
+/**
+ * enables the admission control for new connections with the given limits or
+ * disables it (null). connections exceeding the limits of their client are
+ * dropped right after accept(), before any callback is invoked, reading from
+ * a client exceeding its byte rate is paused. connections which are open
+ * already are not affected. returns 1 if everything is ok and 0 if not.
+ */
+int serverSetAdmission(const admitConfig_t *config)
+{
+	int fd;
+
+	/* keep the state of the clients when the limits change */
+	if(config != NULL && _isAdmitEnabled)
+	{
+		admitSetConfig(&_admit, config);
+
+		return 1;
+	}
+
+	/* forget the groups of the open connections */
+	for(fd=0;fd<=_highestSocket;++fd)
+	{
+		_sockets[fd].admit = NULL;
+
+		if(_sockets[fd].resumeAt > 0)
+		{
+			_sockets[fd].resumeAt = 0;
+
+			if(FD_ISSET(fd, &_socketSet) && !_sockets[fd].isPaused)
+			{
+				FD_SET(fd, &_socketReadSet);
+			}
+		}
+	}
+
+	_throttledCount = 0;
+
+	if(_isAdmitEnabled)
+	{
+		admitClear(&_admit);
+		_isAdmitEnabled = 0;
+	}
+
+	if(config != NULL)
+	{
+		_isAdmitEnabled = admitInit(&_admit, config);
+
+		return _isAdmitEnabled;
+	}
+
+	return 1;
+}
+
+/**
+ * takes the given number of requests from the request rate of the client of
+ * the given socket. returns 1 if the requests are admitted (or there is no
+ * admission control for the socket) and 0 if not.
+ */
+int serverAdmitRequest(int fd, double count)
+{
+	if(!_isValidSocket(fd) || _sockets[fd].admit == NULL)
+	{
+		return 1;
+	}
+
+	return admitRequest(&_admit, _sockets[fd].admit, count);
+}
+
+/**
+ * returns the counters of the admission control or null if it is disabled.
+ */
+const admitStats_t *serverGetAdmitStats(void)
+{
+	return _isAdmitEnabled ? admitGetStats(&_admit) : NULL;
+}
+
 /**
  * returns the address and port of the given socket. for server sockets this is
  * the address the socket is bound to and for client sockets this is the peer
@@ -624,6 +1901,15 @@ int serverGetSocketAddr(int fd, const char **hostDst, int *portDst)
 	/* is there a socket for the given descriptor */
 	if(_isValidSocket(fd))
 	{
+		/* behind a proxy the client address is the one sent by the proxy */
+		if(!_sockets[fd].isServer
+			&& _sockets[fd].proxyAddr.ss_family != AF_UNSPEC)
+		{
+			return socketFormatAddr(
+				&(_sockets[fd].proxyAddr), hostDst, portDst
+			);
+		}
+
 		/* get the address information for the socket */
 		return _sockets[fd].isServer
 			? socketGetBoundAddr(fd, hostDst, portDst)
@@ -778,8 +2064,15 @@ int serverDaemonize(void)
 }
 
 /**
- * shuts the server down. this function literally does nothing.
+ * shuts the server down, it stops the helper threads of the resolver.
  */
 void serverShutdown(void)
 {
+	/* stop the helper threads of the resolver */
+	if(_isResolverReady)
+	{
+		serverUnwatchFd(resolveGetFd(&_resolver));
+		resolveClear(&_resolver);
+		_isResolverReady = 0;
+	}
 }
@@ -28,8 +28,11 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 
 /**
  * defines the maximum number of sockets that can be active concurrently. this
@@ -165,44 +168,2339 @@ typedef struct {
  */
 typedef int (*serverCallback_t)(eventContext_t*);
 
+/**
+ * defines the events of a descriptor watched with serverWatchFd().
+ */
+#define WATCH_READ (1)
+#define WATCH_WRITE (2)
+
+/**
+ * defines the signature of the callback of a descriptor watched with
+ * serverWatchFd(). it gets the descriptor, the event (WATCH_READ or
+ * WATCH_WRITE) and the custom argument.
+ */
+typedef void (*watchCallback_t)(int, int, void*);
+
+/**
+ * defines the signature of the callback of a signal watched with
+ * signalWatch(). it gets the signal number and the custom argument.
+ */
+typedef void (*signalCallback_t)(int, void*);
+
+/**
+ * defines the counters of the server. they are only updated by the event loop
+ * (there is a single one), so a plain struct is enough.
+ */
+typedef struct {
+
+	/* stores the accepted and the closed client connections */
+	unsigned long accepts, closes;
+
+	/* stores the bytes read from and written to client sockets */
+	unsigned long bytesIn, bytesOut;
+
+	/* stores the number of callbacks per event */
+	unsigned long events[EVENT_COUNT];
+
+	/* stores how often select() returned and how often it timed out */
+	unsigned long wakeups, timeouts;
+
+	/* stores the failures of select(), accepting and writing */
+	unsigned long selectErrors, acceptErrors, writeErrors;
+
+	/* stores the open client connections and the memory of their buffers,
+	 * both are determined when the counters are requested */
+	size_t connections, bufferMemory;
+
+} serverStats_t;
+
+/**
+ * defines the tcp information of a connection, see socketGetTcpInfo().
+ */
+typedef struct {
+
+	/* stores the smoothed round trip time and its variance in microseconds */
+	unsigned long rtt, rttVar;
+
+	/* stores the number of retransmitted segments */
+	unsigned long retransmits;
+
+	/* stores the congestion window in segments */
+	unsigned long cwnd;
+
+} tcpInfo_t;
+
+/**
+ * defines the metrics the connections can be sorted by with
+ * serverGetTopConns().
+ */
+typedef enum {
+
+	CONN_AGE,
+	CONN_BYTES_IN,
+	CONN_BYTES_OUT,
+	CONN_EVENTS,
+	CONN_CALLBACK_TIME,
+	CONN_RTT,
+	CONN_RETRANSMITS,
+	CONN_CWND,
+
+	/* this must always be the last in the enumeration */
+	CONN_METRIC_COUNT
+
+} connMetric_t;
+
+/**
+ * defines the accounting of a client connection.
+ */
+typedef struct {
+
+	/* stores the socket and its age in seconds */
+	int fd;
+	double age;
+
+	/* stores the bytes read and written and the number of callbacks */
+	unsigned long bytesIn, bytesOut, events;
+
+	/* stores the seconds spent in the callbacks (only measured while the
+	 * accounting is enabled) */
+	double callbackTime;
+
+	/* stores the last sample of the tcp information (zero if there is
+	 * none) */
+	tcpInfo_t tcpInfo;
+
+} connStats_t;
+
+/**
+ * defines the maximum size of the headers of a single part of a multipart
+ * form.
+ */
+#ifndef FORM_HEADER_MAX
+#define FORM_HEADER_MAX (8 * 1024)
+#endif
+
+/**
+ * defines the maximum size of a single field of an urlencoded form.
+ */
+#ifndef FORM_FIELD_MAX
+#define FORM_FIELD_MAX (1024 * 1024)
+#endif
+
+/**
+ * defines the maximum length of a multipart boundary (see rfc 2046).
+ */
+#define FORM_BOUNDARY_MAX (70)
+
+/**
+ * defines the supported types of forms.
+ */
+typedef enum {
+
+	/* application/x-www-form-urlencoded and query strings */
+	FORM_URLENCODED,
+
+	/* multipart/form-data */
+	FORM_MULTIPART
+
+} formType_t;
+
+/**
+ * defines the events reported by a form parser.
+ */
+typedef enum {
+
+	/* a field of an urlencoded form was parsed. the name and value fields of
+	 * the form data contain the decoded name and value. */
+	FORM_EVENT_FIELD,
+
+	/* a new part of a multipart form begins. the name field contains the name
+	 * of the part, the value field the filename and the type field the
+	 * content type. every one of them may be empty. */
+	FORM_EVENT_PART,
+
+	/* a chunk of data of the current part was parsed. only the value field is
+	 * used. */
+	FORM_EVENT_DATA,
+
+	/* the current part of a multipart form is complete. no fields are used. */
+	FORM_EVENT_END
+
+} formEvent_t;
+
+/**
+ * defines the data passed to the form callback. the pointers are only valid
+ * during the callback and the strings are not null terminated.
+ */
+typedef struct {
+
+	/* stores the type of the event */
+	formEvent_t event;
+
+	/* stores the name, value and type depending on the event */
+	const char *name, *value, *type;
+
+	/* stores the lengths of the name, value and type */
+	size_t nameLen, valueLen, typeLen;
+
+} formData_t;
+
+/**
+ * defines the signature of the form callback. the second parameter is the user
+ * data passed to the parser. returning 0 aborts the parser.
+ */
+typedef int (*formCallback_t)(formData_t*, void*);
+
+/**
+ * defines the maximum nesting depth of json documents.
+ */
+#ifndef JSON_DEPTH_MAX
+#define JSON_DEPTH_MAX (128)
+#endif
+
+/**
+ * defines the default number of significant digits used for json numbers.
+ */
+#ifndef JSON_PRECISION
+#define JSON_PRECISION (14)
+#endif
+
+/**
+ * defines the tokens reported by the json reader.
+ */
+typedef enum {
+
+	/* the literals null, false and true */
+	JSON_NULL,
+	JSON_FALSE,
+	JSON_TRUE,
+
+	/* a number, the value is stored in the number field of the reader */
+	JSON_NUMBER,
+
+	/* a string value, stored in the str and strLen fields of the reader */
+	JSON_STRING,
+
+	/* a key of an object, stored like a string. the value follows. */
+	JSON_KEY,
+
+	/* the beginning and the end of arrays and objects */
+	JSON_ARRAY_BEGIN,
+	JSON_ARRAY_END,
+	JSON_OBJECT_BEGIN,
+	JSON_OBJECT_END,
+
+	/* the end of the document */
+	JSON_END,
+
+	/* the document is malformed, the error field of the reader contains a
+	 * message */
+	JSON_ERROR
+
+} jsonToken_t;
+
+/**
+ * defines the structure of a json reader. the fields must not be modified
+ * directly. the fields describing the current token (str, strLen, number and
+ * error) and the nesting (depth and stack) may be read.
+ */
+typedef struct {
+
+	/* stores the document */
+	const char *data;
+
+	/* stores the length of the document and the current position */
+	size_t len, pos;
+
+	/* stores the current nesting depth and what is expected next */
+	int depth, state;
+
+	/* stores the type of every open container, 1 for objects */
+	unsigned char stack[JSON_DEPTH_MAX];
+
+	/* stores the current string or key. it points either into the document
+	 * or into the string buffer and is not null terminated. */
+	const char *str;
+
+	/* stores the length of the current string */
+	size_t strLen;
+
+	/* stores the current number */
+	double number;
+
+	/* stores the error message if the document is malformed */
+	const char *error;
+
+	/* stores strings that contain escape sequences */
+	buf_t string;
+
+} jsonReader_t;
+
+/**
+ * defines the maximum size of a messagepack message.
+ */
+#ifndef MPACK_MESSAGE_MAX
+#define MPACK_MESSAGE_MAX (16 * 1024 * 1024)
+#endif
+
+/**
+ * defines the maximum nesting depth of messagepack messages.
+ */
+#ifndef MPACK_DEPTH_MAX
+#define MPACK_DEPTH_MAX (128)
+#endif
+
+/**
+ * defines the values reported by the messagepack reader.
+ */
+typedef enum {
+
+	/* nil, false and true */
+	MPACK_NIL,
+	MPACK_FALSE,
+	MPACK_TRUE,
+
+	/* an integer or floating point number, stored as double */
+	MPACK_NUMBER,
+
+	/* a string, a binary and an extension. the payload is stored in the str
+	 * and strLen fields of the reader */
+	MPACK_STRING,
+	MPACK_BINARY,
+	MPACK_EXT,
+
+	/* an array or a map, the number of elements is stored in the count field
+	 * of the reader */
+	MPACK_ARRAY,
+	MPACK_MAP,
+
+	/* there is not enough data for the next value */
+	MPACK_END,
+
+	/* the data is invalid */
+	MPACK_ERROR
+
+} mpackToken_t;
+
+/**
+ * defines the structure of a messagepack scanner. it checks incrementally
+ * whether a complete message is available.
+ */
+typedef struct {
+
+	/* stores the number of bytes that belong to complete values */
+	size_t pos;
+
+	/* stores the number of values missing to complete the message */
+	unsigned long pending;
+
+} mpackScanner_t;
+
+/**
+ * defines the structure of a messagepack reader. the fields must not be
+ * modified directly.
+ */
+typedef struct {
+
+	/* stores the data and its length */
+	const unsigned char *data;
+	size_t len;
+
+	/* stores the position of the next value */
+	size_t pos;
+
+	/* stores the current number */
+	double number;
+
+	/* stores the number of elements of the current array or map */
+	unsigned long count;
+
+	/* stores the payload of the current string, binary or extension. it
+	 * points into the data and is not null terminated. */
+	const char *str;
+	size_t strLen;
+
+	/* stores the type of the current extension */
+	int extType;
+
+} mpackReader_t;
+
+/**
+ * defines the maximum size of a websocket message (all fragments).
+ */
+#ifndef WS_MESSAGE_MAX
+#define WS_MESSAGE_MAX (16 * 1024 * 1024)
+#endif
+
+/**
+ * defines the websocket opcodes.
+ */
+typedef enum {
+
+	WS_CONTINUATION = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xa
+
+} wsOpcode_t;
+
+/**
+ * defines the structure of a message passed to the websocket callback.
+ */
+typedef struct {
+
+	/* stores the type of the message (WS_TEXT, WS_BINARY, WS_PONG or
+	 * WS_CLOSE) */
+	wsOpcode_t opcode;
+
+	/* stores the unmasked payload, for WS_CLOSE this is the reason */
+	const char *data;
+	size_t len;
+
+	/* stores the status code of a WS_CLOSE message (0 if there is none) */
+	int code;
+
+} wsMessage_t;
+
+/**
+ * defines the signature of the websocket callback. it is invoked for every
+ * complete message, the data is only valid during the callback. returning 0
+ * stops the processing.
+ */
+typedef int (*wsCallback_t)(wsMessage_t*, void*);
+
+/**
+ * defines the structure of a websocket connection. the fields must not be
+ * accessed directly, use the websocket api instead.
+ */
+typedef struct {
+
+	/* stores the opcode of the fragmented message (0 if there is none) */
+	wsOpcode_t opcode;
+
+	/* used to check whether a close frame was sent */
+	int closeSent;
+
+	/* used to check whether a close frame was received */
+	int closeReceived;
+
+	/* stores the fragments of the current message */
+	buf_t message;
+
+} wsConn_t;
+
+/**
+ * defines the maximum size of the hpack dynamic table (the default of http/2,
+ * it is not increased with SETTINGS_HEADER_TABLE_SIZE).
+ */
+#define HPACK_TABLE_SIZE (4096)
+
+/**
+ * defines the maximum number of entries of the hpack dynamic table. every
+ * entry has an overhead of 32 bytes.
+ */
+#define HPACK_ENTRIES_MAX (HPACK_TABLE_SIZE / 32)
+
+/**
+ * defines the structure of an entry of the hpack dynamic table. the value
+ * follows the name in the same memory.
+ */
+typedef struct {
+
+	/* stores the name and the value */
+	char *data;
+
+	/* stores the length of the name and the value */
+	size_t nameLen, valueLen;
+
+} hpackEntry_t;
+
+/**
+ * defines the structure of a hpack decoder. the fields must not be accessed
+ * directly, use the hpack api instead.
+ */
+typedef struct {
+
+	/* stores the entries of the dynamic table as ring, the newest first */
+	hpackEntry_t entries[HPACK_ENTRIES_MAX];
+
+	/* stores the index of the newest entry and the number of entries */
+	size_t first, count;
+
+	/* stores the size of the table and its current maximum */
+	size_t size, maxSize;
+
+	/* used to decode huffman encoded names and values */
+	buf_t name, value;
+
+} hpackDecoder_t;
+
+/**
+ * defines the signature of the callback invoked for every decoded header
+ * field (name, name length, value, value length, user data). returning 0
+ * stops the decoding.
+ */
+typedef int (*hpackCallback_t)(
+	const char*, size_t, const char*, size_t, void*
+);
+
+/**
+ * defines the maximum number of concurrent streams of a http/2 connection.
+ */
+#ifndef H2_STREAMS_MAX
+#define H2_STREAMS_MAX (100)
+#endif
+
+/**
+ * defines the maximum size of the decoded headers of a http/2 request.
+ */
+#ifndef H2_HEADER_LIST_MAX
+#define H2_HEADER_LIST_MAX (64 * 1024)
+#endif
+
+/**
+ * defines the maximum size of a received http/2 frame payload (the default
+ * of http/2, it is not increased with SETTINGS_MAX_FRAME_SIZE).
+ */
+#define H2_FRAME_MAX (16384)
+
+/**
+ * defines the flow control window used for receiving, connections and
+ * streams use the default size of http/2.
+ */
+#define H2_WINDOW (65535)
+
+/**
+ * defines the http/2 error codes.
+ */
+typedef enum {
+
+	H2_NO_ERROR = 0x0,
+	H2_PROTOCOL_ERROR = 0x1,
+	H2_INTERNAL_ERROR = 0x2,
+	H2_FLOW_CONTROL_ERROR = 0x3,
+	H2_STREAM_CLOSED = 0x5,
+	H2_FRAME_SIZE_ERROR = 0x6,
+	H2_REFUSED_STREAM = 0x7,
+	H2_CANCEL = 0x8,
+	H2_COMPRESSION_ERROR = 0x9
+
+} h2Error_t;
+
+/**
+ * defines the events passed to the http/2 callback.
+ */
+typedef enum {
+
+	/* the headers (or trailers) of a request were received */
+	H2_EVENT_HEADERS,
+
+	/* data of a request body was received */
+	H2_EVENT_DATA,
+
+	/* the stream was reset by the client */
+	H2_EVENT_RESET
+
+} h2EventType_t;
+
+/**
+ * defines the structure of a header field.
+ */
+typedef struct {
+
+	const char *name;
+	size_t nameLen;
+
+	const char *value;
+	size_t valueLen;
+
+} h2Header_t;
+
+/**
+ * defines the structure of an event passed to the http/2 callback. the data
+ * is only valid during the callback.
+ */
+typedef struct {
+
+	/* stores the type of the event */
+	h2EventType_t type;
+
+	/* stores the id of the stream */
+	unsigned long stream;
+
+	/* stores the header fields of H2_EVENT_HEADERS */
+	const h2Header_t *headers;
+	size_t count;
+
+	/* stores the data of H2_EVENT_DATA */
+	const char *data;
+	size_t len;
+
+	/* used to check whether the client finished the request */
+	int endStream;
+
+	/* stores the error code of H2_EVENT_RESET */
+	unsigned long code;
+
+} h2Event_t;
+
+/**
+ * defines the signature of the http/2 callback. returning 0 stops the
+ * processing.
+ */
+typedef int (*h2Callback_t)(h2Event_t*, void*);
+
+/**
+ * defines the structure of a http/2 stream.
+ */
+typedef struct {
+
+	/* stores the id of the stream, 0 means the slot is unused */
+	unsigned long id;
+
+	/* stores the flow control windows for sending and receiving */
+	long sendWindow, recvWindow;
+
+	/* used to check whether the client and the server ended the stream */
+	int remoteClosed, localClosed;
+
+	/* used to check whether the pending data ends the stream */
+	int pendingEnd;
+
+	/* stores data that could not be sent because of flow control */
+	buf_t pending;
+
+} h2Stream_t;
+
+/**
+ * defines the structure of a http/2 connection. the fields must not be
+ * accessed directly, use the http/2 api instead.
+ */
+typedef struct {
+
+	/* stores the state of the connection */
+	int state;
+
+	/* stores the highest stream id opened by the client */
+	unsigned long lastStream;
+
+	/* stores the stream of the header block being received (0 if none) and
+	 * whether it ends the stream */
+	unsigned long headerStream;
+	int headerEnd;
+
+	/* stores the flow control windows of the connection */
+	long sendWindow, recvWindow;
+
+	/* stores the settings of the client */
+	long initialWindow;
+	size_t maxFrame;
+
+	/* used to check whether the settings were sent already */
+	int settingsSent;
+
+	/* stores the header compression state */
+	hpackDecoder_t hpack;
+
+	/* stores the fragments of the current header block and the decoded
+	 * header fields */
+	buf_t block, fields;
+
+	/* stores the streams */
+	h2Stream_t streams[H2_STREAMS_MAX];
+
+} h2Conn_t;
+
+/**
+ * defines the default compression level (1 is the fastest, 9 the best).
+ */
+#define COMP_LEVEL_DEFAULT (6)
+
+/**
+ * defines the default size of the compression cache in bytes.
+ */
+#ifndef COMP_CACHE_SIZE
+#define COMP_CACHE_SIZE (16 * 1024 * 1024)
+#endif
+
+/**
+ * defines the supported compression formats (the content codings of http).
+ */
+typedef enum {
+
+	/* gzip format (rfc 1952) */
+	COMP_GZIP,
+
+	/* zlib format (rfc 1950), the "deflate" coding of http */
+	COMP_DEFLATE
+
+} compFormat_t;
+
+/**
+ * defines how much of the data written to a compression filter is flushed.
+ */
+typedef enum {
+
+	/* the compressor decides when to produce output */
+	COMP_NONE,
+
+	/* all data written so far is output, the stream stays open */
+	COMP_FLUSH,
+
+	/* all data is output and the stream is ended */
+	COMP_FINISH
+
+} compFlush_t;
+
+/**
+ * defines the structure of a streaming compression filter. the fields must
+ * not be accessed directly, use the compression api instead.
+ */
+typedef struct {
+
+	/* stores the state of zlib, null if the stream was finished */
+	void *stream;
+
+} compFilter_t;
+
+/**
+ * defines the results of a cache lookup.
+ */
+typedef enum {
+
+	/* the key is not cached (or expired) */
+	CACHE_MISS,
+
+	/* the value is fresh */
+	CACHE_HIT,
+
+	/* the value expired but may still be served while it is revalidated. this
+	 * is reported once per expiration, the caller is expected to set a new
+	 * value, further lookups report a hit until the stale period is over */
+	CACHE_STALE
+
+} cacheResult_t;
+
+/**
+ * defines the structure of a cache entry. the fields must not be accessed
+ * directly, use the cache api instead.
+ */
+typedef struct cacheEntry_s {
+
+	/* stores the next entry of the same bucket */
+	struct cacheEntry_s *next;
+
+	/* stores the neighbours in the lru list of the segment */
+	struct cacheEntry_s *newer, *older;
+
+	/* stores the hash of the key */
+	unsigned long hash;
+
+	/* stores the segment (0 probation, 1 protected) and whether the stale
+	 * value is revalidated already */
+	int segment, revalidating;
+
+	/* stores when the value expires and until when it may be served stale
+	 * (0 means never) */
+	time_t expires, staleUntil;
+
+	/* stores the lengths of the key and the value, both are stored behind
+	 * the entry */
+	size_t keyLen, valueLen;
+
+} cacheEntry_t;
+
+/**
+ * defines the statistics of a cache.
+ */
+typedef struct {
+
+	/* stores the number of lookups by result */
+	unsigned long hits, misses, stale;
+
+	/* stores the number of entries removed to make room */
+	unsigned long evictions;
+
+	/* stores the number of entries and their size in bytes */
+	size_t count, size;
+
+} cacheStats_t;
+
+/**
+ * defines the structure of a cache. the cache is a segmented lru cache: new
+ * entries start in the probation segment and move to the protected segment
+ * on their first hit, so entries used only once are evicted first. the
+ * fields must not be accessed directly, use the cache api instead.
+ */
+typedef struct {
+
+	/* stores the hash table of the entries */
+	cacheEntry_t **buckets;
+	size_t bucketCount;
+
+	/* stores the most and least recently used entries of both segments */
+	cacheEntry_t *newest[2], *oldest[2];
+
+	/* stores the size of both segments and the maximum size in bytes */
+	size_t size[2], maxSize;
+
+	/* stores the statistics */
+	cacheStats_t stats;
+
+} cache_t;
+
+/**
+ * defines the maximum number of files kept open by a static file server.
+ */
+#ifndef FILE_CACHE_MAX
+#define FILE_CACHE_MAX (256)
+#endif
+
+/**
+ * defines the maximum length of a request path served by a static file
+ * server.
+ */
+#ifndef FILE_PATH_MAX
+#define FILE_PATH_MAX (1024)
+#endif
+
+/**
+ * defines the structure of a cached file. the request path and the path of
+ * the file relative to the root follow the entry in the same memory. the
+ * fields must not be accessed directly, use the file api instead.
+ */
+typedef struct fileEntry_s {
+
+	/* stores the next entry of the same bucket */
+	struct fileEntry_s *next;
+
+	/* stores the neighbours in the lru list */
+	struct fileEntry_s *newer, *older;
+
+	/* stores the hash of the request path */
+	unsigned long hash;
+
+	/* stores the open descriptor of the file */
+	int fd;
+
+	/* stores the inotify watch of the directory of the file (-1 if there is
+	 * none, the file is checked with stat() from time to time then) */
+	int wd;
+
+	/* stores the metadata of the file */
+	off_t size;
+	time_t mtime;
+	ino_t ino;
+
+	/* stores when the file was checked the last time (without inotify) */
+	time_t checked;
+
+	/* stores the content type */
+	const char *mime;
+
+	/* stores the validators */
+	char etag[48], lastModified[32];
+
+	/* stores the length of the request path and the file path */
+	size_t pathLen, fileLen;
+
+} fileEntry_t;
+
+/**
+ * defines the parts of a request a static file server looks at. headers not
+ * sent by the client are null.
+ */
+typedef struct {
+
+	/* stores the method and the path (the query is ignored) */
+	const char *method, *path;
+
+	/* stores the headers for conditional and range requests */
+	const char *ifNoneMatch, *ifModifiedSince, *range, *ifRange;
+
+} fileRequest_t;
+
+/**
+ * defines the structure of a static file server. the fields must not be
+ * accessed directly, use the file api instead.
+ */
+typedef struct {
+
+	/* stores the descriptor and the path of the root directory */
+	int rootFd;
+	buf_t root;
+
+	/* stores the names of the index files and the content types by
+	 * extension, both as a list of null terminated strings */
+	buf_t index, mime;
+
+	/* stores the max-age of the Cache-Control header (negative for none) */
+	long maxAge;
+
+	/* stores the inotify descriptor (-1 if it is not available) */
+	int notifyFd;
+
+	/* stores the hash table of the cached files */
+	fileEntry_t **buckets;
+	size_t bucketCount, count;
+
+	/* stores the most and least recently used files */
+	fileEntry_t *newest, *oldest;
+
+	/* stores the number of requests answered from the cache and the number
+	 * of files opened */
+	unsigned long hits, misses;
+
+} fileServer_t;
+
+/**
+ * defines the maximum number of parameters (and wildcards) of a route.
+ */
+#ifndef ROUTER_PARAM_MAX
+#define ROUTER_PARAM_MAX (16)
+#endif
+
+/**
+ * defines the result of a route lookup.
+ */
+typedef enum {
+
+	/* no route matches the path */
+	ROUTE_NOT_FOUND,
+
+	/* a route matches the path and the method */
+	ROUTE_FOUND,
+
+	/* routes match the path, but none of them the method */
+	ROUTE_METHOD_NOT_ALLOWED
+
+} routeResult_t;
+
+/**
+ * defines the structure of a route, the routes ending in the same node form a
+ * list. the method and the names of the parameters follow the route in the
+ * same memory (null terminated). the fields must not be accessed directly,
+ * use the router api instead.
+ */
+typedef struct routeEntry_s {
+
+	/* stores the next route of the same node */
+	struct routeEntry_s *next;
+
+	/* stores the handler of the route */
+	int handler;
+
+	/* stores whether the route accepts any method */
+	int anyMethod;
+
+	/* stores the number of parameters */
+	size_t paramCount;
+
+} routeEntry_t;
+
+/**
+ * defines the structure of a node of the radix tree. static nodes match their
+ * prefix, parameter nodes a single path segment and wildcard nodes the rest of
+ * the path. the prefix follows the node in the same memory. the fields must
+ * not be accessed directly, use the router api instead.
+ */
+typedef struct routeNode_s {
+
+	/* stores the type of the node (static, parameter or wildcard) */
+	int type;
+
+	/* stores the length of the prefix of a static node */
+	size_t prefixLen;
+
+	/* stores the static children and their first characters */
+	struct routeNode_s **children;
+	char *indices;
+	size_t childCount;
+
+	/* stores the parameter and the wildcard child */
+	struct routeNode_s *param, *wildcard;
+
+	/* stores the routes ending in this node */
+	routeEntry_t *routes;
+
+} routeNode_t;
+
+/**
+ * defines the structure of a router. the fields must not be accessed
+ * directly, use the router api instead.
+ */
+typedef struct {
+
+	/* stores the root of the radix tree */
+	routeNode_t *root;
+
+	/* stores the number of routes */
+	size_t routeCount;
+
+} router_t;
+
+/**
+ * defines the result of a successful route lookup. the values of the
+ * parameters point into the path, they are not null terminated.
+ */
+typedef struct {
+
+	/* stores the handler of the route */
+	int handler;
+
+	/* stores the names, values and lengths of the parameters */
+	size_t paramCount;
+	const char *names[ROUTER_PARAM_MAX];
+	const char *values[ROUTER_PARAM_MAX];
+	size_t lengths[ROUTER_PARAM_MAX];
+
+} routeMatch_t;
+
+/**
+ * defines the result of joining a flight.
+ */
+typedef enum {
+
+	/* the caller is the first one and must compute the value */
+	FLIGHT_LEADER,
+
+	/* the value is computed already, the socket is parked until then */
+	FLIGHT_WAITING,
+
+	/* not enough memory */
+	FLIGHT_ERROR
+
+} flightResult_t;
+
+/**
+ * defines the callback invoked for every parked socket when the value of a
+ * flight is available. the parameters are the client socket, its id (see
+ * serverGetSocketId()), its output buffer and the argument given to
+ * flightFinish(). the output buffer is null if the connection was closed in
+ * the meantime (the descriptor may belong to another connection by then), the
+ * callback only releases the data it keeps for the connection then.
+ */
+typedef void (*flightCallback_t)(int, unsigned long, buf_t*, void*);
+
+/**
+ * defines the structure of a socket parked on a flight.
+ */
+typedef struct flightWaiter_s {
+
+	/* stores the next waiter of the same flight */
+	struct flightWaiter_s *next;
+
+	/* stores the client socket and the id of its connection */
+	int cFd;
+	unsigned long id;
+
+} flightWaiter_t;
+
+/**
+ * defines the structure of a flight, i.e. a value being computed. the key
+ * follows the flight in the same memory. the fields must not be accessed
+ * directly, use the flight api instead.
+ */
+typedef struct flightEntry_s {
+
+	/* stores the next flight of the same bucket */
+	struct flightEntry_s *next;
+
+	/* stores the hash and the length of the key */
+	unsigned long hash;
+	size_t keyLen;
+
+	/* stores the parked sockets in the order they joined */
+	flightWaiter_t *first, *last;
+
+} flightEntry_t;
+
+/**
+ * defines the structure of a group of flights. the fields must not be
+ * accessed directly, use the flight api instead.
+ */
+typedef struct {
+
+	/* stores the hash table of the flights */
+	flightEntry_t **buckets;
+	size_t bucketCount, count;
+
+	/* stores the number of flights started and of sockets parked */
+	unsigned long leaders, waiters;
+
+} flight_t;
+
+/**
+ * defines the maximum number of client groups tracked by the admission
+ * control. it must exceed SOCKET_MAX, so there is always a group without
+ * connections which can be reused.
+ */
+#ifndef ADMIT_ENTRY_MAX
+#define ADMIT_ENTRY_MAX (4096)
+#endif
+
+/**
+ * defines the limits of the admission control. clients are grouped by the
+ * leading bits of their address, the limits apply to each group. a value of 0
+ * means no limit.
+ */
+typedef struct {
+
+	/* stores the number of leading bits of ipv4 and ipv6 addresses which
+	 * form a group (e.g. 32 for single ipv4 addresses, 64 for ipv6 networks) */
+	int ipv4Prefix, ipv6Prefix;
+
+	/* stores the maximum number of concurrent connections */
+	unsigned int maxConnections;
+
+	/* stores the requests per second and the burst, every connection counts
+	 * as a request */
+	double rate, burst;
+
+	/* stores the bytes read per second and the burst */
+	double byteRate, byteBurst;
+
+} admitConfig_t;
+
+/**
+ * defines the counters of the admission control.
+ */
+typedef struct {
+
+	/* stores the number of connections accepted */
+	unsigned long accepted;
+
+	/* stores the number of connections rejected because of the connection
+	 * limit and the request rate */
+	unsigned long rejectedConnections, rejectedRate;
+
+	/* stores the number of requests rejected after the connection was
+	 * accepted */
+	unsigned long rejectedRequests;
+
+	/* stores how often reading from a connection was paused because of the
+	 * byte rate */
+	unsigned long throttled;
+
+	/* stores the number of groups forgotten to make room for new ones */
+	unsigned long evictions;
+
+} admitStats_t;
+
+/**
+ * defines the state of a group of clients. the fields must not be accessed
+ * directly, use the admission api instead.
+ */
+typedef struct admitEntry_s {
+
+	/* stores the next entry of the same bucket */
+	struct admitEntry_s *next;
+
+	/* stores the neighbours in the lru list */
+	struct admitEntry_s *newer, *older;
+
+	/* stores the masked address (family and address) and its hash */
+	unsigned char key[17];
+	unsigned long hash;
+
+	/* stores the number of open connections */
+	unsigned int connections;
+
+	/* stores the tokens of the request and the byte bucket and when they were
+	 * filled up the last time */
+	double tokens, byteTokens, updated;
+
+} admitEntry_t;
+
+/**
+ * defines the structure of the admission control. the memory used is fixed,
+ * the least recently used group without connections is forgotten to make room
+ * for a new one. the fields must not be accessed directly, use the admission
+ * api instead.
+ */
+typedef struct {
+
+	/* stores the limits */
+	admitConfig_t config;
+
+	/* stores all entries and the hash table */
+	admitEntry_t *entries, **buckets;
+	size_t count;
+
+	/* stores the most and least recently used entries */
+	admitEntry_t *newest, *oldest;
+
+	/* stores the counters */
+	admitStats_t stats;
+
+} admit_t;
+
+/**
+ * defines the maximum length of a proxy protocol v1 header including the
+ * line break, as defined by the specification.
+ */
+#define PROXY_V1_MAX (107)
+
+/**
+ * defines the results of the proxy protocol parser.
+ */
+typedef enum {
+
+	/* the data does not start with a valid header */
+	PROXY_ERROR,
+
+	/* the header is incomplete, more data is needed */
+	PROXY_MORE,
+
+	/* the header was parsed */
+	PROXY_DONE
+
+} proxyResult_t;
+
+/**
+ * defines the number of points a node of a hash ring gets on the ring per unit
+ * of weight. more points spread the keys more evenly but make changes of the
+ * ring more expensive.
+ */
+#ifndef RING_POINTS
+#define RING_POINTS (160)
+#endif
+
+/**
+ * defines the maximum weight of a node of a hash ring.
+ */
+#ifndef RING_WEIGHT_MAX
+#define RING_WEIGHT_MAX (1000)
+#endif
+
+/**
+ * defines the structure of a node of a hash ring. the name follows the
+ * structure in the same memory. the fields must not be accessed directly, use
+ * the ring api instead.
+ */
+typedef struct ringNode_s {
+
+	/* stores the next node */
+	struct ringNode_s *next;
+
+	/* stores the length of the name and the weight */
+	size_t len;
+	unsigned int weight;
+
+} ringNode_t;
+
+/**
+ * defines a point on a hash ring, the keys hashed between the previous point
+ * and this one belong to its node.
+ */
+typedef struct {
+
+	/* stores the position on the ring */
+	unsigned long hash;
+
+	/* stores the node owning the point */
+	ringNode_t *node;
+
+} ringPoint_t;
+
+/**
+ * defines the structure of a consistent hash ring (ketama). the points of a
+ * node only depend on its name and weight, so adding or removing a node only
+ * moves the keys of that node. the fields must not be accessed directly, use
+ * the ring api instead.
+ */
+typedef struct {
+
+	/* stores the nodes */
+	ringNode_t *nodes;
+	size_t count;
+
+	/* stores the points sorted by their position, they are computed again on
+	 * the next lookup after the nodes changed */
+	ringPoint_t *points;
+	size_t pointCount;
+	int isDirty;
+
+} ring_t;
+
+/**
+ * defines the number of helper threads resolving names. a slow lookup blocks
+ * a thread, not the event loop.
+ */
+#ifndef RESOLVE_THREADS
+#define RESOLVE_THREADS (4)
+#endif
+
+/**
+ * defines the maximum number of names kept in the cache of the resolver, the
+ * least recently used one is forgotten to make room for a new one.
+ */
+#ifndef RESOLVE_CACHE_MAX
+#define RESOLVE_CACHE_MAX (1024)
+#endif
+
+/**
+ * defines the maximum number of addresses kept for a name.
+ */
+#ifndef RESOLVE_ADDR_MAX
+#define RESOLVE_ADDR_MAX (4)
+#endif
+
+/**
+ * defines how long (in seconds) resolved names and failures are cached by
+ * default. getaddrinfo() does not return the ttl of the records.
+ */
+#ifndef RESOLVE_TTL
+#define RESOLVE_TTL (60)
+#endif
+
+#ifndef RESOLVE_NEGATIVE_TTL
+#define RESOLVE_NEGATIVE_TTL (5)
+#endif
+
+/**
+ * defines the results of resolveLookup().
+ */
+typedef enum {
+
+	/* the name is cached (or numeric), the callback was invoked already */
+	RESOLVE_CACHED,
+
+	/* the name is resolved in the background, the callback is invoked by
+	 * resolvePoll() */
+	RESOLVE_PENDING,
+
+	/* not enough memory or no helper thread */
+	RESOLVE_ERROR
+
+} resolveResult_t;
+
+/**
+ * defines the signature of the callback invoked when a name was resolved. it
+ * gets the name, the addresses (the port is 0), their number, the error code
+ * of getaddrinfo() (0 if there is none) and the custom argument.
+ */
+typedef void (*resolveCallback_t)(
+	const char*, const struct sockaddr_storage*, size_t, int, void*
+);
+
+/**
+ * defines a callback waiting for a name.
+ */
+typedef struct resolveWaiter_s {
+
+	/* stores the next waiter */
+	struct resolveWaiter_s *next;
+
+	/* stores the callback and its argument */
+	resolveCallback_t callback;
+	void *arg;
+
+} resolveWaiter_t;
+
+/**
+ * defines a name in the cache of the resolver. the name follows the structure
+ * in the same memory. the fields must not be accessed directly, use the
+ * resolver api instead.
+ */
+typedef struct resolveEntry_s {
+
+	/* stores the next entry of the same bucket */
+	struct resolveEntry_s *next;
+
+	/* stores the neighbours in the lru list */
+	struct resolveEntry_s *newer, *older;
+
+	/* stores the next entry in the queue of the helper threads or in the
+	 * list of resolved entries */
+	struct resolveEntry_s *nextJob;
+
+	/* stores the hash of the name and when the entry expires */
+	unsigned long hash;
+	double expires;
+
+	/* used to check whether the name is being resolved, the helper thread
+	 * owns the result fields then */
+	int isPending;
+
+	/* stores the result */
+	struct sockaddr_storage addrs[RESOLVE_ADDR_MAX];
+	size_t count;
+	int error;
+
+	/* stores the callbacks waiting for the result */
+	resolveWaiter_t *waiters;
+
+} resolveEntry_t;
+
+/**
+ * defines the counters of the resolver.
+ */
+typedef struct {
+
+	/* stores the lookups answered by the cache and by getaddrinfo() */
+	unsigned long hits, misses;
+
+	/* stores the lookups joining a pending lookup of the same name */
+	unsigned long coalesced;
+
+	/* stores the number of failed lookups */
+	unsigned long failures;
+
+	/* stores the number of names being resolved */
+	size_t pending;
+
+} resolveStats_t;
+
+/**
+ * defines the structure of a resolver. names are resolved with getaddrinfo()
+ * on helper threads, the results are handed to the event loop through a pipe.
+ * the fields must not be accessed directly, use the resolver api instead.
+ */
+typedef struct {
+
+	/* stores how long results and failures are cached (in seconds) */
+	double ttl, negativeTtl;
+
+	/* stores the hash table of the cache */
+	resolveEntry_t **buckets;
+	size_t bucketCount, count;
+
+	/* stores the most and least recently used entries */
+	resolveEntry_t *newest, *oldest;
+
+	/* stores the helper threads */
+	pthread_t threads[RESOLVE_THREADS];
+	size_t threadCount;
+
+	/* protects the queue, the list of resolved entries and the stop flag */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	/* stores the entries to resolve and the resolved ones */
+	resolveEntry_t *queue, *queueTail, *done;
+	int isStopping;
+
+	/* stores the pipe signalling resolved entries to the event loop */
+	int notify[2];
+
+	/* stores the counters */
+	resolveStats_t stats;
+
+} resolver_t;
+
+/**
+ * defines the events reported for a child process.
+ */
+typedef enum {
+
+	/* data was read from the standard output or error of the child, it is
+	 * appended to the buffer passed to the callback */
+	PROCESS_STDOUT,
+	PROCESS_STDERR,
+
+	/* the data written with processWrite() was sent completely */
+	PROCESS_DRAIN,
+
+	/* the child exited and its output was read completely, the process is
+	 * freed after the callback */
+	PROCESS_EXIT
+
+} processEvent_t;
+
+struct process_s;
+
+/**
+ * defines the signature of the callback of a child process. it gets the
+ * process, the event, the buffer of the output (null for the other events)
+ * and the custom argument.
+ */
+typedef void (*processCallback_t)(
+	struct process_s*, processEvent_t, buf_t*, void*
+);
+
+/**
+ * defines the structure of a child process. the fields must not be accessed
+ * directly, use the process api instead.
+ */
+typedef struct process_s {
+
+	/* stores the next running process */
+	struct process_s *next;
+
+	/* stores the process id */
+	pid_t pid;
+
+	/* stores the pipes of the standard input, output and error (-1 if they
+	 * are closed) and their buffers */
+	int fds[3];
+	buf_t buffers[3];
+
+	/* used to check whether the input is closed once it is written */
+	int isClosingInput;
+
+	/* used to check whether the child exited and stores its wait status */
+	int hasExited, status;
+
+	/* stores the callback and its argument */
+	processCallback_t callback;
+	void *arg;
+
+} process_t;
+
+/**
+ * defines the size of a sha-1 digest in bytes.
+ */
+#define HASH_SHA1_SIZE (20)
+
+/**
+ * defines the size of a sha-256 digest in bytes.
+ */
+#define HASH_SHA256_SIZE (32)
+
+/**
+ * defines the structure of a streaming form parser. the fields must not be
+ * accessed directly, use the form api instead.
+ */
+typedef struct {
+
+	/* stores the type of the form */
+	formType_t type;
+
+	/* stores the current state of the parser */
+	int state;
+
+	/* stores the multipart delimiter ("\r\n--" followed by the boundary) */
+	char delim[FORM_BOUNDARY_MAX + 4];
+
+	/* stores the length of the delimiter */
+	size_t delimLen;
+
+	/* stores the size of the headers of the current part */
+	size_t headerLen;
+
+	/* stores data which could not be parsed yet */
+	buf_t pending;
+
+	/* scratch buffers for the name, value and type of the current field */
+	buf_t name, value, mime;
+
+} formParser_t;
+
 /* --- buffer api ----------------------------------------------------------- */
 
 /**
- * appends the given data to the specified buffer. returns 1 if this operation
- * succeeded or 0 if not.
+ * appends the given data to the specified buffer. returns 1 if this operation
+ * succeeded or 0 if not.
+ */
+int bufAppend(buf_t* , const void*, size_t);
+
+/**
+ * makes sure that the given number of bytes can be appended to the buffer
+ * without reallocation. the free space starts at data + len and may be filled
+ * directly, len must be increased accordingly. returns 1 if this operation
+ * succeeded or 0 if not.
+ */
+int bufReserve(buf_t*, size_t);
+
+/**
+ * returns the data of the given buffer without removing it from the buffer. the
+ * pointer returned must not be free()ed manually.
+ */
+void *bufPeek(buf_t*, size_t*);
+
+/**
+ * returns the data of the given buffer and resets its data. the size of the
+ * data is stored in the second parameter. the data pointed to by the return
+ * value must be freed manually with free(). this function may return null if
+ * no data is present, the second parameter is left untouched.
+ */
+void* bufExtract(buf_t*, size_t*);
+
+/**
+ * removes the given number of bytes from the beginning of the buffer. if the
+ * buffer contains less data than that it is emptied. the memory of the buffer
+ * is kept for further use.
+ */
+void bufConsume(buf_t*, size_t);
+
+/**
+ * checks whether the given buffer contains data or not. returns 1 if the buffer
+ * contains data and 0 if not.
+ */
+int bufHasData(buf_t*);
+
+/**
+ * clears the data of the given buffer.
+ */
+void bufClear(buf_t*);
+
+/**
+ * set a new allocator function used for memory allocation. this should be done
+ * before any buffer is filled with data.
+ */
+void bufSetAlloc(bufAlloc_t);
+
+/* --- encoding api --------------------------------------------------------- */
+
+/**
+ * url encodes the given data and appends the result to the buffer. letters and
+ * digits are copied, a space is turned into '+' and everything else into a
+ * %XX sequence. returns 1 if everything is ok and 0 if not.
+ */
+int encUrlEncode(buf_t*, const void*, size_t);
+
+/**
+ * decodes the given url encoded data and appends the result to the buffer.
+ * '+' is turned into a space and every valid %XX sequence into the character
+ * it represents; invalid sequences are left untouched. returns 1 if everything
+ * is ok and 0 if not.
+ */
+int encUrlDecode(buf_t*, const void*, size_t);
+
+/**
+ * base64 encodes the given data (with padding) and appends the result to the
+ * buffer. returns 1 if everything is ok and 0 if not.
+ */
+int encBase64Encode(buf_t*, const void*, size_t);
+
+/**
+ * decodes the given base64 data and appends the result to the buffer. the
+ * padding is optional. returns 0 if the data is invalid (the buffer is left
+ * untouched) and 1 if everything is ok.
+ */
+int encBase64Decode(buf_t*, const void*, size_t);
+
+/**
+ * checks whether the given data is valid utf-8 (no overlong sequences, no
+ * surrogates and nothing above U+10FFFF). returns 1 if it is valid and 0 if
+ * not.
+ */
+int encIsUtf8(const void*, size_t);
+
+/* --- hash api ------------------------------------------------------------- */
+
+/**
+ * updates the given crc32c (castagnoli) checksum with the data and returns
+ * the new checksum. the initial checksum is 0. uses the crc32 instruction of
+ * the cpu if it is available.
+ */
+unsigned long hashCrc32c(unsigned long, const void*, size_t);
+
+/**
+ * computes the sha-1 digest of the given data and stores it in the third
+ * parameter, which must be able to hold HASH_SHA1_SIZE bytes.
+ */
+void hashSha1(const void*, size_t, unsigned char*);
+
+/**
+ * computes the sha-256 digest of the given data and stores it in the third
+ * parameter, which must be able to hold HASH_SHA256_SIZE bytes.
+ */
+void hashSha256(const void*, size_t, unsigned char*);
+
+/* --- websocket api -------------------------------------------------------- */
+
+/**
+ * appends the response to a websocket upgrade request with the given
+ * Sec-WebSocket-Key to the buffer. the protocol is optional (null means none).
+ * returns 0 if the key is invalid or the buffer could not be written and 1 if
+ * everything is ok.
+ */
+int wsHandshake(buf_t*, const char*, size_t, const char*);
+
+/**
+ * initializes the given websocket connection.
+ */
+void wsInit(wsConn_t*);
+
+/**
+ * processes all complete frames of the input buffer and removes them from it.
+ * pings are answered and close frames are replied directly in the output
+ * buffer, all other messages are passed to the callback once they are
+ * complete. returns 1 if the connection is still open, 2 if it was closed
+ * properly and 0 in case of an error. in case of a protocol error a close
+ * frame is appended to the output buffer. in the last two cases the socket
+ * should be closed after the output buffer is flushed.
+ */
+int wsExec(wsConn_t*, buf_t*, buf_t*, wsCallback_t, void*);
+
+/**
+ * appends a frame with the given opcode and payload to the buffer. control
+ * frames can have at most 125 bytes payload. returns 0 if the close handshake
+ * was started already or the frame is invalid and 1 if everything is ok.
+ */
+int wsSend(wsConn_t*, buf_t*, wsOpcode_t, const void*, size_t);
+
+/**
+ * starts the close handshake by appending a close frame with the given code
+ * (0 means none) and reason to the buffer. returns 1 if everything is ok and
+ * 0 if not.
+ */
+int wsClose(wsConn_t*, buf_t*, int, const char*, size_t);
+
+/**
+ * frees the resources of the given websocket connection.
+ */
+void wsClear(wsConn_t*);
+
+/* --- hpack api ------------------------------------------------------------ */
+
+/**
+ * initializes the given hpack decoder.
+ */
+void hpackInit(hpackDecoder_t*);
+
+/**
+ * decodes the given header block and invokes the callback for every header
+ * field. returns 1 if everything is ok and 0 if the block is invalid (this is
+ * a connection error, the state of the decoder is undefined afterwards).
+ */
+int hpackDecode(hpackDecoder_t*, const void*, size_t, hpackCallback_t, void*);
+
+/**
+ * appends the given header field to the buffer (without using the dynamic
+ * table). returns 1 if everything is ok and 0 if not.
+ */
+int hpackEncode(buf_t*, const char*, size_t, const char*, size_t);
+
+/**
+ * frees the resources of the given hpack decoder.
+ */
+void hpackClear(hpackDecoder_t*);
+
+/* --- http/2 api ----------------------------------------------------------- */
+
+/**
+ * initializes the given http/2 connection. the connection expects the client
+ * connection preface (prior knowledge).
+ */
+void h2Init(h2Conn_t*);
+
+/**
+ * upgrades a http/1.1 connection. the 101 response and the settings of the
+ * server are appended to the buffer. the second parameter is the value of the
+ * HTTP2-Settings header. the request of the upgrade becomes stream 1, its
+ * response must be sent with h2SendHeaders() and h2SendData(). returns 1 if
+ * everything is ok and 0 if the settings are invalid.
+ */
+int h2Upgrade(h2Conn_t*, buf_t*, const char*, size_t);
+
+/**
+ * processes all complete frames of the input buffer and removes them from it.
+ * settings, pings and flow control are handled directly, requests are passed
+ * to the callback stream by stream. returns 1 if the connection is still
+ * open, 2 if the client sent GOAWAY and 0 in case of an error (GOAWAY is
+ * appended to the output buffer). in the last two cases the socket should be
+ * closed after the output buffer is flushed.
+ */
+int h2Exec(h2Conn_t*, buf_t*, buf_t*, h2Callback_t, void*);
+
+/**
+ * appends the given header fields of a response to the buffer. names are
+ * converted to lower case. returns 0 if the stream is not open and 1 if
+ * everything is ok.
+ */
+int h2SendHeaders(
+	h2Conn_t*, buf_t*, unsigned long, const h2Header_t*, size_t, int
+);
+
+/**
+ * appends data of a response to the buffer. data exceeding the flow control
+ * windows is kept and sent as soon as the client allows it. returns 0 if the
+ * stream is not open and 1 if everything is ok.
+ */
+int h2SendData(h2Conn_t*, buf_t*, unsigned long, const void*, size_t, int);
+
+/**
+ * resets the given stream with the error code. returns 0 if the stream is not
+ * open and 1 if everything is ok.
+ */
+int h2Reset(h2Conn_t*, buf_t*, unsigned long, h2Error_t);
+
+/**
+ * appends GOAWAY with the given error code to the buffer. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int h2Close(h2Conn_t*, buf_t*, h2Error_t);
+
+/**
+ * frees the resources of the given http/2 connection.
+ */
+void h2Clear(h2Conn_t*);
+
+/* --- compression api ------------------------------------------------------ */
+
+/**
+ * chooses the compression format for the given value of the Accept-Encoding
+ * header. gzip is preferred over deflate, codings with q=0 are not used.
+ * returns the format or -1 if the client does not accept compressed data.
+ */
+int compNegotiate(const char*, size_t);
+
+/**
+ * compresses the given data with the format and level and appends the result
+ * to the buffer. if the last parameter is set the result is kept in the
+ * compression cache and identical data is not compressed again. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int compCompress(buf_t*, const void*, size_t, compFormat_t, int, int);
+
+/**
+ * sets the maximum size of the compression cache in bytes, the least recently
+ * used entries are removed if necessary. 0 disables the cache.
+ */
+void compSetCacheSize(size_t);
+
+/**
+ * stores the number of cache hits and misses and the current size of the
+ * cache in bytes.
+ */
+void compGetCacheStats(size_t*, size_t*, size_t*);
+
+/**
+ * frees the compression cache and the internal compression state.
+ */
+void compCleanup(void);
+
+/**
+ * initializes the given compression filter with the format and the level.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int compInit(compFilter_t*, compFormat_t, int);
+
+/**
+ * compresses the given data and appends the output to the buffer. the data
+ * may be passed in arbitrary pieces, see compFlush_t for the last parameter.
+ * returns 0 in case of an error or if the filter was finished already and 1
+ * if everything is ok.
+ */
+int compWrite(compFilter_t*, buf_t*, const void*, size_t, compFlush_t);
+
+/**
+ * frees the resources of the given compression filter.
+ */
+void compClear(compFilter_t*);
+
+/* --- cache api ------------------------------------------------------------ */
+
+/**
+ * initializes the given cache with its maximum size in bytes. the size
+ * includes the keys and the bookkeeping of the entries.
+ */
+void cacheInit(cache_t*, size_t);
+
+/**
+ * stores a copy of the given value under the key. the value expires after the
+ * given number of seconds (0 means never) and may be served stale for the
+ * number of seconds of the last parameter afterwards. least recently used
+ * entries are evicted to make room. returns 1 if everything is ok and 0 if
+ * the value does not fit or there is not enough memory.
+ */
+int cacheSet(
+	cache_t*, const void*, size_t, const void*, size_t, long, long
+);
+
+/**
+ * looks up the value of the given key. the value and its length are stored in
+ * the last two parameters, the value stays valid until the cache is modified.
+ * returns the result of the lookup.
+ */
+cacheResult_t cacheGet(cache_t*, const void*, size_t, const void**, size_t*);
+
+/**
+ * looks up the value of the given key and appends it to the buffer. returns
+ * the result of the lookup, CACHE_MISS if the buffer could not be written.
+ */
+cacheResult_t cacheWrite(cache_t*, buf_t*, const void*, size_t);
+
+/**
+ * removes the given key from the cache. returns 1 if it was cached and 0 if
+ * not.
+ */
+int cacheDelete(cache_t*, const void*, size_t);
+
+/**
+ * returns the statistics of the given cache.
+ */
+const cacheStats_t *cacheGetStats(cache_t*);
+
+/**
+ * removes all entries and frees the resources of the given cache. the cache
+ * can be used again afterwards.
+ */
+void cacheClear(cache_t*);
+
+/* --- file api ------------------------------------------------------------- */
+
+/**
+ * initializes the given static file server with its root directory. returns
+ * 1 if everything is ok and 0 if the directory can not be opened.
+ */
+int fileInit(fileServer_t*, const char*);
+
+/**
+ * adds an index file name, which is served for requests to a directory.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int fileAddIndex(fileServer_t*, const char*);
+
+/**
+ * sets the content type of the given file name extension (without the dot).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int fileSetMime(fileServer_t*, const char*, const char*);
+
+/**
+ * sets the max-age of the Cache-Control header, a negative value omits the
+ * header.
+ */
+void fileSetMaxAge(fileServer_t*, long);
+
+/**
+ * answers a GET or HEAD request for a file below the root directory. the
+ * response header is appended to the buffer and the content is queued with
+ * serverSendFile() for the given client socket. conditional requests
+ * (If-None-Match, If-Modified-Since) and single byte ranges (Range, If-Range)
+ * are supported. returns the status code of the response or 0 if the request
+ * was not answered (other method, invalid path or file not found).
+ */
+int fileServe(fileServer_t*, int, buf_t*, const fileRequest_t*);
+
+/**
+ * stores the number of requests answered from the cache, the number of files
+ * opened and the number of files currently open in the given parameters.
+ */
+void fileGetStats(fileServer_t*, unsigned long*, unsigned long*, size_t*);
+
+/**
+ * frees the resources of the given static file server.
+ */
+void fileClear(fileServer_t*);
+
+/* --- router api ----------------------------------------------------------- */
+
+/**
+ * initializes the given router.
+ */
+void routerInit(router_t*);
+
+/**
+ * adds a route for the method (null for any method) and the pattern to the
+ * router. the pattern is a path starting with a slash, a segment starting with
+ * a colon (e.g. /users/:id) matches any single path segment and a last segment
+ * starting with an asterisk (e.g. *path) matches the rest of the path. returns
+ * 1 if everything is ok and 0 if the pattern is invalid, the route exists
+ * already or there is not enough memory.
+ */
+int routerAdd(router_t*, const char*, const char*, int);
+
+/**
+ * looks up the route for the method and the path of the given length. static
+ * segments take precedence over parameters and parameters over wildcards. the
+ * handler and the parameters are stored in the last parameter.
+ */
+routeResult_t routerMatch(
+	router_t*, const char*, const char*, size_t, routeMatch_t*
+);
+
+/**
+ * returns the number of routes of the given router.
+ */
+size_t routerGetCount(router_t*);
+
+/**
+ * frees all routes of the given router.
+ */
+void routerClear(router_t*);
+
+/* --- flight api ----------------------------------------------------------- */
+
+/**
+ * initializes the given group of flights.
+ */
+void flightInit(flight_t*);
+
+/**
+ * joins the flight of the given key with the client socket. the first socket
+ * becomes the leader and must compute the value, every other socket is parked
+ * (reading is paused) until flightFinish() is called for the key.
+ */
+flightResult_t flightJoin(flight_t*, const void*, size_t, int);
+
+/**
+ * finishes the flight of the given key. reading is resumed on every parked
+ * socket and the callback is invoked with the socket, its output buffer and
+ * the given argument. sockets closed in the meantime are left alone, even if
+ * their descriptor was reused. the flight is removed before, so the callback
+ * may start a new one. returns the number of sockets woken.
+ */
+size_t flightFinish(flight_t*, const void*, size_t, flightCallback_t, void*);
+
+/**
+ * removes the given client socket from every flight it is parked on, used
+ * when the socket is closed (calling it is optional, see flightFinish()).
+ * returns 1 if it was parked and 0 if not.
  */
-int bufAppend(buf_t* , const void*, size_t);
+int flightCancel(flight_t*, int);
 
 /**
- * returns the data of the given buffer without removing it from the buffer. the
- * pointer returned must not be free()ed manually.
+ * stores the number of flights started, the number of sockets parked and the
+ * number of flights in progress in the given parameters.
  */
-void *bufPeek(buf_t*, size_t*);
+void flightGetStats(flight_t*, unsigned long*, unsigned long*, size_t*);
 
 /**
- * returns the data of the given buffer and resets its data. the size of the
- * data is stored in the second parameter. the data pointed to by the return
- * value must be freed manually with free(). this function may return null if
- * no data is present, the second parameter is left untouched.
+ * frees all flights without waking the parked sockets.
  */
-void* bufExtract(buf_t*, size_t*);
+void flightClear(flight_t*);
+
+/* --- admission api -------------------------------------------------------- */
 
 /**
- * checks whether the given buffer contains data or not. returns 1 if the buffer
- * contains data and 0 if not.
+ * initializes the given admission control with the limits. returns 1 if
+ * everything is ok and 0 if there is not enough memory.
  */
-int bufHasData(buf_t*);
+int admitInit(admit_t*, const admitConfig_t*);
 
 /**
- * clears the data of the given buffer.
+ * changes the limits of the given admission control, the state of the known
+ * groups is kept.
  */
-void bufClear(buf_t*);
+void admitSetConfig(admit_t*, const admitConfig_t*);
 
 /**
- * set a new allocator function used for memory allocation. this should be done
- * before any buffer is filled with data.
+ * admits a new connection from the given address. returns the group of the
+ * client or null if the connection exceeds the connection limit or the
+ * request rate of the group.
  */
-void bufSetAlloc(bufAlloc_t);
+admitEntry_t *admitConnect(admit_t*, const struct sockaddr*);
+
+/**
+ * releases a connection admitted with admitConnect().
+ */
+void admitDisconnect(admit_t*, admitEntry_t*);
+
+/**
+ * takes the given number of requests from the request bucket of the group.
+ * returns 1 if the requests are admitted and 0 if not.
+ */
+int admitRequest(admit_t*, admitEntry_t*, double);
+
+/**
+ * takes the given number of bytes read from the byte bucket of the group.
+ * returns the number of milliseconds reading must pause or 0.
+ */
+long admitRead(admit_t*, admitEntry_t*, size_t);
+
+/**
+ * returns the counters of the given admission control.
+ */
+const admitStats_t *admitGetStats(admit_t*);
+
+/**
+ * frees the resources of the given admission control.
+ */
+void admitClear(admit_t*);
+
+/* --- proxy protocol api --------------------------------------------------- */
+
+/**
+ * parses the proxy protocol header (v1 or v2) at the start of the given data.
+ * if the header is complete the source address is stored in the third
+ * parameter and the length of the header in the fourth parameter. the family
+ * of the address is AF_UNSPEC if the header carries none (e.g. health checks
+ * of the proxy), the address of the connection must be used then.
+ */
+proxyResult_t proxyParse(
+	const void*, size_t, struct sockaddr_storage*, size_t*
+);
+
+/* --- ring api ------------------------------------------------------------- */
+
+/**
+ * initializes the given hash ring without any node.
+ */
+void ringInit(ring_t*);
+
+/**
+ * adds the node with the given name and weight (1 to RING_WEIGHT_MAX) to the
+ * ring or changes the weight of the node if it is known already. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int ringAdd(ring_t*, const void*, size_t, unsigned int);
+
+/**
+ * removes the node with the given name from the ring. returns 1 if the node
+ * was removed and 0 if there is no such node.
+ */
+int ringRemove(ring_t*, const void*, size_t);
+
+/**
+ * returns the name of the node the given key belongs to and stores its length
+ * in the last parameter. returns null if the ring is empty or there is not
+ * enough memory to build it.
+ */
+const char *ringLookup(ring_t*, const void*, size_t, size_t*);
+
+/**
+ * returns the number of nodes of the given ring.
+ */
+size_t ringGetCount(ring_t*);
+
+/**
+ * frees the resources of the given ring.
+ */
+void ringClear(ring_t*);
+
+/* --- resolver api --------------------------------------------------------- */
+
+/**
+ * initializes the given resolver. the helper threads are started on the first
+ * lookup. returns 1 if everything is ok and 0 if not.
+ */
+int resolveInit(resolver_t*);
+
+/**
+ * changes how long results and failures are cached (in seconds).
+ */
+void resolveSetTtl(resolver_t*, double, double);
+
+/**
+ * resolves the given name. cached and numeric names are answered right away,
+ * every other name is resolved by a helper thread and the callback is invoked
+ * by resolvePoll(). lookups of a name being resolved already wait for the
+ * same result.
+ */
+resolveResult_t resolveLookup(
+	resolver_t*, const char*, resolveCallback_t, void*
+);
+
+/**
+ * returns the descriptor which becomes readable when names were resolved.
+ */
+int resolveGetFd(resolver_t*);
+
+/**
+ * invokes the callbacks of all names resolved since the last call.
+ */
+void resolvePoll(resolver_t*);
+
+/**
+ * returns the counters of the given resolver.
+ */
+const resolveStats_t *resolveGetStats(resolver_t*);
+
+/**
+ * stops the helper threads and frees the resources of the given resolver. the
+ * callbacks still waiting are not invoked.
+ */
+void resolveClear(resolver_t*);
+
+/* --- signal api --------------------------------------------------------- */
+
+/**
+ * handles the given signal in the event loop: the signal handler only writes
+ * the number into a pipe watched by the loop, the callback is invoked from
+ * serverExec() like any other event. calling it again changes the callback.
+ * returns 1 if everything is ok and 0 if the signal cannot be caught.
+ */
+int signalWatch(int, signalCallback_t, void*);
+
+/**
+ * stops handling the given signal and restores the disposition it had before
+ * signalWatch() (e.g. the handlers of main.c).
+ */
+void signalUnwatch(int);
+
+/* --- process api -------------------------------------------------------- */
+
+/**
+ * starts the program of the given argument vector (searched in PATH) with the
+ * given environment (null for the environment of the server) using
+ * posix_spawn(). the standard input, output and error of the child are pipes
+ * watched by the event loop. returns the process or null if it was not
+ * possible to start it.
+ */
+process_t *processSpawn(char *const*, char *const*, processCallback_t, void*);
+
+/**
+ * queues data for the standard input of the child. returns 1 if everything is
+ * ok and 0 if not (e.g. the input was closed).
+ */
+int processWrite(process_t*, const void*, size_t);
+
+/**
+ * closes the standard input of the child once the queued data is written.
+ */
+void processCloseInput(process_t*);
+
+/**
+ * sends the given signal to the child. returns 1 if everything is ok and 0
+ * if not.
+ */
+int processKill(process_t*, int);
+
+/**
+ * returns the process id of the child.
+ */
+pid_t processGetPid(process_t*);
+
+/**
+ * returns the wait status of the child, it is only valid for PROCESS_EXIT.
+ */
+int processGetStatus(process_t*);
+
+/**
+ * returns the running process with the given process id or null if there is
+ * none.
+ */
+process_t *processFind(pid_t);
+
+/* --- form api ------------------------------------------------------------- */
+
+/**
+ * initializes the form parser for the given content type. supported are
+ * "application/x-www-form-urlencoded" and "multipart/form-data" with a
+ * boundary parameter. returns 1 if the content type is supported and 0 if
+ * not.
+ */
+int formInit(formParser_t*, const char*);
+
+/**
+ * feeds the given data into the form parser. the callback is invoked for
+ * every event found in the data. returns 1 if more data is required, 2 if the
+ * form is complete and 0 in case of an error.
+ */
+int formExec(formParser_t*, const void*, size_t, formCallback_t, void*);
+
+/**
+ * tells the form parser that there is no more data. the last field of an
+ * urlencoded form is reported at this point. returns 2 if the form is
+ * complete and 0 if not.
+ */
+int formFinish(formParser_t*, formCallback_t, void*);
+
+/**
+ * frees all resources of the form parser.
+ */
+void formClear(formParser_t*);
+
+/**
+ * parses the given query string (without the leading '?'). the callback is
+ * invoked for every field. returns 1 if everything is ok and 0 if not.
+ */
+int formParseQuery(const void*, size_t, formCallback_t, void*);
+
+/* --- json api ------------------------------------------------------------- */
+
+/**
+ * initializes the reader with the given document. the data must stay valid as
+ * long as the reader is used.
+ */
+void jsonReaderInit(jsonReader_t*, const void*, size_t);
+
+/**
+ * reads the next token of the document. the reader validates the structure of
+ * the document, keys are reported as JSON_KEY. after JSON_STRING and JSON_KEY
+ * the str and strLen fields contain the decoded string, after JSON_NUMBER the
+ * number field contains the value. returns JSON_END at the end of the
+ * document and JSON_ERROR in case of an error (the error field contains a
+ * message then).
+ */
+jsonToken_t jsonNext(jsonReader_t*);
+
+/**
+ * frees all resources of the reader.
+ */
+void jsonReaderClear(jsonReader_t*);
+
+/**
+ * appends the given string as json string (including the quotes) to the
+ * buffer. returns 1 if everything is ok and 0 if not.
+ */
+int jsonWriteString(buf_t*, const void*, size_t);
+
+/**
+ * appends the given number to the buffer. integral values are written without
+ * fraction, all other values with the given number of significant digits.
+ * returns 0 if the number can not be represented in json (nan and infinity)
+ * or in case of an error and 1 otherwise.
+ */
+int jsonWriteNumber(buf_t*, double, int);
+
+/* --- messagepack api ------------------------------------------------------ */
+
+/**
+ * initializes the scanner. a scanner is used to find out whether a complete
+ * message is available without decoding it.
+ */
+void mpackScanInit(mpackScanner_t*);
+
+/**
+ * scans the given data for a complete message. the data must always start
+ * with the beginning of the message and may grow between the calls, the
+ * scanner continues where it stopped. returns 1 if more data is required, 2
+ * if the message is complete (its length is stored in the pos field of the
+ * scanner) and 0 if the data is invalid or the message is too big.
+ */
+int mpackScan(mpackScanner_t*, const void*, size_t);
+
+/**
+ * initializes the reader with the given data. the data must stay valid as long
+ * as the reader is used.
+ */
+void mpackReaderInit(mpackReader_t*, const void*, size_t);
+
+/**
+ * reads the next value. after MPACK_NUMBER the number field contains the
+ * value, after MPACK_STRING, MPACK_BINARY and MPACK_EXT the str and strLen
+ * fields contain the payload (and extType the type of the extension) and
+ * after MPACK_ARRAY and MPACK_MAP the count field contains the number of
+ * elements (a map with count n is followed by n keys and n values). returns
+ * MPACK_END if there is not enough data for the next value and MPACK_ERROR if
+ * the data is invalid.
+ */
+mpackToken_t mpackNext(mpackReader_t*);
+
+/**
+ * appends nil to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteNil(buf_t*);
+
+/**
+ * appends a boolean to the buffer. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteBoolean(buf_t*, int);
+
+/**
+ * appends a number to the buffer. integral numbers are written in the
+ * smallest integer format, all other numbers as 64 bit float. returns 1 if
+ * everything is ok and 0 if not.
+ */
+int mpackWriteNumber(buf_t*, double);
+
+/**
+ * appends a string to the buffer. the binary format is used if the last
+ * parameter is not 0. returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteString(buf_t*, const void*, size_t, int);
+
+/**
+ * appends the header of an array with the given number of elements to the
+ * buffer. the elements have to be written afterwards. returns 1 if everything
+ * is ok and 0 if not.
+ */
+int mpackWriteArray(buf_t*, unsigned long);
+
+/**
+ * appends the header of a map with the given number of pairs to the buffer.
+ * the keys and values have to be written afterwards (key, value, key, ...).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int mpackWriteMap(buf_t*, unsigned long);
 
 /* --- log api -------------------------------------------------------------- */
 
@@ -226,11 +2524,12 @@ void logWrite(const char*);
 int socketOpenServer(const char*, const char*);
 
 /**
- * accepts a new client connection on the given server socket. returns either
- * the new socket descriptor (value >= 0) or -1 (INVALID_SOCKET) in case of
- * error.
+ * accepts a new client connection on the given server socket. the address of
+ * the client is stored in the second parameter unless it is null. returns
+ * either the new socket descriptor (value >= 0) or -1 (INVALID_SOCKET) in
+ * case of error.
  */
-int socketAccept(int);
+int socketAccept(int, struct sockaddr_storage*);
 
 /**
  * reads data from the socket and stores it in the given buffer. returns 1 if
@@ -246,11 +2545,33 @@ int socketRead(int, buf_t*);
  */
 int socketWrite(int, buf_t*);
 
+/**
+ * writes the given data into the specified socket. if the last parameter is
+ * set more data follows right away, so the kernel may hold the data back to
+ * send it together (e.g. a header in front of a file). returns the number of
+ * bytes written, which may be less than requested, or -1 in case of an error.
+ */
+ssize_t socketWriteData(int, const void*, size_t, int);
+
+/**
+ * writes up to the given number of bytes of the file at the offset into the
+ * specified socket. the offset is advanced by the number of bytes written.
+ * uses sendfile() where it is available, so the data is not copied into user
+ * space. returns the number of bytes written or -1 in case of an error.
+ */
+ssize_t socketSendFile(int, int, off_t*, size_t);
+
 /**
  * closes the specified socket.
  */
 void socketClose(int);
 
+/**
+ * closes the specified socket with a reset instead of the normal shutdown, so
+ * no state is kept for it (TIME_WAIT). used to drop unwanted connections.
+ */
+void socketReset(int);
+
 /**
  * returns the address and the port of the connected peer. fills the second and
  * third parameter with data. the pointer stored in the second parameter points
@@ -261,12 +2582,26 @@ void socketClose(int);
  */
 int socketGetPeerAddr(int, const char**, int*);
 
+/**
+ * returns the address and the port stored in the given address structure.
+ * fills the second and third parameter with data. the pointer stored in the
+ * second parameter points to a static address and must not be free()ed.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int socketFormatAddr(const struct sockaddr_storage*, const char**, int*);
+
 /**
  * does the same as socketGetPeerAddr() but for server sockets. returns the
  * address bound to the socket.
  */
 int socketGetBoundAddr(int, const char**, int*);
 
+/**
+ * reads the tcp information (TCP_INFO) of the given socket. returns 1 if
+ * everything is ok and 0 if not or if the system does not support it.
+ */
+int socketGetTcpInfo(int, tcpInfo_t*);
+
 /* --- server api ----------------------------------------------------------- */
 
 /**
@@ -316,11 +2651,165 @@ int serverOpenSocket(const char*, const char*);
  */
 void serverCloseSocket(int);
 
+/**
+ * stops reading from the given client socket. the data already stored in the
+ * input buffer is left untouched and no more read events are triggered for
+ * this socket until serverResumeRead() is called. this is used to apply
+ * backpressure when the consumer of the data is slower than the client.
+ */
+void serverPauseRead(int);
+
+/**
+ * resumes reading from a client socket previously paused with
+ * serverPauseRead().
+ */
+void serverResumeRead(int);
+
+/**
+ * queues a part of a file (descriptor, offset and length) for sending on the
+ * given client socket. the data already in the output buffer is sent first,
+ * data appended later is sent after the file. the descriptor is duplicated, so
+ * the caller may close it. only one file can be queued per socket. returns 1
+ * if everything is ok and 0 if not (e.g. a file is queued already).
+ */
+int serverSendFile(int, int, off_t, size_t);
+
+/**
+ * enables the admission control for new connections with the given limits or
+ * disables it (null). connections exceeding the limits of their client are
+ * dropped right after accept(), before any callback is invoked, reading from
+ * a client exceeding its byte rate is paused. connections which are open
+ * already are not affected. returns 1 if everything is ok and 0 if not.
+ */
+int serverSetAdmission(const admitConfig_t*);
+
+/**
+ * takes the given number of requests from the request rate of the client of
+ * the given socket. returns 1 if the requests are admitted (or there is no
+ * admission control for the socket) and 0 if not.
+ */
+int serverAdmitRequest(int, double);
+
+/**
+ * returns the counters of the admission control or null if it is disabled.
+ */
+const admitStats_t *serverGetAdmitStats(void);
+
+/**
+ * enables (1) or disables (0) the proxy protocol for the given server socket.
+ * new connections of the socket must start with a proxy protocol header (v1
+ * or v2), which is removed before any callback is invoked. the accept event is
+ * delayed until the header was read and the address of the client socket is
+ * the one sent by the proxy. connections with an invalid header are dropped
+ * silently. returns 1 if everything is ok and 0 if not.
+ */
+int serverSetProxyProtocol(int, int);
+
+/**
+ * resolves the given name without blocking the event loop, see
+ * resolveLookup(). the callback of a name which is not cached is invoked from
+ * serverExec() once a helper thread resolved it.
+ */
+resolveResult_t serverResolve(const char*, resolveCallback_t, void*);
+
+/**
+ * changes how long the resolver caches results and failures (in seconds).
+ * returns 1 if everything is ok and 0 if not.
+ */
+int serverSetResolveTtl(double, double);
+
+/**
+ * returns the counters of the resolver or null if it was not used yet.
+ */
+const resolveStats_t *serverGetResolveStats(void);
+
+/**
+ * returns the counters of the server.
+ */
+const serverStats_t *serverGetStats(void);
+
+/**
+ * appends the counters of the server in the prometheus text format to the
+ * given buffer. returns 1 if everything is ok and 0 if not.
+ */
+int serverFormatStats(buf_t*);
+
+/**
+ * enables (1) or disables (0) the statistics endpoint on the given server
+ * socket. every request to a new connection of the socket is answered with
+ * the counters in the prometheus text format (see serverFormatStats()) by the
+ * server itself, the callback is not invoked for these connections. returns 1
+ * if everything is ok and 0 if not.
+ */
+int serverSetStatsEndpoint(int, int);
+
+/**
+ * enables (1) or disables (0) measuring the time spent in the callbacks of
+ * every connection and sets the interval in seconds the tcp information of
+ * all connections is sampled in (0 disables it). the bytes and callbacks of
+ * the connections are always counted. returns 1 if everything is ok and 0 if
+ * not.
+ */
+int serverSetAccounting(int, double);
+
+/**
+ * fills the accounting of the given client socket. returns 1 if everything is
+ * ok and 0 if there is no such client.
+ */
+int serverGetConnStats(int, connStats_t*);
+
+/**
+ * stores the accounting of up to the given number of client connections with
+ * the largest values of the given metric (in descending order). returns the
+ * number of connections stored.
+ */
+size_t serverGetTopConns(connMetric_t, connStats_t*, size_t);
+
+/**
+ * appends a table of the given number of client connections with the largest
+ * values of the given metric to the buffer. returns 1 if everything is ok and
+ * 0 if not.
+ */
+int serverFormatTopConns(buf_t*, connMetric_t, size_t);
+
+/**
+ * watches the given descriptor (e.g. a pipe) for the given events (WATCH_READ
+ * and WATCH_WRITE) and invokes the callback when it is ready. calling it again
+ * with the same callback changes the events and the argument. the descriptor
+ * is neither read nor closed by the server and the callback must consume the
+ * event (e.g. read the data), otherwise it is invoked again right away.
+ * watched descriptors keep the server running like sockets. returns 1 if
+ * everything is ok and 0 if the descriptor is invalid, a socket of the server
+ * or watched with another callback.
+ */
+int serverWatchFd(int, int, watchCallback_t, void*);
+
+/**
+ * stops watching the given descriptor, it is not closed.
+ */
+void serverUnwatchFd(int);
+
+/**
+ * returns the output buffer of the given client socket or null if there is no
+ * such socket. the socket is put into the write set, so data appended to the
+ * buffer outside of the callback of the socket (e.g. the answer to a parked
+ * request) is sent as well.
+ */
+buf_t *serverGetOutput(int);
+
+/**
+ * returns the id of the given client socket or 0 if there is no such socket.
+ * unlike the descriptor, the id of a connection is never reused, it tells
+ * whether a descriptor still refers to the same connection.
+ */
+unsigned long serverGetSocketId(int);
+
 /**
  * returns the address and port of the given socket. for server sockets this is
  * the address the socket is bound to and for client sockets this is the peer
- * address. the address and port are stored in the second and third parameter.
- * returns 1 if everything is ok and 0 if not.
+ * address (or the client address sent with the proxy protocol). the address
+ * and port are stored in the second and third parameter. returns 1 if
+ * everything is ok and 0 if not.
  */
 int serverGetSocketAddr(int, const char**, int*);
 
@@ -370,7 +2859,7 @@ int serverChangeUserAndJail(const char*, const char*);
 int serverDaemonize(void);
 
 /**
- * shuts the server down. this function literally does nothing.
+ * shuts the server down, it stops the helper threads of the resolver.
  */
 void serverShutdown(void);
 
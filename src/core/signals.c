@@ -0,0 +1,211 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * defines the number of signals, NSIG is not part of posix.
+ */
+#ifdef NSIG
+#define _SIGNAL_MAX NSIG
+#else
+#define _SIGNAL_MAX (65)
+#endif
+
+/**
+ * defines the state of a watched signal.
+ */
+typedef struct {
+
+	/* stores the callback (null if the signal is not watched) and its
+	 * argument */
+	signalCallback_t callback;
+	void *arg;
+
+	/* stores the disposition the signal had before */
+	struct sigaction previous;
+
+} _signal_t;
+
+/**
+ * stores the state of all signals.
+ */
+static _signal_t _signals[_SIGNAL_MAX];
+
+/**
+ * stores the number of watched signals.
+ */
+static int _watchCount;
+
+/**
+ * stores the pipe the signal handler writes the signal numbers to.
+ */
+static int _pipe[2] = {-1, -1};
+
+/**
+ * the signal handler of all watched signals, it only wakes up the event loop.
+ */
+static void _handleSignal(int sigNo)
+{
+	int error = errno;
+	unsigned char byte = (unsigned char) sigNo;
+
+	if(write(_pipe[1], &byte, 1) < 0)
+	{
+		/* the pipe is full, the event loop is woken up anyway */
+	}
+
+	errno = error;
+}
+
+/**
+ * invokes the callbacks of the signals written into the pipe.
+ */
+static void _dispatch(int fd, int events, void *arg)
+{
+	unsigned char signals[64];
+	ssize_t count, i;
+
+	while((count = read(fd, signals, sizeof(signals))) > 0)
+	{
+		for(i=0;i<count;++i)
+		{
+			/* the signal may have been unwatched by a previous callback */
+			if(signals[i] < _SIGNAL_MAX
+				&& _signals[signals[i]].callback != NULL)
+			{
+				_signals[signals[i]].callback(
+					signals[i], _signals[signals[i]].arg
+				);
+			}
+		}
+	}
+}
+
+/**
+ * creates the pipe, returns 1 if everything is ok and 0 if not.
+ */
+static int _preparePipe(void)
+{
+	int i;
+
+	if(_pipe[0] >= 0)
+	{
+		return 1;
+	}
+
+	if(pipe(_pipe) != 0)
+	{
+		return 0;
+	}
+
+	/* the handler must never block, the loop reads until it is empty */
+	for(i=0;i<2;++i)
+	{
+		fcntl(_pipe[i], F_SETFL, fcntl(_pipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	return 1;
+}
+
+/**
+ * handles the given signal in the event loop: the signal handler only writes
+ * the number into a pipe watched by the loop, the callback is invoked from
+ * serverExec() like any other event. calling it again changes the callback.
+ * returns 1 if everything is ok and 0 if the signal cannot be caught.
+ */
+int signalWatch(int sigNo, signalCallback_t callback, void *arg)
+{
+	struct sigaction action;
+
+	if(sigNo <= 0 || sigNo >= _SIGNAL_MAX || sigNo > 255 || callback == NULL
+		|| !_preparePipe())
+	{
+		return 0;
+	}
+
+	/* only the callback changes */
+	if(_signals[sigNo].callback != NULL)
+	{
+		_signals[sigNo].callback = callback;
+		_signals[sigNo].arg = arg;
+
+		return 1;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = _handleSignal;
+	action.sa_flags = SA_RESTART | (sigNo == SIGCHLD ? SA_NOCLDSTOP : 0);
+	sigemptyset(&(action.sa_mask));
+
+	if((_watchCount == 0
+		&& !serverWatchFd(_pipe[0], WATCH_READ, _dispatch, NULL))
+		|| sigaction(sigNo, &action, &(_signals[sigNo].previous)) != 0)
+	{
+		if(_watchCount == 0)
+		{
+			serverUnwatchFd(_pipe[0]);
+		}
+
+		return 0;
+	}
+
+	_signals[sigNo].callback = callback;
+	_signals[sigNo].arg = arg;
+
+	++_watchCount;
+
+	return 1;
+}
+
+/**
+ * stops handling the given signal and restores the disposition it had before
+ * signalWatch() (e.g. the handlers of main.c).
+ */
+void signalUnwatch(int sigNo)
+{
+	if(sigNo <= 0 || sigNo >= _SIGNAL_MAX || _signals[sigNo].callback == NULL)
+	{
+		return;
+	}
+
+	sigaction(sigNo, &(_signals[sigNo].previous), NULL);
+
+	_signals[sigNo].callback = NULL;
+	_signals[sigNo].arg = NULL;
+
+	/* the pipe does not keep the server running without watched signals */
+	if(--_watchCount == 0)
+	{
+		serverUnwatchFd(_pipe[0]);
+	}
+}
@@ -31,8 +31,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 /**
  * makes the given socket non-blocking.
  */
@@ -153,14 +159,19 @@ int socketOpenServer(const char *host, const char *port)
 }
 
 /**
- * accepts a new client connection on the given server socket. returns either
- * the new socket descriptor (value >= 0) or -1 (INVALID_SOCKET) in case of
- * error.
+ * accepts a new client connection on the given server socket. the address of
+ * the client is stored in the second parameter unless it is null. returns
+ * either the new socket descriptor (value >= 0) or -1 (INVALID_SOCKET) in
+ * case of error.
  */
-int socketAccept(int fd)
+int socketAccept(int fd, struct sockaddr_storage *addr)
 {
+	socklen_t addrLen = sizeof(struct sockaddr_storage);
+
 	/* accept the new connection */
-	int newFd = accept(fd, NULL, NULL);
+	int newFd = accept(
+		fd, (struct sockaddr*) addr, addr != NULL ? &addrLen : NULL
+	);
 
 	/* is there a valid socket */
 	if(newFd >= 0)
@@ -280,6 +291,101 @@ int socketWrite(int fd, buf_t *buf)
 	return 1;
 }
 
+/**
+ * writes the given data into the specified socket. if the last parameter is
+ * set more data follows right away, so the kernel may hold the data back to
+ * send it together (e.g. a header in front of a file). returns the number of
+ * bytes written, which may be less than requested, or -1 in case of an error.
+ */
+ssize_t socketWriteData(int fd, const void *data, size_t len, int more)
+{
+#ifdef MSG_MORE
+	ssize_t bytesWritten = send(fd, data, len, more ? MSG_MORE : 0);
+#else
+	ssize_t bytesWritten = send(fd, data, len, 0);
+
+	(void) more;
+#endif
+
+	/* a full socket buffer is not an error */
+	if(bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return 0;
+	}
+
+	if(bytesWritten < 0)
+	{
+		/* failed to send any data, make a panic message */
+		logWrite("ERROR send()");
+		logWrite(strerror(errno));
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * writes up to the given number of bytes of the file at the offset into the
+ * specified socket. the offset is advanced by the number of bytes written.
+ * uses sendfile() where it is available, so the data is not copied into user
+ * space. returns the number of bytes written or -1 in case of an error.
+ */
+ssize_t socketSendFile(int fd, int fileFd, off_t *offset, size_t len)
+{
+	ssize_t bytesWritten;
+
+#ifdef __linux__
+	bytesWritten = sendfile(fd, fileFd, offset, len);
+
+	/* a full socket buffer is not an error */
+	if(bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return 0;
+	}
+
+	if(bytesWritten < 0)
+	{
+		logWrite("ERROR sendfile()");
+		logWrite(strerror(errno));
+	}
+
+	/* a file shorter than expected is an error */
+	if(bytesWritten == 0 && len > 0)
+	{
+		return -1;
+	}
+#else
+	static unsigned char tmpBuf[IO_BUF_SIZE * 16];
+	ssize_t bytesRead;
+
+	/* read a piece of the file and send it */
+	bytesRead = pread(
+		fileFd, tmpBuf, len < sizeof(tmpBuf) ? len : sizeof(tmpBuf), *offset
+	);
+
+	if(bytesRead < 0)
+	{
+		logWrite("ERROR pread()");
+		logWrite(strerror(errno));
+	}
+
+	/* a file shorter than expected is an error */
+	if(bytesRead <= 0 && len > 0)
+	{
+		return -1;
+	}
+
+	bytesWritten = socketWriteData(fd, tmpBuf, (size_t) bytesRead, 0);
+
+	/* sendfile() advances the offset itself */
+	if(bytesWritten > 0)
+	{
+		*offset += bytesWritten;
+	}
+#endif
+
+	return bytesWritten;
+}
+
 /**
  * closes the specified socket.
  */
@@ -289,6 +395,75 @@ void socketClose(int fd)
 	close(fd);
 }
 
+/**
+ * closes the specified socket with a reset instead of the normal shutdown, so
+ * no state is kept for it (TIME_WAIT). used to drop unwanted connections.
+ */
+void socketReset(int fd)
+{
+	struct linger linger;
+
+	linger.l_onoff = 1;
+	linger.l_linger = 0;
+
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+
+	close(fd);
+}
+
+/**
+ * returns the address and the port stored in the given address structure.
+ * fills the second and third parameter with data. the pointer stored in the
+ * second parameter points to a static address and must not be free()ed.
+ * returns 1 if everything is ok and 0 if not.
+ */
+int socketFormatAddr(
+	const struct sockaddr_storage *addr,
+	const char **hostDst,
+	int *portDst
+)
+{
+	static char host[INET6_ADDRSTRLEN];
+	static int port;
+
+	const struct sockaddr_in* addrV4;
+	const struct sockaddr_in6* addrV6;
+
+	/* the structure can contain either ipv4 or ipv6 data */
+	if(addr->ss_family == AF_INET)
+	{
+		/* ipv4 */
+		addrV4 = (const struct sockaddr_in*) addr;
+
+		/* get the port number from the ipv4 structure */
+		port = ntohs(addrV4->sin_port);
+
+		/* get the ipv4 address */
+		inet_ntop(AF_INET, &(addrV4->sin_addr), host, sizeof(host));
+	}
+	else if(addr->ss_family == AF_INET6)
+	{
+		/* ipv6 */
+		addrV6 = (const struct sockaddr_in6*) addr;
+
+		/* get the port from the ipv6 structure */
+		port = ntohs(addrV6->sin6_port);
+
+		/* get the ipv6 address */
+		inet_ntop(AF_INET6, &(addrV6->sin6_addr), host, sizeof(host));
+	}
+	else
+	{
+		return 0;
+	}
+
+	/* copy the information into the destinations */
+	*hostDst = host;
+	*portDst = port;
+
+	return 1;
+}
+
 /**
  * returns the address and the port of the connected peer. fills the second and
  * third parameter with data. the pointer stored in the second parameter points
@@ -299,51 +474,13 @@ void socketClose(int fd)
  */
 int socketGetPeerAddr(int fd, const char **hostDst, int *portDst)
 {
-	static char host[INET6_ADDRSTRLEN];
-	static int port;
-
-	struct sockaddr_in* addrV4;
-	struct sockaddr_in6* addrV6;
-
 	struct sockaddr_storage addr;
 	socklen_t addrLen = sizeof(addr);
 
 	/* get the peer address information */
 	if(getpeername(fd, (struct sockaddr*) &addr, &addrLen) == 0)
 	{
-		/* getpeername() can return either ipv4 or ipv6 data */
-		if(addr.ss_family == AF_INET)
-		{
-			/* ipv4 */
-			addrV4 = (struct sockaddr_in*) &addr;
-
-			/* get the port number from the ipv4 structure */
-			port = ntohs(addrV4->sin_port);
-
-			/* get the ipv4 address */
-			inet_ntop(AF_INET, &(addrV4->sin_addr), host, sizeof(host));
-		}
-		else if(addr.ss_family == AF_INET6)
-		{
-			/* ipv6 */
-			addrV6 = (struct sockaddr_in6*) &addr;
-
-			/* get the port from the ipv6 structure */
-			port = ntohs(addrV6->sin6_port);
-
-			/* get the ipv6 address */
-			inet_ntop(AF_INET6, &(addrV6->sin6_addr), host, sizeof(host));
-		}
-		else
-		{
-			return 0;
-		}
-
-		/* copy the information into the destinations */
-		*hostDst = host;
-		*portDst = port;
-
-		return 1;
+		return socketFormatAddr(&addr, hostDst, portDst);
 	}
 
 	return 0;
@@ -355,52 +492,41 @@ int socketGetPeerAddr(int fd, const char **hostDst, int *portDst)
  */
 int socketGetBoundAddr(int fd, const char **hostDst, int *portDst)
 {
-	static char host[INET6_ADDRSTRLEN];
-	static int port;
-
-	struct sockaddr_in* addrV4;
-	struct sockaddr_in6* addrV6;
-
 	struct sockaddr_storage addr;
 	socklen_t addrLen = sizeof(addr);
 
 	/* get the address information of the socket */
 	if(getsockname(fd, (struct sockaddr*) &addr, &addrLen) == 0)
 	{
-		/* getsockname() can return either ipv4 or ipv6 data */
-		if(addr.ss_family == AF_INET)
-		{
-			/* ipv4 */
-			addrV4 = (struct sockaddr_in*) &addr;
-
-			/* get the port number from the ipv4 structure */
-			port = ntohs(addrV4->sin_port);
-
-			/* get the ipv4 address */
-			inet_ntop(AF_INET, &(addrV4->sin_addr), host, sizeof(host));
-		}
-		else if(addr.ss_family == AF_INET6)
-		{
-			/* ipv6 */
-			addrV6 = (struct sockaddr_in6*) &addr;
+		return socketFormatAddr(&addr, hostDst, portDst);
+	}
 
-			/* get the port from the ipv6 structure */
-			port = ntohs(addrV6->sin6_port);
+	return 0;
+}
 
-			/* get the ipv6 address */
-			inet_ntop(AF_INET6, &(addrV6->sin6_addr), host, sizeof(host));
-		}
-		else
-		{
-			return 0;
-		}
+/**
+ * reads the tcp information (TCP_INFO) of the given socket. returns 1 if
+ * everything is ok and 0 if not or if the system does not support it.
+ */
+int socketGetTcpInfo(int fd, tcpInfo_t *infoDst)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
 
-		/* copy the information into the destinations */
-		*hostDst = host;
-		*portDst = port;
+	if(getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+	{
+		infoDst->rtt = info.tcpi_rtt;
+		infoDst->rttVar = info.tcpi_rttvar;
+		infoDst->retransmits = info.tcpi_total_retrans;
+		infoDst->cwnd = info.tcpi_snd_cwnd;
 
 		return 1;
 	}
+#else
+	(void) fd;
+	(void) infoDst;
+#endif
 
 	return 0;
 }
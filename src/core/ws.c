@@ -0,0 +1,660 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2014 0x6d72
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "server.h"
+
+#include <string.h>
+
+/**
+ * defines the guid appended to the key of the handshake (see rfc 6455).
+ */
+#define _WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * defines the length of a valid Sec-WebSocket-Key (16 bytes base64 encoded).
+ */
+#define _WS_KEY_LEN (24)
+
+/**
+ * defines the maximum payload of control frames.
+ */
+#define _WS_CONTROL_MAX (125)
+
+/**
+ * defines the status codes used when the connection is closed by the server.
+ */
+#define _WS_CLOSE_PROTOCOL (1002)
+#define _WS_CLOSE_INVALID_DATA (1007)
+#define _WS_CLOSE_TOO_BIG (1009)
+
+/**
+ * used by _handleFrame() to indicate that the callback stopped the
+ * processing.
+ */
+#define _WS_ABORT (-1)
+
+/**
+ * defines the structure of a decoded frame header.
+ */
+typedef struct {
+
+	/* used to check whether this is the last fragment */
+	int fin;
+
+	/* stores the opcode of the frame */
+	wsOpcode_t opcode;
+
+	/* stores the masking key */
+	unsigned char key[4];
+
+	/* stores the length of the payload */
+	size_t len;
+
+	/* stores the status code in case the header is invalid */
+	int error;
+
+} _frame_t;
+
+/**
+ * unmasks the given data in place. the data is processed a word at a time,
+ * the key is repeated to fill the word.
+ */
+static void _unmask(unsigned char *data, size_t len, const unsigned char *key)
+{
+	unsigned long word, keyWord;
+	size_t i;
+
+	/* the size of the word is a multiple of 4, so the key stays aligned */
+	for(i=0;i<sizeof(keyWord);++i)
+	{
+		((unsigned char*) &keyWord)[i] = key[i & 3];
+	}
+
+	for(i=0;i+sizeof(word)<=len;i+=sizeof(word))
+	{
+		memcpy(&word, data + i, sizeof(word));
+		word ^= keyWord;
+		memcpy(data + i, &word, sizeof(word));
+	}
+
+	for(;i<len;++i)
+	{
+		data[i] ^= key[i & 3];
+	}
+}
+
+/**
+ * checks whether the given status code may be used in a close frame. returns
+ * 1 if it is valid and 0 if not.
+ */
+static int _isValidCode(int code)
+{
+	return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014)
+		|| (code >= 3000 && code <= 4999);
+}
+
+/**
+ * decodes the header of the next frame. returns the size of the header, 0 if
+ * there is not enough data and (size_t) -1 if the header is invalid (the
+ * error field of the frame contains the status code then).
+ */
+static size_t _readHeader(
+	const unsigned char *data,
+	size_t len,
+	_frame_t *frame
+)
+{
+	size_t size = 2, i;
+	unsigned long high = 0;
+
+	if(len < 2)
+	{
+		return 0;
+	}
+
+	frame->fin = (data[0] & 0x80) != 0;
+	frame->opcode = (wsOpcode_t) (data[0] & 0x0f);
+	frame->len = data[1] & 0x7f;
+	frame->error = _WS_CLOSE_PROTOCOL;
+
+	/* no extensions are negotiated, so the reserved bits must be zero. frames
+	 * sent by clients must be masked. */
+	if((data[0] & 0x70) != 0 || (data[1] & 0x80) == 0)
+	{
+		return (size_t) -1;
+	}
+
+	switch(frame->opcode)
+	{
+		case WS_CONTINUATION:
+		case WS_TEXT:
+		case WS_BINARY:
+			break;
+
+		case WS_CLOSE:
+		case WS_PING:
+		case WS_PONG:
+			/* control frames must not be fragmented */
+			if(!frame->fin || frame->len > _WS_CONTROL_MAX)
+			{
+				return (size_t) -1;
+			}
+
+			break;
+
+		default:
+			return (size_t) -1;
+	}
+
+	/* read the extended length, big endian */
+	if(frame->len == 126)
+	{
+		size = 4;
+	}
+	else if(frame->len == 127)
+	{
+		size = 10;
+	}
+
+	if(len < size + 4)
+	{
+		return 0;
+	}
+
+	if(size > 2)
+	{
+		frame->len = 0;
+
+		for(i=2;i<size;++i)
+		{
+			/* remember the bits that do not fit into the size limit */
+			high |= (unsigned long) (frame->len >> 24);
+			frame->len = ((frame->len & 0xffffff) << 8) | data[i];
+		}
+
+		if(high != 0 || frame->len > WS_MESSAGE_MAX)
+		{
+			frame->error = _WS_CLOSE_TOO_BIG;
+
+			return (size_t) -1;
+		}
+	}
+
+	memcpy(frame->key, data + size, 4);
+
+	return size + 4;
+}
+
+/**
+ * appends a frame header with the given opcode and payload length to the
+ * buffer. returns 1 if everything is ok and 0 if not.
+ */
+static int _writeHeader(buf_t *buf, wsOpcode_t opcode, size_t len)
+{
+	unsigned char header[10];
+	size_t size = 2;
+
+	header[0] = (unsigned char) (0x80 | opcode);
+
+	if(len < 126)
+	{
+		header[1] = (unsigned char) len;
+	}
+	else if(len <= 0xffff)
+	{
+		header[1] = 126;
+		header[2] = (unsigned char) (len >> 8);
+		header[3] = (unsigned char) len;
+		size = 4;
+	}
+	else
+	{
+		/* the size_t is split, because it may have only 32 bits */
+		header[1] = 127;
+		header[2] = (unsigned char) ((len >> 16 >> 16 >> 16 >> 8) & 0xff);
+		header[3] = (unsigned char) ((len >> 16 >> 16 >> 16) & 0xff);
+		header[4] = (unsigned char) ((len >> 16 >> 16 >> 8) & 0xff);
+		header[5] = (unsigned char) ((len >> 16 >> 16) & 0xff);
+		header[6] = (unsigned char) (len >> 24);
+		header[7] = (unsigned char) (len >> 16);
+		header[8] = (unsigned char) (len >> 8);
+		header[9] = (unsigned char) len;
+		size = 10;
+	}
+
+	return bufAppend(buf, header, size);
+}
+
+/**
+ * appends a frame with the given opcode and payload to the buffer. returns 1
+ * if everything is ok and 0 if not.
+ */
+static int _writeFrame(
+	buf_t *buf, wsOpcode_t opcode, const void *data, size_t len
+)
+{
+	size_t start = buf->len;
+
+	if(_writeHeader(buf, opcode, len)
+		&& (len == 0 || bufAppend(buf, data, len)))
+	{
+		return 1;
+	}
+
+	buf->len = start;
+
+	return 0;
+}
+
+/**
+ * passes a complete message to the callback. text messages must be valid
+ * utf-8. returns 0 if everything is ok, _WS_ABORT if the callback stopped the
+ * processing and a status code in case of an error.
+ */
+static int _deliver(
+	wsOpcode_t opcode, const void *data, size_t len, wsCallback_t callback,
+	void *userData
+)
+{
+	wsMessage_t message;
+
+	if(opcode == WS_TEXT && !encIsUtf8(data, len))
+	{
+		return _WS_CLOSE_INVALID_DATA;
+	}
+
+	message.opcode = opcode;
+	message.data = len > 0 ? (const char*) data : "";
+	message.len = len;
+	message.code = 0;
+
+	return callback(&message, userData) ? 0 : _WS_ABORT;
+}
+
+/**
+ * handles the close frame with the given payload. returns 0 if everything is
+ * ok, _WS_ABORT if the callback stopped the processing and a status code in
+ * case of an error.
+ */
+static int _handleClose(
+	wsConn_t *conn, buf_t *oBuf, const unsigned char *data, size_t len,
+	wsCallback_t callback, void *userData
+)
+{
+	wsMessage_t message;
+
+	message.opcode = WS_CLOSE;
+	message.code = 0;
+	message.data = "";
+	message.len = 0;
+
+	/* the payload is either empty or starts with a status code */
+	if(len == 1)
+	{
+		return _WS_CLOSE_PROTOCOL;
+	}
+
+	if(len >= 2)
+	{
+		message.code = (data[0] << 8) | data[1];
+		message.data = (const char*) data + 2;
+		message.len = len - 2;
+
+		if(!_isValidCode(message.code))
+		{
+			return _WS_CLOSE_PROTOCOL;
+		}
+
+		if(!encIsUtf8(message.data, message.len))
+		{
+			return _WS_CLOSE_INVALID_DATA;
+		}
+	}
+
+	conn->closeReceived = 1;
+
+	/* reply with the same status code, unless the server started the close
+	 * handshake */
+	if(!conn->closeSent)
+	{
+		conn->closeSent = 1;
+
+		if(!_writeFrame(oBuf, WS_CLOSE, data, len >= 2 ? 2 : 0))
+		{
+			return _WS_ABORT;
+		}
+	}
+
+	return callback(&message, userData) ? 0 : _WS_ABORT;
+}
+
+/**
+ * handles a single unmasked frame. returns 0 if everything is ok, _WS_ABORT
+ * if the processing should stop and a status code in case of an error.
+ */
+static int _handleFrame(
+	wsConn_t *conn, buf_t *oBuf, const _frame_t *frame,
+	const unsigned char *data, wsCallback_t callback, void *userData
+)
+{
+	int result;
+
+	switch(frame->opcode)
+	{
+		case WS_TEXT:
+		case WS_BINARY:
+			/* a new message must not start within a fragmented one */
+			if(conn->opcode != WS_CONTINUATION)
+			{
+				return _WS_CLOSE_PROTOCOL;
+			}
+
+			/* unfragmented messages are passed without copying them */
+			if(frame->fin)
+			{
+				return _deliver(
+					frame->opcode, data, frame->len, callback, userData
+				);
+			}
+
+			conn->opcode = frame->opcode;
+
+			return bufAppend(&(conn->message), data, frame->len)
+				? 0 : _WS_ABORT;
+
+		case WS_CONTINUATION:
+			if(conn->opcode == WS_CONTINUATION)
+			{
+				return _WS_CLOSE_PROTOCOL;
+			}
+
+			if(conn->message.len + frame->len > WS_MESSAGE_MAX)
+			{
+				return _WS_CLOSE_TOO_BIG;
+			}
+
+			if(frame->len > 0
+				&& !bufAppend(&(conn->message), data, frame->len))
+			{
+				return _WS_ABORT;
+			}
+
+			if(!frame->fin)
+			{
+				return 0;
+			}
+
+			/* the message is complete, the memory of large messages should
+			 * not stay with the connection */
+			result = _deliver(
+				conn->opcode, conn->message.data, conn->message.len, callback,
+				userData
+			);
+
+			conn->opcode = WS_CONTINUATION;
+			bufClear(&(conn->message));
+
+			return result;
+
+		case WS_PING:
+			/* answer pings with the same payload */
+			if(conn->closeSent)
+			{
+				return 0;
+			}
+
+			return _writeFrame(oBuf, WS_PONG, data, frame->len)
+				? 0 : _WS_ABORT;
+
+		case WS_PONG:
+			return _deliver(WS_PONG, data, frame->len, callback, userData);
+
+		default:
+			return _handleClose(
+				conn, oBuf, data, frame->len, callback, userData
+			);
+	}
+}
+
+/**
+ * appends the response to a websocket upgrade request with the given
+ * Sec-WebSocket-Key to the buffer. the protocol is optional (null means none).
+ * returns 0 if the key is invalid or the buffer could not be written and 1 if
+ * everything is ok.
+ */
+int wsHandshake(
+	buf_t *buf,
+	const char *key,
+	size_t keyLen,
+	const char *protocol
+)
+{
+	static const char digits[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	static const char response[] =
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: ";
+
+	static const char protocolHeader[] = "\r\nSec-WebSocket-Protocol: ";
+
+	char tmp[_WS_KEY_LEN + sizeof(_WS_GUID)];
+	unsigned char digest[HASH_SHA1_SIZE];
+	size_t start = buf->len, i;
+
+	/* the key must be 16 base64 encoded bytes */
+	if(keyLen != _WS_KEY_LEN || key[22] != '=' || key[23] != '=')
+	{
+		return 0;
+	}
+
+	for(i=0;i<22;++i)
+	{
+		if(key[i] == '\0' || strchr(digits, key[i]) == NULL)
+		{
+			return 0;
+		}
+	}
+
+	/* the accept value is the sha-1 of the key and the guid */
+	memcpy(tmp, key, _WS_KEY_LEN);
+	memcpy(tmp + _WS_KEY_LEN, _WS_GUID, sizeof(_WS_GUID) - 1);
+	hashSha1(tmp, _WS_KEY_LEN + sizeof(_WS_GUID) - 1, digest);
+
+	if(bufAppend(buf, response, sizeof(response) - 1)
+		&& encBase64Encode(buf, digest, sizeof(digest))
+		&& (protocol == NULL || (
+			bufAppend(buf, protocolHeader, sizeof(protocolHeader) - 1)
+			&& bufAppend(buf, protocol, strlen(protocol))
+		))
+		&& bufAppend(buf, "\r\n\r\n", 4))
+	{
+		return 1;
+	}
+
+	buf->len = start;
+
+	return 0;
+}
+
+/**
+ * initializes the given websocket connection.
+ */
+void wsInit(wsConn_t *conn)
+{
+	memset(conn, 0, sizeof(*conn));
+
+	conn->opcode = WS_CONTINUATION;
+}
+
+/**
+ * processes all complete frames of the input buffer and removes them from it.
+ * pings are answered and close frames are replied directly in the output
+ * buffer, all other messages are passed to the callback once they are
+ * complete. returns 1 if the connection is still open, 2 if it was closed
+ * properly and 0 in case of an error. in case of a protocol error a close
+ * frame is appended to the output buffer. in the last two cases the socket
+ * should be closed after the output buffer is flushed.
+ */
+int wsExec(
+	wsConn_t *conn, buf_t *iBuf, buf_t *oBuf, wsCallback_t callback,
+	void *userData
+)
+{
+	unsigned char *data, code[2];
+	size_t len, pos = 0, size;
+	_frame_t frame;
+	int result = 0;
+
+	if(!bufHasData(iBuf))
+	{
+		return conn->closeReceived ? 2 : 1;
+	}
+
+	data = (unsigned char*) bufPeek(iBuf, &len);
+
+	/* handle all complete frames, the frames are removed at once at the
+	 * end */
+	while(!conn->closeReceived && result == 0)
+	{
+		size = _readHeader(data + pos, len - pos, &frame);
+
+		if(size == (size_t) -1)
+		{
+			result = frame.error;
+			break;
+		}
+
+		/* wait for the rest of the frame */
+		if(size == 0 || len - pos - size < frame.len)
+		{
+			break;
+		}
+
+		_unmask(data + pos + size, frame.len, frame.key);
+		result = _handleFrame(
+			conn, oBuf, &frame, data + pos + size, callback, userData
+		);
+
+		pos += size + frame.len;
+	}
+
+	bufConsume(iBuf, pos);
+
+	if(result == _WS_ABORT)
+	{
+		return 0;
+	}
+
+	/* close the connection with the status code of the error */
+	if(result > 0)
+	{
+		if(!conn->closeSent)
+		{
+			code[0] = (unsigned char) (result >> 8);
+			code[1] = (unsigned char) result;
+
+			conn->closeSent = 1;
+			(void) _writeFrame(oBuf, WS_CLOSE, code, 2);
+		}
+
+		return 0;
+	}
+
+	return conn->closeReceived ? 2 : 1;
+}
+
+/**
+ * appends a frame with the given opcode and payload to the buffer. control
+ * frames can have at most 125 bytes payload. returns 0 if the close handshake
+ * was started already or the frame is invalid and 1 if everything is ok.
+ */
+int wsSend(
+	wsConn_t *conn, buf_t *buf, wsOpcode_t opcode, const void *data,
+	size_t len
+)
+{
+	/* nothing may follow the close frame */
+	if(conn->closeSent)
+	{
+		return 0;
+	}
+
+	switch(opcode)
+	{
+		case WS_TEXT:
+		case WS_BINARY:
+			return _writeFrame(buf, opcode, data, len);
+
+		case WS_PING:
+		case WS_PONG:
+			return len <= _WS_CONTROL_MAX
+				&& _writeFrame(buf, opcode, data, len);
+
+		default:
+			return 0;
+	}
+}
+
+/**
+ * starts the close handshake by appending a close frame with the given code
+ * (0 means none) and reason to the buffer. returns 1 if everything is ok and
+ * 0 if not.
+ */
+int wsClose(
+	wsConn_t *conn, buf_t *buf, int code, const char *reason, size_t len
+)
+{
+	unsigned char payload[_WS_CONTROL_MAX];
+
+	if(conn->closeSent || (code != 0 && !_isValidCode(code))
+		|| (code == 0 && len > 0) || len > _WS_CONTROL_MAX - 2)
+	{
+		return 0;
+	}
+
+	/* the status code is followed by the reason */
+	payload[0] = (unsigned char) (code >> 8);
+	payload[1] = (unsigned char) code;
+
+	if(len > 0)
+	{
+		memcpy(payload + 2, reason, len);
+	}
+
+	conn->closeSent = 1;
+
+	return _writeFrame(buf, WS_CLOSE, payload, code != 0 ? len + 2 : 0);
+}
+
+/**
+ * frees the resources of the given websocket connection.
+ */
+void wsClear(wsConn_t *conn)
+{
+	bufClear(&(conn->message));
+}
@@ -3,6 +3,9 @@ server.setCallback(function (context)
 	if context.event == "socket_read" then
 		context.oBuf:append(context.iBuf:extract())
 	end
+
+	-- keep the connection open
+	return true
 end)
 
-server.addServerSocket("0.0.0.0", 12345)
+server.openSocket("0.0.0.0", "12345")
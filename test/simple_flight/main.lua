@@ -0,0 +1,124 @@
+-- checks the flight api against real connections and exits with 0 if every
+-- check passed. a client started with bash sends "get k" on three
+-- connections: the first one computes the value (the leader), the other two
+-- are parked. the first parked connection is closed by the server before the
+-- value is available, without calling flight:cancel(), and new connections
+-- sending "ping" take over its descriptor. only the leader and the second
+-- parked connection may get the value.
+
+local _port = "12351"
+
+-- stores the connections which sent "ping" and the descriptor of the closed
+-- parked connection
+local _pingList = {}
+local _closedFd = nil
+
+-- stores the results of the checks done by the server
+local _failures = {}
+local _reused = false
+local _woken = nil
+
+local function _fail(msg)
+	_failures[#_failures + 1] = msg
+end
+
+local _pages = flight.new(function (cFd, oBuf, data, value)
+	if _pingList[cFd] or data ~= "get" then
+		_fail("value sent to a ping connection " .. cFd)
+	end
+
+	oBuf:append(value .. "\n")
+end)
+
+-- computes the value slowly in a child process
+local function _compute()
+	server.spawn({"sleep", "0.5"}, nil, function (pid, event)
+		if event == "exit" then
+			_woken = _pages:finish("k", "v1")
+		end
+	end)
+end
+
+server.setCallback(function (context)
+	if context.event == "socket_read" then
+		local line = context.iBuf:extract():match("^(%a+)")
+
+		if line == "ping" then
+			_pingList[context.cFd] = true
+			_reused = _reused or context.cFd == _closedFd
+			context.oBuf:append("pong\n")
+		elseif line == "get" then
+			if _pages:join("k", context.cFd, "get") then
+				-- the value is computed asynchronously, so the leader is
+				-- parked and answered like every other connection
+				_pages:join("k", context.cFd, "get")
+				_compute()
+			elseif _closedFd == nil then
+				_closedFd = context.cFd
+
+				-- close it while it is parked, without flight:cancel()
+				server.spawn({"sleep", "0.2"}, nil, function (pid, event)
+					if event == "exit" then
+						server.closeSocket(_closedFd)
+					end
+				end)
+			end
+		end
+	elseif context.event == "socket_close" then
+		_pingList[context.cFd] = nil
+	end
+
+	return true
+end)
+
+server.openSocket("127.0.0.1", _port)
+
+-- the client prints what every connection received, "-" for nothing
+local _client = [[
+	exec 3<>/dev/tcp/127.0.0.1/PORT; echo "get k" >&3; sleep 0.05
+	exec 4<>/dev/tcp/127.0.0.1/PORT; echo "get k" >&4; sleep 0.05
+	exec 5<>/dev/tcp/127.0.0.1/PORT; echo "get k" >&5; sleep 0.35
+	for fd in 6 7 8 9; do
+		eval "exec $fd<>/dev/tcp/127.0.0.1/PORT"; echo ping >&$fd
+	done
+	for fd in 3 5 6 7 8 9; do
+		read -t 2 line <&$fd || line=-; printf "%s " "$line"
+		read -t 0.2 line <&$fd || line=-; printf "%s " "$line"
+	done
+]]
+
+local _output = ""
+
+server.spawn({"bash", "-c", (_client:gsub("PORT", _port))}, nil,
+	function (pid, event, data)
+		if event == "stdout" then
+			_output = _output .. data
+		elseif event == "exit" then
+			if _output ~= "v1 - v1 - pong - pong - pong - pong - " then
+				_fail("unexpected client output: " .. _output)
+			end
+
+			if not _reused then
+				_fail("the descriptor of the closed connection was not reused")
+			end
+
+			if _woken ~= 2 then
+				_fail("woke " .. tostring(_woken) .. " connections, expected 2")
+			end
+
+			if _pages:stats().pending ~= 0 then
+				_fail("flights still pending")
+			end
+
+			for _, msg in ipairs(_failures) do
+				print("FAIL " .. msg)
+			end
+
+			if #_failures == 0 then
+				print("ok")
+			end
+
+			os.exit(#_failures == 0 and 0 or 1)
+		end
+	end
+)
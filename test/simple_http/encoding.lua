@@ -43,3 +43,11 @@ end
 function decode.url(data)
 	return _gsub(_gsub(data, "+", " "), "%%(%x%x)", _hexToChar)
 end
+
+-- -----------------------------------------------------------------------------
+-- use the native implementations if the server provides them
+-- -----------------------------------------------------------------------------
+if encoding ~= nil then
+	encode.url = encoding.urlEncode
+	decode.url = encoding.urlDecode
+end
@@ -4,6 +4,7 @@ local _match = string.match
 local _lower = string.lower
 local _gsub = string.gsub
 local _sub = string.sub
+local _concat = table.concat
 local _toNumber = tonumber
 local _toString = tostring
 local _urlDecode = decode.url
@@ -24,12 +25,20 @@ local _statusError = 6
 httpRequestParser = {}
 
 -- -----------------------------------------------------------------------------
--- creates a new request parser instance
+-- creates a new request parser instance. if a body handler is given the body
+-- of a request is not collected by the parser, instead every chunk of the body
+-- is passed to the handler as soon as it arrives with the signature
+-- bodyHandler(request, chunk). in this case the maximum request size only
+-- limits the request line and the headers. the maximum body size limits the
+-- announced content-length of a request in any case.
 -- -----------------------------------------------------------------------------
-function httpRequestParser.new(maxRequestSize)
+function httpRequestParser.new(maxRequestSize, bodyHandler, maxBodySize)
 	-- adjust the maximum request size (the default is 1mib)
 	maxRequestSize = maxRequestSize or (1024 * 1024)
 
+	-- adjust the maximum body size (the default is the maximum request size)
+	maxBodySize = maxBodySize or maxRequestSize
+
 	-- -------------------------------------------------------------------------
 	-- stores data that could not be parsed
 	-- -------------------------------------------------------------------------
@@ -50,6 +59,17 @@ function httpRequestParser.new(maxRequestSize)
 	-- -------------------------------------------------------------------------
 	local _request
 
+	-- -------------------------------------------------------------------------
+	-- stores the parts of the body received so far (only used without a body
+	-- handler)
+	-- -------------------------------------------------------------------------
+	local _bodyParts
+
+	-- -------------------------------------------------------------------------
+	-- stores the number of body bytes still expected
+	-- -------------------------------------------------------------------------
+	local _bodyRemaining
+
 	-- -------------------------------------------------------------------------
 	-- stores the number of bytes processed by this parser instance.
 	-- -------------------------------------------------------------------------
@@ -145,6 +165,13 @@ function httpRequestParser.new(maxRequestSize)
 				return false
 			end
 
+			-- the body must not exceed the limit, this is checked before any
+			-- of it is received
+			if length > maxBodySize then
+				_setError(413)
+				return false
+			end
+
 			-- replace the string with a number
 			_request.headers["content-length"] = length
 		else
@@ -203,6 +230,7 @@ function httpRequestParser.new(maxRequestSize)
 			if _checkHeader() then
 				-- switch to the appropriate status
 				if _request.method == "post" then
+					_bodyRemaining = _request.headers["content-length"]
 					_status = _statusBody
 				else
 					_status = _statusDone
@@ -217,15 +245,34 @@ function httpRequestParser.new(maxRequestSize)
 	local function _handleBody()
 		-- should the body be consumed
 		if _status == _statusBody then
-			-- just append the data to the body
-			_request.body = _request.body .. _chunk
+			-- is there any data for the body
+			if #_chunk > 0 then
+				-- take only as much data as the body still needs
+				local part = _chunk
 
-			-- is there enough data
-			if #_request.body >= _request.headers["content-length"] then
-				-- truncate the body to the specified length
-				_request.body = _sub(
-					_request.body, 1, _request.headers["content-length"]
-				)
+				if #part > _bodyRemaining then
+					part = _sub(_chunk, 1, _bodyRemaining)
+				end
+
+				-- the chunk is consumed by the body
+				_chunk = ""
+				_bodyRemaining = _bodyRemaining - #part
+
+				-- either pass the part on or keep it for later
+				if bodyHandler ~= nil then
+					bodyHandler(_request, part)
+				else
+					_bodyParts[#_bodyParts + 1] = part
+				end
+			end
+
+			-- is the body complete
+			if _bodyRemaining <= 0 then
+				-- join the parts of the body once
+				if bodyHandler == nil then
+					_request.body = _concat(_bodyParts)
+					_bodyParts = {}
+				end
 
 				-- the request is now done
 				_status = _statusDone
@@ -250,6 +297,8 @@ function httpRequestParser.new(maxRequestSize)
 			headers = {},
 			body = ""
 		}
+		_bodyParts = {}
+		_bodyRemaining = 0
 		_bytesProcessed = 0
 	end
 
@@ -266,8 +315,11 @@ function httpRequestParser.new(maxRequestSize)
 	-- request is fully parsed.
 	-- -------------------------------------------------------------------------
 	function parser.exec(data)
-		-- calculate the number of bytes processed
-		_bytesProcessed = _bytesProcessed + #data
+		-- calculate the number of bytes processed. a streamed body does not
+		-- count towards the maximum request size
+		if bodyHandler == nil or _status ~= _statusBody then
+			_bytesProcessed = _bytesProcessed + #data
+		end
 
 		-- check if the request is too big
 		if _bytesProcessed > maxRequestSize then
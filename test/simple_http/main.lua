@@ -1,7 +1,57 @@
 
+-- load the parser and the response builder next to this script
+local _dir = debug.getinfo(1, "S").source:match("^@(.-)[^/]*$")
+
+dofile(_dir .. "encoding.lua")
+dofile(_dir .. "httpRequest.lua")
+dofile(_dir .. "httpResponse.lua")
+
 -- stores all socket parsers
 local _socketList = {}
 
+-- stores the websocket connections
+local _websocketList = {}
+
+-- stores the http/2 connections and their open streams
+local _http2List = {}
+
+-- bodies larger than this are spooled to a temporary file
+local _spoolThreshold = 64 * 1024
+
+-- bodies larger than this are rejected
+local _maxBodySize = 16 * 1024 * 1024
+
+-- reading from a connection is paused while a response larger than this is
+-- being sent
+local _pauseThreshold = 64 * 1024
+
+-- response bodies smaller than this are sent uncompressed
+local _compressMinSize = 256
+
+-- -----------------------------------------------------------------------------
+-- receives the body of a request chunk by chunk. small bodies are kept in
+-- memory, large ones are written to a temporary file so that the memory used
+-- per connection stays constant. the file is handed to the request handler as
+-- request.bodyFile.
+-- -----------------------------------------------------------------------------
+local function _handleBody(request, chunk)
+	request.bodyLength = (request.bodyLength or 0) + #chunk
+
+	-- switch to a temporary file once the body gets too large
+	if request.bodyFile == nil
+		and request.headers["content-length"] > _spoolThreshold
+	then
+		request.bodyFile = io.tmpfile()
+	end
+
+	if request.bodyFile ~= nil then
+		request.bodyFile:write(chunk)
+	else
+		request.bodyParts = request.bodyParts or {}
+		request.bodyParts[#request.bodyParts + 1] = chunk
+	end
+end
+
 local function _serialize(v, i)
 	i = i or 0
 	local r
@@ -23,12 +73,134 @@ local function _serialize(v, i)
 	return r
 end
 
+-- compresses the body of the response if the client accepts it
+local function _compressResponse(response, acceptEncoding)
+	local format = compress.negotiate(acceptEncoding)
+
+	response.headers["vary"] = "accept-encoding"
+
+	if format ~= nil then
+		local body = compress.encode(
+			response.body, { format = format, minSize = _compressMinSize }
+		)
+
+		if body ~= nil then
+			response.body = body
+			response.headers["content-encoding"] = format
+		end
+	end
+end
+
+-- sends the default response on a http/2 stream
+local function _respondHttp2(context, h2, stream, request)
+	local response = {
+		headers = {
+			[":status"] = 200,
+			["content-type"] = "text/plain"
+		},
+		body = _serialize(request)
+	}
+
+	_compressResponse(response, request.headers["accept-encoding"])
+	response.headers["content-length"] = #response.body
+
+	h2.conn:sendHeaders(context.oBuf, stream, response.headers)
+	h2.conn:sendData(context.oBuf, stream, response.body, true)
+end
+
+-- handles the frames of a http/2 connection, every stream is a request
+local function _handleHttp2(context, h2)
+	local open = h2.conn:read(
+		context.iBuf, context.oBuf, function (kind, stream, data, last)
+			if kind == "headers" then
+				-- the first header block is the request, a second one the trailers
+				local request = h2.streams[stream]
+
+				if request == nil then
+					request = { headers = data, bodyParts = {} }
+					h2.streams[stream] = request
+				else
+					request.trailers = data
+				end
+
+				if last then
+					h2.streams[stream] = nil
+					request.body = table.concat(request.bodyParts)
+					request.bodyParts = nil
+					_respondHttp2(context, h2, stream, request)
+				end
+
+			elseif kind == "data" then
+				local request = h2.streams[stream]
+				request.bodyParts[#request.bodyParts + 1] = data
+
+				if last then
+					h2.streams[stream] = nil
+					request.body = table.concat(request.bodyParts)
+					request.bodyParts = nil
+					_respondHttp2(context, h2, stream, request)
+				end
+
+			-- the client cancelled the stream
+			else
+				h2.streams[stream] = nil
+			end
+		end
+	)
+
+	-- the connection is closed after the goaway frame was sent
+	if not open then
+		server.closeSocket(context.cFd)
+	end
+end
+
 -- handles the request
 local function _handleRequest(context, parser)
 
 	local request = parser.getRequest()
 	local keepAlive = parser.shouldKeepAlive()
-	
+
+	-- join a body kept in memory
+	if request.bodyParts ~= nil then
+		request.body = table.concat(request.bodyParts)
+		request.bodyParts = nil
+	end
+
+	-- the spooled body is read from the start by the handler
+	if request.bodyFile ~= nil then
+		request.bodyFile:flush()
+		request.bodyFile:seek("set")
+	end
+
+	-- requests to /echo can be upgraded to a websocket
+	if request.uri == "/echo"
+		and string.lower(request.headers["upgrade"] or "") == "websocket"
+		and websocket.handshake(
+			request.headers["sec-websocket-key"] or "", context.oBuf
+		)
+	then
+		_websocketList[context.cFd] = websocket.new()
+		_socketList[context.cFd] = nil
+		return
+	end
+
+	-- requests without a body can be upgraded to http/2, the request becomes
+	-- stream 1 of the new connection
+	if string.find(string.lower(request.headers["upgrade"] or ""), "h2c", 1, true)
+		and request.headers["http2-settings"] ~= nil
+		and request.bodyFile == nil
+		and (request.body or "") == ""
+	then
+		local h2 = { conn = http2.new(), streams = {} }
+
+		if h2.conn:upgrade(context.oBuf, request.headers["http2-settings"]) then
+			_http2List[context.cFd] = h2
+			_socketList[context.cFd] = nil
+			_respondHttp2(context, h2, 1, request)
+			return
+		end
+	end
+
 	-- default response
 	local response = {
 		status = 200,
@@ -38,6 +210,17 @@ local function _handleRequest(context, parser)
 		body = _serialize(request)
 	}
 
+	-- the spooled body is not needed anymore
+	if request.bodyFile ~= nil then
+		response.body = response.body .. string.format(
+			"\nspooled body: %d bytes", request.bodyFile:seek("end")
+		)
+		request.bodyFile:close()
+		request.bodyFile = nil
+	end
+
+	_compressResponse(response, request.headers["accept-encoding"])
+
 	-- only allow five requests per connections
 	if parser.getIterations() > 5 then
 		keepAlive = false
@@ -51,9 +234,14 @@ local function _handleRequest(context, parser)
 	end
 
 	-- write the response
-	context.oBuf:append(
-		httpResponseBuilder.buildResponse(response, request.version)
-	)
+	local data = httpResponseBuilder.buildResponse(response, request.version)
+	context.oBuf:append(data)
+
+	-- a large response is sent before the next request is read, so a client
+	-- that does not read its responses cannot fill the memory of the server
+	if keepAlive and #data > _pauseThreshold then
+		server.pauseRead(context.cFd)
+	end
 
 	-- without keep alive the connection will be terminated
 	if not keepAlive then
@@ -68,14 +256,58 @@ local function _handleRequest(context, parser)
 	end
 end
 
+-- answers a request the parser rejected and closes the connection
+local function _handleError(context, parser)
+	local response = {
+		status = parser.getError(),
+		headers = {
+			["content-type"] = "text/plain",
+			["connection"] = "close"
+		},
+		body = ""
+	}
+
+	context.oBuf:append(httpResponseBuilder.buildResponse(response, 1.1))
+	server.closeSocket(context.cFd)
+	_socketList[context.cFd] = nil
+end
+
 -- set the callback
 server.setCallback(function (context)
+	-- react to a read event on a websocket, every message is sent back
+	if context.event == "socket_read" and _websocketList[context.cFd] then
+		local ws = _websocketList[context.cFd]
+
+		local open = ws:read(context.iBuf, context.oBuf, function (kind, data)
+			if kind == "text" or kind == "binary" then
+				ws:send(context.oBuf, data, kind == "binary")
+			end
+		end)
+
+		-- the connection is closed after the close frame was sent
+		if not open then
+			server.closeSocket(context.cFd)
+		end
+
+	-- react to a read event on a http/2 connection
+	elseif context.event == "socket_read" and _http2List[context.cFd] then
+		_handleHttp2(context, _http2List[context.cFd])
+
+	-- a new connection starting with the http/2 preface (prior knowledge)
+	elseif context.event == "socket_read" and _socketList[context.cFd] == nil
+		and string.sub(context.iBuf:peek(), 1, 4) == "PRI "
+	then
+		_http2List[context.cFd] = { conn = http2.new(), streams = {} }
+		_handleHttp2(context, _http2List[context.cFd])
+
 	-- react to a read event
-	if context.event == "socket_read" then
+	elseif context.event == "socket_read" then
 		-- is there a parser for this connection
 		if _socketList[context.cFd] == nil then
 			-- no parser present create a new one
-			_socketList[context.cFd] = httpRequestParser.new()
+			_socketList[context.cFd] = httpRequestParser.new(
+				nil, _handleBody, _maxBodySize
+			)
 		end
 	
 		-- get the parser for this connection
@@ -83,15 +315,36 @@ server.setCallback(function (context)
 		
 		-- is the request done
 		if not parser.exec(context.iBuf:extract()) then
-			-- handle the request
-			return _handleRequest(context, parser)
+			-- handle the request or the error
+			if parser.hasError() then
+				_handleError(context, parser)
+			else
+				_handleRequest(context, parser)
+			end
 		end
-		
+
+	-- continue reading once a large response was sent
+	elseif context.event == "socket_write" then
+		if not context.oBuf:hasData() then
+			server.resumeRead(context.cFd)
+		end
+
+	-- forget the parser of a closed connection
+	elseif context.event == "socket_close" then
+		if context.cFd ~= nil then
+			_socketList[context.cFd] = nil
+			_websocketList[context.cFd] = nil
+			_http2List[context.cFd] = nil
+		end
+
 	-- react to an idle event
 	elseif context.event == "idle" then
 		collectgarbage();
 	end
+
+	-- keep the connection open
+	return true
 end)
 
 -- add the server
-server.addServerSocket("0.0.0.0", "12345")
+server.openSocket("0.0.0.0", "12345")